@@ -0,0 +1,168 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+// Measures the CPU cost of the Udpcap receive path (header parsing, IP
+// reassembly and copying the payload) by feeding prebuilt frames from memory
+// into a socket. No network device, driver or kernel is involved.
+//
+// Usage: udpcap_receive_benchmark [payload_size] [repetitions]
+//
+// Payloads larger than 1472 bytes are sent as IPv4 fragments.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <udpcap/udpcap_socket.h>
+
+namespace
+{
+  constexpr size_t   mtu           = 1500;
+  constexpr uint16_t port          = 14000;
+  constexpr size_t   num_datagrams = 1000;
+
+  void appendUint16(std::vector<char>& frame, uint16_t value)
+  {
+    frame.push_back(static_cast<char>(value >> 8));
+    frame.push_back(static_cast<char>(value & 0xFF));
+  }
+
+  // Creates the Ethernet frames for one UDP datagram. The datagram is
+  // fragmented, if it doesn't fit into the MTU.
+  std::vector<std::vector<char>> createFrames(uint16_t ip_id, const std::vector<char>& payload)
+  {
+    // The UDP header and payload are the IP payload that may be fragmented
+    std::vector<char> udp_datagram;
+    appendUint16(udp_datagram, 5000);                                        // Source port
+    appendUint16(udp_datagram, port);                                        // Destination port
+    appendUint16(udp_datagram, static_cast<uint16_t>(8 + payload.size()));   // Length
+    appendUint16(udp_datagram, 0);                                           // Checksum
+    udp_datagram.insert(udp_datagram.end(), payload.begin(), payload.end());
+
+    constexpr size_t max_fragment_size = (mtu - 20) & ~static_cast<size_t>(7); // Fragment offsets are counted in 8 byte blocks
+
+    std::vector<std::vector<char>> frames;
+    for (size_t offset = 0; offset < udp_datagram.size(); offset += max_fragment_size)
+    {
+      const size_t fragment_size  = std::min(max_fragment_size, udp_datagram.size() - offset);
+      const bool   more_fragments = (offset + fragment_size < udp_datagram.size());
+
+      std::vector<char> frame
+      {
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x02,   // Destination MAC
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x01,   // Source MAC
+        0x08, 0x00,                           // EtherType IPv4
+        0x45, 0x00,                           // Version & IHL, TOS
+      };
+      appendUint16(frame, static_cast<uint16_t>(20 + fragment_size));                          // Total length
+      appendUint16(frame, ip_id);                                                             // Identification
+      appendUint16(frame, static_cast<uint16_t>((more_fragments ? 0x2000 : 0) | (offset / 8))); // Flags & fragment offset
+      frame.insert(frame.end(), { 0x40, 0x11, 0x00, 0x00 });                                   // TTL, protocol UDP, checksum
+      frame.insert(frame.end(), { static_cast<char>(192), static_cast<char>(168), 0, 1 });     // Source IP
+      frame.insert(frame.end(), { static_cast<char>(192), static_cast<char>(168), 0, 2 });     // Destination IP
+
+      frame.insert(frame.end(), udp_datagram.begin() + offset, udp_datagram.begin() + offset + fragment_size);
+      frames.push_back(std::move(frame));
+    }
+
+    return frames;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const size_t payload_size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64);
+  const size_t repetitions  = (argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000);
+
+  if (payload_size > 65507)
+  {
+    std::cerr << "ERROR: The payload size must not exceed 65507 bytes" << std::endl;
+    return 1;
+  }
+
+  // 1) Build the frames for a number of datagrams with different IP IDs
+  std::vector<std::vector<char>> frames;
+  const std::vector<char> payload(payload_size, 'x');
+  for (size_t i = 0; i < num_datagrams; i++)
+  {
+    auto datagram_frames = createFrames(static_cast<uint16_t>(i), payload);
+    frames.insert(frames.end(), datagram_frames.begin(), datagram_frames.end());
+  }
+
+  // 2) Create a socket that receives the frames from memory
+  Udpcap::UdpcapSocket socket;
+
+  if (!socket.isValid())
+  {
+    std::cerr << "ERROR: Failed to Creater UDPcap Socket" << std::endl;
+    return 1;
+  }
+
+  if (!socket.setCaptureFrames(frames, repetitions))
+  {
+    std::cerr << "ERROR: Failed to set capture frames" << std::endl;
+    return 1;
+  }
+
+  if (!socket.bind(Udpcap::HostAddress::Any(), port))
+  {
+    std::cerr << "ERROR: Failed to bind socket" << std::endl;
+    return 1;
+  }
+
+  // 3) Receive all datagrams and measure the time
+  std::vector<char> received_datagram(65536);
+  size_t received_datagrams = 0;
+  size_t received_bytes     = 0;
+
+  std::cout << "Receiving " << num_datagrams * repetitions << " datagrams with " << payload_size << " bytes payload (" << frames.size() / num_datagrams << " frame(s) per datagram)..." << std::endl;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  for (;;)
+  {
+    Udpcap::Error error = Udpcap::Error::OK;
+    const size_t bytes = socket.receiveDatagram(received_datagram.data(), received_datagram.size(), error);
+
+    if (error == Udpcap::Error::END_OF_FILE)
+      break;
+
+    if (error)
+    {
+      std::cerr << "ERROR while receiving data:" << error.ToString() << std::endl;
+      return 1;
+    }
+
+    received_datagrams++;
+    received_bytes += bytes;
+  }
+  const auto end_time = std::chrono::steady_clock::now();
+
+  const double seconds = std::chrono::duration<double>(end_time - start_time).count();
+
+  std::cout << "Received " << received_datagrams << " datagrams (" << received_bytes << " bytes) in " << seconds << " s" << std::endl;
+  if (received_datagrams > 0)
+  {
+    std::cout << "  " << static_cast<double>(received_datagrams) / seconds << " datagrams/s" << std::endl;
+    std::cout << "  " << seconds * 1e9 / static_cast<double>(received_datagrams) << " ns/datagram" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ * 
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <asio.hpp>
+
+#include <udpcap/asio_udpcap_socket.h>
+
+// Receives multicast traffic on two ports with a single thread. Every socket
+// keeps one receive operation pending on the io_context.
+class Receiver
+{
+public:
+  Receiver(asio::io_context& io_context, uint16_t port)
+    : socket_  (io_context)
+    , buffer_  (65536)
+  {
+    socket_.udpcapSocket().setMulticastLoopbackEnabled(true);
+
+    if (!socket_.bind(Udpcap::HostAddress::Any(), port)
+      || !socket_.udpcapSocket().joinMulticastGroup(Udpcap::HostAddress("239.0.0.1")))
+    {
+      std::cerr << "ERROR: Failed to bind socket to port " << port << std::endl;
+      return;
+    }
+
+    std::cout << "Start receiving data on port " << port << "..." << std::endl;
+    receive();
+  }
+
+private:
+  void receive()
+  {
+    socket_.async_receive_from(asio::buffer(buffer_), sender_endpoint_
+                              , [this](const asio::error_code& ec, std::size_t received_bytes)
+                                {
+                                  if (ec)
+                                  {
+                                    std::cerr << "ERROR while receiving data: " << ec.message() << std::endl;
+                                    return;
+                                  }
+
+                                  std::cout << "Received " << received_bytes << " bytes from " << sender_endpoint_ << " on port " << socket_.udpcapSocket().localPort() << ": " << std::string(buffer_.data(), received_bytes) << std::endl;
+                                  receive();
+                                });
+  }
+
+  Udpcap::AsioUdpcapSocket  socket_;
+  asio::ip::udp::endpoint   sender_endpoint_;
+  std::vector<char>         buffer_;
+};
+
+int main()
+{
+  asio::io_context io_context;
+
+  // Both sockets wait for data in the same io_context.run() call. No
+  // thread is blocked per socket.
+  Receiver receiver_1(io_context, 14000);
+  Receiver receiver_2(io_context, 14001);
+
+  io_context.run();
+
+  return 0;
+}
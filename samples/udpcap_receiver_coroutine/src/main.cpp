@@ -0,0 +1,88 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ * 
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <asio.hpp>
+
+#include <udpcap/asio_udpcap_socket.h>
+
+// Minimal coroutine type that starts right away and is never awaited. Any
+// other coroutine type (e.g. from a task library) works just as well.
+struct DetachedTask
+{
+  struct promise_type
+  {
+    DetachedTask        get_return_object()              { return {}; }
+    std::suspend_never  initial_suspend() noexcept       { return {}; }
+    std::suspend_never  final_suspend()   noexcept       { return {}; }
+    void                return_void()                    {}
+    void                unhandled_exception()            { std::terminate(); }
+  };
+};
+
+DetachedTask receive(Udpcap::AsioUdpcapSocket& socket)
+{
+  std::vector<char> buffer(65536);
+
+  for (;;)
+  {
+    // Suspends the coroutine until a datagram has been received. The thread
+    // running the io_context is free to serve other sockets meanwhile.
+    const auto result = co_await socket.async_receive(asio::buffer(buffer));
+
+    if (result.error)
+    {
+      std::cerr << "ERROR while receiving data: " << result.error.message() << std::endl;
+      co_return;
+    }
+
+    std::cout << "Received " << result.received_bytes << " bytes from " << result.source << " on port " << socket.udpcapSocket().localPort() << ": " << std::string(buffer.data(), result.received_bytes) << std::endl;
+  }
+}
+
+int main()
+{
+  asio::io_context io_context;
+
+  // One coroutine per socket, all of them run by the same thread
+  std::vector<std::unique_ptr<Udpcap::AsioUdpcapSocket>> sockets;
+  for (uint16_t port = 14000; port < 14010; port++)
+  {
+    sockets.push_back(std::make_unique<Udpcap::AsioUdpcapSocket>(io_context));
+    sockets.back()->udpcapSocket().setMulticastLoopbackEnabled(true);
+
+    if (!sockets.back()->bind(Udpcap::HostAddress::Any(), port)
+      || !sockets.back()->udpcapSocket().joinMulticastGroup(Udpcap::HostAddress("239.0.0.1")))
+    {
+      std::cerr << "ERROR: Failed to bind socket to port " << port << std::endl;
+      return 1;
+    }
+
+    receive(*sockets.back());
+  }
+
+  std::cout << "Start receiving data on ports 14000 - 14009..." << std::endl;
+  io_context.run();
+
+  return 0;
+}
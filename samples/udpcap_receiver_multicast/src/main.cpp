@@ -88,13 +88,23 @@ int main()
     Udpcap::HostAddress sender_address;
     uint16_t            sender_port(0);
 
-    // Allocate memory for the received datagram (with the maximum possible udp datagram size)
-    std::vector<char> received_datagram(65536);
-
     // Initialize error object
     Udpcap::Error error = Udpcap::Error::OK;
 
-    // Blocking receive a datagram
+    // Blocking wait for the next datagram and get its size, without
+    // receiving it, yet
+    const size_t datagram_length = socket.peekDatagramLength(error);
+
+    if (error)
+    {
+      std::cerr << "ERROR while receiving data:" << error.ToString() << std::endl;
+      return 1;
+    }
+
+    // Allocate exactly the memory needed for the received datagram
+    std::vector<char> received_datagram(datagram_length);
+
+    // Receive the peeked datagram
     size_t received_bytes = socket.receiveDatagram(received_datagram.data(), received_datagram.size(), &sender_address, &sender_port, error);
 
     if (error)
@@ -103,7 +113,8 @@ int main()
       return 1;
     }
 
-    // Shrink the received_datagram to the actual size
+    // Shrink the received_datagram to the actual size (it is smaller, if the
+    // capture has cut off the end of the datagram)
     received_datagram.resize(received_bytes);
     std::cout << "Received " << received_datagram.size() << " bytes from " << sender_address.toString() << ":" << sender_port << ": " << std::string(received_datagram.data(), received_datagram.size()) << std::endl;
   }
@@ -0,0 +1,137 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ * 
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <udpcap/asio_udpcap_socket.h>
+#include <asio.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+// The co_await API is only available, if the compiler supports C++20 coroutines
+#ifdef UDPCAP_HAS_COROUTINES
+
+namespace
+{
+  // Creates an Ethernet frame with an IPv4 / UDP packet
+  std::vector<char> createUdpFrame(const std::string& source_ip, const std::string& destination_ip, uint16_t source_port, uint16_t destination_port, const std::string& payload)
+  {
+    const auto source_ip_bytes      = asio::ip::make_address_v4(source_ip).to_bytes();
+    const auto destination_ip_bytes = asio::ip::make_address_v4(destination_ip).to_bytes();
+    const auto ip_total_length      = static_cast<uint16_t>(20 + 8 + payload.size());
+    const auto udp_length           = static_cast<uint16_t>(8 + payload.size());
+
+    std::vector<char> frame
+    {
+      // Ethernet: destination MAC, source MAC, EtherType IPv4
+      0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+      0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+      0x08, 0x00,
+
+      // IPv4: version & IHL, TOS, total length, identification, flags & fragment offset, TTL, protocol UDP, checksum
+      0x45, 0x00, static_cast<char>(ip_total_length >> 8), static_cast<char>(ip_total_length & 0xFF),
+      0x00, 0x01, 0x00, 0x00,
+      0x40, 0x11, 0x00, 0x00,
+      static_cast<char>(source_ip_bytes[0]),      static_cast<char>(source_ip_bytes[1]),      static_cast<char>(source_ip_bytes[2]),      static_cast<char>(source_ip_bytes[3]),
+      static_cast<char>(destination_ip_bytes[0]), static_cast<char>(destination_ip_bytes[1]), static_cast<char>(destination_ip_bytes[2]), static_cast<char>(destination_ip_bytes[3]),
+
+      // UDP: source port, destination port, length, checksum
+      static_cast<char>(source_port >> 8),      static_cast<char>(source_port & 0xFF),
+      static_cast<char>(destination_port >> 8), static_cast<char>(destination_port & 0xFF),
+      static_cast<char>(udp_length >> 8),       static_cast<char>(udp_length & 0xFF),
+      0x00, 0x00,
+    };
+
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return frame;
+  }
+
+  // Minimal coroutine type that starts right away and is never awaited
+  struct DetachedTask
+  {
+    struct promise_type
+    {
+      DetachedTask        get_return_object()              { return {}; }
+      std::suspend_never  initial_suspend() noexcept       { return {}; }
+      std::suspend_never  final_suspend()   noexcept       { return {}; }
+      void                return_void()                    {}
+      void                unhandled_exception()            { std::terminate(); }
+    };
+  };
+
+  // Receives datagrams until an error occurs
+  DetachedTask coAwaitReceive(Udpcap::AsioUdpcapSocket& socket, std::vector<Udpcap::AsioUdpcapSocket::ReceiveResult>& results, std::vector<std::string>& payloads)
+  {
+    std::vector<char> buffer(65536);
+
+    for (;;)
+    {
+      const auto result = co_await socket.async_receive(asio::buffer(buffer));
+      results.push_back(result);
+
+      if (result.error)
+        co_return;
+
+      payloads.emplace_back(buffer.data(), result.received_bytes);
+    }
+  }
+}
+
+// co_await datagrams from memory
+TEST(udpcap, AsioCoAwaitReceive)
+{
+  const std::vector<std::vector<char>> frames
+  {
+    createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"),
+    createUdpFrame("192.168.0.3", "192.168.0.2", 5001, 14000, "Hello Coroutine"),
+  };
+
+  asio::io_context io_context;
+
+  Udpcap::AsioUdpcapSocket udpcap_socket(io_context);
+  ASSERT_TRUE(udpcap_socket.udpcapSocket().setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  std::vector<Udpcap::AsioUdpcapSocket::ReceiveResult> results;
+  std::vector<std::string>                             payloads;
+  coAwaitReceive(udpcap_socket, results, payloads);
+
+  // The coroutine is suspended until the io_context runs
+  ASSERT_TRUE(results.empty());
+
+  io_context.run_for(std::chrono::milliseconds(1000));
+
+  ASSERT_EQ(results.size(), 3);
+
+  ASSERT_FALSE(results[0].error);
+  ASSERT_EQ(results[0].received_bytes, 11);
+  ASSERT_EQ(payloads[0], "Hello World");
+  ASSERT_EQ(results[0].source, asio::ip::udp::endpoint(asio::ip::make_address("192.168.0.1"), 5000));
+
+  ASSERT_FALSE(results[1].error);
+  ASSERT_EQ(results[1].received_bytes, 15);
+  ASSERT_EQ(payloads[1], "Hello Coroutine");
+  ASSERT_EQ(results[1].source, asio::ip::udp::endpoint(asio::ip::make_address("192.168.0.3"), 5001));
+
+  ASSERT_EQ(results[2].error, asio::error::eof);
+  ASSERT_EQ(results[2].received_bytes, 0);
+}
+
+#endif // UDPCAP_HAS_COROUTINES
@@ -17,11 +17,144 @@
 #include <gtest/gtest.h>
 
 #include <udpcap/udpcap_socket.h>
+#include <udpcap/udpcap_selector.h>
+#include <udpcap/asio_udpcap_socket.h>
 #include <asio.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "atomic_signalable.h"
+#include "packet_parser.h"
+
+#ifdef __linux__
+#include <poll.h>
+#endif // __linux__
+
+namespace
+{
+  // Creates an Ethernet frame with an IPv4 / UDP packet
+  std::vector<char> createUdpFrame(const std::string& source_ip, const std::string& destination_ip, uint16_t source_port, uint16_t destination_port, const std::string& payload)
+  {
+    const auto source_ip_bytes      = asio::ip::make_address_v4(source_ip).to_bytes();
+    const auto destination_ip_bytes = asio::ip::make_address_v4(destination_ip).to_bytes();
+    const auto ip_total_length      = static_cast<uint16_t>(20 + 8 + payload.size());
+    const auto udp_length           = static_cast<uint16_t>(8 + payload.size());
+
+    std::vector<char> frame
+    {
+      // Ethernet: destination MAC, source MAC, EtherType IPv4
+      0x02, 0x00, 0x00, 0x00, 0x00, 0x02,
+      0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+      0x08, 0x00,
+
+      // IPv4: version & IHL, TOS, total length, identification, flags & fragment offset, TTL, protocol UDP, checksum
+      0x45, 0x00, static_cast<char>(ip_total_length >> 8), static_cast<char>(ip_total_length & 0xFF),
+      0x00, 0x01, 0x00, 0x00,
+      0x40, 0x11, 0x00, 0x00,
+      static_cast<char>(source_ip_bytes[0]),      static_cast<char>(source_ip_bytes[1]),      static_cast<char>(source_ip_bytes[2]),      static_cast<char>(source_ip_bytes[3]),
+      static_cast<char>(destination_ip_bytes[0]), static_cast<char>(destination_ip_bytes[1]), static_cast<char>(destination_ip_bytes[2]), static_cast<char>(destination_ip_bytes[3]),
+
+      // UDP: source port, destination port, length, checksum
+      static_cast<char>(source_port >> 8),      static_cast<char>(source_port & 0xFF),
+      static_cast<char>(destination_port >> 8), static_cast<char>(destination_port & 0xFF),
+      static_cast<char>(udp_length >> 8),       static_cast<char>(udp_length & 0xFF),
+      0x00, 0x00,
+    };
+
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return frame;
+  }
+
+  // Creates an IPv4 fragment of a frame created by createUdpFrame(). The
+  // offset is relative to the IPv4 payload and must be a multiple of 8.
+  std::vector<char> createFragment(const std::vector<char>& frame, uint16_t identification, size_t offset, size_t size, bool more_fragments)
+  {
+    const auto total_length     = static_cast<uint16_t>(20 + size);
+    const auto flags_and_offset = static_cast<uint16_t>((more_fragments ? 0x2000 : 0) | (offset / 8));
+    const auto ip_payload_begin = frame.begin() + 14 + 20;                      // UDP header & payload
+
+    std::vector<char> fragment(frame.begin(), ip_payload_begin);                // Ethernet & IPv4 header
+    fragment[14 + 2] = static_cast<char>(total_length >> 8);
+    fragment[14 + 3] = static_cast<char>(total_length & 0xFF);
+    fragment[14 + 4] = static_cast<char>(identification >> 8);
+    fragment[14 + 5] = static_cast<char>(identification & 0xFF);
+    fragment[14 + 6] = static_cast<char>(flags_and_offset >> 8);
+    fragment[14 + 7] = static_cast<char>(flags_and_offset & 0xFF);
+    fragment.insert(fragment.end(), ip_payload_begin + offset, ip_payload_begin + offset + size);
+
+    return fragment;
+  }
+
+  // Splits the IPv4 packet of a frame created by createUdpFrame() into IPv4
+  // fragments. The fragment payload size must be a multiple of 8.
+  std::vector<std::vector<char>> fragmentUdpFrame(const std::vector<char>& frame, uint16_t identification, size_t fragment_payload_size)
+  {
+    const size_t ip_payload_size = frame.size() - 14 - 20;
+
+    std::vector<std::vector<char>> fragments;
+    for (size_t offset = 0; offset < ip_payload_size; offset += fragment_payload_size)
+    {
+      const size_t size = std::min(fragment_payload_size, ip_payload_size - offset);
+      fragments.push_back(createFragment(frame, identification, offset, size, (offset + size < ip_payload_size)));
+    }
+    return fragments;
+  }
+
+  // Writes the given frames with their timestamps (in microseconds, or in
+  // nanoseconds for a nanosecond pcap file) to a pcap file with the given link
+  // type (default: Ethernet)
+  bool writeCaptureFile(const std::string& file_path, const std::vector<std::pair<long long, std::vector<char>>>& frames, uint32_t linktype = 1, bool nanosecond_timestamps = false)
+  {
+    FILE* file = fopen(file_path.c_str(), "wb");
+    if (file == nullptr)
+      return false;
+
+    const uint32_t magic_number  = (nanosecond_timestamps ? 0xa1b23c4d : 0xa1b2c3d4);
+    const uint16_t version_major = 2;
+    const uint16_t version_minor = 4;
+    const int32_t  thiszone      = 0;
+    const uint32_t sigfigs       = 0;
+    const uint32_t snaplen       = 65535;
+
+    fwrite(&magic_number,  sizeof(magic_number),  1, file);
+    fwrite(&version_major, sizeof(version_major), 1, file);
+    fwrite(&version_minor, sizeof(version_minor), 1, file);
+    fwrite(&thiszone,      sizeof(thiszone),      1, file);
+    fwrite(&sigfigs,       sizeof(sigfigs),       1, file);
+    fwrite(&snaplen,       sizeof(snaplen),       1, file);
+    fwrite(&linktype,      sizeof(linktype),      1, file);
+
+    for (const auto& frame : frames)
+    {
+      const long long ticks_per_second = (nanosecond_timestamps ? 1000000000 : 1000000);
+      const auto ts_sec  = static_cast<uint32_t>(frame.first / ticks_per_second);
+      const auto ts_usec = static_cast<uint32_t>(frame.first % ticks_per_second);   // Nanoseconds in a nanosecond pcap file
+      const auto length  = static_cast<uint32_t>(frame.second.size());
+
+      fwrite(&ts_sec,  sizeof(ts_sec),  1, file);
+      fwrite(&ts_usec, sizeof(ts_usec), 1, file);
+      fwrite(&length,  sizeof(length),  1, file); // captured length
+      fwrite(&length,  sizeof(length),  1, file); // original length
+      fwrite(frame.second.data(), 1, frame.second.size(), file);
+    }
+
+    fclose(file);
+    return true;
+  }
+
+  // Converts a frame created by createUdpFrame() to the byte buffer that the packet parser works on
+  std::vector<uint8_t> toBytes(const std::vector<char>& frame)
+  {
+    return std::vector<uint8_t>(frame.begin(), frame.end());
+  }
+}
 
 // Create and destroy as UdpcapSocket
 TEST(udpcap, RAII)
@@ -94,6 +227,73 @@ TEST(udpcap, RAIIWithSomebodyWaiting)
   // Delete the socket
 }
 
+#ifndef _WIN32
+// Receive from the loopback device with the libpcap backend, that waits with poll() and is woken up by close()
+TEST(udpcap, PosixLoopbackReceive)
+{
+  // Create a udpcap socket
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+
+  // bind the socket to the loopback device
+  const bool success = udpcap_socket.bind(Udpcap::HostAddress::LocalHost(), 14000);
+  ASSERT_TRUE(success);
+
+  std::vector<char> received_datagram;
+  received_datagram.resize(65536);
+
+  // poll() must time out, if there is no data
+  {
+    Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 10, error);
+    ASSERT_EQ(received_bytes, 0);
+    ASSERT_EQ(error, Udpcap::Error(Udpcap::Error::ErrorCode::TIMEOUT));
+  }
+
+  // Create an asio UDP sender socket
+  asio::io_context io_context;
+  const asio::ip::udp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), 14000);
+  asio::ip::udp::socket         asio_socket(io_context, endpoint.protocol());
+  asio_socket.connect(endpoint);
+  const auto asio_local_endpoint = asio_socket.local_endpoint();
+
+  const std::string buffer_string = "Hello World";
+  asio_socket.send_to(asio::buffer(buffer_string), endpoint);
+
+  // poll() must wake up for the datagram
+  {
+    Udpcap::HostAddress sender_address;
+    uint16_t            sender_port(0);
+    Udpcap::Error       error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_FALSE(bool(error));
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), buffer_string);
+    ASSERT_EQ(sender_address.toString(), asio_local_endpoint.address().to_string());
+    ASSERT_EQ(sender_port,               asio_local_endpoint.port());
+  }
+
+  // close() must wake up a receive that waits forever
+  std::thread receive_thread([&udpcap_socket, &received_datagram]()
+                            {
+                              Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+                              const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), -1, error);
+
+                              ASSERT_EQ(received_bytes, 0);
+                              ASSERT_EQ(error, Udpcap::Error(Udpcap::Error::ErrorCode::SOCKET_CLOSED));
+                            });
+
+  // Give the receive thread some time to start waiting
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  asio_socket.close();
+  udpcap_socket.close();
+
+  receive_thread.join();
+}
+#endif // !_WIN32
+
 // Test the return value of a bind with an invalid address
 TEST(udpcap, BindInvalidAddress)
 {
@@ -118,6 +318,39 @@ TEST(udpcap, BindInvalidAddress2)
   ASSERT_FALSE(success);
 }
 
+// The capture engine can only be changed before binding the socket
+TEST(udpcap, SetCaptureEngine)
+{
+  // Create a udpcap socket
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_EQ(udpcap_socket.captureEngine(), Udpcap::CaptureEngine::Pcap);
+
+#ifdef __linux__
+  // The packet mmap engine is accepted before binding
+  ASSERT_TRUE(udpcap_socket.setCaptureEngine(Udpcap::CaptureEngine::PacketMmap));
+  ASSERT_EQ(udpcap_socket.captureEngine(), Udpcap::CaptureEngine::PacketMmap);
+#else
+  // The packet mmap engine is only available on Linux
+  ASSERT_FALSE(udpcap_socket.setCaptureEngine(Udpcap::CaptureEngine::PacketMmap));
+  ASSERT_EQ(udpcap_socket.captureEngine(), Udpcap::CaptureEngine::Pcap);
+#endif // __linux__
+
+  ASSERT_TRUE(udpcap_socket.setCaptureEngine(Udpcap::CaptureEngine::Pcap));
+  ASSERT_EQ(udpcap_socket.captureEngine(), Udpcap::CaptureEngine::Pcap);
+
+  // bind the socket
+  const bool success = udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000);
+  ASSERT_TRUE(success);
+
+  // The capture engine cannot be changed anymore
+  ASSERT_FALSE(udpcap_socket.setCaptureEngine(Udpcap::CaptureEngine::PacketMmap));
+  ASSERT_FALSE(udpcap_socket.setCaptureEngine(Udpcap::CaptureEngine::Pcap));
+  ASSERT_EQ(udpcap_socket.captureEngine(), Udpcap::CaptureEngine::Pcap);
+
+  udpcap_socket.close();
+}
+
 // Receive a simple Hello World Message
 TEST(udpcap, SimpleReceive)
 {
@@ -988,3 +1221,1554 @@ TEST(udpcap, ManyMulticastSockets)
   send_thread1.join();
   send_thread2.join();
 }
+
+// Replay a capture file as fast as possible
+TEST(udpcap, ReplayCaptureFile)
+{
+  const std::string capture_file_path = "udpcap_test_replay.pcap";
+
+  const std::vector<std::pair<long long, std::vector<char>>> frames
+  {
+    { 1000000, createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 1") },
+    { 1001000, createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14001, "Wrong port") },
+    { 9000000, createUdpFrame("192.168.0.1", "192.168.0.2", 5001, 14000, "Hello World 2") },
+  };
+  ASSERT_TRUE(writeCaptureFile(capture_file_path, frames));
+
+  // Create a udpcap socket that replays the file
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFile(capture_file_path, Udpcap::ReplayPacing::AsFastAsPossible));
+
+  {
+    const bool success = udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000);
+    ASSERT_TRUE(success);
+  }
+
+  // Initialize variables for the sender's address and port
+  Udpcap::HostAddress sender_address;
+  uint16_t            sender_port(0);
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Allocate buffer with max udp datagram size
+  std::vector<char> received_datagram(65536);
+
+  // The frames are available immediately, even though they were recorded 8 seconds apart
+  const auto start_time = std::chrono::steady_clock::now();
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 1");
+    ASSERT_EQ(sender_address.toString(), "192.168.0.1");
+    ASSERT_EQ(sender_port, 5000);
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 2");
+    ASSERT_EQ(sender_port, 5001);
+  }
+
+  ASSERT_LE(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count(), 1000);
+
+  // The file is exhausted
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  udpcap_socket.close();
+  std::remove(capture_file_path.c_str());
+}
+
+// Replay a capture file with a scaled timing
+TEST(udpcap, ReplayCaptureFileScaled)
+{
+  const std::string capture_file_path = "udpcap_test_replay_scaled.pcap";
+
+  // 400ms between the frames are replayed as 200ms
+  const std::vector<std::pair<long long, std::vector<char>>> frames
+  {
+    { 1000000, createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 1") },
+    { 1400000, createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 2") },
+  };
+  ASSERT_TRUE(writeCaptureFile(capture_file_path, frames));
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_FALSE(udpcap_socket.setCaptureFile(capture_file_path, Udpcap::ReplayPacing::Scaled, 0.0));
+  ASSERT_TRUE (udpcap_socket.setCaptureFile(capture_file_path, Udpcap::ReplayPacing::Scaled, 2.0));
+
+  {
+    const bool success = udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000);
+    ASSERT_TRUE(success);
+  }
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  std::vector<char> received_datagram(65536);
+
+  // The first frame is released immediately
+  const auto start_time = std::chrono::steady_clock::now();
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 1");
+  }
+
+  // The second frame is not due, yet
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  // The second frame is released after 200ms
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 2");
+
+    const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    ASSERT_GE(elapsed_ms, 190);
+    ASSERT_LE(elapsed_ms, 390);
+  }
+
+  udpcap_socket.close();
+  std::remove(capture_file_path.c_str());
+}
+
+// Receive frames from memory multiple times
+TEST(udpcap, ReceiveCaptureFrames)
+{
+  const std::vector<std::vector<char>> frames
+  {
+    createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"),
+    createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14001, "Wrong port"),
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames, 3));
+
+  {
+    const bool success = udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000);
+    ASSERT_TRUE(success);
+  }
+
+  // The frames cannot be changed after binding
+  ASSERT_FALSE(udpcap_socket.setCaptureFrames(frames, 1));
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  std::vector<char> received_datagram(65536);
+
+  // Each repetition contains one matching datagram
+  for (int i = 0; i < 3; i++)
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World");
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  udpcap_socket.close();
+}
+
+// Replay capture files with link types other than Ethernet
+TEST(udpcap, ReplayCaptureFileLinkTypes)
+{
+  const std::string capture_file_path = "udpcap_test_replay_link_types.pcap";
+
+  // The IPv4 packet without the 14 byte Ethernet header
+  const std::vector<char> ethernet_frame = createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World");
+  const std::vector<char> ip_packet(ethernet_frame.begin() + 14, ethernet_frame.end());
+
+  // Linux cooked capture v2 header: protocol IPv4, reserved, interface index, ARPHRD_ETHER, PACKET_HOST, address length, address
+  std::vector<char> sll2_frame
+  {
+    0x08, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x02,
+    0x00, 0x01, 0x00, 0x06,
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+  };
+  sll2_frame.insert(sll2_frame.end(), ip_packet.begin(), ip_packet.end());
+
+  // BSD loopback header: AF_INET in the byte order of the capturing machine
+  const uint32_t af_inet = 2;
+  std::vector<char> null_frame(reinterpret_cast<const char*>(&af_inet), reinterpret_cast<const char*>(&af_inet) + sizeof(af_inet));
+  null_frame.insert(null_frame.end(), ip_packet.begin(), ip_packet.end());
+
+  const std::vector<std::pair<uint32_t, std::vector<char>>> link_types
+  {
+    { 0,   null_frame },  // LINKTYPE_NULL
+    { 101, ip_packet },   // LINKTYPE_RAW
+    { 276, sll2_frame },  // LINKTYPE_LINUX_SLL2
+  };
+
+  for (const auto& link_type : link_types)
+  {
+    ASSERT_TRUE(writeCaptureFile(capture_file_path, { { 1000000, link_type.second } }, link_type.first));
+
+    Udpcap::UdpcapSocket udpcap_socket;
+    ASSERT_TRUE(udpcap_socket.isValid());
+    ASSERT_TRUE(udpcap_socket.setCaptureFile(capture_file_path));
+    ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+    Udpcap::HostAddress sender_address;
+    uint16_t            sender_port(0);
+    Udpcap::Error       error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+    std::vector<char>   received_datagram(65536);
+
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_EQ(error, Udpcap::Error::OK) << "Link type " << link_type.first;
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World");
+    ASSERT_EQ(sender_address.toString(), "192.168.0.1");
+    ASSERT_EQ(sender_port, 5000);
+
+    udpcap_socket.close();
+  }
+
+  std::remove(capture_file_path.c_str());
+}
+
+// Frames and IPv4 packets that are too short for their headers must be rejected
+TEST(udpcap, PacketParserShortHeaders)
+{
+  const auto frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"));
+
+  const uint8_t* ip_data   = nullptr;
+  size_t         ip_length = 0;
+
+  // Ethernet header cut off
+  ASSERT_FALSE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), 13, ip_data, ip_length));
+  ASSERT_TRUE (Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), 14, ip_data, ip_length));
+  ASSERT_EQ(ip_data,   frame.data() + 14);
+  ASSERT_EQ(ip_length, 0);
+
+  // IPv4 header cut off
+  Udpcap::PacketParser::Ipv4Packet ip_packet{};
+  ASSERT_FALSE(Udpcap::PacketParser::parseIpv4(frame.data() + 14, 19, ip_packet));
+  ASSERT_TRUE (Udpcap::PacketParser::parseIpv4(frame.data() + 14, 20, ip_packet));
+  ASSERT_EQ(ip_packet.payload_length, 0);
+
+  // UDP header cut off
+  Udpcap::PacketParser::UdpDatagram udp_datagram{};
+  ASSERT_FALSE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  ASSERT_TRUE (Udpcap::PacketParser::parseIpv4(frame.data() + 14, 27, ip_packet));
+  ASSERT_FALSE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+}
+
+// An IPv4 header length that exceeds the captured data or is below the minimum must be rejected
+TEST(udpcap, PacketParserInvalidIhl)
+{
+  auto frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"));
+  const uint8_t* ip_data   = frame.data() + 14;
+  const size_t   ip_length = frame.size() - 14;   // 39 bytes
+
+  Udpcap::PacketParser::Ipv4Packet ip_packet{};
+
+  // 60 byte header, but only 39 bytes captured
+  frame[14] = 0x4F;
+  ASSERT_FALSE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+
+  // 36 byte header fits into the 39 captured bytes
+  frame[14] = 0x49;
+  ASSERT_TRUE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+  ASSERT_EQ(ip_packet.payload,        ip_data + 36);
+  ASSERT_EQ(ip_packet.payload_length, 3);
+
+  // 16 byte header is below the minimum
+  frame[14] = 0x44;
+  ASSERT_FALSE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+
+  // Not IPv4
+  frame[14] = 0x65;
+  ASSERT_FALSE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+}
+
+// A UDP length field below the UDP header length must be rejected
+TEST(udpcap, PacketParserInvalidUdpLength)
+{
+  auto frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"));
+
+  Udpcap::PacketParser::Ipv4Packet  ip_packet{};
+  Udpcap::PacketParser::UdpDatagram udp_datagram{};
+
+  for (const uint8_t udp_length : { 0, 7 })
+  {
+    frame[14 + 20 + 4] = 0;
+    frame[14 + 20 + 5] = udp_length;
+    ASSERT_TRUE (Udpcap::PacketParser::parseIpv4(frame.data() + 14, frame.size() - 14, ip_packet));
+    ASSERT_FALSE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  }
+
+  // Empty datagram
+  frame[14 + 20 + 5] = 8;
+  ASSERT_TRUE(Udpcap::PacketParser::parseIpv4(frame.data() + 14, frame.size() - 14, ip_packet));
+  ASSERT_TRUE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  ASSERT_EQ(udp_datagram.payload_length,  0);
+  ASSERT_EQ(udp_datagram.datagram_length, 0);
+  ASSERT_FALSE(udp_datagram.is_truncated);
+}
+
+// A frame that has been cut off by the capture yields the available part of the payload
+TEST(udpcap, PacketParserTruncatedPayload)
+{
+  const auto frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"));
+  const size_t captured_length = 14 + 20 + 8 + 5;
+
+  const uint8_t* ip_data   = nullptr;
+  size_t         ip_length = 0;
+  ASSERT_TRUE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), captured_length, ip_data, ip_length));
+
+  Udpcap::PacketParser::Ipv4Packet ip_packet{};
+  ASSERT_TRUE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+  ASSERT_EQ(ip_packet.length,         20 + 8 + 5);
+  ASSERT_EQ(ip_packet.payload_length, 8 + 5);
+
+  Udpcap::PacketParser::UdpDatagram udp_datagram{};
+  ASSERT_TRUE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  ASSERT_EQ(udp_datagram.source_port,      5000);
+  ASSERT_EQ(udp_datagram.destination_port, 14000);
+  ASSERT_EQ(udp_datagram.payload_length,   5);
+  ASSERT_EQ(udp_datagram.datagram_length,  11);
+  ASSERT_TRUE(udp_datagram.is_truncated);
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(udp_datagram.payload), udp_datagram.payload_length), "Hello");
+}
+
+// Up to two VLAN tags (802.1ad outer tag, 802.1Q inner tag) are skipped
+TEST(udpcap, PacketParserDoubleVlan)
+{
+  const auto untagged_frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World"));
+
+  // Insert the tags between the MAC addresses and the EtherType IPv4
+  const std::vector<uint8_t> outer_tag { 0x88, 0xA8, 0x00, 0x64 };
+  const std::vector<uint8_t> inner_tag { 0x81, 0x00, 0x00, 0x0A };
+
+  std::vector<uint8_t> frame(untagged_frame.begin(), untagged_frame.begin() + 12);
+  frame.insert(frame.end(), outer_tag.begin(), outer_tag.end());
+  frame.insert(frame.end(), inner_tag.begin(), inner_tag.end());
+  frame.insert(frame.end(), untagged_frame.begin() + 12, untagged_frame.end());
+
+  const uint8_t* ip_data   = nullptr;
+  size_t         ip_length = 0;
+  ASSERT_TRUE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), frame.size(), ip_data, ip_length));
+  ASSERT_EQ(ip_data,   frame.data() + 22);
+  ASSERT_EQ(ip_length, frame.size() - 22);
+
+  Udpcap::PacketParser::Ipv4Packet  ip_packet{};
+  Udpcap::PacketParser::UdpDatagram udp_datagram{};
+  ASSERT_TRUE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+  ASSERT_TRUE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(udp_datagram.payload), udp_datagram.payload_length), "Hello World");
+
+  // The second tag cut off
+  ASSERT_FALSE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), 19, ip_data, ip_length));
+
+  // A third tag is not supported
+  std::vector<uint8_t> triple_tagged_frame(frame.begin(), frame.begin() + 20);
+  triple_tagged_frame.insert(triple_tagged_frame.end(), inner_tag.begin(), inner_tag.end());
+  triple_tagged_frame.insert(triple_tagged_frame.end(), frame.begin() + 20, frame.end());
+  ASSERT_FALSE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(triple_tagged_frame.data(), triple_tagged_frame.size(), ip_data, ip_length));
+}
+
+// Ethernet pads short frames to 60 bytes. The padding must not end up in the payload.
+TEST(udpcap, PacketParserEthernetPadding)
+{
+  auto frame = toBytes(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hi"));
+  ASSERT_EQ(frame.size(), 44);
+  frame.resize(60, 0xAA);
+
+  const uint8_t* ip_data   = nullptr;
+  size_t         ip_length = 0;
+  ASSERT_TRUE(Udpcap::PacketParser::decodeLinkLayer<DLT_EN10MB>(frame.data(), frame.size(), ip_data, ip_length));
+  ASSERT_EQ(ip_length, 46);
+
+  Udpcap::PacketParser::Ipv4Packet ip_packet{};
+  ASSERT_TRUE(Udpcap::PacketParser::parseIpv4(ip_data, ip_length, ip_packet));
+  ASSERT_EQ(ip_packet.length,         30);
+  ASSERT_EQ(ip_packet.payload_length, 10);
+
+  Udpcap::PacketParser::UdpDatagram udp_datagram{};
+  ASSERT_TRUE(Udpcap::PacketParser::parseUdp(ip_packet, udp_datagram));
+  ASSERT_EQ(udp_datagram.payload_length,  2);
+  ASSERT_EQ(udp_datagram.datagram_length, 2);
+  ASSERT_FALSE(udp_datagram.is_truncated);
+  ASSERT_EQ(std::string(reinterpret_cast<const char*>(udp_datagram.payload), udp_datagram.payload_length), "Hi");
+}
+
+// Reassemble fragmented datagrams with fragments out of order, duplicated and interleaved
+TEST(udpcap, ReassembleFragmentedDatagrams)
+{
+  const std::string payload_1(4000, 'a');
+  const std::string payload_2(3000, 'b');
+
+  // Same IP ID, but different senders. These must not be mixed up.
+  const auto fragments_1 = fragmentUdpFrame(createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, payload_1), 42, 1480);
+  const auto fragments_2 = fragmentUdpFrame(createUdpFrame("192.168.0.3", "192.168.0.2", 5001, 14000, payload_2), 42, 1480);
+  ASSERT_EQ(fragments_1.size(), 3);
+  ASSERT_EQ(fragments_2.size(), 3);
+
+  const std::vector<std::vector<char>> frames
+  {
+    fragments_1[2],
+    fragments_2[0],
+    fragments_1[1],
+    fragments_1[1],  // Duplicate
+    fragments_2[2],
+    fragments_1[0],  // Completes datagram 1
+    fragments_2[1],  // Completes datagram 2
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  Udpcap::HostAddress sender_address;
+  uint16_t            sender_port(0);
+  Udpcap::Error       error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  std::vector<char>   received_datagram(65536);
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), payload_1);
+    ASSERT_EQ(sender_address.toString(), "192.168.0.1");
+    ASSERT_EQ(sender_port, 5000);
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, &sender_address, &sender_port, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), payload_2);
+    ASSERT_EQ(sender_address.toString(), "192.168.0.3");
+    ASSERT_EQ(sender_port, 5001);
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  udpcap_socket.close();
+}
+
+// A last fragment that ends before fragments that have already been received must not complete the datagram
+TEST(udpcap, ReassembleFragmentsBeyondLastFragment)
+{
+  // 32 bytes of IPv4 payload, i.e. four 8 byte blocks
+  const auto frame       = createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, std::string(24, 'a'));
+  const auto valid_frame = createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, std::string(24, 'b'));
+
+  const std::vector<std::vector<char>> frames
+  {
+    createFragment(frame, 42, 0,  8, true),
+    createFragment(frame, 42, 24, 8, true),
+    createFragment(frame, 42, 16, 8, false),   // Claims a payload length of 24 bytes, block 1 is still missing
+    createFragment(frame, 42, 8,  8, true),    // Must not complete the dropped datagram
+
+    createFragment(valid_frame, 43, 0,  16, true),
+    createFragment(valid_frame, 43, 16, 16, false),
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  std::vector<char> received_datagram(65536);
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), std::string(24, 'b'));
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  udpcap_socket.close();
+}
+
+// Overlapping fragments with the same data are reassembled to the original datagram
+TEST(udpcap, ReassembleOverlappingFragments)
+{
+  std::string payload(40, 'a');
+  for (size_t i = 0; i < payload.size(); i++)
+    payload[i] = static_cast<char>('a' + i % 26);
+
+  // 48 bytes of IPv4 payload, i.e. six 8 byte blocks
+  const auto frame = createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, payload);
+
+  const std::vector<std::vector<char>> frames
+  {
+    createFragment(frame, 42, 32, 16, false),
+    createFragment(frame, 42, 0,  16, true),
+    createFragment(frame, 42, 8,  24, true),   // Overlaps both neighbours
+    createFragment(frame, 42, 16, 16, true),   // Completely covered by the previous fragment
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  std::vector<char> received_datagram(65536);
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), payload);
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_bytes, 0);
+  }
+
+  udpcap_socket.close();
+}
+
+// Receive multiple datagrams with a single call
+TEST(udpcap, ReceiveDatagramsBatch)
+{
+  std::vector<std::vector<char>> frames;
+  for (int i = 0; i < 5; i++)
+    frames.push_back(createUdpFrame("192.168.0.1", "192.168.0.2", static_cast<uint16_t>(5000 + i), 14000, "Hello World " + std::to_string(i)));
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  std::vector<std::vector<char>>      memory(3, std::vector<char>(65536));
+  std::vector<Udpcap::DatagramBuffer> buffers(3);
+  for (size_t i = 0; i < buffers.size(); i++)
+  {
+    buffers[i].data    = memory[i].data();
+    buffers[i].max_len = memory[i].size();
+  }
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // The first call fills all buffers
+  {
+    const size_t received_datagrams = udpcap_socket.receiveDatagrams(buffers.data(), buffers.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(received_datagrams, 3);
+
+    for (size_t i = 0; i < received_datagrams; i++)
+    {
+      ASSERT_EQ(std::string(buffers[i].data, buffers[i].length), "Hello World " + std::to_string(i));
+      ASSERT_EQ(buffers[i].source_address.toString(), "192.168.0.1");
+      ASSERT_EQ(buffers[i].source_port, 5000 + i);
+    }
+  }
+
+  // The second call returns the remaining datagrams without waiting for more
+  {
+    const size_t received_datagrams = udpcap_socket.receiveDatagrams(buffers.data(), buffers.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(received_datagrams, 2);
+
+    for (size_t i = 0; i < received_datagrams; i++)
+      ASSERT_EQ(std::string(buffers[i].data, buffers[i].length), "Hello World " + std::to_string(i + 3));
+  }
+
+  {
+    const size_t received_datagrams = udpcap_socket.receiveDatagrams(buffers.data(), buffers.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+    ASSERT_EQ(received_datagrams, 0);
+  }
+
+  udpcap_socket.close();
+}
+
+// Receive datagrams without copying them
+TEST(udpcap, ReceiveDatagramView)
+{
+  const std::string large_payload(5000, 'x');
+
+  std::vector<std::vector<char>> frames { createUdpFrame("192.168.0.1", "239.0.0.1", 5000, 14000, "Hello World") };
+  for (const auto& fragment : fragmentUdpFrame(createUdpFrame("192.168.0.1", "192.168.0.2", 5001, 14000, large_payload), 1, 1480))
+    frames.push_back(fragment);
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+  ASSERT_TRUE(udpcap_socket.joinMulticastGroup(Udpcap::HostAddress("239.0.0.1")));
+
+  Udpcap::DatagramView view;
+  Udpcap::Error        error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  {
+    ASSERT_TRUE(udpcap_socket.receiveDatagramView(view, 1000, error));
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(view.data, view.length), "Hello World");
+    ASSERT_EQ(view.source_address.toString(),      "192.168.0.1");
+    ASSERT_EQ(view.source_port,                    5000);
+    ASSERT_EQ(view.destination_address.toString(), "239.0.0.1");
+    ASSERT_EQ(view.destination_port,               14000);
+  }
+
+  // The fragmented datagram is referenced in the IP reassembly
+  {
+    ASSERT_TRUE(udpcap_socket.receiveDatagramView(view, 1000, error));
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(view.data, view.length), large_payload);
+    ASSERT_EQ(view.source_port,                    5001);
+    ASSERT_EQ(view.destination_address.toString(), "192.168.0.2");
+  }
+
+  {
+    ASSERT_FALSE(udpcap_socket.receiveDatagramView(view, 1000, error));
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+  }
+
+  udpcap_socket.close();
+}
+
+// Receive datagrams in a callback
+TEST(udpcap, ReceiveCallback)
+{
+  constexpr int num_datagrams = 10;
+
+  std::vector<std::vector<char>> frames;
+  for (int i = 0; i < num_datagrams; i++)
+    frames.push_back(createUdpFrame("192.168.0." + std::to_string(i + 10), "192.168.0.2", static_cast<uint16_t>(5000 + i), 14000, "Hello World " + std::to_string(i)));
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+
+  // The socket must be bound
+  ASSERT_FALSE(udpcap_socket.setReceiveCallback([](const Udpcap::DatagramView&) {}));
+
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  atomic_signalable<int>   received_messages(0);
+  std::vector<std::string> received_payloads;
+
+  ASSERT_TRUE(udpcap_socket.setReceiveCallback([&received_messages, &received_payloads](const Udpcap::DatagramView& datagram)
+                                              {
+                                                received_payloads.emplace_back(datagram.data, datagram.length);
+                                                received_messages++;
+                                              }));
+
+  // Only one callback at a time
+  ASSERT_FALSE(udpcap_socket.setReceiveCallback([](const Udpcap::DatagramView&) {}));
+
+  received_messages.wait_for([](int value) { return value >= num_datagrams; }, std::chrono::milliseconds(1000));
+
+  // close() stops the thread, so there is no concurrent access to received_payloads afterwards
+  udpcap_socket.close();
+
+  ASSERT_EQ(received_messages.get(), num_datagrams);
+  for (int i = 0; i < num_datagrams; i++)
+    ASSERT_EQ(received_payloads[i], "Hello World " + std::to_string(i));
+}
+
+// Receive asynchronously on an io_context
+TEST(udpcap, AsioReceiveFrom)
+{
+  asio::io_context io_context;
+
+  Udpcap::AsioUdpcapSocket udpcap_socket(io_context);
+  ASSERT_TRUE(udpcap_socket.udpcapSocket().isValid());
+
+  std::vector<char>       received_datagram(65536);
+  asio::ip::udp::endpoint sender_endpoint;
+  asio::error_code        receive_error;
+  size_t                  received_bytes = 0;
+  int                     completed_receives = 0;
+
+  const auto receive_handler = [&](const asio::error_code& ec, std::size_t bytes)
+                               {
+                                 receive_error  = ec;
+                                 received_bytes = bytes;
+                                 completed_receives++;
+                               };
+
+  // Not bound
+  udpcap_socket.async_receive_from(asio::buffer(received_datagram), sender_endpoint, receive_handler);
+  ASSERT_EQ(completed_receives, 0); // Never called from within async_receive_from()
+  io_context.run();
+  io_context.restart();
+  ASSERT_EQ(completed_receives, 1);
+  ASSERT_EQ(receive_error, asio::error::bad_descriptor);
+
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  // Create an asio UDP sender socket
+  const asio::ip::udp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), 14000);
+  asio::ip::udp::socket         asio_socket(io_context, endpoint.protocol());
+  asio_socket.connect(endpoint);
+  const auto asio_local_endpoint = asio_socket.local_endpoint();
+
+  // The datagram is sent while the receive operation is already waiting
+  udpcap_socket.async_receive_from(asio::buffer(received_datagram), sender_endpoint, receive_handler);
+
+  asio::steady_timer send_timer(io_context, std::chrono::milliseconds(10));
+  send_timer.async_wait([&asio_socket, &endpoint](const asio::error_code&)
+                        {
+                          const std::string buffer_string = "Hello World";
+                          asio_socket.send_to(asio::buffer(buffer_string), endpoint);
+                        });
+
+  io_context.run_for(std::chrono::milliseconds(500));
+  io_context.restart();
+  ASSERT_EQ(completed_receives, 2);
+  ASSERT_FALSE(receive_error);
+  ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World");
+  ASSERT_EQ(sender_endpoint.address().to_string(), "127.0.0.1");
+  ASSERT_EQ(sender_endpoint.port(),                asio_local_endpoint.port());
+  ASSERT_EQ(sender_endpoint,                       asio_local_endpoint);
+
+  // Cancelling completes the pending operation
+  udpcap_socket.async_receive_from(asio::buffer(received_datagram), sender_endpoint, receive_handler);
+  io_context.poll();
+  udpcap_socket.cancel();
+  io_context.run_for(std::chrono::milliseconds(500));
+  io_context.restart();
+  ASSERT_EQ(completed_receives, 3);
+  ASSERT_EQ(receive_error, asio::error::operation_aborted);
+
+  // And so does closing
+  udpcap_socket.async_receive_from(asio::buffer(received_datagram), sender_endpoint, receive_handler);
+  io_context.poll();
+  udpcap_socket.close();
+  io_context.run_for(std::chrono::milliseconds(500));
+  ASSERT_EQ(completed_receives, 4);
+  ASSERT_EQ(receive_error, asio::error::operation_aborted);
+
+  asio_socket.close();
+}
+
+// Frames from memory have no wait handle and are polled
+TEST(udpcap, AsioReceiveFromCaptureFrames)
+{
+  constexpr int num_datagrams = 10;
+
+  std::vector<std::vector<char>> frames;
+  for (int i = 0; i < num_datagrams; i++)
+    frames.push_back(createUdpFrame("192.168.0." + std::to_string(i + 10), "192.168.0.2", static_cast<uint16_t>(5000 + i), 14000, "Hello World " + std::to_string(i)));
+
+  asio::io_context io_context;
+
+  Udpcap::AsioUdpcapSocket udpcap_socket(io_context);
+  ASSERT_TRUE(udpcap_socket.udpcapSocket().setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  std::vector<char>                    received_datagram(65536);
+  asio::ip::udp::endpoint              sender_endpoint;
+  std::vector<std::string>             received_payloads;
+  std::vector<asio::ip::udp::endpoint> sender_endpoints;
+  asio::error_code                     final_error;
+
+  std::function<void()> receive = [&]()
+                                  {
+                                    udpcap_socket.async_receive_from(asio::buffer(received_datagram), sender_endpoint
+                                                                    , [&](const asio::error_code& ec, std::size_t bytes)
+                                                                      {
+                                                                        if (ec)
+                                                                        {
+                                                                          final_error = ec;
+                                                                          return;
+                                                                        }
+                                                                        received_payloads.emplace_back(received_datagram.data(), bytes);
+                                                                        sender_endpoints.push_back(sender_endpoint);
+                                                                        receive();
+                                                                      });
+                                  };
+  receive();
+
+  io_context.run_for(std::chrono::milliseconds(1000));
+
+  ASSERT_EQ(final_error, asio::error::eof);
+  ASSERT_EQ(received_payloads.size(), static_cast<size_t>(num_datagrams));
+  for (int i = 0; i < num_datagrams; i++)
+  {
+    ASSERT_EQ(received_payloads[i], "Hello World " + std::to_string(i));
+    ASSERT_EQ(sender_endpoints[i].address().to_string(), "192.168.0." + std::to_string(i + 10));
+    ASSERT_EQ(sender_endpoints[i].port(),                5000 + i);
+  }
+}
+
+// Receive the capture metadata of datagrams
+TEST(udpcap, ReceiveDatagramInfo)
+{
+  const std::string capture_file_path = "udpcap_test_datagram_info.pcap";
+
+  // The second frame has been cut off by the capture
+  std::vector<char> truncated_frame = createUdpFrame("192.168.0.1", "192.168.0.2", 5001, 14000, "Hello World 2");
+  truncated_frame.resize(truncated_frame.size() - 2);
+
+  const std::vector<std::pair<long long, std::vector<char>>> frames
+  {
+    { 1500000, createUdpFrame("192.168.0.1", "239.0.0.1",   5000, 14000, "Hello World 1") },
+    { 2000001, truncated_frame },
+  };
+  ASSERT_TRUE(writeCaptureFile(capture_file_path, frames));
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFile(capture_file_path));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+  ASSERT_TRUE(udpcap_socket.joinMulticastGroup(Udpcap::HostAddress("239.0.0.1")));
+
+  Udpcap::Error        error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+  Udpcap::DatagramInfo info;
+
+  // The buffer is too small for the first datagram
+  {
+    std::vector<char> received_datagram(5);
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, info, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello");
+    ASSERT_EQ(info.source_address.toString(),      "192.168.0.1");
+    ASSERT_EQ(info.source_port,                    5000);
+    ASSERT_EQ(info.destination_address.toString(), "239.0.0.1");
+    ASSERT_EQ(info.destination_port,               14000);
+    ASSERT_EQ(info.datagram_length,                13);
+    ASSERT_EQ(info.timestamp,                      std::chrono::microseconds(1500000));
+    ASSERT_EQ(std::string(info.device_name),       capture_file_path);
+    ASSERT_FALSE(info.truncated);
+    ASSERT_TRUE (info.buffer_too_small);
+  }
+
+  {
+    std::vector<char> received_datagram(65536);
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, info, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World");
+    ASSERT_EQ(info.destination_address.toString(), "192.168.0.2");
+    ASSERT_EQ(info.datagram_length,                13);
+    ASSERT_EQ(info.timestamp,                      std::chrono::microseconds(2000001));
+    ASSERT_TRUE (info.truncated);
+    ASSERT_FALSE(info.buffer_too_small);
+  }
+
+  udpcap_socket.close();
+
+  // The device name stays valid after the capture devices have been closed
+  ASSERT_EQ(std::string(info.device_name), capture_file_path);
+
+  std::remove(capture_file_path.c_str());
+}
+
+// Peek the length of the next datagram and receive it with a buffer of exactly that size
+TEST(udpcap, PeekDatagramLength)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames({ createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World")
+                                             , createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hi") }));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Peeking twice returns the same datagram
+  ASSERT_EQ(udpcap_socket.peekDatagramLength(1000, error), 11);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+  ASSERT_EQ(udpcap_socket.peekDatagramLength(1000, error), 11);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+
+  {
+    std::vector<char> received_datagram(11);
+    Udpcap::DatagramInfo info;
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, info, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World");
+    ASSERT_EQ(info.source_port, 5000);
+    ASSERT_FALSE(info.buffer_too_small);
+  }
+
+  // Without peeking, the full length is reported along with the copied bytes
+  {
+    Udpcap::DatagramBuffer buffer;
+    std::vector<char> received_datagram(1);
+    buffer.data    = received_datagram.data();
+    buffer.max_len = received_datagram.size();
+    ASSERT_EQ(udpcap_socket.receiveDatagrams(&buffer, 1, 1000, error), 1);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(buffer.length,          1);
+    ASSERT_EQ(buffer.datagram_length, 2);
+  }
+
+  ASSERT_EQ(udpcap_socket.peekDatagramLength(1000, error), 0);
+  ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+
+  udpcap_socket.close();
+}
+
+// Interrupt a blocking receive call from another thread
+TEST(udpcap, CancelReceive)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  std::chrono::steady_clock::time_point cancel_time;
+  std::chrono::steady_clock::time_point return_time;
+
+  std::thread receive_thread([&]()
+                              {
+                                const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), error);
+                                return_time = std::chrono::steady_clock::now();
+                                ASSERT_EQ(received_bytes, 0);
+                              });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  cancel_time = std::chrono::steady_clock::now();
+  udpcap_socket.cancel();
+  receive_thread.join();
+
+  ASSERT_EQ(error, Udpcap::Error::CANCELLED);
+  ASSERT_LT(return_time - cancel_time, std::chrono::milliseconds(100));
+
+  // The socket is still bound and the next call is not cancelled
+  udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 10, error);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+
+  udpcap_socket.close();
+}
+
+#ifdef __linux__
+// Wait for the single readiness handle of the socket with poll()
+TEST(udpcap, NativeReadinessHandle)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames({ createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 1")
+                                             , createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 2") }));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  const int readiness_handle = udpcap_socket.nativeReadinessHandle();
+  ASSERT_GE(readiness_handle, 0);
+
+  const auto is_ready = [readiness_handle]() -> bool
+                        {
+                          pollfd readiness_pollfd{};
+                          readiness_pollfd.fd     = readiness_handle;
+                          readiness_pollfd.events = POLLIN;
+                          return (poll(&readiness_pollfd, 1, 0) == 1);
+                        };
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Each datagram may be followed by more, so the handle stays signaled
+  for (int i = 1; i <= 2; i++)
+  {
+    ASSERT_TRUE(is_ready());
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World " + std::to_string(i));
+  }
+
+  // Once a receive call has found nothing, the handle is reset
+  ASSERT_TRUE(is_ready());
+  udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+  ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+  ASSERT_FALSE(is_ready());
+
+  // Cancelling and closing signal the handle
+  udpcap_socket.cancel();
+  ASSERT_TRUE(is_ready());
+  udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+  ASSERT_FALSE(is_ready());
+
+  udpcap_socket.close();
+  ASSERT_TRUE(is_ready());
+}
+#endif // __linux__
+
+// Wait for multiple sockets with a single call
+TEST(udpcap, Selector)
+{
+  Udpcap::UdpcapSelector selector;
+  ASSERT_TRUE(selector.isValid());
+
+  Udpcap::UdpcapSocket socket_1;
+  Udpcap::UdpcapSocket socket_2;
+  ASSERT_TRUE(socket_1.setCaptureFrames({ createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World 1") }));
+  ASSERT_TRUE(socket_2.setCaptureFrames({ createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14001, "Hello World 2") }));
+  ASSERT_TRUE(socket_1.bind(Udpcap::HostAddress::Any(), 14000));
+  ASSERT_TRUE(socket_2.bind(Udpcap::HostAddress::Any(), 14001));
+
+  ASSERT_TRUE (selector.addSocket(socket_1));
+  ASSERT_TRUE (selector.addSocket(socket_2));
+  ASSERT_FALSE(selector.addSocket(socket_1));
+
+  std::vector<Udpcap::UdpcapSocket*> ready_sockets;
+  std::vector<char>                  received_datagram(65536);
+  Udpcap::Error                      error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Both sockets have a datagram
+  ASSERT_EQ(selector.wait(ready_sockets, 1000, error), 2);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+
+  // Drain the first socket. The second one stays ready.
+  {
+    const size_t received_bytes = socket_1.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 1");
+    socket_1.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+  }
+
+  ASSERT_EQ(selector.wait(ready_sockets, 1000, error), 1);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+  ASSERT_EQ(ready_sockets[0], &socket_2);
+
+  // Drain the second socket
+  {
+    const size_t received_bytes = socket_2.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 2");
+    socket_2.receiveDatagram(received_datagram.data(), received_datagram.size(), 0, error);
+    ASSERT_EQ(error, Udpcap::Error::END_OF_FILE);
+  }
+
+  ASSERT_EQ(selector.wait(ready_sockets, 10, error), 0);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+
+  // A cancelled selector returns immediately
+  selector.cancel();
+  ASSERT_EQ(selector.wait(ready_sockets, -1, error), 0);
+  ASSERT_EQ(error, Udpcap::Error::CANCELLED);
+
+  // A closed socket is ready
+  socket_1.close();
+  ASSERT_EQ(selector.wait(ready_sockets, 1000, error), 1);
+  ASSERT_EQ(ready_sockets[0], &socket_1);
+
+  ASSERT_TRUE (selector.removeSocket(socket_1));
+  ASSERT_FALSE(selector.removeSocket(socket_1));
+  ASSERT_TRUE (selector.removeSocket(socket_2));
+}
+
+// Select the timestamp source and precision and convert capture timestamps to the steady clock
+TEST(udpcap, CaptureTimestamps)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+
+  ASSERT_EQ(udpcap_socket.timestampSource(),    Udpcap::TimestampSource::Default);
+  ASSERT_EQ(udpcap_socket.timestampPrecision(), Udpcap::TimestampPrecision::Nanoseconds);
+
+  ASSERT_TRUE(udpcap_socket.setTimestampSource(Udpcap::TimestampSource::HostHighPrecision));
+  ASSERT_TRUE(udpcap_socket.setTimestampPrecision(Udpcap::TimestampPrecision::Microseconds));
+  ASSERT_EQ(udpcap_socket.timestampSource(),    Udpcap::TimestampSource::HostHighPrecision);
+  ASSERT_EQ(udpcap_socket.timestampPrecision(), Udpcap::TimestampPrecision::Microseconds);
+
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames({ createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World") }));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+  // Both have to be set before binding
+  ASSERT_FALSE(udpcap_socket.setTimestampSource(Udpcap::TimestampSource::Adapter));
+  ASSERT_FALSE(udpcap_socket.setTimestampPrecision(Udpcap::TimestampPrecision::Nanoseconds));
+
+  udpcap_socket.close();
+
+  // A datagram captured 10ms ago
+  const auto capture_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()) - std::chrono::milliseconds(10);
+  const auto latency      = std::chrono::steady_clock::now() - Udpcap::captureTimeToSteadyClock(capture_time);
+
+  ASSERT_GE(latency, std::chrono::milliseconds(10));
+  ASSERT_LT(latency, std::chrono::milliseconds(100));
+}
+
+// Nanosecond timestamps reach DatagramInfo unchanged, microsecond timestamps are scaled to nanoseconds
+TEST(udpcap, CaptureTimestampUnits)
+{
+  const std::string micro_file_path = "udpcap_test_timestamps_micro.pcap";
+  const std::string nano_file_path  = "udpcap_test_timestamps_nano.pcap";
+
+  const auto frame = createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Hello World");
+
+  ASSERT_TRUE(writeCaptureFile(micro_file_path, { { 1700000000123456LL,    frame } }));
+  ASSERT_TRUE(writeCaptureFile(nano_file_path,  { { 1700000000123456789LL, frame } }, 1, true));
+
+  const std::vector<std::pair<std::string, std::chrono::nanoseconds>> expected_timestamps
+  {
+    { micro_file_path, std::chrono::nanoseconds(1700000000123456000LL) },
+    { nano_file_path,  std::chrono::nanoseconds(1700000000123456789LL) },
+  };
+
+  for (const auto& expected_timestamp : expected_timestamps)
+  {
+    Udpcap::UdpcapSocket udpcap_socket;
+    ASSERT_TRUE(udpcap_socket.isValid());
+    ASSERT_TRUE(udpcap_socket.setCaptureFile(expected_timestamp.first));
+    ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+
+    Udpcap::Error        error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+    Udpcap::DatagramInfo info;
+    std::vector<char>    received_datagram(65536);
+
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, info, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(received_bytes, 11);
+    ASSERT_EQ(info.timestamp.count(), expected_timestamp.second.count()) << expected_timestamp.first;
+
+    udpcap_socket.close();
+  }
+
+  std::remove(micro_file_path.c_str());
+  std::remove(nano_file_path.c_str());
+}
+
+// Multiple sockets sharing one capture handle per interface
+TEST(udpcap, SharedCapture)
+{
+  Udpcap::UdpcapSocket udpcap_socket_1;
+  Udpcap::UdpcapSocket udpcap_socket_2;
+  Udpcap::UdpcapSocket udpcap_socket_3;
+  ASSERT_TRUE(udpcap_socket_1.setSharedCaptureEnabled(true));
+  ASSERT_TRUE(udpcap_socket_2.setSharedCaptureEnabled(true));
+  ASSERT_TRUE(udpcap_socket_3.setSharedCaptureEnabled(true));
+  ASSERT_TRUE(udpcap_socket_1.isSharedCaptureEnabled());
+
+  ASSERT_TRUE(udpcap_socket_1.bind(Udpcap::HostAddress::LocalHost(), 14000));
+  ASSERT_TRUE(udpcap_socket_2.bind(Udpcap::HostAddress::LocalHost(), 14000));
+  ASSERT_TRUE(udpcap_socket_3.bind(Udpcap::HostAddress::LocalHost(), 14001));
+
+  // Shared capture must be enabled before binding
+  ASSERT_FALSE(udpcap_socket_1.setSharedCaptureEnabled(false));
+
+  asio::io_context io_context;
+  asio::ip::udp::socket asio_socket(io_context, asio::ip::udp::v4());
+  asio_socket.send_to(asio::buffer(std::string("Hello World 1")), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 14000));
+  asio_socket.send_to(asio::buffer(std::string("Hello World 2")), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 14001));
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Both sockets bound to the port receive the first datagram, the third socket only the second one
+  for (Udpcap::UdpcapSocket* udpcap_socket : { &udpcap_socket_1, &udpcap_socket_2 })
+  {
+    const size_t received_bytes = udpcap_socket->receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 1");
+  }
+
+  {
+    const size_t received_bytes = udpcap_socket_3.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 2");
+  }
+
+  // Closing one socket doesn't affect the others
+  udpcap_socket_2.close();
+  asio_socket.send_to(asio::buffer(std::string("Hello World 3")), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 14000));
+
+  {
+    const size_t received_bytes = udpcap_socket_1.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), "Hello World 3");
+  }
+
+  udpcap_socket_1.receiveDatagram(received_datagram.data(), received_datagram.size(), 10, error);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+}
+
+// Distribute the datagrams among sockets bound to the same port
+TEST(udpcap, LoadBalancing)
+{
+  asio::io_context io_context;
+  asio::ip::udp::socket asio_socket(io_context, asio::ip::udp::v4());
+  const asio::ip::udp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), 14000);
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  const auto count_datagrams = [&received_datagram, &error](Udpcap::UdpcapSocket& udpcap_socket) -> int
+                                {
+                                  int received_datagrams = 0;
+                                  for (;;)
+                                  {
+                                    udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 100, error);
+                                    if (error != Udpcap::Error::OK)
+                                      return received_datagrams;
+                                    received_datagrams++;
+                                  }
+                                };
+
+  // Round-robin spreads the datagrams evenly
+  {
+    Udpcap::UdpcapSocket udpcap_socket_1;
+    Udpcap::UdpcapSocket udpcap_socket_2;
+    ASSERT_TRUE(udpcap_socket_1.setLoadBalancing(Udpcap::LoadBalancing::RoundRobin));
+    ASSERT_TRUE(udpcap_socket_2.setLoadBalancing(Udpcap::LoadBalancing::RoundRobin));
+    ASSERT_EQ(udpcap_socket_1.loadBalancing(), Udpcap::LoadBalancing::RoundRobin);
+    ASSERT_TRUE(udpcap_socket_1.bind(Udpcap::HostAddress::LocalHost(), 14000));
+    ASSERT_TRUE(udpcap_socket_2.bind(Udpcap::HostAddress::LocalHost(), 14000));
+    ASSERT_FALSE(udpcap_socket_1.setLoadBalancing(Udpcap::LoadBalancing::None));
+
+    for (int i = 0; i < 4; i++)
+      asio_socket.send_to(asio::buffer(std::string("Hello World")), endpoint);
+
+    ASSERT_EQ(count_datagrams(udpcap_socket_1), 2);
+    ASSERT_EQ(count_datagrams(udpcap_socket_2), 2);
+  }
+
+  // The flow hash keeps all datagrams of a flow at the same socket
+  {
+    Udpcap::UdpcapSocket udpcap_socket_1;
+    Udpcap::UdpcapSocket udpcap_socket_2;
+    ASSERT_TRUE(udpcap_socket_1.setLoadBalancing(Udpcap::LoadBalancing::FlowHash));
+    ASSERT_TRUE(udpcap_socket_2.setLoadBalancing(Udpcap::LoadBalancing::FlowHash));
+    ASSERT_TRUE(udpcap_socket_1.bind(Udpcap::HostAddress::LocalHost(), 14000));
+    ASSERT_TRUE(udpcap_socket_2.bind(Udpcap::HostAddress::LocalHost(), 14000));
+
+    for (int i = 0; i < 4; i++)
+      asio_socket.send_to(asio::buffer(std::string("Hello World")), endpoint);
+
+    const int received_datagrams_1 = count_datagrams(udpcap_socket_1);
+    const int received_datagrams_2 = count_datagrams(udpcap_socket_2);
+    ASSERT_EQ(received_datagrams_1 + received_datagrams_2, 4);
+    ASSERT_TRUE((received_datagrams_1 == 0) || (received_datagrams_2 == 0));
+  }
+}
+
+// Capture with multiple PACKET_FANOUT queues, merged and per queue
+TEST(udpcap, CaptureQueues)
+{
+#ifdef __linux__
+  asio::io_context io_context;
+  const asio::ip::udp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), 14000);
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  const auto count_datagrams = [&received_datagram, &error](Udpcap::UdpcapSocket& udpcap_socket) -> int
+                                {
+                                  int received_datagrams = 0;
+                                  for (;;)
+                                  {
+                                    udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 100, error);
+                                    if (error != Udpcap::Error::OK)
+                                      return received_datagrams;
+                                    received_datagrams++;
+                                  }
+                                };
+
+  // One merged consumer and one consumer per queue
+  Udpcap::UdpcapSocket merged_socket;
+  Udpcap::UdpcapSocket queue_socket_1;
+  Udpcap::UdpcapSocket queue_socket_2;
+  for (Udpcap::UdpcapSocket* udpcap_socket : { &merged_socket, &queue_socket_1, &queue_socket_2 })
+    ASSERT_TRUE(udpcap_socket->setCaptureQueues(2, Udpcap::FanoutMode::Hash));
+  ASSERT_EQ(merged_socket.captureQueueCount(), 2);
+  ASSERT_TRUE(queue_socket_1.setLoadBalancing(Udpcap::LoadBalancing::CaptureQueue));
+  ASSERT_TRUE(queue_socket_2.setLoadBalancing(Udpcap::LoadBalancing::CaptureQueue));
+
+  for (Udpcap::UdpcapSocket* udpcap_socket : { &merged_socket, &queue_socket_1, &queue_socket_2 })
+    ASSERT_TRUE(udpcap_socket->bind(Udpcap::HostAddress::LocalHost(), 14000));
+
+  ASSERT_FALSE(merged_socket.setCaptureQueues(1, Udpcap::FanoutMode::Hash));
+
+  // Send from many source ports, so the flows are spread across the queues
+  for (int flow = 0; flow < 8; flow++)
+  {
+    asio::ip::udp::socket asio_socket(io_context, asio::ip::udp::v4());
+    for (int i = 0; i < 4; i++)
+      asio_socket.send_to(asio::buffer(std::string("Hello World")), endpoint);
+  }
+
+  ASSERT_EQ(count_datagrams(merged_socket), 32);
+  ASSERT_EQ(count_datagrams(queue_socket_1) + count_datagrams(queue_socket_2), 32);
+#else
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_FALSE(udpcap_socket.setCaptureQueues(2, Udpcap::FanoutMode::Hash));
+  ASSERT_TRUE (udpcap_socket.setCaptureQueues(1, Udpcap::FanoutMode::Hash));
+#endif // __linux__
+}
+
+// Buffer a burst in user space while the application doesn't receive
+TEST(udpcap, UserBuffer)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_FALSE(udpcap_socket.setUserBufferSize(1024 * 1024, 64 * 1024));
+  ASSERT_TRUE (udpcap_socket.setUserBufferSize(64 * 1024, 8 * 1024 * 1024));
+  ASSERT_EQ(udpcap_socket.userBufferMaxSize(), 8 * 1024 * 1024);
+
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::LocalHost(), 14000));
+
+  // The user buffer must be set before binding
+  ASSERT_FALSE(udpcap_socket.setUserBufferSize(0, 0));
+
+  // The burst is larger than the initial size of the user buffer, so it has to grow
+  const std::string datagram(1000, 'u');
+  const int         datagram_count = 500;
+
+  {
+    asio::io_context io_context;
+    asio::ip::udp::socket asio_socket(io_context, asio::ip::udp::v4());
+    for (int i = 0; i < datagram_count; i++)
+      asio_socket.send_to(asio::buffer(datagram), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 14000));
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  for (int i = 0; i < datagram_count; i++)
+  {
+    const size_t received_bytes = udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), datagram);
+  }
+
+  udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 10, error);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+}
+
+// Keep either the oldest or the freshest datagrams, when the receive queue is full
+TEST(udpcap, ReceiveQueueOverflow)
+{
+  Udpcap::UdpcapSocket drop_newest_socket;
+  Udpcap::UdpcapSocket drop_oldest_socket;
+  ASSERT_TRUE(drop_newest_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::DropNewest));
+  ASSERT_TRUE(drop_oldest_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::DropOldest));
+  ASSERT_EQ(drop_oldest_socket.receiveQueueLimit(), 5);
+  ASSERT_EQ(drop_oldest_socket.overflowPolicy(), Udpcap::OverflowPolicy::DropOldest);
+
+  ASSERT_TRUE(drop_newest_socket.bind(Udpcap::HostAddress::LocalHost(), 14000));
+  ASSERT_TRUE(drop_oldest_socket.bind(Udpcap::HostAddress::LocalHost(), 14000));
+
+  // The receive queue must be set before binding
+  ASSERT_FALSE(drop_oldest_socket.setReceiveQueueLimit(0, Udpcap::OverflowPolicy::DropNewest));
+
+  {
+    asio::io_context io_context;
+    asio::ip::udp::socket asio_socket(io_context, asio::ip::udp::v4());
+    for (int i = 0; i < 20; i++)
+      asio_socket.send_to(asio::buffer(std::to_string(i)), asio::ip::udp::endpoint(asio::ip::make_address("127.0.0.1"), 14000));
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  const Udpcap::ReceiveQueueStatistics drop_newest_statistics = drop_newest_socket.receiveQueueStatistics();
+  ASSERT_EQ(drop_newest_statistics.queued_frames,         5);
+  ASSERT_EQ(drop_newest_statistics.dropped_newest_frames, 15);
+  ASSERT_EQ(drop_newest_statistics.dropped_oldest_frames, 0);
+
+  const Udpcap::ReceiveQueueStatistics drop_oldest_statistics = drop_oldest_socket.receiveQueueStatistics();
+  ASSERT_EQ(drop_oldest_statistics.queued_frames,         5);
+  ASSERT_EQ(drop_oldest_statistics.dropped_newest_frames, 0);
+  ASSERT_EQ(drop_oldest_statistics.dropped_oldest_frames, 15);
+
+  std::vector<char> received_datagram(65536);
+  Udpcap::Error     error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // One socket keeps the first datagrams, the other one the last datagrams
+  for (int i = 0; i < 5; i++)
+  {
+    size_t received_bytes = drop_newest_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), std::to_string(i));
+
+    received_bytes = drop_oldest_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, error);
+    ASSERT_EQ(error, Udpcap::Error::OK);
+    ASSERT_EQ(std::string(received_datagram.data(), received_bytes), std::to_string(15 + i));
+  }
+
+  drop_oldest_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 10, error);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+}
+
+// Shared capture cannot wait for a full receive queue, no matter which one is set first
+TEST(udpcap, ReceiveQueueBlockWithSharedCapture)
+{
+  Udpcap::UdpcapSocket shared_socket;
+  ASSERT_TRUE(shared_socket.setSharedCaptureEnabled(true));
+  ASSERT_FALSE(shared_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::Block));
+  ASSERT_EQ(shared_socket.overflowPolicy(), Udpcap::OverflowPolicy::DropNewest);
+  ASSERT_TRUE(shared_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::DropOldest));
+
+  Udpcap::UdpcapSocket load_balancing_socket;
+  ASSERT_TRUE(load_balancing_socket.setLoadBalancing(Udpcap::LoadBalancing::RoundRobin));
+  ASSERT_FALSE(load_balancing_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::Block));
+
+  Udpcap::UdpcapSocket blocking_socket;
+  ASSERT_TRUE(blocking_socket.setReceiveQueueLimit(5, Udpcap::OverflowPolicy::Block));
+  ASSERT_FALSE(blocking_socket.setSharedCaptureEnabled(true));
+  ASSERT_FALSE(blocking_socket.isSharedCaptureEnabled());
+  ASSERT_FALSE(blocking_socket.setLoadBalancing(Udpcap::LoadBalancing::FlowHash));
+  ASSERT_TRUE(blocking_socket.setSharedCaptureEnabled(false));
+}
+
+// Only keep the latest datagram of each sender
+TEST(udpcap, Conflation)
+{
+  Udpcap::UdpcapSocket udpcap_socket;
+
+  // Conflation needs a bound socket
+  ASSERT_FALSE(udpcap_socket.enableConflation(16, 1500));
+
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::LocalHost(), 14000));
+  ASSERT_TRUE(udpcap_socket.enableConflation(16, 1500));
+
+  {
+    asio::io_context io_context;
+    asio::ip::udp::socket asio_socket_1(io_context, asio::ip::udp::v4());
+    asio::ip::udp::socket asio_socket_2(io_context, asio::ip::udp::v4());
+    const asio::ip::udp::endpoint endpoint(asio::ip::make_address("127.0.0.1"), 14000);
+
+    for (int i = 0; i < 10; i++)
+    {
+      asio_socket_1.send_to(asio::buffer("Sender 1: " + std::to_string(i)), endpoint);
+      asio_socket_2.send_to(asio::buffer("Sender 2: " + std::to_string(i)), endpoint);
+    }
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  std::vector<std::vector<char>>      buffer_memory(4, std::vector<char>(1500));
+  std::vector<Udpcap::DatagramBuffer> buffers(buffer_memory.size());
+  std::vector<Udpcap::DatagramInfo>   infos(buffer_memory.size());
+  for (size_t i = 0; i < buffers.size(); i++)
+  {
+    buffers[i].data    = buffer_memory[i].data();
+    buffers[i].max_len = buffer_memory[i].size();
+  }
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  // Each sender is one flow, of which only the last datagram is left
+  const size_t received_datagrams = udpcap_socket.receiveLatestDatagrams(buffers.data(), infos.data(), buffers.size(), 1000, error);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+  ASSERT_EQ(received_datagrams, 2);
+  ASSERT_EQ(std::string(buffers[0].data, buffers[0].length), "Sender 1: 9");
+  ASSERT_EQ(std::string(buffers[1].data, buffers[1].length), "Sender 2: 9");
+  ASSERT_NE(infos[0].source_port, infos[1].source_port);
+  ASSERT_EQ(infos[0].destination_port, 14000);
+
+  ASSERT_EQ(udpcap_socket.receiveQueueStatistics().conflated_datagrams, 18);
+
+  // The flows are only returned again, once they have been updated
+  udpcap_socket.receiveLatestDatagrams(buffers.data(), infos.data(), buffers.size(), 10, error);
+  ASSERT_EQ(error, Udpcap::Error::TIMEOUT);
+
+  udpcap_socket.close();
+  udpcap_socket.receiveLatestDatagrams(buffers.data(), infos.data(), buffers.size(), -1, error);
+  ASSERT_EQ(error, Udpcap::Error::SOCKET_CLOSED);
+}
+
+// The latest datagrams can still be taken after closing the socket, including their device name
+TEST(udpcap, ConflationAfterClose)
+{
+  const std::vector<std::vector<char>> frames
+  {
+    createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "Old"),
+    createUdpFrame("192.168.0.1", "192.168.0.2", 5000, 14000, "New"),
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+  ASSERT_TRUE(udpcap_socket.enableConflation(4, 1500));
+
+  // Wait for the receive thread to update the flow with both frames
+  for (int i = 0; (i < 100) && (udpcap_socket.receiveQueueStatistics().conflated_datagrams < 1); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  udpcap_socket.close();
+
+  std::vector<char>      buffer_memory(1500);
+  Udpcap::DatagramBuffer buffer;
+  Udpcap::DatagramInfo   info;
+  buffer.data    = buffer_memory.data();
+  buffer.max_len = buffer_memory.size();
+
+  Udpcap::Error error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+  const size_t received_datagrams = udpcap_socket.receiveLatestDatagrams(&buffer, &info, 1, 0, error);
+  ASSERT_EQ(error, Udpcap::Error::OK);
+  ASSERT_EQ(received_datagrams, 1);
+  ASSERT_EQ(std::string(buffer.data, buffer.length), "New");
+  ASSERT_EQ(std::string(info.device_name), "memory");
+
+  udpcap_socket.receiveLatestDatagrams(&buffer, &info, 1, 0, error);
+  ASSERT_EQ(error, Udpcap::Error::SOCKET_CLOSED);
+}
+
+// Join and leave a multicast group at a high rate while another thread is receiving
+TEST(udpcap, JoinLeaveWhileReceiving)
+{
+  const std::vector<std::vector<char>> frames
+  {
+    createUdpFrame("192.168.0.1", "239.0.0.1", 5000, 14000, "Group 1"),
+    createUdpFrame("192.168.0.1", "239.0.0.2", 5000, 14000, "Group 2"),
+  };
+
+  Udpcap::UdpcapSocket udpcap_socket;
+  ASSERT_TRUE(udpcap_socket.isValid());
+  ASSERT_TRUE(udpcap_socket.setCaptureFrames(frames, 0));
+  ASSERT_TRUE(udpcap_socket.bind(Udpcap::HostAddress::Any(), 14000));
+  ASSERT_TRUE(udpcap_socket.joinMulticastGroup(Udpcap::HostAddress("239.0.0.1")));
+
+  std::atomic<bool> group_2_left(false);
+  std::atomic<int>  group_1_datagrams(0);
+  std::atomic<int>  group_2_datagrams_after_leave(0);
+
+  std::thread receive_thread([&]()
+                             {
+                               std::vector<char>    received_datagram(65536);
+                               Udpcap::DatagramInfo info;
+                               Udpcap::Error        error = Udpcap::Error::ErrorCode::GENERIC_ERROR;
+
+                               for (;;)
+                               {
+                                 // Read before receiving, as a datagram captured before leaving may be returned until then
+                                 const bool left = group_2_left;
+
+                                 udpcap_socket.receiveDatagram(received_datagram.data(), received_datagram.size(), 1000, info, error);
+                                 if (error)
+                                   break;
+
+                                 if (info.destination_address == Udpcap::HostAddress("239.0.0.1"))
+                                   group_1_datagrams++;
+                                 else if (left)
+                                   group_2_datagrams_after_leave++;
+                               }
+                             });
+
+  int failed_calls = 0;
+  for (int i = 0; i < 200; i++)
+  {
+    if (!udpcap_socket.joinMulticastGroup(Udpcap::HostAddress("239.0.0.2")))
+      failed_calls++;
+    if (!udpcap_socket.leaveMulticastGroup(Udpcap::HostAddress("239.0.0.2")))
+      failed_calls++;
+  }
+  group_2_left = true;
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  udpcap_socket.close();
+  receive_thread.join();
+
+  ASSERT_EQ(failed_calls, 0);
+  ASSERT_GT(group_1_datagrams, 0);
+  ASSERT_EQ(group_2_datagrams_after_leave, 0);
+}
@@ -0,0 +1,56 @@
+# - Try to find the libpcap include dirs and libraries
+#
+# Usage of this module as follows:
+#
+#     find_package(libpcap)
+#
+# Variables used by this module, they can change the default behaviour and need
+# to be set before calling find_package:
+#
+#  libpcap_ROOT_DIR          Set this variable to the root directory of
+#                            a libpcap installation
+#
+# Targets created by this module:
+#   
+#  libpcap::libpcap           Imported target for the libpcap library
+#
+# Variables defined by this module:
+#
+#  libpcap_FOUND              System has libpcap, include and library dirs found
+#  libpcap_INCLUDE_DIR        The libpcap include directories.
+#  libpcap_LIBRARY            The libpcap library
+#
+
+# Include dir
+find_path(libpcap_INCLUDE_DIR
+    NAMES
+        pcap/pcap.h
+    HINTS
+        "${libpcap_ROOT_DIR}/include"
+)
+
+# Library
+find_library(libpcap_LIBRARY
+    NAMES
+        pcap
+    HINTS
+        "${libpcap_ROOT_DIR}/lib"
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(libpcap DEFAULT_MSG
+    libpcap_LIBRARY
+    libpcap_INCLUDE_DIR
+)
+
+if (libpcap_FOUND AND NOT TARGET libpcap::libpcap)
+    add_library(libpcap::libpcap UNKNOWN IMPORTED)
+    set_target_properties(libpcap::libpcap PROPERTIES
+                        INTERFACE_INCLUDE_DIRECTORIES "${libpcap_INCLUDE_DIR}"
+                        IMPORTED_LOCATION "${libpcap_LIBRARY}")
+endif()
+
+mark_as_advanced(
+    libpcap_INCLUDE_DIR
+    libpcap_LIBRARY
+)
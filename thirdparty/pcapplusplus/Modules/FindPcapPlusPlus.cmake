@@ -1 +0,0 @@
-set(PcapPlusPlus_FOUND TRUE CACHE BOOL "Found Pcap++" FORCE)
\ No newline at end of file
@@ -0,0 +1,464 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <udpcap/error.h>
+#include <udpcap/host_address.h>
+#include <udpcap/udpcap_socket.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <asio.hpp>
+
+#ifndef _WIN32
+#include <unistd.h>         // dup()
+#endif // !_WIN32
+
+// The co_await API needs C++20 coroutines. The rest of this header works with C++14.
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#define UDPCAP_HAS_COROUTINES 1
+#endif
+#endif // __has_include
+
+// This header is not compiled into the udpcap library. The application has to
+// provide asio itself, just like for using any other asio socket.
+
+namespace Udpcap
+{
+  /**
+   * @brief A UdpcapSocket that receives asynchronously on an asio executor
+   *
+   * The wait handles of the capture devices (see
+   * UdpcapSocket::nativeWaitHandles()) are registered with the reactor of the
+   * executor's io_context. Waiting for data therefore doesn't block a thread,
+   * and many sockets can share a single io_context.
+   *
+   * async_receive_from() has the same semantics as
+   * asio::ip::udp::socket::async_receive_from():
+   *    - The handler is called with the error and the number of bytes copied to the buffer
+   *    - The handler is never called from within async_receive_from()
+   *    - The handler is called through its associated executor
+   *    - Datagrams that don't fit into the buffer are truncated
+   *    - cancel() and close() complete a pending receive with asio::error::operation_aborted
+   *
+   * Errors of the UdpcapSocket are mapped to asio errors:
+   *    - NOT_BOUND             -> asio::error::bad_descriptor
+   *    - SOCKET_CLOSED         -> asio::error::operation_aborted
+   *    - CANCELLED             -> asio::error::operation_aborted
+   *    - END_OF_FILE           -> asio::error::eof
+   *    - NPCAP_NOT_INITIALIZED -> asio::error::no_such_device
+   *    - GENERIC_ERROR         -> asio::error::network_down
+   *
+   * Capture files and frames from memory can't be waited on. For those, the
+   * socket checks for new datagrams every millisecond.
+   *
+   * Thread safety:
+   *   - Like the asio sockets, this class is not thread safe. Use it from the threads running the executor (or from a strand).
+   *   - Only one receive operation may be pending at a time
+   *   - The socket may be configured with udpcapSocket(). It must however be closed with close() of this class.
+   */
+  class AsioUdpcapSocket
+  {
+  public:
+    using executor_type = asio::any_io_executor;
+
+    /**
+     * @brief Creates a new socket that receives on the given executor
+     *
+     * Just like the UdpcapSocket, the socket is not bound.
+     */
+    explicit AsioUdpcapSocket(const executor_type& executor)
+      : impl_(std::make_shared<Implementation>(executor))
+    {}
+
+    template <typename ExecutionContext>
+    explicit AsioUdpcapSocket(ExecutionContext& context
+                            , typename std::enable_if<std::is_convertible<ExecutionContext&, asio::execution_context&>::value>::type* = nullptr)
+      : AsioUdpcapSocket(executor_type(context.get_executor()))
+    {}
+
+    ~AsioUdpcapSocket()
+    {
+      if (impl_)
+        impl_->close();
+    }
+
+    // Copy
+    AsioUdpcapSocket(const AsioUdpcapSocket&)            = delete;
+    AsioUdpcapSocket& operator=(const AsioUdpcapSocket&) = delete;
+
+    // Move
+    AsioUdpcapSocket(AsioUdpcapSocket&&)                 = default;
+    AsioUdpcapSocket& operator=(AsioUdpcapSocket&& other)
+    {
+      if (this != &other)
+      {
+        if (impl_)
+          impl_->close();
+        impl_ = std::move(other.impl_);
+      }
+      return *this;
+    }
+
+    executor_type get_executor() const noexcept { return impl_->executor_; }
+
+    /**
+     * @brief The underlying UdpcapSocket, e.g. for joining multicast groups
+     */
+    UdpcapSocket&       udpcapSocket()       { return impl_->socket_; }
+    const UdpcapSocket& udpcapSocket() const { return impl_->socket_; }
+
+    /**
+     * @brief Binds the socket to an address and a port (see UdpcapSocket::bind())
+     */
+    bool bind(const HostAddress& local_address, uint16_t local_port)
+    {
+      return impl_->socket_.bind(local_address, local_port);
+    }
+
+    /**
+     * @brief Starts receiving a datagram asynchronously
+     *
+     * @param buffer           The destination memory. It must stay valid until the handler is called.
+     * @param sender_endpoint  [out] The sender of the datagram. It must stay valid until the handler is called.
+     * @param token            The completion token. Handlers have the signature void(asio::error_code, std::size_t).
+     */
+    template <typename ReadToken>
+    auto async_receive_from(const asio::mutable_buffer& buffer, asio::ip::udp::endpoint& sender_endpoint, ReadToken&& token)
+    {
+      return asio::async_initiate<ReadToken, void(asio::error_code, std::size_t)>(InitiateReceiveFrom{impl_}, token, buffer, &sender_endpoint);
+    }
+
+#ifdef UDPCAP_HAS_COROUTINES
+    /**
+     * @brief Result of co_await async_receive()
+     */
+    struct ReceiveResult
+    {
+      asio::error_code        error;                                            /**< The error, just like for async_receive_from() */
+      std::size_t             received_bytes = 0;                               /**< The number of bytes copied to the buffer */
+      asio::ip::udp::endpoint source;                                           /**< The sender of the datagram */
+    };
+
+    /**
+     * @brief Awaitable returned by async_receive()
+     *
+     * The coroutine is resumed on the thread running the executor. It works
+     * with any coroutine type, e.g. a simple detached task.
+     */
+    class ReceiveAwaitable
+    {
+    public:
+      ReceiveAwaitable(AsioUdpcapSocket& socket, const asio::mutable_buffer& buffer)
+        : socket_(socket)
+        , buffer_(buffer)
+      {}
+
+      bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<> coroutine)
+      {
+        // The awaitable lives in the coroutine frame until the coroutine has been resumed
+        socket_.async_receive_from(buffer_, result_.source
+                                  , [this, coroutine](const asio::error_code& ec, std::size_t received_bytes)
+                                    {
+                                      result_.error          = ec;
+                                      result_.received_bytes = received_bytes;
+                                      coroutine.resume();
+                                    });
+      }
+
+      ReceiveResult await_resume() const { return result_; }
+
+    private:
+      AsioUdpcapSocket&     socket_;
+      asio::mutable_buffer  buffer_;
+      ReceiveResult         result_;
+    };
+
+    /**
+     * @brief Receives a datagram in a coroutine: co_await socket.async_receive(buffer)
+     *
+     * This is async_receive_from() for C++20 coroutines. Waiting for the
+     * datagram is done by the executor, so a single thread running the
+     * io_context can serve the pending receives of many coroutines and
+     * sockets.
+     *
+     * @param buffer  The destination memory. It must stay valid until the coroutine has been resumed.
+     *
+     * @return An awaitable that yields a ReceiveResult
+     */
+    ReceiveAwaitable async_receive(const asio::mutable_buffer& buffer)
+    {
+      return ReceiveAwaitable(*this, buffer);
+    }
+#endif // UDPCAP_HAS_COROUTINES
+
+    /**
+     * @brief Completes a pending receive operation with asio::error::operation_aborted
+     */
+    void cancel()
+    {
+      impl_->cancel();
+    }
+
+    /**
+     * @brief Cancels a pending receive operation and closes the socket
+     */
+    void close()
+    {
+      impl_->close();
+    }
+
+  private:
+    template <typename Handler>
+    struct ReceiveOperation
+    {
+      using HandlerExecutor = typename asio::associated_executor<Handler, executor_type>::type;
+
+      ReceiveOperation(Handler handler_in, const asio::mutable_buffer& buffer_in, asio::ip::udp::endpoint* sender_endpoint_in, const executor_type& executor, uint64_t cancel_generation_in)
+        : handler          (std::move(handler_in))
+        , work             (asio::get_associated_executor(handler, executor))
+        , buffer           (buffer_in)
+        , sender_endpoint  (sender_endpoint_in)
+        , cancel_generation(cancel_generation_in)
+        , pending_waits    (0)
+      {}
+
+      Handler                                     handler;
+      asio::executor_work_guard<HandlerExecutor>  work;                         /**< Keeps the executor of the handler busy until the handler has been called */
+      asio::mutable_buffer                        buffer;
+      asio::ip::udp::endpoint*                    sender_endpoint;
+      uint64_t                                    cancel_generation;            /**< The operation has been cancelled, if the socket's generation differs */
+      size_t                                      pending_waits;                /**< Wait handles and poll timer that have not returned, yet */
+    };
+
+    // Shared with all pending waits, so the socket may be destroyed while
+    // asio still has to call them.
+    class Implementation : public std::enable_shared_from_this<Implementation>
+    {
+    public:
+#ifdef _WIN32
+      using WaitHandle = asio::windows::object_handle;
+#else
+      using WaitHandle = asio::posix::stream_descriptor;
+#endif // _WIN32
+
+      explicit Implementation(const executor_type& executor)
+        : executor_               (executor)
+        , poll_timer_             (executor)
+        , wait_handles_registered_(false)
+        , poll_                   (false)
+        , cancel_generation_      (0)
+      {}
+
+      template <typename Operation>
+      void receive(const std::shared_ptr<Operation>& operation)
+      {
+        if (operation->cancel_generation != cancel_generation_)
+        {
+          complete(operation, asio::error::operation_aborted, 0);
+          return;
+        }
+
+        HostAddress   source_address;
+        uint16_t      source_port(0);
+        Udpcap::Error error = Udpcap::Error::OK;
+
+        // Don't wait, the reactor does that for us
+        const size_t received_bytes = socket_.receiveDatagram(static_cast<char*>(operation->buffer.data()), operation->buffer.size(), 0, &source_address, &source_port, error);
+
+        if (error == Udpcap::Error::TIMEOUT)
+        {
+          wait(operation);
+          return;
+        }
+
+        if (!error)
+        {
+          // HostAddress stores the address in network byte order
+          const uint32_t source_address_int = source_address.toInt();
+          asio::ip::address_v4::bytes_type source_address_bytes;
+          memcpy(source_address_bytes.data(), &source_address_int, source_address_bytes.size());
+
+          *operation->sender_endpoint = asio::ip::udp::endpoint(asio::ip::address_v4(source_address_bytes), source_port);
+        }
+
+        complete(operation, toAsioErrorCode(error), received_bytes);
+      }
+
+      uint64_t cancelGeneration() const
+      {
+        return cancel_generation_;
+      }
+
+      void cancel()
+      {
+        cancel_generation_++;
+        cancelWaits();
+      }
+
+      void close()
+      {
+        cancel();
+
+        // Closing the handles completes their pending waits
+        for (auto& wait_handle : wait_handles_)
+        {
+          asio::error_code ignored_error;
+          wait_handle.close(ignored_error);
+        }
+        wait_handles_.clear();
+        wait_handles_registered_ = false;
+        poll_                    = false;
+
+        socket_.close();
+      }
+
+    private:
+      template <typename Operation>
+      void wait(const std::shared_ptr<Operation>& operation)
+      {
+        if (!wait_handles_registered_)
+          registerWaitHandles();
+
+        auto self = this->shared_from_this();
+        const auto on_wait_completed = [self, operation](const asio::error_code& ec) { self->onWaitCompleted(operation, ec); };
+
+        operation->pending_waits = wait_handles_.size() + (poll_ ? 1 : 0);
+
+        for (auto& wait_handle : wait_handles_)
+        {
+#ifdef _WIN32
+          wait_handle.async_wait(on_wait_completed);
+#else
+          wait_handle.async_wait(WaitHandle::wait_read, on_wait_completed);
+#endif // _WIN32
+        }
+
+        if (poll_)
+        {
+          poll_timer_.expires_after(std::chrono::milliseconds(1));
+          poll_timer_.async_wait(on_wait_completed);
+        }
+      }
+
+      template <typename Operation>
+      void onWaitCompleted(const std::shared_ptr<Operation>& operation, const asio::error_code& ec)
+      {
+        operation->pending_waits--;
+
+        // The first wait that returns cancels the others. We try receiving
+        // again, once all of them have returned.
+        if (ec != asio::error::operation_aborted)
+          cancelWaits();
+
+        if (operation->pending_waits == 0)
+          receive(operation);
+      }
+
+      template <typename Operation>
+      void complete(const std::shared_ptr<Operation>& operation, const asio::error_code& ec, std::size_t received_bytes)
+      {
+        auto handler_executor = operation->work.get_executor();
+        asio::post(handler_executor, [handler = std::move(operation->handler), ec, received_bytes]() mutable { handler(ec, received_bytes); });
+        operation->work.reset();
+      }
+
+      void registerWaitHandles()
+      {
+        // The socket keeps ownership of its handles, asio gets duplicates. A
+        // device whose handle cannot be duplicated is polled.
+        const std::vector<NativeWaitHandle> native_wait_handles = socket_.nativeWaitHandles();
+
+        for (const NativeWaitHandle native_wait_handle : native_wait_handles)
+        {
+#ifdef _WIN32
+          HANDLE duplicate_handle = nullptr;
+          if (DuplicateHandle(GetCurrentProcess(), native_wait_handle, GetCurrentProcess(), &duplicate_handle, 0, FALSE, DUPLICATE_SAME_ACCESS) != 0)
+            wait_handles_.emplace_back(executor_, duplicate_handle);
+#else
+          const int duplicate_fd = ::dup(native_wait_handle);
+          if (duplicate_fd >= 0)
+            wait_handles_.emplace_back(executor_, duplicate_fd);
+#endif // _WIN32
+        }
+
+        poll_                    = (native_wait_handles.empty() || (wait_handles_.size() != native_wait_handles.size()));
+        wait_handles_registered_ = true;
+      }
+
+      void cancelWaits()
+      {
+        for (auto& wait_handle : wait_handles_)
+        {
+          asio::error_code ignored_error;
+          wait_handle.cancel(ignored_error);
+        }
+        poll_timer_.cancel();
+      }
+
+      static asio::error_code toAsioErrorCode(const Udpcap::Error& error)
+      {
+        switch (error.GetErrorCode())
+        {
+        case Udpcap::Error::OK:                     return asio::error_code();
+        case Udpcap::Error::NOT_BOUND:              return asio::error::bad_descriptor;
+        case Udpcap::Error::SOCKET_CLOSED:          return asio::error::operation_aborted;
+        case Udpcap::Error::CANCELLED:              return asio::error::operation_aborted;
+        case Udpcap::Error::END_OF_FILE:            return asio::error::eof;
+        case Udpcap::Error::NPCAP_NOT_INITIALIZED:  return asio::error::no_such_device;
+        default:                                    return asio::error::network_down;
+        }
+      }
+
+    public:
+      executor_type           executor_;
+      UdpcapSocket            socket_;
+
+    private:
+      std::vector<WaitHandle> wait_handles_;                                    /**< Duplicates of the wait handles of the socket, owned by asio */
+      asio::steady_timer      poll_timer_;                                      /**< For devices that have no wait handle */
+      bool                    wait_handles_registered_;                         /**< The handles are registered lazily, as the socket may be bound through udpcapSocket() */
+      bool                    poll_;
+      uint64_t                cancel_generation_;                               /**< Incremented by cancel() */
+    };
+
+    struct InitiateReceiveFrom
+    {
+      template <typename Handler>
+      void operator()(Handler&& handler, const asio::mutable_buffer& buffer, asio::ip::udp::endpoint* sender_endpoint) const
+      {
+        using Operation = ReceiveOperation<typename std::decay<Handler>::type>;
+        impl->receive(std::make_shared<Operation>(std::forward<Handler>(handler), buffer, sender_endpoint, impl->executor_, impl->cancelGeneration()));
+      }
+
+      std::shared_ptr<Implementation> impl;
+    };
+
+    std::shared_ptr<Implementation> impl_;
+  };
+}
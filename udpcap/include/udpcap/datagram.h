@@ -0,0 +1,113 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ * 
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// IWYU pragma: begin_exports
+#include <udpcap/host_address.h>
+// IWYU pragma: end_exports
+
+namespace Udpcap
+{
+  /**
+   * @brief Destination buffer and result of one datagram for UdpcapSocket::receiveDatagrams()
+   *
+   * The caller provides the memory (data, max_len). The socket fills in the
+   * remaining fields for every datagram it receives.
+   */
+  struct DatagramBuffer
+  {
+    char*       data            = nullptr;  /**< [in]  The destination memory */
+    size_t      max_len         = 0;        /**< [in]  The maximum bytes available at the destination */
+
+    size_t      length          = 0;        /**< [out] The number of bytes copied to data. The datagram is truncated, if it was larger than max_len. */
+    size_t      datagram_length = 0;        /**< [out] The payload length of the datagram as sent, like recv() returns it with MSG_TRUNC. Larger than length, if the datagram has been truncated. */
+    HostAddress source_address;             /**< [out] The sender address of the datagram */
+    uint16_t    source_port     = 0;        /**< [out] The sender port of the datagram */
+  };
+
+  /**
+   * @brief Capture metadata of a received datagram, see UdpcapSocket::receiveDatagram()
+   */
+  struct DatagramInfo
+  {
+    HostAddress              source_address;                 /**< The sender address of the datagram */
+    uint16_t                 source_port         = 0;        /**< The sender port of the datagram */
+    HostAddress              destination_address;            /**< The destination address of the datagram, e.g. the multicast group */
+    uint16_t                 destination_port    = 0;        /**< The destination port of the datagram */
+    size_t                   datagram_length     = 0;        /**< The payload length of the datagram as sent, like recv() returns it with MSG_TRUNC */
+    std::chrono::nanoseconds timestamp           {0};        /**< Capture time of the (last fragment of the) datagram since the Unix epoch. Nanosecond precision, if the capture device supports it, microseconds otherwise. */
+    const char*              device_name         = nullptr;  /**< The capture device (or capture file) the datagram has been received from. Valid for the lifetime of the process, so it may be copied and kept like the other fields. */
+    bool                     truncated           = false;    /**< The capture did not contain the entire datagram (e.g. caplen < len), so the payload is incomplete */
+    bool                     buffer_too_small    = false;    /**< The payload was larger than the destination buffer and has been cut off when copying */
+  };
+
+  /**
+   * @brief Converts a capture timestamp to the steady clock
+   *
+   * Capture timestamps (DatagramInfo::timestamp, DatagramView::timestamp) are
+   * taken from the host's wall clock. This converts them to a point in time of
+   * the steady clock, so the time a datagram has spent between being captured
+   * and being processed can be computed as
+   * std::chrono::steady_clock::now() - captureTimeToSteadyClock(info.timestamp).
+   *
+   * The offset between both clocks is measured on every call, so adjustments
+   * of the wall clock (e.g. by NTP) are taken into account. This is not
+   * possible for timestamps of an unsynchronized adapter clock.
+   *
+   * @param capture_time The capture timestamp since the Unix epoch
+   *
+   * @return The capture time as steady clock time point
+   */
+  inline std::chrono::steady_clock::time_point captureTimeToSteadyClock(std::chrono::nanoseconds capture_time)
+  {
+    // Reading the steady clock before and after the wall clock pins down the
+    // offset between both clocks to half the time of one clock read.
+    const auto steady_before = std::chrono::steady_clock::now();
+    const auto system_now    = std::chrono::system_clock::now();
+    const auto steady_after  = std::chrono::steady_clock::now();
+
+    const auto steady_now    = steady_before + (steady_after - steady_before) / 2;
+    const auto capture_age   = std::chrono::duration_cast<std::chrono::steady_clock::duration>(system_now.time_since_epoch() - capture_time);
+
+    return steady_now - capture_age;
+  }
+
+  /**
+   * @brief A received datagram that has not been copied, see UdpcapSocket::receiveDatagramView()
+   *
+   * The payload points directly into the capture buffer (or into the IP
+   * reassembly, for fragmented datagrams). It is only valid until the next
+   * receive call on the same socket or until the socket is closed.
+   */
+  struct DatagramView
+  {
+    const char*              data                = nullptr;  /**< The UDP payload */
+    size_t                   length              = 0;        /**< The number of bytes at data */
+    size_t                   datagram_length     = 0;        /**< The payload length of the datagram as sent. Larger than length, if the capture has truncated the datagram. */
+    HostAddress              source_address;                 /**< The sender address of the datagram */
+    uint16_t                 source_port         = 0;        /**< The sender port of the datagram */
+    HostAddress              destination_address;            /**< The destination address of the datagram, e.g. the multicast group */
+    uint16_t                 destination_port    = 0;        /**< The destination port of the datagram */
+    std::chrono::nanoseconds timestamp           {0};        /**< Capture time of the (last fragment of the) datagram since the Unix epoch */
+    const char*              device_name         = nullptr;  /**< The capture device (or capture file) the datagram has been received from. Valid for the lifetime of the process, so it may be copied and kept like the other fields. */
+    bool                     truncated           = false;    /**< The capture did not contain the entire datagram (e.g. caplen < len), so the payload is incomplete */
+  };
+}
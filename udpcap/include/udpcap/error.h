@@ -39,6 +39,8 @@ namespace Udpcap
       NOT_BOUND,
       TIMEOUT,
       SOCKET_CLOSED,
+      END_OF_FILE,
+      CANCELLED,
     };
 
   //////////////////////////////////////////
@@ -75,6 +77,8 @@ namespace Udpcap
       case NOT_BOUND:                             return "Socket not bound";                              break;
       case TIMEOUT:                               return "Timeout";                                       break;
       case SOCKET_CLOSED:                         return "Socket closed";                                 break;
+      case END_OF_FILE:                           return "End of capture file";                           break;
+      case CANCELLED:                             return "Receive cancelled";                             break;
 
       default:                                    return "Unknown error";
       }
@@ -0,0 +1,135 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+// IWYU pragma: begin_exports
+#include <udpcap/error.h>
+#include <udpcap/udpcap_export.h>
+#include <udpcap/udpcap_socket.h>
+// IWYU pragma: end_exports
+
+#include <memory>
+#include <vector>
+
+namespace Udpcap
+{
+  class UdpcapSelectorPrivate;
+
+  /**
+   * @brief Waits for many UdpcapSockets with a single call, like select() or epoll_wait()
+   *
+   * Instead of blocking one thread per socket in receiveDatagram(), one
+   * thread adds all sockets to the selector and waits for the set of sockets
+   * that may have a datagram. It then receives from each of those sockets
+   * with a timeout of 0, until the socket returns TIMEOUT:
+   *
+   * @code
+   *   std::vector<Udpcap::UdpcapSocket*> ready_sockets;
+   *   while (selector.wait(ready_sockets, -1, error) > 0)
+   *   {
+   *     for (Udpcap::UdpcapSocket* socket : ready_sockets)
+   *       while (socket->receiveDatagram(buffer.data(), buffer.size(), 0, error) > 0) { ... }
+   *   }
+   * @endcode
+   *
+   * The selector is built on UdpcapSocket::nativeReadinessHandle(). Just like
+   * that handle, the selector is level-triggered: a socket is reported again
+   * and again, until a receive call on that socket has found no datagram. A
+   * socket may be reported without a datagram for it being available. Closed
+   * sockets are reported as ready, their receive calls return SOCKET_CLOSED.
+   *
+   * The selector is supported on Linux and Windows. On other platforms,
+   * isValid() returns false.
+   *
+   * Thread safety:
+   *    - There must only be 1 thread calling wait() at the same time
+   *    - addSocket() and removeSocket() must not be called while another thread is calling wait()
+   *    - cancel() may be called from any thread at any time
+   */
+  class UdpcapSelector
+  {
+  public:
+    /**
+     * @brief Creates an empty selector
+     */
+    UDPCAP_EXPORT UdpcapSelector();
+    UDPCAP_EXPORT ~UdpcapSelector();
+
+    // Copy
+    UdpcapSelector(UdpcapSelector const&)             = delete;
+    UdpcapSelector& operator= (UdpcapSelector const&) = delete;
+
+    // Move
+    UDPCAP_EXPORT UdpcapSelector& operator=(UdpcapSelector&&) noexcept;
+    UDPCAP_EXPORT UdpcapSelector(UdpcapSelector&&) noexcept;
+
+    /**
+     * @brief Returns whether the selector could be created on this platform
+     */
+    UDPCAP_EXPORT bool isValid() const;
+
+    /**
+     * @brief Adds a socket to the set of sockets to wait for
+     *
+     * The socket may be bound before or after adding it. It must not be
+     * destroyed or moved before it has been removed from the selector again.
+     *
+     * @param socket The socket to wait for
+     *
+     * @return true if successfull, false if the selector or the socket is invalid or the socket has already been added
+     */
+    UDPCAP_EXPORT bool addSocket(UdpcapSocket& socket);
+
+    /**
+     * @brief Removes a socket from the set of sockets to wait for
+     *
+     * @param socket The socket to remove
+     *
+     * @return true if successfull, false if the socket has not been added
+     */
+    UDPCAP_EXPORT bool removeSocket(UdpcapSocket& socket);
+
+    /**
+     * @brief Blocks until at least one of the sockets may have a datagram
+     *
+     * Possible errors:
+     *   OK                     if at least one socket is ready
+     *   TIMEOUT                if the given timeout has elapsed and no socket has become ready
+     *   CANCELLED              if another thread has called cancel()
+     *   NPCAP_NOT_INITIALIZED  if the selector is invalid
+     *   GNERIC_ERROR           in cases of internal errors
+     *
+     * @param ready_sockets  [out]: The sockets that may have a datagram. The vector is cleared first, but keeps its capacity.
+     * @param timeout_ms     [in]:  Maximum time to wait in ms. If -1, the method will block until a socket is ready
+     * @param error          [out]: The error that occured
+     *
+     * @return The number of ready sockets
+     */
+    UDPCAP_EXPORT size_t wait(std::vector<UdpcapSocket*>& ready_sockets, long long timeout_ms, Udpcap::Error& error);
+
+    /**
+     * @brief Interrupts a wait() call in another thread
+     *
+     * The wait() call returns with the CANCELLED error. If no thread is
+     * currently waiting, the next wait() call returns immediately.
+     */
+    UDPCAP_EXPORT void cancel();
+
+  private:
+    std::unique_ptr<Udpcap::UdpcapSelectorPrivate> udpcap_selector_private_;
+  };
+}
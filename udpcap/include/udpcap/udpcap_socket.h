@@ -17,14 +17,17 @@
 #pragma once
 
 // IWYU pragma: begin_exports
+#include <udpcap/datagram.h>
 #include <udpcap/error.h>
 #include <udpcap/host_address.h>
 #include <udpcap/udpcap_export.h>
 #include <udpcap/udpcap_version.h>
 // IWYU pragma: end_exports
 
-#include <vector>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 /*
 Differences to Winsocks:
@@ -36,6 +39,102 @@ namespace Udpcap
 {
   class UdpcapSocketPrivate;
 
+  /**
+   * @brief Callback for UdpcapSocket::setReceiveCallback()
+   *
+   * The datagram is only valid during the callback.
+   */
+  using ReceiveCallback = std::function<void(const DatagramView& datagram)>;
+
+#ifdef _WIN32
+  using NativeWaitHandle = void*;   /**< Win32 event HANDLE that is signaled when data is available */
+#else
+  using NativeWaitHandle = int;     /**< File descriptor that becomes readable when data is available */
+#endif // _WIN32
+
+  /**
+   * @brief The engine that captures the frames from the network devices
+   */
+  enum class CaptureEngine
+  {
+    Pcap,         /**< Npcap / libpcap. This is the default and available on all platforms. */
+    PacketMmap,   /**< Linux only: AF_PACKET socket with a TPACKET_V3 memory-mapped receive ring. Frames are read directly from memory shared with the kernel, without a system call or copy per frame. */
+  };
+
+  /**
+   * @brief The clock that timestamps the captured frames (see pcap-tstamp(7))
+   */
+  enum class TimestampSource
+  {
+    Default,            /**< The default of the device, usually the host clock */
+    Host,               /**< Host clock, precision unknown (PCAP_TSTAMP_HOST) */
+    HostLowPrecision,   /**< Host clock, low precision but cheap to read (PCAP_TSTAMP_HOST_LOWPREC) */
+    HostHighPrecision,  /**< Host clock, high precision (PCAP_TSTAMP_HOST_HIPREC) */
+    Adapter,            /**< Clock of the network adapter, synchronized with the host clock (PCAP_TSTAMP_ADAPTER) */
+    AdapterUnsynced,    /**< Clock of the network adapter, not synchronized with the host clock (PCAP_TSTAMP_ADAPTER_UNSYNCED) */
+  };
+
+  /**
+   * @brief The precision of the capture timestamps
+   */
+  enum class TimestampPrecision
+  {
+    Microseconds,
+    Nanoseconds,        /**< Falls back to microseconds on devices that don't support nanoseconds */
+  };
+
+  /**
+   * @brief When the frames of a capture file are handed to the socket
+   */
+  enum class ReplayPacing
+  {
+    AsFastAsPossible,   /**< Every frame is available immediately */
+    OriginalTiming,     /**< Frames are released with the inter-packet timing recorded in the file */
+    Scaled,             /**< Like OriginalTiming, but faster or slower by a speed factor */
+  };
+
+  /**
+   * @brief How the datagrams are distributed among sockets bound to the same port (see UdpcapSocket::setLoadBalancing())
+   */
+  enum class LoadBalancing
+  {
+    None,               /**< Every socket receives every datagram. This is the default. */
+    FlowHash,           /**< Each datagram goes to one socket of the group, chosen by a hash of its source address and port. Datagrams of the same flow always go to the same socket and stay in order. */
+    RoundRobin,         /**< Each datagram goes to the next socket of the group. The datagrams of a flow are spread across all sockets. */
+    CaptureQueue,       /**< Each datagram goes to the socket assigned to the capture queue that captured it (see UdpcapSocket::setCaptureQueues()). With as many sockets as queues, each socket consumes exactly one queue. */
+  };
+
+  /**
+   * @brief How the kernel distributes the frames among multiple capture queues (see UdpcapSocket::setCaptureQueues())
+   */
+  enum class FanoutMode
+  {
+    Hash,               /**< By a hash of the addresses and ports of the frame (PACKET_FANOUT_HASH). The frames of a flow always go to the same queue. */
+    Cpu,                /**< By the CPU that received the frame (PACKET_FANOUT_CPU). Combined with receive side scaling of the network adapter, the frames stay on the CPU they arrived on. */
+  };
+
+  /**
+   * @brief What happens to a frame that arrives while the receive queue of the socket is full (see UdpcapSocket::setReceiveQueueLimit())
+   */
+  enum class OverflowPolicy
+  {
+    DropNewest,         /**< The new frame is dropped, just like a full kernel buffer would drop it. This is the default. */
+    DropOldest,         /**< The oldest frame in the queue is dropped to make room, so the socket always receives the freshest data */
+    Block,              /**< The capture thread waits until the socket has received enough frames. Meanwhile, the frames pile up in the kernel buffer. */
+  };
+
+  /**
+   * @brief Counters of the receive queue of a socket, summed up over all its devices (see UdpcapSocket::receiveQueueStatistics())
+   */
+  struct ReceiveQueueStatistics
+  {
+    size_t queued_frames          = 0;  /**< Frames currently waiting in the queue */
+    size_t dropped_newest_frames  = 0;  /**< Frames dropped on arrival, as the queue was full (OverflowPolicy::DropNewest) or the frame was larger than the entire queue */
+    size_t dropped_oldest_frames  = 0;  /**< Frames dropped from the queue to make room for new ones (OverflowPolicy::DropOldest) */
+    size_t blocked_frames         = 0;  /**< Frames the capture thread had to wait with, as the queue was full (OverflowPolicy::Block) */
+    size_t conflated_datagrams    = 0;  /**< Datagrams replaced by a newer datagram of the same flow before they have been received (see UdpcapSocket::enableConflation()) */
+    size_t dropped_flow_datagrams = 0;  /**< Datagrams dropped, as all conflation slots were taken by other flows */
+  };
 
   /**
    * @brief The UdpcapSocket is a (receive-only) UDP Socket implementation using Npcap.
@@ -46,6 +145,8 @@ namespace Udpcap
    *    - Joining and leaving multicast groups
    *    - Enabling and disabling multicast loopback (I managed to fix the cold start issue)
    *    - Receiving unicast and multicast packages (Only one memcpy from kernel to user space memory)
+   *    - Receiving many datagrams with a single call (receiveDatagrams())
+   *    - Receiving datagrams in a callback from an internal thread (setReceiveCallback())
    *    - Fragmented IPv4 traffic
    *
    * Non supported features:
@@ -66,7 +167,7 @@ namespace Udpcap
    * 
    * Thread safety:
    *    - There must only be 1 thread calling receiveDatagram() at the same time
-   *    - It is safe to call close(), join and leave multicast groups while another thread is calling receiveDatagram()
+   *    - It is safe to call close(), cancel(), join and leave multicast groups while another thread is calling receiveDatagram()
    *    - Other modifications to the socket must not be made while another thread is calling receiveDatagram()
    */
   class UdpcapSocket
@@ -134,6 +235,266 @@ namespace Udpcap
      */
     UDPCAP_EXPORT bool setReceiveBufferSize(int receive_buffer_size);
 
+    /**
+     * @brief Sets the engine that is used for capturing the traffic
+     *
+     * The capture engine has to be set before binding the socket. With
+     * CaptureEngine::PacketMmap, the receive buffer size is used as size of
+     * the memory-mapped ring.
+     *
+     * @param capture_engine The capture engine to use
+     * @return true if successfull, false if the socket is already bound or the engine is not supported on this platform
+     */
+    UDPCAP_EXPORT bool setCaptureEngine(CaptureEngine capture_engine);
+
+    /**
+     * @brief Returns the engine that is used for capturing the traffic
+     */
+    UDPCAP_EXPORT CaptureEngine captureEngine() const;
+
+    /**
+     * @brief Enables sharing the capture handles with the other sockets of the process
+     *
+     * Usually, each socket opens its own capture handle for each interface it
+     * binds to. The kernel then copies every frame once per socket. With
+     * shared capture, all sockets of the process that have it enabled share
+     * one capture handle per interface. A capture thread reads each frame
+     * once, reassembles fragmented datagrams once and hands the datagrams to
+     * the sockets bound to their destination port.
+     *
+     * Shared capture has to be enabled before binding the socket. The shared
+     * handle of an interface is opened with the receive buffer size, capture
+     * engine and timestamp settings of the first socket that binds to it.
+     * The receive buffer size of each socket limits its own queue of
+     * datagrams waiting to be received. Capture files and frames from memory
+     * are never shared.
+     *
+     * @param enabled Whether to share the capture handles
+     * @return true if successfull, false if the socket is already bound or the receive queue uses OverflowPolicy::Block
+     */
+    UDPCAP_EXPORT bool setSharedCaptureEnabled(bool enabled);
+
+    /**
+     * @brief Returns whether the socket shares the capture handles with the other sockets of the process
+     */
+    UDPCAP_EXPORT bool isSharedCaptureEnabled() const;
+
+    /**
+     * @brief Makes the socket a member of a load-balancing group, similar to SO_REUSEPORT
+     *
+     * Sockets bound to the same port with the same load-balancing mode form
+     * a group. Each datagram that would be received by the members of the
+     * group is only handed to one of them, e.g. for processing a single
+     * high-rate stream with several worker threads. Only members whose
+     * address and multicast groups accept the datagram are considered.
+     * Sockets without load balancing still receive every datagram.
+     *
+     * Load balancing works on the shared capture handles, so it also enables
+     * shared capture (see setSharedCaptureEnabled()). The group is formed
+     * per interface. Joining or leaving the group redistributes the flows.
+     *
+     * The load-balancing mode has to be set before binding the socket.
+     *
+     * @param load_balancing How to choose the member that receives a datagram
+     * @return true if successfull, false if the socket is already bound or the receive queue uses OverflowPolicy::Block
+     */
+    UDPCAP_EXPORT bool setLoadBalancing(LoadBalancing load_balancing);
+
+    /**
+     * @brief Returns the load-balancing mode of the socket
+     */
+    UDPCAP_EXPORT LoadBalancing loadBalancing() const;
+
+    /**
+     * @brief Captures with multiple queues, each drained by its own thread on its own CPU (Linux only)
+     *
+     * Usually, all frames of an interface are captured, parsed and
+     * reassembled by the thread that calls receiveDatagram(). With multiple
+     * capture queues, each interface is opened queue_count times and all
+     * handles are joined to one PACKET_FANOUT group, so the kernel distributes
+     * the frames among them. Each queue is drained by its own capture thread,
+     * which is pinned to the CPU with the index of the queue. The kernel
+     * defragments the frames before distributing them.
+     *
+     * The capture threads feed either a merged output, i.e. every socket
+     * receives the datagrams of all queues, or per-queue consumers: sockets
+     * with LoadBalancing::CaptureQueue bound to the same port each receive
+     * the datagrams of their share of the queues.
+     *
+     * Capture queues work on the shared capture handles, so they also enable
+     * shared capture (see setSharedCaptureEnabled()). Only sockets with the
+     * same queue settings share the queues.
+     *
+     * The capture queues have to be set before binding the socket.
+     *
+     * @param queue_count  Number of capture queues. 1 disables the fanout.
+     * @param fanout_mode  How the kernel distributes the frames among the queues
+     * @return true if successfull, false if the socket is already bound, multiple queues are not supported on this platform or the receive queue uses OverflowPolicy::Block
+     */
+    UDPCAP_EXPORT bool setCaptureQueues(size_t queue_count, FanoutMode fanout_mode);
+
+    /**
+     * @brief Returns the number of capture queues
+     */
+    UDPCAP_EXPORT size_t captureQueueCount() const;
+
+    /**
+     * @brief Drains the kernel buffer with a capture thread into a buffer in user space
+     *
+     * Usually, the captured frames stay in the kernel buffer until
+     * receiveDatagram() is called. If the application is too slow during a
+     * burst, the kernel buffer overflows and the frames are dropped. With a
+     * user buffer, a capture thread per interface copies the frames from the
+     * kernel buffer to a ring buffer in user space as soon as they arrive.
+     * The receive calls consume the frames from that ring.
+     *
+     * The ring is allocated with initial_size bytes when binding the socket.
+     * Whenever it is full, it doubles its size, until it reaches max_size.
+     * Then, new frames are dropped. The ring never shrinks.
+     *
+     * With shared capture (see setSharedCaptureEnabled()), the capture thread
+     * of the shared handle already drains the kernel buffer. Then, max_size
+     * limits the queue of the socket instead of the receive buffer size.
+     * Capture files and frames from memory are never buffered.
+     *
+     * The user buffer has to be set before binding the socket.
+     *
+     * @param initial_size  Number of bytes allocated upfront
+     * @param max_size      Number of bytes the buffer may grow to. 0 disables the user buffer.
+     * @return true if successfull, false if the socket is already bound or the initial size exceeds the maximum size
+     */
+    UDPCAP_EXPORT bool setUserBufferSize(size_t initial_size, size_t max_size);
+
+    /**
+     * @brief Returns the maximum size of the user buffer, or 0 if it is disabled
+     */
+    UDPCAP_EXPORT size_t userBufferMaxSize() const;
+
+    /**
+     * @brief Limits the receive queue of the socket and sets what happens when it is full
+     *
+     * Usually, the socket receives whatever the kernel buffer holds, no
+     * matter how old it is. With a limited receive queue, a capture thread
+     * drains the kernel buffer into a queue of the socket (see
+     * setUserBufferSize(), which also limits the size of the queue in bytes).
+     * If the queue is full, the overflow policy decides whether the new
+     * frame or the oldest frame is dropped, or whether the capture thread
+     * waits. receiveQueueStatistics() counts the affected frames.
+     *
+     * Without a user buffer or shared capture, the limit enables a user
+     * buffer of up to 2 MiB or the receive buffer size, if it has been set.
+     * With shared capture, OverflowPolicy::Block is rejected, as waiting
+     * would stall all other sockets of the interface.
+     *
+     * The limit counts captured frames, so a datagram that has been split
+     * into fragments may count once per fragment.
+     *
+     * The receive queue has to be set before binding the socket.
+     *
+     * @param max_frames       Maximum number of frames in the queue. 0 only limits the size in bytes.
+     * @param overflow_policy  What happens to a frame that arrives while the queue is full
+     * @return true if successfull, false if the socket is already bound or OverflowPolicy::Block is combined with shared capture
+     */
+    UDPCAP_EXPORT bool setReceiveQueueLimit(size_t max_frames, OverflowPolicy overflow_policy);
+
+    /**
+     * @brief Returns the maximum number of frames in the receive queue, or 0 if only the size in bytes is limited
+     */
+    UDPCAP_EXPORT size_t receiveQueueLimit() const;
+
+    /**
+     * @brief Returns what happens to a frame that arrives while the receive queue is full
+     */
+    UDPCAP_EXPORT OverflowPolicy overflowPolicy() const;
+
+    /**
+     * @brief Returns the counters of the receive queue
+     *
+     * The counters are summed up over all devices of the socket and reset,
+     * when the socket is bound again. Without a receive queue (i.e. without
+     * user buffer and shared capture), all counters are 0.
+     */
+    UDPCAP_EXPORT ReceiveQueueStatistics receiveQueueStatistics() const;
+
+    /**
+     * @brief Sets the clock that timestamps the captured frames (see DatagramInfo::timestamp)
+     *
+     * The timestamp source has to be set before binding the socket. Devices
+     * that don't support the source use their default clock instead and a
+     * warning is printed. The packet mmap capture engine always uses the
+     * host clock.
+     *
+     * Timestamps of adapters that are not synchronized with the host (i.e.
+     * TimestampSource::AdapterUnsynced) cannot be converted to the host's
+     * clocks with captureTimeToSteadyClock().
+     *
+     * @param timestamp_source The clock to use
+     * @return true if successfull, false if the socket is already bound
+     */
+    UDPCAP_EXPORT bool setTimestampSource(TimestampSource timestamp_source);
+
+    /**
+     * @brief Returns the clock that timestamps the captured frames
+     */
+    UDPCAP_EXPORT TimestampSource timestampSource() const;
+
+    /**
+     * @brief Sets the precision of the capture timestamps
+     *
+     * The precision has to be set before binding the socket. The default is
+     * TimestampPrecision::Nanoseconds, which falls back to microseconds on
+     * devices that don't support it. Capture files and the packet mmap
+     * capture engine always deliver nanoseconds.
+     *
+     * @param timestamp_precision The precision to use
+     * @return true if successfull, false if the socket is already bound
+     */
+    UDPCAP_EXPORT bool setTimestampPrecision(TimestampPrecision timestamp_precision);
+
+    /**
+     * @brief Returns the precision of the capture timestamps
+     */
+    UDPCAP_EXPORT TimestampPrecision timestampPrecision() const;
+
+    /**
+     * @brief Replays a pcap or pcapng capture file instead of capturing from the network devices
+     *
+     * The capture file has to be set before binding the socket. bind() then
+     * opens the file instead of the network devices. The address and port
+     * given to bind(), multicast groups and multicast loopback filter the
+     * recorded traffic just like live traffic. Capturing from a file neither
+     * requires Npcap / libpcap capture privileges nor a network device.
+     *
+     * Once all frames of the file have been read, receiveDatagram() returns
+     * the END_OF_FILE error.
+     *
+     * @param file_path     Path of the capture file
+     * @param pacing        When the frames of the file are handed to the socket
+     * @param speed_factor  Replay speed relative to the recorded timing (e.g. 2.0 for twice as fast). Only used with ReplayPacing::Scaled.
+     *
+     * @return true if successfull, false if the socket is already bound, the path is empty or the speed factor is not positive
+     */
+    UDPCAP_EXPORT bool setCaptureFile(const std::string& file_path, ReplayPacing pacing = ReplayPacing::AsFastAsPossible, double speed_factor = 1.0);
+
+    /**
+     * @brief Receives prebuilt Ethernet frames from memory instead of capturing from the network devices
+     *
+     * This is meant for benchmarking the receive path of Udpcap (parsing, IP
+     * reassembly and copying) without any driver or kernel noise. Just like
+     * with setCaptureFile(), the frames have to be set before binding the
+     * socket and are filtered by bind(), joinMulticastGroup() etc. The
+     * frames are handed out as fast as possible and without a copy.
+     *
+     * Once all frames have been handed out the given number of times,
+     * receiveDatagram() returns the END_OF_FILE error.
+     *
+     * @param frames       Ethernet frames with IPv4 / UDP payload (may contain IPv4 fragments)
+     * @param repetitions  How often the frames are handed out. 0 means forever.
+     *
+     * @return true if successfull, false if the socket is already bound or no frames are given
+     */
+    UDPCAP_EXPORT bool setCaptureFrames(const std::vector<std::vector<char>>& frames, size_t repetitions = 1);
+
     /**
      * @brief Blocks for the given time until a packet arives and copies it to the given memory
      *
@@ -148,12 +509,15 @@ namespace Udpcap
      *   NOT_BOUND              if the socket hasn't been bound, yet
      *   SOCKET_CLOSED          if the socket has been closed by the user
      *   TIMEOUT                if the given timeout has elapsed and no datagram was available
+     *   END_OF_FILE            if the socket replays a capture file or frames from memory and all frames have been read
+     *   CANCELLED              if another thread has called cancel()
      *   GNERIC_ERROR           in cases of internal libpcap errors
      * 
      * Thread safety:
      *   - This method must not be called from multiple threads at the same time
      *   - While one thread is calling this method, another thread may call one (and only one) of the following functions:
      *      - close()
+     *      - cancel()
      *      - joinMulticastGroup()
      *      - leaveMulticastGroup()
      *      - setMulticastLoopbackEnabled()
@@ -190,6 +554,257 @@ namespace Udpcap
                                         , uint16_t*       source_port
                                         , Udpcap::Error&  error);
 
+    /**
+     * @brief Receives a datagram and its capture metadata
+     *
+     * Just like receiveDatagram(), but also returns when and on which device
+     * the datagram has been captured, where it was sent to and whether it has
+     * been truncated. This e.g. allows measuring the latency from the wire to
+     * the application or telling apart multicast groups that are received by
+     * the same socket.
+     *
+     * The possible errors and the thread safety are the same as for
+     * receiveDatagram().
+     *
+     * @param data        [out]: The destination memory
+     * @param max_len     [in]:  The maximum bytes available at the destination
+     * @param timeout_ms  [in]:  Maximum time to wait for a datagram in ms. If -1, the method will block until a datagram is available
+     * @param info        [out]: The metadata of the datagram
+     * @param error       [out]: The error that occured
+     *
+     * @return The number of bytes copied to the data pointer
+     */
+    UDPCAP_EXPORT size_t receiveDatagram(char*            data
+                                        , size_t          max_len
+                                        , long long       timeout_ms
+                                        , DatagramInfo&   info
+                                        , Udpcap::Error&  error);
+
+    UDPCAP_EXPORT size_t receiveDatagram(char*            data
+                                        , size_t          max_len
+                                        , DatagramInfo&   info
+                                        , Udpcap::Error&  error);
+
+    /**
+     * @brief Waits for the next datagram and returns its length without receiving it
+     *
+     * This is the equivalent of recv() with MSG_PEEK | MSG_TRUNC. The next
+     * call of any of the receive functions returns the same datagram. This
+     * allows allocating a buffer of the exact size instead of one for the
+     * largest possible datagram. Calling this function multiple times
+     * returns the length of the same datagram.
+     *
+     * The peeked datagram is kept in a buffer of the socket, which costs one
+     * additional copy. Closing the socket discards it.
+     *
+     * The possible errors and the thread safety are the same as for
+     * receiveDatagram().
+     *
+     * @param timeout_ms  [in]:  Maximum time to wait for a datagram in ms. If -1, the method will block until a datagram is available
+     * @param error       [out]: The error that occured
+     *
+     * @return The payload length of the next datagram (see DatagramInfo::datagram_length), or 0 on errors
+     */
+    UDPCAP_EXPORT size_t peekDatagramLength(long long       timeout_ms
+                                           , Udpcap::Error& error);
+
+    UDPCAP_EXPORT size_t peekDatagramLength(Udpcap::Error& error);
+
+    /**
+     * @brief Receives multiple datagrams with a single call
+     *
+     * Blocks for the given time until at least one datagram arrives. Then, all
+     * datagrams that are available on any device without waiting again are
+     * copied to the given buffers, until max_count buffers have been filled.
+     * This is the equivalent of recvmmsg(). The locks and the wait for new
+     * data are only paid once per call instead of once per datagram.
+     *
+     * The possible errors and the thread safety are the same as for
+     * receiveDatagram(). Closing the socket or reaching the end of a capture
+     * file only causes an error, if no datagram has been received by the
+     * call. Internal errors are reported immediately, the datagrams that
+     * have been received until then are valid nevertheless.
+     *
+     * @param buffers     [in/out]: The destination buffers. The first n buffers are filled, if n is returned.
+     * @param max_count   [in]:     The number of buffers
+     * @param timeout_ms  [in]:     Maximum time to wait for the first datagram in ms. If -1, the method will block until a datagram is available
+     * @param error       [out]:    The error that occured
+     *
+     * @return The number of datagrams received, i.e. the number of filled buffers
+     */
+    UDPCAP_EXPORT size_t receiveDatagrams(DatagramBuffer*   buffers
+                                         , size_t           max_count
+                                         , long long        timeout_ms
+                                         , Udpcap::Error&   error);
+
+    UDPCAP_EXPORT size_t receiveDatagrams(DatagramBuffer*   buffers
+                                         , size_t           max_count
+                                         , Udpcap::Error&   error);
+
+    /**
+     * @brief Receives a datagram without copying it
+     *
+     * Just like receiveDatagram(), but instead of copying the payload, the
+     * view points to it in the capture buffer (or, for fragmented datagrams,
+     * in the IP reassembly). This saves a copy for consumers that only read
+     * the payload once.
+     *
+     * The view is only valid until the next receive call on this socket
+     * (with any of the receive functions) or until the socket is closed. It
+     * must therefore not be used while another thread may call close().
+     *
+     * The possible errors and the thread safety are the same as for
+     * receiveDatagram().
+     *
+     * @param view        [out]: The received datagram
+     * @param timeout_ms  [in]:  Maximum time to wait for a datagram in ms. If -1, the method will block until a datagram is available
+     * @param error       [out]: The error that occured
+     *
+     * @return True if a datagram has been received
+     */
+    UDPCAP_EXPORT bool receiveDatagramView(DatagramView&    view
+                                          , long long       timeout_ms
+                                          , Udpcap::Error&  error);
+
+    UDPCAP_EXPORT bool receiveDatagramView(DatagramView&    view
+                                          , Udpcap::Error&  error);
+
+    /**
+     * @brief Receives all datagrams in a callback from an internal capture thread
+     *
+     * Starts a thread that receives datagrams from all devices and calls the
+     * callback for each one. The datagram passed to the callback is not
+     * copied and only valid during the callback (see receiveDatagramView()).
+     * The application therefore doesn't need a dedicated thread that blocks
+     * in receiveDatagram().
+     *
+     * The socket must be bound. The thread runs until the socket is closed or
+     * all frames of a capture file or of setCaptureFrames() have been
+     * received. close() waits for a running callback to return and stops the
+     * thread. close() may also be called from within the callback.
+     *
+     * Thread safety:
+     *   - While the callback is set, the receive functions must not be called
+     *   - joinMulticastGroup(), leaveMulticastGroup() and setMulticastLoopbackEnabled() may be called while the thread is running
+     *   - The socket must not be destroyed from within the callback
+     *
+     * @param callback The callback to call for each datagram
+     *
+     * @return true if the thread has been started, false if the socket is not bound, the callback is empty or a callback has already been set since binding
+     */
+    UDPCAP_EXPORT bool setReceiveCallback(const ReceiveCallback& callback);
+
+    /**
+     * @brief Keeps only the latest datagram of each flow instead of queueing all datagrams
+     *
+     * Many streams (e.g. sensor samples) only need the newest datagram of
+     * each sender. In conflation mode, an internal thread receives all
+     * datagrams (just like setReceiveCallback()) and stores each one in the
+     * slot of its flow, i.e. of its source address and port and its
+     * destination address (e.g. the multicast group) and port. A datagram
+     * that has not been read when the next datagram of its flow arrives is
+     * replaced. receiveLatestDatagrams() returns the latest datagram of each
+     * flow that has been updated since the last call.
+     *
+     * A slow consumer therefore neither lets the memory grow nor has to work
+     * off a backlog of stale datagrams. All slots are allocated by this call.
+     * Once max_flows flows have been seen, the datagrams of new flows are
+     * dropped. Datagrams larger than max_datagram_size are truncated.
+     * receiveQueueStatistics() counts the replaced and dropped datagrams.
+     *
+     * The socket must be bound. As conflation uses the receive callback
+     * thread, a socket cannot have both. The receive functions must not be
+     * called in conflation mode.
+     *
+     * @param max_flows          Number of flows to keep the latest datagram of
+     * @param max_datagram_size  Maximum payload size of a datagram in bytes
+     *
+     * @return true if successfull, false if the socket is not bound, max_flows is 0 or a callback has already been set since binding
+     */
+    UDPCAP_EXPORT bool enableConflation(size_t max_flows, size_t max_datagram_size);
+
+    /**
+     * @brief Receives the latest datagram of each flow that has been updated since the last call (see enableConflation())
+     *
+     * Blocks for the given time until at least one flow has been updated.
+     * Then, the latest datagram of each updated flow is copied to the given
+     * buffers, until max_count buffers have been filled. The flows are
+     * returned in the order in which they have been updated first. Flows
+     * that did not fit into the buffers are returned by the next call.
+     *
+     * @param buffers     [in/out]: The destination buffers. The first n buffers are filled, if n is returned.
+     * @param infos       [out]:    The capture metadata of the datagrams, in sync with the buffers. May be nullptr.
+     * @param max_count   [in]:     The number of buffers
+     * @param timeout_ms  [in]:     Maximum time to wait for an updated flow in ms. If -1, the method will block until a flow is updated
+     * @param error       [out]:    The error that occured. SOCKET_CLOSED once the socket has been closed and all updated flows have been received.
+     *
+     * @return The number of datagrams received, i.e. the number of filled buffers
+     */
+    UDPCAP_EXPORT size_t receiveLatestDatagrams(DatagramBuffer*   buffers
+                                               , DatagramInfo*    infos
+                                               , size_t           max_count
+                                               , long long        timeout_ms
+                                               , Udpcap::Error&   error);
+
+    /**
+     * @brief Returns the handles that signal new data on the capture devices
+     *
+     * This is meant for integrating the socket into an event loop (e.g. an
+     * asio io_context, see asio_udpcap_socket.h): wait for any of the
+     * handles, then call one of the receive functions with a timeout of 0.
+     * A handle may be signaled without a datagram for this socket being
+     * available, as the devices capture more than the filtered traffic.
+     *
+     * The handles are owned by the socket. They must not be closed and are
+     * invalid after close(). Capture files and frames from memory have no
+     * handle, as their frames don't arrive from a device. For those, the list
+     * is empty.
+     *
+     * @return The handles of all live capture devices. Empty, if the socket is not bound.
+     */
+    UDPCAP_EXPORT std::vector<NativeWaitHandle> nativeWaitHandles() const;
+
+    /**
+     * @brief Returns a single handle that signals that a datagram may be ready
+     *
+     * Unlike nativeWaitHandles(), this is one handle for all devices of the
+     * socket, e.g. for adding the socket to an epoll set next to ordinary
+     * file descriptors. On Linux, it is an epoll file descriptor that becomes
+     * readable, on Windows an event that is signaled, when:
+     *   - any live capture device has data
+     *   - a receive call has returned while more datagrams may be available
+     *   - a capture file or frames from memory may have frames left
+     *   - the socket has been closed or cancel() has been called
+     *
+     * The handle is level-triggered. It stays signaled until a receive call
+     * has found no datagram, so after it has been signaled, receive with a
+     * timeout of 0 until the call returns TIMEOUT. The handle may be signaled
+     * without a datagram for this socket being available.
+     *
+     * The handle is owned by the socket and stays valid (across close() and
+     * bind()) until the socket is destroyed. It must not be closed. Capture
+     * files replayed with their original timing don't signal the handle when
+     * their next frame is due.
+     *
+     * Other POSIX systems have no way of combining the file descriptors
+     * without a thread, so this function returns -1 there.
+     *
+     * @return The handle, or -1 / nullptr if it is not supported or the socket is invalid
+     */
+    UDPCAP_EXPORT NativeWaitHandle nativeReadinessHandle();
+
+    /**
+     * @brief Interrupts a receive call that is blocked in another thread
+     *
+     * The receive call returns immediately with the CANCELLED error (or with
+     * the datagrams it has already received). A receive call started after
+     * this function has returned is not affected. The socket stays bound.
+     *
+     * Thread safety:
+     * - This function may be called while another thread is calling receiveDatagram()
+     */
+    UDPCAP_EXPORT void cancel();
+
     /**
      * @brief Joins the given multicast group
      *
@@ -202,6 +817,8 @@ namespace Udpcap
      * 
      * Thread safety:
      * - This function may be called while another thread is calling receiveDatagram()
+     * - The receiving thread never waits for this function (e.g. for compiling the new capture filter), so groups may be joined and left at a high rate while receiving
+     * - This function waits for the receiving thread to finish processing the frames that have already been captured. It never waits for new data to arrive.
      *
      * @param group_address: The multicast group to join
      *
@@ -215,9 +832,13 @@ namespace Udpcap
      * Leaving a multicast group fails, when the Socket is invalid, not bound,
      * the given address is not a multicast address or this Socket has not
      * joined the group, yet.
+     *
+     * Once this function has returned, no datagram of the group is received
+     * anymore, even if it has been captured before.
      * 
      * Thread safety:
      * - This function may be called while another thread is calling receiveDatagram()
+     * - The receiving thread never waits for this function, but this function waits for the receiving thread to finish processing the frames that have already been captured, see joinMulticastGroup()
      *
      * @param group_address: The multicast group to leave
      *
@@ -244,6 +865,9 @@ namespace Udpcap
 
     /**
      * @brief Closes the socket
+     *
+     * A receive call that is blocked in another thread returns immediately
+     * with the SOCKET_CLOSED error.
      * 
      * Thread safety:
      * - This function may be called while another thread is calling receiveDatagram()
@@ -0,0 +1,484 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "buffered_capture_source.h"
+
+#include "log_debug.h"
+#include "pcap_capture_source.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  BufferedCaptureSource::BufferedCaptureSource(std::unique_ptr<CaptureSource>&& capture_source, size_t initial_buffer_size, size_t max_buffer_size, size_t max_frames, OverflowPolicy overflow_policy)
+    : capture_source_      (std::move(capture_source))
+    , datalink_            (capture_source_->datalink())
+    , timestamp_precision_ (capture_source_->timestampPrecision())
+    , dead_pcap_handle_    (pcap_open_dead(datalink_, 65535))
+    , max_frames_          (max_frames)
+    , overflow_policy_     (overflow_policy)
+    , frame_ring_          (initial_buffer_size, max_buffer_size)
+    , has_current_frame_   (false)
+    , current_header_      {}
+    , filter_generation_   (0)
+    , filter_program_      {}
+    , has_filter_program_  (false)
+    , error_code_          (0)
+    , is_closed_           (false)
+#ifdef _WIN32
+    , wait_handle_         (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wait_pipe_           {-1, -1}
+#endif // _WIN32
+    , wait_handle_signaled_(false)
+    , stop_                (false)
+#ifdef _WIN32
+    , wake_up_event_       (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wake_up_pipe_        {-1, -1}
+#endif // _WIN32
+    , pending_header_      {}
+    , pending_filter_generation_(0)
+    , has_pending_frame_   (false)
+  {
+#ifdef _WIN32
+    if ((wait_handle_ == nullptr) || (wake_up_event_ == nullptr))
+    {
+      LOG_DEBUG("Error creating capture buffer events: " + std::system_category().message(GetLastError()));
+    }
+#else
+    for (std::array<int, 2>* fds : { &wait_pipe_, &wake_up_pipe_ })
+    {
+      if (pipe(fds->data()) == 0)
+      {
+        fcntl((*fds)[0], F_SETFL, fcntl((*fds)[0], F_GETFL) | O_NONBLOCK);
+        fcntl((*fds)[1], F_SETFL, fcntl((*fds)[1], F_GETFL) | O_NONBLOCK);
+      }
+      else
+      {
+        LOG_DEBUG("Error creating capture buffer pipe: " + std::system_category().message(errno));
+      }
+    }
+#endif // _WIN32
+
+    capture_thread_ = std::thread(&BufferedCaptureSource::captureThread, this);
+  }
+
+  BufferedCaptureSource::~BufferedCaptureSource()
+  {
+    close();
+  }
+
+  //////////////////////////////////////////
+  //// CaptureSource API
+  //////////////////////////////////////////
+
+  int BufferedCaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+
+    if (is_closed_)
+    {
+      last_error_ = "Capture source closed";
+      return PCAP_ERROR_NOT_ACTIVATED;
+    }
+
+    // The caller is done with the frame that we have returned the last time
+    if (has_current_frame_)
+    {
+      frame_ring_.pop();
+      has_current_frame_ = false;
+    }
+
+    if (overflow_policy_ == OverflowPolicy::Block)
+      space_available_.notify_one();
+
+    const pcap_pkthdr* frame_header = nullptr;
+    const u_char*      frame_data   = nullptr;
+    uint32_t           generation   = 0;
+
+    while (frame_ring_.front(&frame_header, &frame_data, &generation))
+    {
+      // Frames buffered before the filter has changed may not match the new
+      // filter. Usually, pcap discards those frames from the kernel buffer.
+      if ((generation != filter_generation_) && has_filter_program_
+        && (pcap_offline_filter(&filter_program_, frame_header, frame_data) == 0))
+      {
+        frame_ring_.pop();
+        continue;
+      }
+
+      if (overflow_policy_ == OverflowPolicy::DropOldest)
+      {
+        // The capture thread may drop the front of the ring at any time, so
+        // we hand out a copy
+        current_header_ = *frame_header;
+        current_data_.assign(frame_data, frame_data + frame_header->caplen);
+        frame_ring_.pop();
+
+        *header = &current_header_;
+        *data   = current_data_.data();
+        return 1;
+      }
+
+      has_current_frame_ = true;
+
+      *header = const_cast<pcap_pkthdr*>(frame_header);
+      *data   = frame_data;
+      return 1;
+    }
+
+    if (error_code_ != 0)
+      return error_code_;
+
+    // The capture thread signals again when it buffers the next frame
+    resetWaitHandle_nolock();
+    return 0;
+  }
+
+  int BufferedCaptureSource::datalink() const
+  {
+    return datalink_;
+  }
+
+  int BufferedCaptureSource::timestampPrecision() const
+  {
+    return timestamp_precision_;
+  }
+
+  bool BufferedCaptureSource::setFilter(const std::string& filter_string)
+  {
+    const std::lock_guard<std::mutex> source_lock(source_mutex_);
+
+    if (!capture_source_->setFilter(filter_string))
+      return false;
+
+    bpf_program filter_program{};
+    const bool  has_filter_program = (dead_pcap_handle_ != nullptr)
+                                  && (PcapCaptureSource::compileFilter(dead_pcap_handle_, &filter_program, filter_string) != PCAP_ERROR);
+
+    if (!has_filter_program)
+    {
+      LOG_DEBUG("Capture buffer: Unable to compile filter \"" + filter_string + "\". Buffered frames will not be filtered again.");
+    }
+
+    // The capture thread cannot read any frames right now, as we are holding
+    // the source lock. So all frames buffered afterwards have passed the new
+    // filter.
+    const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+
+    if (has_filter_program_)
+      pcap_freecode(&filter_program_);
+
+    filter_program_     = filter_program;
+    has_filter_program_ = has_filter_program;
+    filter_generation_++;
+
+    return true;
+  }
+
+  NativeWaitHandle BufferedCaptureSource::getWaitHandle() const
+  {
+#ifdef _WIN32
+    return wait_handle_;
+#else
+    return wait_pipe_[0];
+#endif // _WIN32
+  }
+
+  ReceiveQueueStatistics BufferedCaptureSource::queueStatistics() const
+  {
+    const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+
+    ReceiveQueueStatistics statistics = statistics_;
+    statistics.queued_frames = frame_ring_.size() - (has_current_frame_ ? 1 : 0);
+    return statistics;
+  }
+
+  pcap_t* BufferedCaptureSource::getPcapHandle() const
+  {
+    // Needed for pcap specific queries like the MAC address on Windows. The
+    // handle must not be used for capturing.
+    return capture_source_->getPcapHandle();
+  }
+
+  std::string BufferedCaptureSource::getLastError() const
+  {
+    const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+    return last_error_;
+  }
+
+  void BufferedCaptureSource::close()
+  {
+    {
+      const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+      if (is_closed_)
+        return;
+    }
+
+    {
+      // Under the lock, so a capture thread waiting for space cannot miss it
+      const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+      stop_ = true;
+    }
+    space_available_.notify_all();
+    signalWakeUp();
+
+    if (capture_thread_.joinable())
+      capture_thread_.join();
+
+    {
+      const std::lock_guard<std::mutex> source_lock(source_mutex_);
+      capture_source_->close();
+    }
+
+    {
+      const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+
+      is_closed_         = true;
+      has_current_frame_ = false;
+      frame_ring_.clear();
+
+      if (has_filter_program_)
+      {
+        pcap_freecode(&filter_program_);
+        has_filter_program_ = false;
+      }
+    }
+
+    LOG_DEBUG("Capture buffer: Peak usage " + std::to_string(frame_ring_.peakBytes()) + " bytes, "
+              + std::to_string(statistics_.dropped_newest_frames + statistics_.dropped_oldest_frames) + " frames dropped, "
+              + std::to_string(statistics_.blocked_frames) + " frames blocked");
+
+    if (dead_pcap_handle_ != nullptr)
+      pcap_close(dead_pcap_handle_);
+
+#ifdef _WIN32
+    for (HANDLE* handle : { &wait_handle_, &wake_up_event_ })
+    {
+      if (*handle != nullptr)
+      {
+        CloseHandle(*handle);
+        *handle = nullptr;
+      }
+    }
+#else
+    for (std::array<int, 2>* fds : { &wait_pipe_, &wake_up_pipe_ })
+    {
+      for (int& fd : *fds)
+      {
+        if (fd >= 0)
+        {
+          ::close(fd);
+          fd = -1;
+        }
+      }
+    }
+#endif // _WIN32
+  }
+
+  //////////////////////////////////////////
+  //// Capture thread
+  //////////////////////////////////////////
+
+  void BufferedCaptureSource::captureThread()
+  {
+    while (!stop_)
+    {
+      bool received_any_data = false;
+
+      {
+        const std::lock_guard<std::mutex> source_lock(source_mutex_);
+
+        // Drain the source before waiting, as the wait handle may not be
+        // signaled while there still is data in the buffer
+        for (int i = 0; (i < 1024) && !stop_; i++)
+        {
+          pcap_pkthdr*  header = nullptr;
+          const u_char* data   = nullptr;
+
+          const int next_packet_result = capture_source_->nextPacket(&header, &data);
+
+          if (next_packet_result == 0)
+            break;
+
+          const std::lock_guard<std::mutex> buffer_lock(buffer_mutex_);
+
+          if (next_packet_result == 1)
+          {
+            received_any_data = true;
+
+            if (!pushFrame_nolock(header, data, filter_generation_))
+            {
+              // The ring is full and we have to wait. The frame may become
+              // invalid when the filter is set, so we keep a copy and wait
+              // without the source lock.
+              pending_header_            = *header;
+              pending_filter_generation_ = filter_generation_;
+              pending_data_.assign(data, data + header->caplen);
+              has_pending_frame_         = true;
+              statistics_.blocked_frames++;
+              break;
+            }
+          }
+          else
+          {
+            // Hand the error to the receiving thread, once it has received the buffered frames
+            error_code_ = next_packet_result;
+            last_error_ = capture_source_->getLastError();
+            signalWaitHandle_nolock();
+            return;
+          }
+        }
+      }
+
+      if (has_pending_frame_)
+        waitForSpace();
+      else if (!received_any_data)
+        waitForData();
+    }
+  }
+
+  bool BufferedCaptureSource::pushFrame_nolock(const pcap_pkthdr* header, const u_char* data, uint32_t filter_generation)
+  {
+    for (;;)
+    {
+      if (((max_frames_ == 0) || (frame_ring_.size() < max_frames_))
+        && frame_ring_.push(header, data, filter_generation))
+      {
+        signalWaitHandle_nolock();
+        return true;
+      }
+
+      // If the ring is empty, the frame is larger than the entire ring. The
+      // frame still used by the receiving thread counts as well, as its space
+      // is freed with the next call to nextPacket().
+      const bool is_frame_too_large = frame_ring_.empty();
+
+      if ((overflow_policy_ == OverflowPolicy::DropOldest) && !is_frame_too_large)
+      {
+        frame_ring_.pop();
+        statistics_.dropped_oldest_frames++;
+        continue;
+      }
+
+      if ((overflow_policy_ == OverflowPolicy::Block) && !is_frame_too_large)
+        return false;
+
+      // Just like a full kernel buffer, a full ring drops the new frames
+      statistics_.dropped_newest_frames++;
+      return true;
+    }
+  }
+
+  void BufferedCaptureSource::waitForSpace()
+  {
+    std::unique_lock<std::mutex> buffer_lock(buffer_mutex_);
+
+    // Frames from an older filter generation are filtered by nextPacket(), so
+    // it is fine if the filter has changed in the meantime
+    space_available_.wait(buffer_lock, [this]() { return stop_ || pushFrame_nolock(&pending_header_, pending_data_.data(), pending_filter_generation_); });
+
+    has_pending_frame_ = false;
+  }
+
+  void BufferedCaptureSource::waitForData()
+  {
+#ifdef _WIN32
+    const std::array<HANDLE, 2> wait_handles{ wake_up_event_, capture_source_->getWaitHandle() };
+    const DWORD wait_result = WaitForMultipleObjects(static_cast<DWORD>(wait_handles.size()), wait_handles.data(), FALSE, INFINITE);
+    if (wait_result == WAIT_FAILED)
+    {
+      LOG_DEBUG("Capture buffer error: WAIT_FAILED: " + std::system_category().message(GetLastError()));
+    }
+#else
+    std::array<pollfd, 2> pollfds{};
+    pollfds[0].fd     = wake_up_pipe_[0];
+    pollfds[0].events = POLLIN;
+    pollfds[1].fd     = capture_source_->getWaitHandle();
+    pollfds[1].events = POLLIN;
+
+    if ((poll(pollfds.data(), static_cast<nfds_t>(pollfds.size()), -1) < 0) && (errno != EINTR))
+    {
+      LOG_DEBUG("Capture buffer error: poll failed: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+  }
+
+  void BufferedCaptureSource::signalWakeUp()
+  {
+    // Only used for stopping, so the signal is never reset
+#ifdef _WIN32
+    SetEvent(wake_up_event_);
+#else
+    const char wake_up_signal = 1;
+    if ((write(wake_up_pipe_[1], &wake_up_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      LOG_DEBUG("Error signaling capture buffer wake-up pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+  }
+
+  void BufferedCaptureSource::signalWaitHandle_nolock()
+  {
+    if (wait_handle_signaled_)
+      return;
+
+#ifdef _WIN32
+    SetEvent(wait_handle_);
+#else
+    const char wait_signal = 1;
+    if ((write(wait_pipe_[1], &wait_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      LOG_DEBUG("Error signaling capture buffer pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+    wait_handle_signaled_ = true;
+  }
+
+  void BufferedCaptureSource::resetWaitHandle_nolock()
+  {
+    if (!wait_handle_signaled_)
+      return;
+
+#ifdef _WIN32
+    ResetEvent(wait_handle_);
+#else
+    std::array<char, 64> drain_buffer{};
+    while (read(wait_pipe_[0], drain_buffer.data(), drain_buffer.size()) > 0) {}
+#endif // _WIN32
+    wait_handle_signaled_ = false;
+  }
+}
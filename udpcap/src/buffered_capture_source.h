@@ -0,0 +1,136 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+#include "frame_ring.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h> // IWYU pragma: keep
+#endif // _WIN32
+
+namespace Udpcap
+{
+  /**
+   * @brief CaptureSource that drains another source with its own thread
+   *
+   * The capture thread copies the frames from the kernel buffer of the
+   * wrapped source to a FrameRing in user space, as fast as they arrive. This
+   * way, bursts that exceed the kernel buffer are not dropped, just because
+   * the application doesn't call receiveDatagram() fast enough. Once the
+   * ring has reached its maximum size or frame count, the overflow policy
+   * decides which frames to drop, or lets the capture thread wait.
+   *
+   * The wait handle is signaled while the ring is not empty.
+   */
+  class BufferedCaptureSource : public CaptureSource
+  {
+  public:
+    /**
+     * @param capture_source       The live source to drain
+     * @param initial_buffer_size  Size of the ring that is allocated upfront
+     * @param max_buffer_size      Size the ring may grow to
+     * @param max_frames           Maximum number of frames in the ring, or 0 for no limit
+     * @param overflow_policy      What happens to a frame that arrives while the ring is full
+     */
+    BufferedCaptureSource(std::unique_ptr<CaptureSource>&& capture_source, size_t initial_buffer_size, size_t max_buffer_size, size_t max_frames, OverflowPolicy overflow_policy);
+    ~BufferedCaptureSource() override;
+
+    // Copy
+    BufferedCaptureSource(const BufferedCaptureSource&)            = delete;
+    BufferedCaptureSource& operator=(const BufferedCaptureSource&) = delete;
+
+    // Move
+    BufferedCaptureSource(BufferedCaptureSource&&)                 = delete;
+    BufferedCaptureSource& operator=(BufferedCaptureSource&&)      = delete;
+
+    int              nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    int              datalink() const override;
+    int              timestampPrecision() const override;
+    bool             setFilter(const std::string& filter_string) override;
+    NativeWaitHandle getWaitHandle() const override;
+    ReceiveQueueStatistics queueStatistics() const override;
+    pcap_t*          getPcapHandle() const override;
+    std::string      getLastError() const override;
+    void             close() override;
+
+  private:
+    void captureThread();
+    bool pushFrame_nolock(const pcap_pkthdr* header, const u_char* data, uint32_t filter_generation);
+    void waitForSpace();
+    void waitForData();
+    void signalWakeUp();
+    void signalWaitHandle_nolock();
+    void resetWaitHandle_nolock();
+
+  private:
+    std::unique_ptr<CaptureSource>  capture_source_;                            /**< The wrapped source */
+    std::mutex                      source_mutex_;                              /**< Protects the wrapped source, as the filter is set while the capture thread drains it */
+    const int                       datalink_;
+    const int                       timestamp_precision_;
+    pcap_t* const                   dead_pcap_handle_;                          /**< For compiling the filter, which is applied to frames that have been buffered before it was set */
+
+    const size_t                    max_frames_;
+    const OverflowPolicy            overflow_policy_;
+
+    mutable std::mutex              buffer_mutex_;                              /**< Protects everything below, except for the capture thread and its wake-up signal */
+    std::condition_variable         space_available_;                           /**< Notified when frames are removed from the ring, for OverflowPolicy::Block */
+    FrameRing                       frame_ring_;                                /**< Each frame is tagged with the filter_generation_ it has been captured with */
+    bool                            has_current_frame_;                         /**< Whether the front of the ring has been returned by nextPacket() and is still in use */
+    pcap_pkthdr                     current_header_;                            /**< Copy of the frame returned by nextPacket() for OverflowPolicy::DropOldest, which may drop the front of the ring at any time */
+    std::vector<u_char>             current_data_;
+    ReceiveQueueStatistics          statistics_;
+    uint32_t                        filter_generation_;
+    bpf_program                     filter_program_;
+    bool                            has_filter_program_;
+    std::string                     last_error_;
+    int                             error_code_;                                /**< The error of the wrapped source. Once the ring is empty, nextPacket() returns it. 0 if there was none. */
+    bool                            is_closed_;
+
+#ifdef _WIN32
+    HANDLE                          wait_handle_;                               /**< Manual-reset event, signaled while the ring is not empty */
+#else
+    std::array<int, 2>              wait_pipe_;                                 /**< Readable while the ring is not empty */
+#endif // _WIN32
+    bool                            wait_handle_signaled_;
+
+    std::atomic<bool>               stop_;
+#ifdef _WIN32
+    HANDLE                          wake_up_event_;                             /**< Wakes up the capture thread for stopping it */
+#else
+    std::array<int, 2>              wake_up_pipe_;                              /**< Wakes up the capture thread for stopping it. Never drained. */
+#endif // _WIN32
+    std::thread                     capture_thread_;
+    pcap_pkthdr                     pending_header_;                            /**< Copy of the frame the capture thread is waiting with for OverflowPolicy::Block. Only used by the capture thread. */
+    std::vector<u_char>             pending_data_;
+    uint32_t                        pending_filter_generation_;
+    bool                            has_pending_frame_;
+  };
+}
@@ -0,0 +1,658 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "capture_hub.h"
+
+#include "hub_capture_source.h"
+#include "ip_reassembly.h"
+#include "log_debug.h"
+#include "packet_parser.h"
+#include "pcap_capture_source.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef __linux__
+#include <linux/if_packet.h> // PACKET_FANOUT
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif // __linux__
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  std::mutex                                                     capture_hubs_mutex;
+  std::map<std::string, std::weak_ptr<Udpcap::CaptureHub>>       capture_hubs;  /**< All hubs of the process, by key */
+}
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Registry
+  //////////////////////////////////////////
+
+  std::shared_ptr<CaptureHub> CaptureHub::acquire(const std::string& key, const SourceFactory& open_source, size_t queue_count, FanoutMode fanout_mode)
+  {
+    const std::lock_guard<std::mutex> capture_hubs_lock(capture_hubs_mutex);
+
+    // Forget the hubs that have lost their last subscriber
+    for (auto hub_it = capture_hubs.begin(); hub_it != capture_hubs.end();)
+    {
+      if (hub_it->second.expired())
+        hub_it = capture_hubs.erase(hub_it);
+      else
+        ++hub_it;
+    }
+
+    const auto existing_hub_it = capture_hubs.find(key);
+    if (existing_hub_it != capture_hubs.end())
+      return existing_hub_it->second.lock();
+
+    std::vector<std::unique_ptr<CaptureSource>> capture_sources;
+    for (size_t i = 0; i < std::max<size_t>(queue_count, 1); i++)
+    {
+      std::unique_ptr<CaptureSource> capture_source = open_source();
+      if (!capture_source)
+        return nullptr;
+
+      capture_sources.push_back(std::move(capture_source));
+    }
+
+    if ((capture_sources.size() > 1) && !joinFanoutGroup(capture_sources, fanout_mode))
+      return nullptr;
+
+    auto capture_hub = std::make_shared<CaptureHub>(std::move(capture_sources));
+    capture_hubs[key] = capture_hub;
+    return capture_hub;
+  }
+
+  bool CaptureHub::joinFanoutGroup(const std::vector<std::unique_ptr<CaptureSource>>& capture_sources, FanoutMode fanout_mode)
+  {
+#ifdef __linux__
+    // The kernel reassembles fragmented packets before distributing them, so
+    // all fragments of a datagram end up in the same queue.
+    const int fanout_type_flags = ((fanout_mode == FanoutMode::Cpu) ? PACKET_FANOUT_CPU : PACKET_FANOUT_HASH) | PACKET_FANOUT_FLAG_DEFRAG;
+
+    // The group id must not be used by anyone else in the network namespace.
+    // Let the kernel pick one, if it can.
+    uint16_t fanout_group_id = 0;
+#ifdef PACKET_FANOUT_FLAG_UNIQUEID
+    {
+      const int fanout_arg = ((fanout_type_flags | PACKET_FANOUT_FLAG_UNIQUEID) << 16);
+      const int packet_socket = capture_sources[0]->getWaitHandle();
+      int       assigned_fanout_arg = 0;
+      socklen_t assigned_fanout_arg_length = sizeof(assigned_fanout_arg);
+
+      if ((setsockopt(packet_socket, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) != 0)
+        || (getsockopt(packet_socket, SOL_PACKET, PACKET_FANOUT, &assigned_fanout_arg, &assigned_fanout_arg_length) != 0))
+      {
+        fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Unable to create PACKET_FANOUT group: " + std::system_category().message(errno)).c_str());
+        return false;
+      }
+
+      fanout_group_id = static_cast<uint16_t>(assigned_fanout_arg & 0xFFFF);
+    }
+    const size_t first_joining_source = 1;
+#else
+    {
+      static std::atomic<uint16_t> next_fanout_group_id(static_cast<uint16_t>(getpid()));
+      fanout_group_id = next_fanout_group_id++;
+    }
+    const size_t first_joining_source = 0;
+#endif // PACKET_FANOUT_FLAG_UNIQUEID
+
+    for (size_t i = first_joining_source; i < capture_sources.size(); i++)
+    {
+      // The wait handle of the live capture sources is the packet socket itself
+      const int fanout_arg    = (fanout_group_id | (fanout_type_flags << 16));
+      const int packet_socket = capture_sources[i]->getWaitHandle();
+
+      if (setsockopt(packet_socket, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) != 0)
+      {
+        fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Unable to join PACKET_FANOUT group: " + std::system_category().message(errno)).c_str());
+        return false;
+      }
+    }
+
+    return true;
+#else
+    static_cast<void>(capture_sources);
+    static_cast<void>(fanout_mode);
+    LOG_DEBUG("Capture hub error: Multiple capture queues are only supported on Linux");
+    return false;
+#endif // __linux__
+  }
+
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  CaptureHub::CaptureHub(std::vector<std::unique_ptr<CaptureSource>>&& capture_sources)
+    : datalink_         (capture_sources.front()->datalink())
+    , decode_link_layer_(PacketParser::getLinkLayerDecoder(datalink_))
+    , dead_pcap_handle_ (pcap_open_dead(datalink_, 65535))
+    , has_failed_       (false)
+    , stop_             (false)
+#ifdef _WIN32
+    , wake_up_event_    (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wake_up_pipe_     {-1, -1}
+#endif // _WIN32
+  {
+#ifdef _WIN32
+    if (wake_up_event_ == nullptr)
+    {
+      LOG_DEBUG("Error creating capture hub wake-up event: " + std::system_category().message(GetLastError()));
+    }
+#else
+    if (pipe(wake_up_pipe_.data()) == 0)
+    {
+      fcntl(wake_up_pipe_[0], F_SETFL, fcntl(wake_up_pipe_[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wake_up_pipe_[1], F_SETFL, fcntl(wake_up_pipe_[1], F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+      LOG_DEBUG("Error creating capture hub wake-up pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+
+    capture_queues_.reserve(capture_sources.size());
+    for (size_t i = 0; i < capture_sources.size(); i++)
+      capture_queues_.push_back(std::make_unique<CaptureQueue>(std::move(capture_sources[i]), i));
+
+    for (auto& capture_queue : capture_queues_)
+    {
+      capture_queue->capture_thread = std::thread(&CaptureHub::captureThread, this, capture_queue.get());
+
+      // A single queue is not pinned, as we wouldn't know which CPU to pick
+      if (capture_queues_.size() > 1)
+        pinToCpu(capture_queue->capture_thread, capture_queue->index);
+    }
+  }
+
+  CaptureHub::~CaptureHub()
+  {
+    stop_ = true;
+    signalWakeUp();
+
+    for (auto& capture_queue : capture_queues_)
+    {
+      if (capture_queue->capture_thread.joinable())
+        capture_queue->capture_thread.join();
+
+      capture_queue->capture_source->close();
+    }
+
+    for (auto& subscription : subscriptions_)
+    {
+      if (subscription->has_filter)
+        pcap_freecode(&subscription->filter_program);
+    }
+
+    if (dead_pcap_handle_ != nullptr)
+      pcap_close(dead_pcap_handle_);
+
+#ifdef _WIN32
+    if (wake_up_event_ != nullptr)
+      CloseHandle(wake_up_event_);
+#else
+    for (const int fd : wake_up_pipe_)
+    {
+      if (fd >= 0)
+        ::close(fd);
+    }
+#endif // _WIN32
+  }
+
+  void CaptureHub::pinToCpu(std::thread& thread, size_t cpu_index)
+  {
+#ifdef __linux__
+    const unsigned int cpu_count = std::max(std::thread::hardware_concurrency(), 1U);
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(static_cast<int>(cpu_index % cpu_count), &cpu_set);
+
+    const int error = pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+    if (error != 0)
+    {
+      LOG_DEBUG("Capture hub warning: Unable to pin capture thread to CPU " + std::to_string(cpu_index % cpu_count) + ": " + std::system_category().message(error));
+    }
+#else
+    static_cast<void>(thread);
+    static_cast<void>(cpu_index);
+#endif // __linux__
+  }
+
+  //////////////////////////////////////////
+  //// Subscriptions
+  //////////////////////////////////////////
+
+  void CaptureHub::subscribe(HubCaptureSource* subscriber, uint16_t port, LoadBalancing load_balancing)
+  {
+    const std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+    auto subscription = std::make_unique<Subscription>();
+    subscription->subscriber     = subscriber;
+    subscription->port           = port;
+    subscription->load_balancing = load_balancing;
+    subscription->filter_program = bpf_program{};
+    subscription->has_filter     = false;
+
+    subscriptions_by_port_[port].subscriptions.push_back(subscription.get());
+    subscriptions_.push_back(std::move(subscription));
+
+    if (has_failed_)
+      subscriber->fail(last_error_);
+  }
+
+  void CaptureHub::unsubscribe(HubCaptureSource* subscriber)
+  {
+    const std::lock_guard<std::mutex> filter_lock(filter_mutex_);
+
+    std::string union_filter_string;
+
+    {
+      // The capture threads only call the subscribers while holding this lock
+      const std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+      Subscription* subscription = findSubscription_nolock(subscriber);
+      if (subscription == nullptr)
+        return;
+
+      auto& port_subscriptions = subscriptions_by_port_[subscription->port].subscriptions;
+      port_subscriptions.erase(std::remove(port_subscriptions.begin(), port_subscriptions.end(), subscription), port_subscriptions.end());
+      if (port_subscriptions.empty())
+        subscriptions_by_port_.erase(subscription->port);
+
+      const bool had_filter = subscription->has_filter;
+      if (had_filter)
+        pcap_freecode(&subscription->filter_program);
+
+      subscriptions_.erase(std::remove_if(subscriptions_.begin(), subscriptions_.end()
+                                          , [subscription](const std::unique_ptr<Subscription>& s) { return s.get() == subscription; })
+                          , subscriptions_.end());
+
+      if (!had_filter || subscriptions_.empty())
+        return;
+
+      union_filter_string = createUnionFilterString_nolock();
+    }
+
+    // Stop capturing what only this subscriber was interested in
+    setSourceFilters(union_filter_string);
+  }
+
+  bool CaptureHub::setSubscriberFilter(HubCaptureSource* subscriber, const std::string& filter_string)
+  {
+    if (dead_pcap_handle_ == nullptr)
+    {
+      fprintf(stderr, "%s\n", "UdpcapSocket ERROR: Unable to create pcap handle for compiling filter");
+      return false;
+    }
+
+    const std::lock_guard<std::mutex> filter_lock(filter_mutex_);
+
+    bpf_program filter_program{};
+    if (PcapCaptureSource::compileFilter(dead_pcap_handle_, &filter_program, filter_string) == PCAP_ERROR)
+    {
+      pcap_perror(dead_pcap_handle_, ("UdpcapSocket ERROR: Unable to compile filter \"" + filter_string + "\"").c_str());
+      return false;
+    }
+
+    std::string union_filter_string;
+
+    {
+      const std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+      Subscription* subscription = findSubscription_nolock(subscriber);
+      if (subscription == nullptr)
+      {
+        pcap_freecode(&filter_program);
+        return false;
+      }
+
+      if (subscription->has_filter)
+        pcap_freecode(&subscription->filter_program);
+
+      subscription->filter_string  = filter_string;
+      subscription->filter_program = filter_program;
+      subscription->has_filter     = true;
+
+      union_filter_string = createUnionFilterString_nolock();
+    }
+
+    return setSourceFilters(union_filter_string);
+  }
+
+  CaptureHub::Subscription* CaptureHub::findSubscription_nolock(const HubCaptureSource* subscriber) const
+  {
+    for (const auto& subscription : subscriptions_)
+    {
+      if (subscription->subscriber == subscriber)
+        return subscription.get();
+    }
+    return nullptr;
+  }
+
+  std::string CaptureHub::createUnionFilterString_nolock() const
+  {
+    // The capture sources let everything pass that at least one subscriber
+    // is interested in. The subscribers filter their share in user space.
+    // Sockets with the same settings have the same filter, so each filter
+    // only needs to be in the union once.
+    std::set<std::string> filter_strings;
+    for (const auto& subscription : subscriptions_)
+    {
+      if (subscription->has_filter)
+        filter_strings.insert(subscription->filter_string);
+    }
+
+    std::string union_filter_string;
+    for (const auto& filter_string : filter_strings)
+    {
+      if (!union_filter_string.empty())
+        union_filter_string += " or ";
+      union_filter_string += "(" + filter_string + ")";
+    }
+
+    return union_filter_string;
+  }
+
+  bool CaptureHub::setSourceFilters(const std::string& union_filter_string)
+  {
+    if (union_filter_string.empty())
+      return true;
+
+    // The capture threads hold the source mutex while reading from their
+    // source. We must not hold the subscriptions mutex here, as the capture
+    // threads lock it while holding their source mutex.
+    bool success = true;
+    for (auto& capture_queue : capture_queues_)
+    {
+      const std::lock_guard<std::mutex> source_lock(capture_queue->source_mutex);
+      success = capture_queue->capture_source->setFilter(union_filter_string) && success;
+    }
+
+    return success;
+  }
+
+  //////////////////////////////////////////
+  //// Getters
+  //////////////////////////////////////////
+
+  int CaptureHub::datalink() const
+  {
+    return datalink_;
+  }
+
+  int CaptureHub::timestampPrecision() const
+  {
+    // All queues have been opened with the same settings
+    CaptureQueue& capture_queue = *capture_queues_.front();
+    const std::lock_guard<std::mutex> source_lock(capture_queue.source_mutex);
+    return capture_queue.capture_source->timestampPrecision();
+  }
+
+  pcap_t* CaptureHub::getPcapHandle() const
+  {
+    CaptureQueue& capture_queue = *capture_queues_.front();
+    const std::lock_guard<std::mutex> source_lock(capture_queue.source_mutex);
+    return capture_queue.capture_source->getPcapHandle();
+  }
+
+  //////////////////////////////////////////
+  //// Capture thread
+  //////////////////////////////////////////
+
+  void CaptureHub::captureThread(CaptureQueue* capture_queue)
+  {
+    while (!stop_)
+    {
+      bool received_any_data = false;
+
+      {
+        const std::lock_guard<std::mutex> source_lock(capture_queue->source_mutex);
+
+        const auto now = std::chrono::steady_clock::now();
+
+        // Drain the source before waiting, as the wait handle may not be
+        // signaled while there still is data in the buffer
+        for (int i = 0; (i < 1024) && !stop_; i++)
+        {
+          pcap_pkthdr*  header = nullptr;
+          const u_char* data   = nullptr;
+
+          const int next_packet_result = capture_queue->capture_source->nextPacket(&header, &data);
+
+          if (next_packet_result == 1)
+          {
+            received_any_data = true;
+            handleFrame(*capture_queue, header, data, now);
+          }
+          else if (next_packet_result == 0)
+          {
+            break;
+          }
+          else
+          {
+            failAll("Shared capture stopped: " + capture_queue->capture_source->getLastError());
+            return;
+          }
+        }
+
+        capture_queue->ip_reassembly.removeOldPackages(now);
+      }
+
+      if (!received_any_data)
+        waitForData(*capture_queue);
+    }
+  }
+
+  void CaptureHub::handleFrame(CaptureQueue& capture_queue, const pcap_pkthdr* header, const u_char* data, std::chrono::steady_clock::time_point now)
+  {
+    const uint8_t* ip_data   = nullptr;
+    size_t         ip_length = 0;
+
+    if ((decode_link_layer_ == nullptr) || !decode_link_layer_(data, header->caplen, ip_data, ip_length))
+      return;
+
+    PacketParser::Ipv4Packet ip_packet{};
+    if (!PacketParser::parseIpv4(ip_data, ip_length, ip_packet))
+      return;
+
+    if (ip_packet.is_fragment)
+    {
+      // Reassemble once for all subscribers. The frame that completes the
+      // datagram stands in for all of its fragments.
+      PacketParser::Ipv4Packet reassembled_ip_packet{};
+      if (!capture_queue.ip_reassembly.processFragment(ip_packet, now, reassembled_ip_packet))
+        return;
+
+      ip_packet = reassembled_ip_packet;
+    }
+
+    PacketParser::UdpDatagram udp_datagram{};
+    if (!PacketParser::parseUdp(ip_packet, udp_datagram))
+      return;
+
+    const std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+    const auto port_subscriptions_it = subscriptions_by_port_.find(udp_datagram.destination_port);
+    if (port_subscriptions_it == subscriptions_by_port_.end())
+      return;
+
+    PortSubscriptions& port_subscriptions = port_subscriptions_it->second;
+
+    pcap_pkthdr   frame_header{};
+    const u_char* frame_data    = nullptr;
+
+    // Prepares the frame once, on the first match. Each subscriber copies it
+    // to its own ring.
+    const auto deliver = [&](Subscription* subscription)
+                          {
+                            if (frame_data == nullptr)
+                            {
+                              const size_t link_layer_length = static_cast<size_t>(ip_data - data);
+                              const size_t ip_total_length   = PacketParser::readUint16(ip_packet.header + 2);
+
+                              if (ip_packet.header == ip_data)
+                              {
+                                // Not reassembled, so the frame can be handed out as it is
+                                frame_data = data;
+                              }
+                              else
+                              {
+                                capture_queue.reassembled_frame.assign(data, data + link_layer_length);
+                                capture_queue.reassembled_frame.insert(capture_queue.reassembled_frame.end(), ip_packet.header, ip_packet.header + ip_packet.length);
+                                frame_data = capture_queue.reassembled_frame.data();
+                              }
+
+                              frame_header        = *header;
+                              frame_header.caplen = static_cast<uint32_t>(link_layer_length + ip_packet.length);
+                              frame_header.len    = static_cast<uint32_t>(link_layer_length + std::max(ip_total_length, ip_packet.length));
+                            }
+
+                            subscription->subscriber->push(&frame_header, frame_data);
+                          };
+
+    capture_queue.flow_hash_candidates    .clear();
+    capture_queue.round_robin_candidates  .clear();
+    capture_queue.capture_queue_candidates.clear();
+
+    for (Subscription* subscription : port_subscriptions.subscriptions)
+    {
+      if (!subscription->has_filter || (pcap_offline_filter(&subscription->filter_program, header, data) == 0))
+        continue;
+
+      switch (subscription->load_balancing)
+      {
+      case LoadBalancing::FlowHash:
+        capture_queue.flow_hash_candidates.push_back(subscription);
+        break;
+      case LoadBalancing::RoundRobin:
+        capture_queue.round_robin_candidates.push_back(subscription);
+        break;
+      case LoadBalancing::CaptureQueue:
+        capture_queue.capture_queue_candidates.push_back(subscription);
+        break;
+      default:
+        deliver(subscription);
+        break;
+      }
+    }
+
+    // Each load-balancing group only gets the datagram once. Only the members
+    // whose filter matches are candidates, so a member is never handed a
+    // datagram that it would not have received on its own.
+    if (!capture_queue.flow_hash_candidates.empty())
+    {
+      const size_t flow_hash = hashFlow(ip_packet.source_address, udp_datagram.source_port);
+      deliver(capture_queue.flow_hash_candidates[flow_hash % capture_queue.flow_hash_candidates.size()]);
+    }
+
+    if (!capture_queue.round_robin_candidates.empty())
+    {
+      deliver(capture_queue.round_robin_candidates[port_subscriptions.round_robin_counter % capture_queue.round_robin_candidates.size()]);
+      port_subscriptions.round_robin_counter++;
+    }
+
+    if (!capture_queue.capture_queue_candidates.empty())
+    {
+      deliver(capture_queue.capture_queue_candidates[capture_queue.index % capture_queue.capture_queue_candidates.size()]);
+    }
+  }
+
+  size_t CaptureHub::hashFlow(uint32_t source_address, uint16_t source_port)
+  {
+    // Fibonacci hashing. Flows that only differ in the lowest bits of the
+    // port must not end up at the same member.
+    const uint64_t flow_key = (static_cast<uint64_t>(source_address) << 16) | source_port;
+    return static_cast<size_t>((flow_key * 0x9E3779B97F4A7C15ULL) >> 32);
+  }
+
+  void CaptureHub::failAll(const std::string& error)
+  {
+    fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: " + error).c_str());
+
+    const std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+    has_failed_ = true;
+    last_error_ = error;
+
+    for (const auto& subscription : subscriptions_)
+      subscription->subscriber->fail(error);
+  }
+
+  void CaptureHub::waitForData(const CaptureQueue& capture_queue)
+  {
+#ifdef _WIN32
+    const std::array<HANDLE, 2> wait_handles{ wake_up_event_, capture_queue.capture_source->getWaitHandle() };
+    const DWORD wait_result = WaitForMultipleObjects(static_cast<DWORD>(wait_handles.size()), wait_handles.data(), FALSE, 1000);
+    if (wait_result == WAIT_FAILED)
+    {
+      LOG_DEBUG("Capture hub error: WAIT_FAILED: " + std::system_category().message(GetLastError()));
+    }
+#else
+    std::array<pollfd, 2> pollfds{};
+    pollfds[0].fd     = wake_up_pipe_[0];
+    pollfds[0].events = POLLIN;
+    pollfds[1].fd     = capture_queue.capture_source->getWaitHandle();
+    pollfds[1].events = POLLIN;
+
+    // The timeout lets the IP reassembly expire incomplete datagrams, even
+    // if there is no traffic
+    if ((poll(pollfds.data(), static_cast<nfds_t>(pollfds.size()), 1000) < 0) && (errno != EINTR))
+    {
+      LOG_DEBUG("Capture hub error: poll failed: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+  }
+
+  void CaptureHub::signalWakeUp()
+  {
+    // Only used for stopping, so the signal is never reset and wakes up all
+    // capture threads
+#ifdef _WIN32
+    SetEvent(wake_up_event_);
+#else
+    const char wake_up_signal = 1;
+    if ((write(wake_up_pipe_[1], &wake_up_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      LOG_DEBUG("Error signaling capture hub wake-up pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+  }
+}
@@ -0,0 +1,210 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+#include "ip_reassembly.h"
+#include "packet_parser.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h> // IWYU pragma: keep
+#endif // _WIN32
+
+namespace Udpcap
+{
+  class HubCaptureSource;
+
+  /**
+   * @brief Process-wide owner of one capture handle per interface
+   *
+   * Every UdpcapSocket that has shared capture enabled subscribes to the hub
+   * of each interface it binds to, instead of opening its own handle. The
+   * kernel then copies each frame to user space once, no matter how many
+   * sockets are interested in it.
+   *
+   * The hub runs a thread that drains the capture handle, parses the frames
+   * and reassembles fragmented IPv4 packets once. Each complete UDP datagram
+   * is looked up by its destination port in a hash index, which yields the
+   * few subscribers bound to that port. Each of them then evaluates its own
+   * capture filter (the one the socket would have set on its own handle) on
+   * the frame in user space. The capture handle itself is set to the union
+   * of all subscriber filters.
+   *
+   * Subscribers of a port that have load balancing enabled form a group per
+   * load-balancing mode. Of each group, only one matching subscriber gets the
+   * datagram, chosen by a flow hash, round-robin or the capture queue.
+   *
+   * On Linux, the hub can capture with multiple queues. Each queue is a
+   * capture handle of its own, and all of them are joined to a PACKET_FANOUT
+   * group, so the kernel distributes the frames among them. Each queue has
+   * its own capture thread, pinned to its own CPU, which does all the work
+   * described above for the frames of its queue. The kernel defragments the
+   * frames before distributing them.
+   *
+   * Fragmented datagrams are handed to the subscribers as a single frame,
+   * consisting of the link-layer header of the last fragment and the
+   * reassembled packet.
+   *
+   * Each subscriber copies the frames it gets to a preallocated ring of its
+   * own, so handing out a frame doesn't allocate any memory.
+   *
+   * The capture sources are opened with the settings (buffer size, engine,
+   * timestamps) of the first subscriber. The hub is destroyed when its last
+   * subscriber has gone.
+   */
+  class CaptureHub
+  {
+  public:
+    using SourceFactory = std::function<std::unique_ptr<CaptureSource>()>;
+
+    /**
+     * @brief Returns the hub for the given key and creates it, if necessary
+     *
+     * @param key           Identifies the interface and anything else that must not be shared (e.g. the capture engine)
+     * @param open_source   Called to open the capture sources, if there is no hub for the key, yet
+     * @param queue_count   Number of capture queues. More than 1 is only supported on Linux.
+     * @param fanout_mode   How the kernel distributes the frames among the queues
+     *
+     * @return The hub or nullptr, if the capture sources could not be opened
+     */
+    static std::shared_ptr<CaptureHub> acquire(const std::string& key, const SourceFactory& open_source, size_t queue_count, FanoutMode fanout_mode);
+
+    explicit CaptureHub(std::vector<std::unique_ptr<CaptureSource>>&& capture_sources);
+    ~CaptureHub();
+
+    // Copy
+    CaptureHub(const CaptureHub&)            = delete;
+    CaptureHub& operator=(const CaptureHub&) = delete;
+
+    // Move
+    CaptureHub(CaptureHub&&)                 = delete;
+    CaptureHub& operator=(CaptureHub&&)      = delete;
+
+    /**
+     * @brief Starts handing the datagrams sent to the given port to the subscriber
+     *
+     * Nothing is handed out before the subscriber has set a filter.
+     * Subscribers of the same port with the same load-balancing mode form a
+     * group, which only gets each datagram once.
+     */
+    void subscribe(HubCaptureSource* subscriber, uint16_t port, LoadBalancing load_balancing);
+
+    /**
+     * @brief Stops handing out datagrams to the subscriber
+     *
+     * When this function returns, the capture threads do not access the
+     * subscriber anymore.
+     */
+    void unsubscribe(HubCaptureSource* subscriber);
+
+    /**
+     * @brief Compiles the filter of a subscriber and updates the filter of the capture sources
+     */
+    bool setSubscriberFilter(HubCaptureSource* subscriber, const std::string& filter_string);
+
+    int     datalink() const;
+    int     timestampPrecision() const;
+    pcap_t* getPcapHandle() const;
+
+  private:
+    struct Subscription
+    {
+      HubCaptureSource* subscriber;
+      uint16_t          port;
+      LoadBalancing     load_balancing;
+      std::string       filter_string;
+      bpf_program       filter_program;                                         /**< Evaluated on every frame sent to the port */
+      bool              has_filter;
+    };
+
+    struct PortSubscriptions
+    {
+      PortSubscriptions() : round_robin_counter(0) {}
+      std::vector<Subscription*> subscriptions;
+      size_t                     round_robin_counter;                           /**< Selects the next member of the round-robin group */
+    };
+
+    struct CaptureQueue
+    {
+      CaptureQueue(std::unique_ptr<CaptureSource>&& capture_source_, size_t index_)
+        : capture_source(std::move(capture_source_))
+        , index         (index_)
+        , ip_reassembly (std::chrono::seconds(5))
+      {}
+
+      std::mutex                      source_mutex;                             /**< Protects the capture_source. Locked before the subscriptions_mutex_, if both are needed. */
+      std::unique_ptr<CaptureSource>  capture_source;
+      const size_t                    index;
+      Udpcap::IpReassembly            ip_reassembly;                            /**< Only used by the capture thread of the queue */
+      std::vector<Subscription*>      flow_hash_candidates;                     /**< Only used by the capture thread of the queue. Kept to save the allocation. */
+      std::vector<Subscription*>      round_robin_candidates;                   /**< Only used by the capture thread of the queue. Kept to save the allocation. */
+      std::vector<Subscription*>      capture_queue_candidates;                 /**< Only used by the capture thread of the queue. Kept to save the allocation. */
+      std::vector<u_char>             reassembled_frame;                        /**< Only used by the capture thread of the queue. Link-layer header + reassembled packet. Kept to save the allocation. */
+      std::thread                     capture_thread;
+    };
+
+    static bool joinFanoutGroup(const std::vector<std::unique_ptr<CaptureSource>>& capture_sources, FanoutMode fanout_mode);
+    static void pinToCpu(std::thread& thread, size_t cpu_index);
+
+    void captureThread(CaptureQueue* capture_queue);
+    void handleFrame(CaptureQueue& capture_queue, const pcap_pkthdr* header, const u_char* data, std::chrono::steady_clock::time_point now);
+    static size_t hashFlow(uint32_t source_address, uint16_t source_port);
+    void failAll(const std::string& error);
+    void waitForData(const CaptureQueue& capture_queue);
+    void signalWakeUp();
+
+    Subscription* findSubscription_nolock(const HubCaptureSource* subscriber) const;
+    std::string createUnionFilterString_nolock() const;
+    bool setSourceFilters(const std::string& union_filter_string);
+
+  private:
+    std::vector<std::unique_ptr<CaptureQueue>>                 capture_queues_; /**< Never empty. The queues must not move, as their capture threads point to them. */
+    const int                                                  datalink_;
+    const PacketParser::LinkLayerDecoder                       decode_link_layer_;
+
+    std::mutex                                                 filter_mutex_;   /**< Serializes the filter updates, so the last update always sets the union of the latest filters. Locked before any other mutex. */
+    pcap_t*                                                    dead_pcap_handle_; /**< For compiling the subscriber filters */
+
+    mutable std::mutex                                         subscriptions_mutex_;
+    std::unordered_map<uint16_t, PortSubscriptions>            subscriptions_by_port_;   /**< Index for finding the subscribers of a datagram by its destination port. Points into the subscriptions_. */
+    std::vector<std::unique_ptr<Subscription>>                 subscriptions_;
+    bool                                                       has_failed_;
+    std::string                                                last_error_;
+
+    std::atomic<bool>                                          stop_;
+#ifdef _WIN32
+    HANDLE                                                     wake_up_event_;  /**< Wakes up the capture threads for stopping them */
+#else
+    std::array<int, 2>                                         wake_up_pipe_;   /**< Wakes up the capture threads for stopping them. Never drained. */
+#endif // _WIN32
+  };
+}
@@ -0,0 +1,132 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <udpcap/udpcap_socket.h>
+
+#include <chrono>
+#include <string>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <pcap.h>           // Pcap API
+
+namespace Udpcap
+{
+  /**
+   * @brief Something the UdpcapSocket can read link-layer frames from
+   *
+   * The interface is modeled after the parts of the pcap API that the receive
+   * loop needs. This lets the receive loop, the header parsing and the IP
+   * reassembly run unchanged, regardless of whether the frames come from a
+   * pcap handle or from a different capture engine.
+   *
+   * A CaptureSource is used by one thread at a time. Only close() may be
+   * called while another thread is waiting on the wait handle.
+   */
+  class CaptureSource
+  {
+  public:
+    CaptureSource() = default;
+    virtual ~CaptureSource() = default;
+
+    // Copy
+    CaptureSource(const CaptureSource&)            = delete;
+    CaptureSource& operator=(const CaptureSource&) = delete;
+
+    // Move
+    CaptureSource(CaptureSource&&)                 = delete;
+    CaptureSource& operator=(CaptureSource&&)      = delete;
+
+    /**
+     * @brief Claims the next frame without blocking
+     *
+     * The returned header and data stay valid until the next call to
+     * nextPacket() or close().
+     *
+     * @return Same semantics as pcap_next_ex():
+     *          1                         if a frame has been returned
+     *          0                         if no frame is available at the moment
+     *          PCAP_ERROR_BREAK          if the source is exhausted and will never deliver another frame
+     *          PCAP_ERROR_NOT_ACTIVATED  if the source is not ready for capturing
+     *          PCAP_ERROR                on errors (see getLastError())
+     */
+    virtual int nextPacket(pcap_pkthdr** header, const u_char** data) = 0;
+
+    /**
+     * @brief Returns the link-layer header type (DLT_ value) of the frames
+     */
+    virtual int datalink() const = 0;
+
+    /**
+     * @brief Returns the unit of pcap_pkthdr::ts.tv_usec of the frames
+     *
+     * @return Same semantics as pcap_get_tstamp_precision(): PCAP_TSTAMP_PRECISION_MICRO or PCAP_TSTAMP_PRECISION_NANO
+     */
+    virtual int timestampPrecision() const = 0;
+
+    /**
+     * @brief Compiles and sets a pcap filter expression
+     * @return True if successfull
+     */
+    virtual bool setFilter(const std::string& filter_string) = 0;
+
+    /**
+     * @brief Returns the handle that signals that nextPacket() may return data
+     *
+     * Just like the pcap handles, a signaled wait handle only indicates that
+     * data may be available. Also, the wait handle may not be signaled while
+     * there still is data left, so nextPacket() must always be called until it
+     * returns 0 before waiting on the handle.
+     */
+    virtual NativeWaitHandle getWaitHandle() const = 0;
+
+    /**
+     * @brief Returns the point in time at which nextPacket() will return data, even though the wait handle is not signaled
+     *
+     * Sources that release their frames on a schedule (e.g. a capture file
+     * replayed with its original timing) cannot signal the wait handle. The
+     * receive loop therefore never waits longer than until the returned time.
+     * Only valid after nextPacket() has returned 0.
+     *
+     * @return The point in time or time_point::max(), if only the wait handle signals new data
+     */
+    virtual std::chrono::steady_clock::time_point readyTime() const { return std::chrono::steady_clock::time_point::max(); }
+
+    /**
+     * @brief Returns the counters of the queue between the capture thread and the receiving thread, if the source has one
+     */
+    virtual ReceiveQueueStatistics queueStatistics() const { return ReceiveQueueStatistics(); }
+
+    /**
+     * @brief Returns the pcap handle for pcap specific operations, or nullptr, if the source is not backed by pcap
+     */
+    virtual pcap_t* getPcapHandle() const = 0;
+
+    /**
+     * @brief Returns a human readable description of the last error
+     */
+    virtual std::string getLastError() const = 0;
+
+    /**
+     * @brief Releases all resources of the capture source.
+     *
+     * Afterwards, nextPacket() must not be called anymore.
+     */
+    virtual void close() = 0;
+  };
+}
@@ -0,0 +1,199 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "conflation_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace Udpcap
+{
+  ConflationTable::ConflationTable(size_t max_flows, size_t max_datagram_size)
+    : slots_                 (max_flows)
+    , used_slots_            (0)
+    , fresh_slots_           (max_flows)
+    , fresh_slots_head_      (0)
+    , fresh_slots_count_     (0)
+    , is_closed_             (false)
+    , conflated_datagrams_   (0)
+    , dropped_flow_datagrams_(0)
+  {
+    for (auto& slot : slots_)
+      slot.payload.resize(max_datagram_size);
+
+    // At most half full, so the probe sequences stay short
+    size_t index_size = 1;
+    while (index_size < max_flows * 2)
+      index_size *= 2;
+    index_.resize(index_size, 0);
+  }
+
+  void ConflationTable::update(const DatagramView& datagram)
+  {
+    FlowKey key;
+    key.source_address      = datagram.source_address.toInt();
+    key.destination_address = datagram.destination_address.toInt();
+    key.source_port         = datagram.source_port;
+    key.destination_port    = datagram.destination_port;
+
+    {
+      const std::lock_guard<std::mutex> table_lock(table_mutex_);
+
+      const size_t slot_index = findOrAddSlot_nolock(key);
+      if (slot_index == std::numeric_limits<size_t>::max())
+      {
+        dropped_flow_datagrams_++;
+        return;
+      }
+
+      Slot& slot = slots_[slot_index];
+
+      slot.length = std::min(datagram.length, slot.payload.size());
+      if (slot.length > 0)
+        memcpy(slot.payload.data(), datagram.data, slot.length);
+
+      slot.info.source_address      = datagram.source_address;
+      slot.info.source_port         = datagram.source_port;
+      slot.info.destination_address = datagram.destination_address;
+      slot.info.destination_port    = datagram.destination_port;
+      slot.info.datagram_length     = datagram.datagram_length;
+      slot.info.timestamp           = datagram.timestamp;
+      slot.info.device_name         = datagram.device_name;
+      slot.info.truncated           = datagram.truncated || (datagram.length > slot.payload.size());
+
+      if (slot.is_fresh)
+      {
+        // The previous datagram has never been read
+        conflated_datagrams_++;
+        return;
+      }
+
+      slot.is_fresh = true;
+      fresh_slots_[(fresh_slots_head_ + fresh_slots_count_) % fresh_slots_.size()] = slot_index;
+      fresh_slots_count_++;
+    }
+
+    fresh_slot_available_.notify_all();
+  }
+
+  size_t ConflationTable::take(DatagramBuffer* buffers, DatagramInfo* infos, size_t max_count, std::chrono::steady_clock::time_point wait_until, Udpcap::Error& error)
+  {
+    std::unique_lock<std::mutex> table_lock(table_mutex_);
+
+    const auto has_fresh_slot = [this]() { return (fresh_slots_count_ > 0) || is_closed_; };
+
+    if (wait_until == std::chrono::steady_clock::time_point::max())
+      fresh_slot_available_.wait(table_lock, has_fresh_slot);
+    else
+      fresh_slot_available_.wait_until(table_lock, wait_until, has_fresh_slot);
+
+    if (fresh_slots_count_ == 0)
+    {
+      error = (is_closed_ ? Udpcap::Error::SOCKET_CLOSED : Udpcap::Error::TIMEOUT);
+      return 0;
+    }
+
+    size_t taken_slots = 0;
+    while ((taken_slots < max_count) && (fresh_slots_count_ > 0))
+    {
+      Slot& slot = slots_[fresh_slots_[fresh_slots_head_]];
+      fresh_slots_head_ = (fresh_slots_head_ + 1) % fresh_slots_.size();
+      fresh_slots_count_--;
+
+      DatagramBuffer& buffer = buffers[taken_slots];
+      const size_t bytes_to_copy = std::min(buffer.max_len, slot.length);
+      if (bytes_to_copy > 0)
+        memcpy(buffer.data, slot.payload.data(), bytes_to_copy);
+
+      buffer.length          = bytes_to_copy;
+      buffer.datagram_length = slot.info.datagram_length;
+      buffer.source_address  = slot.info.source_address;
+      buffer.source_port     = slot.info.source_port;
+
+      if (infos != nullptr)
+      {
+        infos[taken_slots]                  = slot.info;
+        infos[taken_slots].buffer_too_small = (slot.length > buffer.max_len);
+      }
+
+      slot.is_fresh = false;
+      taken_slots++;
+    }
+
+    error = Udpcap::Error::OK;
+    return taken_slots;
+  }
+
+  void ConflationTable::close()
+  {
+    {
+      const std::lock_guard<std::mutex> table_lock(table_mutex_);
+      is_closed_ = true;
+    }
+
+    fresh_slot_available_.notify_all();
+  }
+
+  void ConflationTable::addStatistics(ReceiveQueueStatistics& statistics) const
+  {
+    const std::lock_guard<std::mutex> table_lock(table_mutex_);
+
+    statistics.conflated_datagrams    += conflated_datagrams_;
+    statistics.dropped_flow_datagrams += dropped_flow_datagrams_;
+  }
+
+  size_t ConflationTable::hashFlow(const FlowKey& key)
+  {
+    // Fibonacci hashing of the mixed key
+    const uint64_t addresses = (static_cast<uint64_t>(key.source_address) << 32) | key.destination_address;
+    const uint64_t ports     = (static_cast<uint64_t>(key.source_port)    << 16) | key.destination_port;
+    const uint64_t hash      = (addresses ^ (ports * 0x9E3779B97F4A7C15ULL)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(hash >> 32);
+  }
+
+  size_t ConflationTable::findOrAddSlot_nolock(const FlowKey& key)
+  {
+    if (index_.empty() || slots_.empty())
+      return std::numeric_limits<size_t>::max();
+
+    const size_t mask = index_.size() - 1;
+
+    for (size_t bucket = hashFlow(key) & mask; ; bucket = (bucket + 1) & mask)
+    {
+      const size_t entry = index_[bucket];
+
+      if (entry == 0)
+      {
+        // Unknown flow
+        if (used_slots_ >= slots_.size())
+          return std::numeric_limits<size_t>::max();
+
+        slots_[used_slots_].key = key;
+        index_[bucket]          = used_slots_ + 1;
+        return used_slots_++;
+      }
+
+      if (slots_[entry - 1].key == key)
+        return entry - 1;
+    }
+  }
+}
@@ -0,0 +1,125 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <udpcap/datagram.h>
+#include <udpcap/error.h>
+#include <udpcap/udpcap_socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Udpcap
+{
+  /**
+   * @brief Keeps only the latest datagram of each flow (see UdpcapSocket::enableConflation())
+   *
+   * A flow is identified by the source address and port and the destination
+   * address and port of its datagrams. All slots and the index are allocated
+   * upfront, so updating a flow never allocates. A datagram that is received
+   * while the slot of its flow still holds an unread datagram replaces it.
+   *
+   * Flows are never removed. Once all slots are taken, the datagrams of new
+   * flows are dropped.
+   */
+  class ConflationTable
+  {
+  public:
+    /**
+     * @param max_flows          Number of slots
+     * @param max_datagram_size  Payload bytes per slot. Larger datagrams are truncated.
+     */
+    ConflationTable(size_t max_flows, size_t max_datagram_size);
+
+    /**
+     * @brief Stores the datagram in the slot of its flow. Called by the receive thread of the socket.
+     */
+    void update(const DatagramView& datagram);
+
+    /**
+     * @brief Copies the latest datagram of each flow that has been updated since it has last been taken
+     *
+     * Blocks until at least one flow has been updated, the table is closed
+     * or wait_until has been reached. The flows are returned in the order
+     * they have been updated first.
+     *
+     * @return The number of filled buffers
+     */
+    size_t take(DatagramBuffer* buffers, DatagramInfo* infos, size_t max_count, std::chrono::steady_clock::time_point wait_until, Udpcap::Error& error);
+
+    /**
+     * @brief Wakes up all waiting take() calls. Afterwards, take() returns the remaining datagrams and then fails with SOCKET_CLOSED.
+     *
+     * The remaining datagrams stay complete after the devices of the socket
+     * have been closed, as the device name of a DatagramInfo is valid for
+     * the lifetime of the process.
+     */
+    void close();
+
+    /**
+     * @brief Adds the conflation counters to the statistics
+     */
+    void addStatistics(ReceiveQueueStatistics& statistics) const;
+
+  private:
+    struct FlowKey
+    {
+      uint32_t source_address      = 0;
+      uint32_t destination_address = 0;
+      uint16_t source_port         = 0;
+      uint16_t destination_port    = 0;
+
+      bool operator==(const FlowKey& other) const
+      {
+        return (source_address == other.source_address) && (destination_address == other.destination_address)
+            && (source_port == other.source_port) && (destination_port == other.destination_port);
+      }
+    };
+
+    struct Slot
+    {
+      FlowKey           key;
+      std::vector<char> payload;                                                /**< Preallocated with max_datagram_size bytes */
+      size_t            length   = 0;
+      DatagramInfo      info;
+      bool              is_fresh = false;                                       /**< Updated since take() has returned it the last time */
+    };
+
+    static size_t hashFlow(const FlowKey& key);
+    size_t findOrAddSlot_nolock(const FlowKey& key);
+
+  private:
+    mutable std::mutex      table_mutex_;
+    std::condition_variable fresh_slot_available_;
+
+    std::vector<Slot>       slots_;
+    size_t                  used_slots_;
+    std::vector<size_t>     index_;                                             /**< Open addressing hash table with a power of two size. Holds slot index + 1, 0 for an empty bucket. */
+
+    std::vector<size_t>     fresh_slots_;                                       /**< FIFO of the fresh slots. Each slot is in there at most once, so it never overflows. */
+    size_t                  fresh_slots_head_;
+    size_t                  fresh_slots_count_;
+
+    bool                    is_closed_;
+    size_t                  conflated_datagrams_;
+    size_t                  dropped_flow_datagrams_;
+  };
+}
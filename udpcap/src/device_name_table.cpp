@@ -0,0 +1,36 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "device_name_table.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace Udpcap
+{
+  const char* internDeviceName(const std::string& device_name)
+  {
+    // Never destroyed, so the names stay valid even while other static
+    // objects are destroyed at exit. The elements of an unordered_set are
+    // never moved, so their c_str() stays valid when the set grows.
+    static std::mutex&                       device_names_mutex = *new std::mutex();
+    static std::unordered_set<std::string>&  device_names       = *new std::unordered_set<std::string>();
+
+    const std::lock_guard<std::mutex> device_names_lock(device_names_mutex);
+    return device_names.insert(device_name).first->c_str();
+  }
+}
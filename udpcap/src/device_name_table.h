@@ -0,0 +1,40 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <string>
+
+namespace Udpcap
+{
+  /**
+   * @brief Returns a copy of the device name that is valid for the lifetime of the process
+   *
+   * DatagramInfo and DatagramView are value types that are copied around
+   * freely (e.g. into the conflation table), so the device name they point
+   * to must outlive the socket and its capture devices. Every distinct name
+   * is stored only once, so there are only as many entries as devices and
+   * capture files that have ever been opened.
+   *
+   * This is meant to be called when opening a device, not per datagram.
+   * It is thread safe.
+   *
+   * @param device_name The name of the capture device or capture file
+   *
+   * @return A pointer to the stored name. It is never freed.
+   */
+  const char* internDeviceName(const std::string& device_name);
+}
@@ -0,0 +1,205 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "frame_ring.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace Udpcap
+{
+  FrameRing::FrameRing(size_t initial_capacity, size_t max_capacity)
+    : max_capacity_   (max_capacity - (max_capacity % RECORD_ALIGNMENT))
+    , read_pos_       (0)
+    , write_pos_      (0)
+    , used_bytes_     (0)
+    , peak_used_bytes_(0)
+    , frame_count_    (0)
+  {
+    const size_t aligned_initial_capacity = initial_capacity + ((RECORD_ALIGNMENT - (initial_capacity % RECORD_ALIGNMENT)) % RECORD_ALIGNMENT);
+
+    // The vector value-initializes the memory, so all pages are mapped before the first frame arrives
+    buffer_.resize(std::min(aligned_initial_capacity, max_capacity_));
+  }
+
+  bool FrameRing::push(const pcap_pkthdr* header, const u_char* data, uint32_t tag)
+  {
+    const size_t record_size = recordSize(header->caplen);
+    if ((record_size > max_capacity_) || (record_size > std::numeric_limits<uint32_t>::max()))
+      return false;
+
+    size_t pos = reserve(record_size);
+    if (pos == std::numeric_limits<size_t>::max())
+    {
+      if (!grow(record_size))
+        return false;
+
+      pos = reserve(record_size);
+    }
+
+    RecordHeader* record = recordAt(pos);
+    record->header      = *header;
+    record->record_size = static_cast<uint32_t>(record_size);
+    record->tag         = tag;
+    if (header->caplen > 0)
+      memcpy(&buffer_[pos + sizeof(RecordHeader)], data, header->caplen);
+
+    frame_count_++;
+    peak_used_bytes_ = std::max(peak_used_bytes_, used_bytes_);
+    return true;
+  }
+
+  bool FrameRing::front(const pcap_pkthdr** header, const u_char** data, uint32_t* tag)
+  {
+    // The caller doesn't use the previous frame anymore
+    retired_buffers_.clear();
+
+    if (used_bytes_ == 0)
+      return false;
+
+    // Skip the unused tail of the buffer, if the writer has wrapped around
+    if ((buffer_.size() - read_pos_ < sizeof(RecordHeader)) || (recordAt(read_pos_)->record_size == 0))
+    {
+      used_bytes_ -= buffer_.size() - read_pos_;
+      read_pos_    = 0;
+    }
+
+    RecordHeader* record = recordAt(read_pos_);
+    *header = &record->header;
+    *data   = &buffer_[read_pos_ + sizeof(RecordHeader)];
+    *tag    = record->tag;
+    return true;
+  }
+
+  void FrameRing::pop()
+  {
+    const size_t record_size = recordAt(read_pos_)->record_size;
+
+    read_pos_   += record_size;
+    used_bytes_ -= record_size;
+    frame_count_--;
+
+    if ((read_pos_ == buffer_.size()) || (used_bytes_ == 0))
+      read_pos_ = 0;
+    if (used_bytes_ == 0)
+      write_pos_ = 0;
+  }
+
+  void FrameRing::clear()
+  {
+    read_pos_    = 0;
+    write_pos_   = 0;
+    used_bytes_  = 0;
+    frame_count_ = 0;
+  }
+
+  size_t FrameRing::recordSize(size_t caplen)
+  {
+    const size_t size = sizeof(RecordHeader) + caplen;
+    return size + ((RECORD_ALIGNMENT - (size % RECORD_ALIGNMENT)) % RECORD_ALIGNMENT);
+  }
+
+  size_t FrameRing::reserve(size_t record_size)
+  {
+    const size_t capacity = buffer_.size();
+    size_t       pos      = std::numeric_limits<size_t>::max();
+
+    if ((used_bytes_ == 0) || (write_pos_ > read_pos_))
+    {
+      // The used bytes are [read_pos_, write_pos_), so there is free space at the end and at the beginning
+      if (capacity - write_pos_ >= record_size)
+      {
+        pos = write_pos_;
+      }
+      else if (read_pos_ >= record_size)
+      {
+        // Mark the tail as unused. If it is too short for a header, the reader skips it anyway.
+        if (capacity - write_pos_ >= sizeof(RecordHeader))
+          recordAt(write_pos_)->record_size = 0;
+
+        used_bytes_ += capacity - write_pos_;
+        write_pos_   = 0;
+        pos          = 0;
+      }
+    }
+    else if (read_pos_ - write_pos_ >= record_size)
+    {
+      // The writer has wrapped around, so the only free space is [write_pos_, read_pos_)
+      pos = write_pos_;
+    }
+
+    if (pos == std::numeric_limits<size_t>::max())
+      return pos;
+
+    write_pos_   = pos + record_size;
+    used_bytes_ += record_size;
+
+    if (write_pos_ == capacity)
+      write_pos_ = 0;
+
+    return pos;
+  }
+
+  bool FrameRing::grow(size_t record_size)
+  {
+    const size_t capacity = buffer_.size();
+    if (capacity >= max_capacity_)
+      return false;
+
+    std::vector<u_char> new_buffer(std::min(std::max(capacity * 2, used_bytes_ + record_size), max_capacity_));
+    if (new_buffer.size() < used_bytes_ + record_size)
+      return false;
+
+    // Copy the frames in order to the beginning of the new buffer. The unused
+    // tail, if any, is left out.
+    size_t new_used_bytes = 0;
+    size_t pos            = read_pos_;
+    size_t remaining      = used_bytes_;
+
+    while (remaining > 0)
+    {
+      if ((capacity - pos < sizeof(RecordHeader)) || (recordAt(pos)->record_size == 0))
+      {
+        remaining -= capacity - pos;
+        pos        = 0;
+        continue;
+      }
+
+      const size_t size = recordAt(pos)->record_size;
+      memcpy(&new_buffer[new_used_bytes], &buffer_[pos], size);
+
+      new_used_bytes += size;
+      remaining      -= size;
+      pos            += size;
+
+      if (pos == capacity)
+        pos = 0;
+    }
+
+    retired_buffers_.push_back(std::move(buffer_));
+    buffer_     = std::move(new_buffer);
+    read_pos_   = 0;
+    write_pos_  = new_used_bytes;
+    used_bytes_ = new_used_bytes;
+
+    return true;
+  }
+}
@@ -0,0 +1,106 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <pcap.h>           // Pcap API
+
+namespace Udpcap
+{
+  /**
+   * @brief Ring buffer of captured frames in one contiguous block of memory
+   *
+   * The memory is allocated (and touched) upfront, so storing a frame never
+   * allocates. If a frame does not fit anymore, the ring grows to twice its
+   * size, until it reaches its maximum capacity. Then, new frames are
+   * rejected. The ring never shrinks.
+   *
+   * The frame returned by front() stays valid until the next call to front(),
+   * even if pop() has been called and the ring has grown in between. The ring
+   * is not thread safe.
+   */
+  class FrameRing
+  {
+  public:
+    /**
+     * @param initial_capacity  Number of bytes to allocate upfront
+     * @param max_capacity      Number of bytes the ring may grow to
+     */
+    FrameRing(size_t initial_capacity, size_t max_capacity);
+
+    /**
+     * @brief Copies a frame to the end of the ring
+     *
+     * @param tag  Arbitrary value that front() returns with the frame
+     * @return false, if the ring is full and cannot grow anymore
+     */
+    bool push(const pcap_pkthdr* header, const u_char* data, uint32_t tag);
+
+    /**
+     * @brief Returns the oldest frame without removing it
+     * @return false, if the ring is empty
+     */
+    bool front(const pcap_pkthdr** header, const u_char** data, uint32_t* tag);
+
+    /**
+     * @brief Removes the oldest frame. Only valid after front() has returned true.
+     */
+    void pop();
+
+    /**
+     * @brief Removes all frames
+     */
+    void clear();
+
+    bool   empty()       const { return used_bytes_ == 0; }
+    size_t size()        const { return frame_count_; }
+    size_t capacity()    const { return buffer_.size(); }
+    size_t peakBytes()   const { return peak_used_bytes_; }
+
+  private:
+    struct RecordHeader
+    {
+      pcap_pkthdr header;
+      uint32_t    record_size;                                                  /**< Including this header and the padding. 0 marks an unused tail of the buffer. */
+      uint32_t    tag;
+    };
+
+    static size_t recordSize(size_t caplen);
+
+    size_t reserve(size_t record_size);
+    bool   grow(size_t record_size);
+
+    RecordHeader* recordAt(size_t pos) { return reinterpret_cast<RecordHeader*>(&buffer_[pos]); }
+
+  private:
+    static constexpr size_t RECORD_ALIGNMENT = alignof(RecordHeader);
+
+    std::vector<u_char>              buffer_;
+    std::vector<std::vector<u_char>> retired_buffers_;                          /**< Buffers replaced by grow(), kept until the frame returned by front() is not used anymore */
+    const size_t                     max_capacity_;
+    size_t                           read_pos_;
+    size_t                           write_pos_;
+    size_t                           used_bytes_;                               /**< Including unused tails of the buffer, until the reader has skipped them */
+    size_t                           peak_used_bytes_;
+    size_t                           frame_count_;
+  };
+}
@@ -16,9 +16,13 @@
 
 #include "udpcap/host_address.h"
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <Ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif // _WIN32
 
 #include <array>
 #include <cstdint>
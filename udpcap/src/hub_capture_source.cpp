@@ -0,0 +1,320 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "hub_capture_source.h"
+
+#include "capture_hub.h"
+#include "log_debug.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  HubCaptureSource::HubCaptureSource(const std::shared_ptr<CaptureHub>& capture_hub, uint16_t port, LoadBalancing load_balancing, size_t initial_queued_bytes, size_t max_queued_bytes, size_t max_queued_frames, bool drop_oldest)
+    : capture_hub_         (capture_hub)
+    , datalink_            (capture_hub->datalink())
+    , timestamp_precision_ (capture_hub->timestampPrecision())
+    , frame_ring_          (initial_queued_bytes, max_queued_bytes)
+    , max_queued_frames_   (max_queued_frames)
+    , drop_oldest_         (drop_oldest)
+    , has_failed_          (false)
+    , has_current_frame_   (false)
+    , current_header_      {}
+#ifdef _WIN32
+    , wait_handle_         (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wait_pipe_           {-1, -1}
+#endif // _WIN32
+    , wait_handle_signaled_(false)
+  {
+#ifdef _WIN32
+    if (wait_handle_ == nullptr)
+    {
+      LOG_DEBUG("Error creating shared capture event: " + std::system_category().message(GetLastError()));
+    }
+#else
+    if (pipe(wait_pipe_.data()) == 0)
+    {
+      fcntl(wait_pipe_[0], F_SETFL, fcntl(wait_pipe_[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wait_pipe_[1], F_SETFL, fcntl(wait_pipe_[1], F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+      LOG_DEBUG("Error creating shared capture pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+
+    // Only subscribe once everything is initialized, as the hub may call us right away
+    capture_hub_->subscribe(this, port, load_balancing);
+  }
+
+  HubCaptureSource::~HubCaptureSource()
+  {
+    close();
+  }
+
+  //////////////////////////////////////////
+  //// CaptureSource API
+  //////////////////////////////////////////
+
+  int HubCaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+
+    if (!capture_hub_)
+    {
+      last_error_ = "Capture source closed";
+      return PCAP_ERROR_NOT_ACTIVATED;
+    }
+
+    // The caller is done with the frame that we have returned the last time
+    if (has_current_frame_)
+    {
+      frame_ring_.pop();
+      has_current_frame_ = false;
+    }
+
+    const pcap_pkthdr* frame_header = nullptr;
+    const u_char*      frame_data   = nullptr;
+    uint32_t           tag          = 0;
+
+    if (!frame_ring_.front(&frame_header, &frame_data, &tag))
+    {
+      if (has_failed_)
+        return PCAP_ERROR;
+
+      // The hub signals again when it pushes the next frame
+      resetWaitHandle_nolock();
+      return 0;
+    }
+
+    if (drop_oldest_)
+    {
+      // The capture thread of the hub may drop the front of the ring at any
+      // time, so we hand out a copy
+      current_header_ = *frame_header;
+      current_data_.assign(frame_data, frame_data + frame_header->caplen);
+      frame_ring_.pop();
+
+      *header = &current_header_;
+      *data   = current_data_.data();
+      return 1;
+    }
+
+    has_current_frame_ = true;
+
+    *header = const_cast<pcap_pkthdr*>(frame_header);
+    *data   = frame_data;
+    return 1;
+  }
+
+  int HubCaptureSource::datalink() const
+  {
+    return datalink_;
+  }
+
+  int HubCaptureSource::timestampPrecision() const
+  {
+    return timestamp_precision_;
+  }
+
+  bool HubCaptureSource::setFilter(const std::string& filter_string)
+  {
+    // The hub evaluates our filter for us
+    const std::shared_ptr<CaptureHub> capture_hub = getCaptureHub();
+    if (!capture_hub)
+      return false;
+
+    return capture_hub->setSubscriberFilter(this, filter_string);
+  }
+
+  NativeWaitHandle HubCaptureSource::getWaitHandle() const
+  {
+#ifdef _WIN32
+    return wait_handle_;
+#else
+    return wait_pipe_[0];
+#endif // _WIN32
+  }
+
+  ReceiveQueueStatistics HubCaptureSource::queueStatistics() const
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+
+    ReceiveQueueStatistics statistics = statistics_;
+    statistics.queued_frames = frame_ring_.size() - (has_current_frame_ ? 1 : 0);
+    return statistics;
+  }
+
+  pcap_t* HubCaptureSource::getPcapHandle() const
+  {
+    // Needed for pcap specific queries like the MAC address on Windows. The
+    // handle must not be used for capturing.
+    const std::shared_ptr<CaptureHub> capture_hub = getCaptureHub();
+    if (!capture_hub)
+      return nullptr;
+
+    return capture_hub->getPcapHandle();
+  }
+
+  std::string HubCaptureSource::getLastError() const
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+    return last_error_;
+  }
+
+  void HubCaptureSource::close()
+  {
+    std::shared_ptr<CaptureHub> capture_hub;
+
+    {
+      const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+      capture_hub.swap(capture_hub_);
+      frame_ring_.clear();
+      has_current_frame_ = false;
+    }
+
+    if (!capture_hub)
+      return;
+
+    // Afterwards the capture thread of the hub doesn't call us anymore. If we
+    // have been the last subscriber, this also closes the hub.
+    capture_hub->unsubscribe(this);
+    capture_hub.reset();
+
+    if ((statistics_.dropped_newest_frames > 0) || (statistics_.dropped_oldest_frames > 0))
+    {
+      LOG_DEBUG("Shared capture dropped " + std::to_string(statistics_.dropped_newest_frames + statistics_.dropped_oldest_frames) + " frames, as the receive queue was full");
+    }
+
+#ifdef _WIN32
+    if (wait_handle_ != nullptr)
+    {
+      CloseHandle(wait_handle_);
+      wait_handle_ = nullptr;
+    }
+#else
+    for (int& fd : wait_pipe_)
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+#endif // _WIN32
+  }
+
+  std::shared_ptr<CaptureHub> HubCaptureSource::getCaptureHub() const
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+    return capture_hub_;
+  }
+
+  //////////////////////////////////////////
+  //// Called by the CaptureHub
+  //////////////////////////////////////////
+
+  void HubCaptureSource::push(const pcap_pkthdr* header, const u_char* data)
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+
+    if (!capture_hub_)
+      return;
+
+    for (;;)
+    {
+      // The frame still used by the receiving thread doesn't count, as its
+      // space is freed with the next call to nextPacket()
+      const size_t queued_frames = frame_ring_.size() - (has_current_frame_ ? 1 : 0);
+
+      if (((max_queued_frames_ == 0) || (queued_frames < max_queued_frames_))
+        && frame_ring_.push(header, data, 0))
+      {
+        signalWaitHandle_nolock();
+        return;
+      }
+
+      // A frame larger than the entire ring cannot be stored at all
+      if (!drop_oldest_ || frame_ring_.empty())
+      {
+        // Just like a full kernel buffer, a full queue drops the new frames
+        statistics_.dropped_newest_frames++;
+        return;
+      }
+
+      frame_ring_.pop();
+      statistics_.dropped_oldest_frames++;
+    }
+  }
+
+  void HubCaptureSource::fail(const std::string& error)
+  {
+    const std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+
+    has_failed_ = true;
+    last_error_ = error;
+
+    signalWaitHandle_nolock();
+  }
+
+  void HubCaptureSource::signalWaitHandle_nolock()
+  {
+    if (wait_handle_signaled_)
+      return;
+
+#ifdef _WIN32
+    SetEvent(wait_handle_);
+#else
+    const char wait_signal = 1;
+    if ((write(wait_pipe_[1], &wait_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      LOG_DEBUG("Error signaling shared capture pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+    wait_handle_signaled_ = true;
+  }
+
+  void HubCaptureSource::resetWaitHandle_nolock()
+  {
+    if (!wait_handle_signaled_)
+      return;
+
+#ifdef _WIN32
+    ResetEvent(wait_handle_);
+#else
+    std::array<char, 64> drain_buffer{};
+    while (read(wait_pipe_[0], drain_buffer.data(), drain_buffer.size()) > 0) {}
+#endif // _WIN32
+    wait_handle_signaled_ = false;
+  }
+}
@@ -0,0 +1,116 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_hub.h"
+#include "capture_source.h"
+#include "frame_ring.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h> // IWYU pragma: keep
+#endif // _WIN32
+
+namespace Udpcap
+{
+  /**
+   * @brief CaptureSource that receives its frames from a shared CaptureHub
+   *
+   * The capture thread of the hub copies the frames to a FrameRing, so
+   * queueing a frame doesn't allocate any memory. The wait handle is
+   * signaled while the queue is not empty. If the queue exceeds its maximum
+   * size or frame count, either the new frame is dropped, just like a full
+   * kernel buffer would drop it, or the oldest frames are dropped.
+   * Waiting is not supported, as it would stall the capture thread of the
+   * hub and thus all other subscribers.
+   */
+  class HubCaptureSource : public CaptureSource
+  {
+  public:
+    /**
+     * @param capture_hub           The hub to subscribe to
+     * @param port                  The UDP port the socket is bound to
+     * @param load_balancing        The load-balancing group to join, if any
+     * @param initial_queued_bytes  Size of the queue that is allocated upfront
+     * @param max_queued_bytes      Maximum size of the queue
+     * @param max_queued_frames     Maximum number of frames in the queue, or 0 for no limit
+     * @param drop_oldest           Whether to drop the oldest frames instead of the new one, when the queue is full
+     */
+    HubCaptureSource(const std::shared_ptr<CaptureHub>& capture_hub, uint16_t port, LoadBalancing load_balancing, size_t initial_queued_bytes, size_t max_queued_bytes, size_t max_queued_frames, bool drop_oldest);
+    ~HubCaptureSource() override;
+
+    // Copy
+    HubCaptureSource(const HubCaptureSource&)            = delete;
+    HubCaptureSource& operator=(const HubCaptureSource&) = delete;
+
+    // Move
+    HubCaptureSource(HubCaptureSource&&)                 = delete;
+    HubCaptureSource& operator=(HubCaptureSource&&)      = delete;
+
+    int              nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    int              datalink() const override;
+    int              timestampPrecision() const override;
+    bool             setFilter(const std::string& filter_string) override;
+    NativeWaitHandle getWaitHandle() const override;
+    ReceiveQueueStatistics queueStatistics() const override;
+    pcap_t*          getPcapHandle() const override;
+    std::string      getLastError() const override;
+    void             close() override;
+
+    // Called by the capture thread of the hub
+    void push(const pcap_pkthdr* header, const u_char* data);
+    void fail(const std::string& error);
+
+  private:
+    std::shared_ptr<CaptureHub> getCaptureHub() const;
+    void signalWaitHandle_nolock();
+    void resetWaitHandle_nolock();
+
+  private:
+    std::shared_ptr<CaptureHub>                        capture_hub_;            /**< nullptr after close() */
+    const int                                          datalink_;
+    const int                                          timestamp_precision_;
+
+    mutable std::mutex                                 queue_mutex_;            /**< Protects the queue, the wait handle state and the error */
+    FrameRing                                          frame_ring_;
+    const size_t                                       max_queued_frames_;
+    const bool                                         drop_oldest_;
+    ReceiveQueueStatistics                             statistics_;
+    std::string                                        last_error_;
+    bool                                               has_failed_;             /**< The hub has stopped capturing. Once the queue is empty, nextPacket() returns the error. */
+
+    bool                                               has_current_frame_;      /**< The frame returned by the last nextPacket() call is still at the front of the ring */
+    pcap_pkthdr                                        current_header_;         /**< Copy of the frame returned by the last nextPacket() call, if the oldest frames are dropped */
+    std::vector<u_char>                                current_data_;
+
+#ifdef _WIN32
+    HANDLE                                             wait_handle_;            /**< Manual-reset event, signaled while the queue is not empty */
+#else
+    std::array<int, 2>                                 wait_pipe_;              /**< Readable while the queue is not empty */
+#endif // _WIN32
+    bool                                               wait_handle_signaled_;
+  };
+}
@@ -16,157 +16,322 @@
 
 #include "ip_reassembly.h"
 
-#ifdef _MSC_VER
-#pragma warning( push )
-#pragma warning( disable: 4100 4200)
-#endif // _MSC_VER
-#include <IPv4Layer.h>
-#include <IPv6Layer.h>
-#ifdef _MSC_VER
-#pragma warning( pop )
-#endif // _MSC_VER
+#include "packet_parser.h"
 
+#include <algorithm>
+#include <bitset>
 #include <chrono>
 #include <cstddef>
-#include <iostream>
+#include <cstdint>
+#include <cstring>
 #include <memory>
-#include <utility>
 
 namespace Udpcap
 {
-  /////////////////////////////////////////
-  /// Constructor & Destructor
-  /////////////////////////////////////////
-  
+  constexpr size_t IpReassembly::MAX_HEADER_LENGTH;
+  constexpr size_t IpReassembly::MAX_PAYLOAD_LENGTH;
+  constexpr size_t IpReassembly::SLOT_SIZE;
+  constexpr size_t IpReassembly::BLOCK_COUNT;
+  constexpr size_t IpReassembly::BITMAP_WORDS;
+  constexpr size_t IpReassembly::NO_SLOT;
+
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
   IpReassembly::IpReassembly(std::chrono::nanoseconds max_package_age, size_t max_packets_to_store)
     : max_package_age_(max_package_age)
-    , ip_reassembly_(&IpReassembly::onFragmentsCleanCallback, static_cast<void*>(this), max_packets_to_store)
-  {}
-
-  /////////////////////////////////////////
-  /// API borrowed from pcpp::IPReassembly
-  /////////////////////////////////////////
-  
-  pcpp::Packet* IpReassembly::processPacket(pcpp::Packet* fragment, pcpp::IPReassembly::ReassemblyStatus& status, pcpp::ProtocolType parse_until, pcpp::OsiModelLayer parse_until_layer)
+    , slots_          (std::max<size_t>(max_packets_to_store, 1))
+    , slots_in_use_   (0)
+    , lru_head_       (NO_SLOT)
+    , lru_tail_       (NO_SLOT)
+    , hash_index_mask_(0)
   {
-    removeOldPackages();
-
-    pcpp::Packet* packet = ip_reassembly_.processPacket(fragment, status, parse_until, parse_until_layer);
-
-    if ((status & pcpp::IPReassembly::REASSEMBLED) != 0)
-    {
-      // We have reassembled an entire packet.
-      auto packet_key = getPacketKey(fragment);
-      removePackageFromTimestampMap(std::move(packet_key));
-    }
-    else if ((status & (pcpp::IPReassembly::FIRST_FRAGMENT | pcpp::IPReassembly::FRAGMENT | pcpp::IPReassembly::OUT_OF_ORDER_FRAGMENT)) != 0)
+    free_slots_.reserve(slots_.size());
+    for (size_t i = slots_.size(); i > 0; i--)
     {
-      // The input was a fragment an will be kept in the buffer
-      auto packet_key = getPacketKey(fragment);
-      updatePackageInTimestampMap(std::move(packet_key));
+      slots_[i - 1].lru_previous = NO_SLOT;
+      slots_[i - 1].lru_next     = NO_SLOT;
+      free_slots_.push_back(i - 1);
     }
 
-    return packet;
+    // Keep the load factor of the index at 50% or less, so probe sequences stay short
+    size_t hash_index_size = 1;
+    while (hash_index_size < slots_.size() * 2)
+      hash_index_size *= 2;
+
+    hash_index_.assign(hash_index_size, NO_SLOT);
+    hash_index_mask_ = hash_index_size - 1;
   }
 
-  pcpp::Packet* IpReassembly::processPacket(pcpp::RawPacket* fragment, pcpp::IPReassembly::ReassemblyStatus& status, pcpp::ProtocolType parse_until, pcpp::OsiModelLayer parse_until_layer)
+  //////////////////////////////////////////
+  //// API
+  //////////////////////////////////////////
+
+  bool IpReassembly::processFragment(const PacketParser::Ipv4Packet& fragment, std::chrono::steady_clock::time_point now, PacketParser::Ipv4Packet& reassembled_packet)
   {
-    pcpp::Packet* parsedFragment = new pcpp::Packet(fragment, false, parse_until, parse_until_layer);
-    pcpp::Packet* result         = this->processPacket(parsedFragment, status, parse_until, parse_until_layer);
+    removeOldPackages(now);
 
-    if (result != parsedFragment)
-      delete parsedFragment;
+    const uint16_t flags_and_fragment_offset = PacketParser::readUint16(fragment.header + 6);
+    const bool     more_fragments            = ((flags_and_fragment_offset & 0x2000) != 0);
+    const size_t   fragment_offset           = static_cast<size_t>(flags_and_fragment_offset & 0x1FFF) * 8;
+    const size_t   fragment_length           = fragment.payload_length;
+    const size_t   header_length             = fragment.length - fragment.payload_length;
 
-    return result;
-  }
+    // A truncated fragment would leave a hole that never gets filled
+    if (PacketParser::readUint16(fragment.header + 2) != fragment.length)
+      return false;
+
+    // Only the last fragment may have a length that is not a multiple of 8
+    if ((fragment_length == 0)
+      || (more_fragments && ((fragment_length % 8) != 0))
+      || (fragment_offset + fragment_length > MAX_PAYLOAD_LENGTH))
+    {
+      return false;
+    }
 
-  /////////////////////////////////////////
-  /// Helper functions
-  /////////////////////////////////////////
+    const DatagramKey key{ fragment.source_address, fragment.destination_address, fragment.identification, fragment.protocol };
 
-  std::unique_ptr<pcpp::IPReassembly::PacketKey> IpReassembly::getPacketKey(const pcpp::Packet* packet)
-  {
+    size_t slot_index = findSlot(key);
+    if (slot_index == NO_SLOT)
     {
-      pcpp::IPv4Layer* ipv4_layer  = packet->getLayerOfType<pcpp::IPv4Layer>();
-      if (ipv4_layer != nullptr)
-      {
-        return std::make_unique<pcpp::IPReassembly::IPv4PacketKey>(_byteswap_ushort(ipv4_layer->getIPv4Header()->ipId), ipv4_layer->getSrcIPv4Address(), ipv4_layer->getDstIPv4Address());
-      }
+      slot_index = acquireSlot(key, now);
     }
-    
+    else
+    {
+      slots_[slot_index].last_update = now;
+      lruUnlink  (slot_index);
+      lruPushBack(slot_index);
+    }
+
+    Slot& slot = slots_[slot_index];
+
+    if (!more_fragments)
     {
-      pcpp::IPv6Layer* ipv6_layer  = packet->getLayerOfType<pcpp::IPv6Layer>();
-      if (ipv6_layer != nullptr)
+      // The last fragment tells us the total length. Drop datagrams with
+      // contradicting information, i.e. another last fragment or fragments
+      // beyond the end. We cannot know which fragment is correct.
+      const size_t payload_length = fragment_offset + fragment_length;
+      if (((slot.payload_length != 0) && (slot.payload_length != payload_length))
+        || (slot.received_end > payload_length))
       {
-        auto* frag_header = ipv6_layer->getExtensionOfType<pcpp::IPv6FragmentationHeader>();
-        if (frag_header != nullptr)
-          return std::make_unique<pcpp::IPReassembly::IPv6PacketKey>(ntohl(frag_header->getFragHeader()->id), ipv6_layer->getSrcIPv6Address(), ipv6_layer->getDstIPv6Address());
-        else
-          return nullptr;
+        releaseSlot(slot_index);
+        return false;
       }
+      slot.payload_length = payload_length;
     }
 
-    return nullptr;
-  }
+    if ((slot.payload_length != 0) && (fragment_offset + fragment_length > slot.payload_length))
+    {
+      releaseSlot(slot_index);
+      return false;
+    }
 
-  void IpReassembly::removeOldPackages()
-  {
-    auto now = std::chrono::steady_clock::now();
+    if (fragment_offset == 0)
+    {
+      // The first fragment provides the header of the reassembled packet
+      memcpy(slot.data.get() + MAX_HEADER_LENGTH - header_length, fragment.header, header_length);
+      slot.header_length = header_length;
+    }
+
+    memcpy(slot.data.get() + MAX_HEADER_LENGTH + fragment_offset, fragment.payload, fragment_length);
+    slot.received_end     = std::max(slot.received_end, fragment_offset + fragment_length);
+    slot.received_blocks += markBlocksReceived(slot, fragment_offset / 8, (fragment_offset + fragment_length + 7) / 8);
 
-    for (auto package_timestamp_it = timestamp_map_.begin()
-      ; package_timestamp_it != timestamp_map_.end()
-      ; package_timestamp_it++)
+    if ((slot.header_length == 0)
+      || (slot.payload_length == 0)
+      || (slot.received_blocks != (slot.payload_length + 7) / 8))
     {
-      if (package_timestamp_it->second.second < (now - max_package_age_))
-      {
-        ip_reassembly_.removePacket(*package_timestamp_it->second.first);
-        package_timestamp_it = timestamp_map_.erase(package_timestamp_it);
-      }
+      // Not complete, yet
+      return false;
     }
 
-    if (timestamp_map_.size() != ip_reassembly_.getCurrentCapacity())
+    // Fix the header, so it describes the reassembled packet
+    uint8_t* const header       = slot.data.get() + MAX_HEADER_LENGTH - slot.header_length;
+    const size_t   total_length = slot.header_length + slot.payload_length;
+
+    if (total_length > 65535)
     {
-      std::cerr << "Udpcap: Pcap++ IpReassembly and custom IP Reassembly are outof sync! Pcap++ reassembly capacity: " << ip_reassembly_.getCurrentCapacity() << ", timestamp_map size: " << timestamp_map_.size() << std::endl;
+      releaseSlot(slot_index);
+      return false;
     }
+
+    header[2] = static_cast<uint8_t>(total_length >> 8);
+    header[3] = static_cast<uint8_t>(total_length & 0xFF);
+    header[6] = 0;  // Flags and fragment offset
+    header[7] = 0;
+
+    // The slot is free for the next datagram, but the data stays untouched
+    // until the next call.
+    releaseSlot(slot_index);
+
+    return PacketParser::parseIpv4(header, total_length, reassembled_packet);
   }
 
-  void IpReassembly::removePackageFromTimestampMap(std::unique_ptr<pcpp::IPReassembly::PacketKey> packet_key)
+  void IpReassembly::removeOldPackages(std::chrono::steady_clock::time_point now)
   {
-    auto package_it = timestamp_map_.find(packet_key->getHashValue());
-    if (package_it != timestamp_map_.end())
-    {
-      timestamp_map_.erase(package_it);
-    }
+    // The list is ordered by the last update, so we can stop at the first
+    // datagram that is young enough
+    while ((lru_head_ != NO_SLOT) && (now - slots_[lru_head_].last_update > max_package_age_))
+      releaseSlot(lru_head_);
   }
 
-  void IpReassembly::updatePackageInTimestampMap(std::unique_ptr<pcpp::IPReassembly::PacketKey> packet_key)
+  //////////////////////////////////////////
+  //// Helper functions
+  //////////////////////////////////////////
+
+  size_t IpReassembly::hashKey(const DatagramKey& key)
   {
-    auto now = std::chrono::steady_clock::now();
+    // The identification is the part that changes between datagrams of the
+    // same sender, so it has to end up in the low bits that index the table.
+    uint64_t hash = (static_cast<uint64_t>(key.source_address) << 32) | key.destination_address;
+    hash ^= (static_cast<uint64_t>(key.protocol) << 16) | key.identification;
+    hash *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
 
-    auto package_it = timestamp_map_.find(packet_key->getHashValue());
-    if (package_it != timestamp_map_.end())
+  size_t IpReassembly::findSlot(const DatagramKey& key) const
+  {
+    for (size_t bucket = hashKey(key) & hash_index_mask_; hash_index_[bucket] != NO_SLOT; bucket = (bucket + 1) & hash_index_mask_)
     {
-      package_it->second.second = now;
+      if (slots_[hash_index_[bucket]].key == key)
+        return hash_index_[bucket];
     }
-    else
+    return NO_SLOT;
+  }
+
+  size_t IpReassembly::acquireSlot(const DatagramKey& key, std::chrono::steady_clock::time_point now)
+  {
+    if (free_slots_.empty())
     {
-      auto hash_value = packet_key->getHashValue();
-      timestamp_map_.emplace(hash_value, std::make_pair(std::move(packet_key), now));
+      // Drop the datagram that hasn't received any fragment for the longest time
+      releaseSlot(lru_head_);
     }
+
+    const size_t slot_index = free_slots_.back();
+    free_slots_.pop_back();
+    slots_in_use_++;
+
+    Slot& slot = slots_[slot_index];
+    if (!slot.data)
+      slot.data = std::make_unique<uint8_t[]>(SLOT_SIZE);
+
+    slot.key             = key;
+    slot.last_update     = now;
+    slot.header_length   = 0;
+    slot.payload_length  = 0;
+    slot.received_end    = 0;
+    slot.received_blocks = 0;
+    slot.received_bitmap.fill(0);
+    lruPushBack(slot_index);
+
+    size_t bucket = hashKey(key) & hash_index_mask_;
+    while (hash_index_[bucket] != NO_SLOT)
+      bucket = (bucket + 1) & hash_index_mask_;
+    hash_index_[bucket] = slot_index;
+
+    return slot_index;
   }
 
-  void IpReassembly::onFragmentsCleanCallback(const pcpp::IPReassembly::PacketKey* packt_key, void* this_ptr)
+  void IpReassembly::releaseSlot(size_t slot_index)
   {
-    IpReassembly* this_ = static_cast<IpReassembly*>(this_ptr);
-    auto it_to_erase = this_->timestamp_map_.find(packt_key->getHashValue());
+    Slot& slot = slots_[slot_index];
 
-    if(it_to_erase != this_->timestamp_map_.end())
+    // Find the bucket of the slot
+    size_t bucket = hashKey(slot.key) & hash_index_mask_;
+    while (hash_index_[bucket] != slot_index)
+      bucket = (bucket + 1) & hash_index_mask_;
+
+    // Remove it and shift back the following entries of the probe sequence,
+    // so lookups never stop at the hole we just created
+    size_t next_bucket = bucket;
+    for (;;)
     {
-      this_->timestamp_map_.erase(it_to_erase);
+      hash_index_[bucket] = NO_SLOT;
+
+      for (;;)
+      {
+        next_bucket = (next_bucket + 1) & hash_index_mask_;
+        if (hash_index_[next_bucket] == NO_SLOT)
+          break;
+
+        // Entries that may stay where they are, are the ones whose home
+        // bucket lies cyclically in (bucket, next_bucket]
+        const size_t home_bucket = hashKey(slots_[hash_index_[next_bucket]].key) & hash_index_mask_;
+        const bool   may_stay    = (bucket <= next_bucket)
+                                    ? ((bucket < home_bucket) && (home_bucket <= next_bucket))
+                                    : ((bucket < home_bucket) || (home_bucket <= next_bucket));
+        if (!may_stay)
+          break;
+      }
+
+      if (hash_index_[next_bucket] == NO_SLOT)
+        break;
+
+      hash_index_[bucket] = hash_index_[next_bucket];
+      bucket              = next_bucket;
     }
+
+    lruUnlink(slot_index);
+
+    free_slots_.push_back(slot_index);
+    slots_in_use_--;
+  }
+
+  void IpReassembly::lruUnlink(size_t slot_index)
+  {
+    Slot& slot = slots_[slot_index];
+
+    if (slot.lru_previous != NO_SLOT)
+      slots_[slot.lru_previous].lru_next = slot.lru_next;
+    else
+      lru_head_ = slot.lru_next;
+
+    if (slot.lru_next != NO_SLOT)
+      slots_[slot.lru_next].lru_previous = slot.lru_previous;
+    else
+      lru_tail_ = slot.lru_previous;
+
+    slot.lru_previous = NO_SLOT;
+    slot.lru_next     = NO_SLOT;
+  }
+
+  void IpReassembly::lruPushBack(size_t slot_index)
+  {
+    Slot& slot = slots_[slot_index];
+
+    slot.lru_previous = lru_tail_;
+    slot.lru_next     = NO_SLOT;
+
+    if (lru_tail_ != NO_SLOT)
+      slots_[lru_tail_].lru_next = slot_index;
     else
+      lru_head_ = slot_index;
+
+    lru_tail_ = slot_index;
+  }
+
+  size_t IpReassembly::markBlocksReceived(Slot& slot, size_t first_block, size_t end_block)
+  {
+    size_t newly_received_blocks = 0;
+
+    for (size_t block = first_block; block < end_block;)
     {
-      std::cerr << "Udpcap: Pcap++ deleted an IP Fragment that we did not know anything about!" << std::endl;
+      const size_t   word_index = block / 64;
+      const size_t   first_bit  = block % 64;
+      const size_t   end_bit    = std::min<size_t>(64, first_bit + (end_block - block));
+      const size_t   bit_count  = end_bit - first_bit;
+      const uint64_t mask       = (bit_count == 64 ? ~uint64_t(0) : ((uint64_t(1) << bit_count) - 1) << first_bit);
+
+      uint64_t&      word       = slot.received_bitmap[word_index];
+      const uint64_t new_bits = mask & ~word;
+      word |= mask;
+
+      newly_received_blocks += std::bitset<64>(new_bits).count();
+
+      block += bit_count;
     }
+
+    return newly_received_blocks;
   }
 }
@@ -16,138 +16,171 @@
 
 #pragma once
 
-#ifdef _MSC_VER
-#pragma warning( push )
-#pragma warning( disable: 4800 4200 4100)
-#endif // _MSC_VER
-#include <IPReassembly.h>   // Pcap++ de-fragmentation of IP packets
-#ifdef _MSC_VER
-#pragma warning( pop )
-#endif // _MSC_VER
+#include "packet_parser.h"
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 namespace Udpcap
 {
+  /**
+   * @brief Reassembly of fragmented IPv4 packets
+   *
+   * Datagrams are reassembled in 64 KiB slots. The buffer of a slot is
+   * allocated when the slot is used for the first time and reused afterwards,
+   * so there is no allocation per fragment or per datagram. Every fragment is
+   * copied straight to its final position in the slot. Received parts are
+   * tracked by a bitmap with one bit per 8 byte block (the unit of the IPv4
+   * fragment offset), so fragments may arrive in any order and may overlap.
+   *
+   * Datagrams are identified by (identification, source, destination,
+   * protocol) as required by RFC 791. The slot of a datagram is found via an
+   * open addressing hash index, that doesn't allocate any memory either.
+   *
+   * Datagrams that have not been completed within the maximum age are
+   * dropped. When all slots are in use, the oldest datagram is dropped to
+   * make room for a new one. The slots in use are kept in an intrusive list
+   * ordered by their last update, so both only ever look at the head of the
+   * list.
+   *
+   * The reassembler never reads the clock itself. The caller passes the
+   * current time, so it can read the clock once for an entire batch of
+   * fragments.
+   */
   class IpReassembly
   {
-
-  /////////////////////////////////////////
-  /// Constructor & Destructor
-  /////////////////////////////////////////
+  //////////////////////////////////////////
+  //// Helper Structs
+  //////////////////////////////////////////
+  private:
+    struct DatagramKey
+    {
+      uint32_t source_address;
+      uint32_t destination_address;
+      uint16_t identification;
+      uint8_t  protocol;
+
+      bool operator==(const DatagramKey& other) const
+      {
+        return (identification      == other.identification)
+            && (source_address      == other.source_address)
+            && (destination_address == other.destination_address)
+            && (protocol            == other.protocol);
+      }
+    };
+
+    static constexpr size_t MAX_HEADER_LENGTH  = 60;                            /**< IHL is 4 bit, counted in 32 bit words */
+    static constexpr size_t MAX_PAYLOAD_LENGTH = 65535 - 20;                    /**< Total length is 16 bit, minus the minimum header */
+    static constexpr size_t SLOT_SIZE          = MAX_HEADER_LENGTH + 65536;     /**< Header area + 64 KiB payload area */
+    static constexpr size_t BLOCK_COUNT        = 65536 / 8;                     /**< 8 byte blocks of the payload area */
+    static constexpr size_t BITMAP_WORDS       = BLOCK_COUNT / 64;
+
+    struct Slot
+    {
+      DatagramKey                           key;
+      std::chrono::steady_clock::time_point last_update;
+      size_t                                lru_previous;                       /**< Previous slot in the expiry list (updated less recently). NO_SLOT for the head. */
+      size_t                                lru_next;                           /**< Next slot in the expiry list (updated more recently). NO_SLOT for the tail. */
+      size_t                                header_length;                      /**< Length of the header of the first fragment. 0, if the first fragment has not been received, yet */
+      size_t                                payload_length;                     /**< Known once the last fragment has been received. 0 before. */
+      size_t                                received_end;                       /**< End of the received fragment with the highest offset, i.e. the payload length seen so far */
+      size_t                                received_blocks;
+      std::array<uint64_t, BITMAP_WORDS>    received_bitmap;                    /**< One bit per 8 byte block of the payload */
+      std::unique_ptr<uint8_t[]>            data;                               /**< SLOT_SIZE bytes. The header is stored so that it ends at MAX_HEADER_LENGTH, followed by the payload. nullptr until the slot is used for the first time. */
+    };
+
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
   public:
-	/**
-	  * A c'tor for this class.
-	  * 
-	  * @param[in] max_package_age The maximum age that a packet may have for being used for reassembly.
-	  * @param[in] max_packets_to_store Set the capacity limit of the IP reassembly mechanism. Default capacity is #PCPP_IP_REASSEMBLY_DEFAULT_MAX_PACKETS_TO_STORE
-	  */
-	IpReassembly(std::chrono::nanoseconds max_package_age, size_t max_packets_to_store = PCPP_IP_REASSEMBLY_DEFAULT_MAX_PACKETS_TO_STORE);
-
-	~IpReassembly() = default;
-
-	// Disable copy and move construction, as we need the this pointer as callback cookie. So this must never change.
-	IpReassembly ( const IpReassembly & ) = delete;
-	void operator=( const IpReassembly & ) = delete;
-	IpReassembly ( IpReassembly && ) = delete;
-	void operator=( const IpReassembly && ) = delete;
-
-
-  /////////////////////////////////////////
-  /// API borrowed from pcpp::IPReassembly
-  /////////////////////////////////////////
-  
+    /**
+     * @param max_package_age       The time after which an incomplete datagram is dropped
+     * @param max_packets_to_store  How many datagrams can be reassembled at the same time. Each one takes a 64 KiB slot.
+     */
+    explicit IpReassembly(std::chrono::nanoseconds max_package_age, size_t max_packets_to_store = 128);
+    ~IpReassembly() = default;
+
+    // Copy
+    IpReassembly(const IpReassembly&)            = delete;
+    IpReassembly& operator=(const IpReassembly&) = delete;
+
+    // Move
+    IpReassembly(IpReassembly&&)                 = delete;
+    IpReassembly& operator=(IpReassembly&&)      = delete;
+
+  //////////////////////////////////////////
+  //// API
+  //////////////////////////////////////////
   public:
-	/**
-	  * The main API that drives IPReassembly. This method should be called whenever a fragment arrives. This method finds the relevant
-	  * packet this fragment belongs to and runs the IP reassembly logic that is described in IPReassembly.h.
-	  * @param[in] fragment The fragment to process (IPv4 or IPv6). Please notice that the reassembly logic doesn't change or manipulate
-	  * this object in any way. All of its data is copied to internal structures and manipulated there
-	  * @param[out] status An indication of the packet reassembly status following the processing of this fragment. Possible values are:
-	  * - The input fragment is not a IPv4 or IPv6 packet
-	  * - The input fragment is not a IPv4 or IPv6 fragment packet
-	  * - The input fragment is the first fragment of the packet
-	  * - The input fragment is not the first or last fragment
-	  * - The input fragment came out-of-order, meaning that wasn't the fragment that was currently expected (it's data is copied to
-	  *   the out-of-order fragment list)
-	  * - The input fragment is malformed and will be ignored
-	  * - The input fragment is the last one and the packet is now fully reassembled. In this case the return value will contain
-	  *   a pointer to the reassebmled packet
-	  * @param[in] parse_until Optional parameter. Parse the reassembled packet until you reach a certain protocol (inclusive). Can be useful for cases when you need to parse only up to a
-	  * certain layer and want to avoid the performance impact and memory consumption of parsing the whole packet. Default value is ::UnknownProtocol which means don't take this
-	  * parameter into account
-	  * @param[in] parse_until_layer Optional parameter. Parse the reassembled packet until you reach a certain layer in the OSI model (inclusive). Can be useful for cases when you need to
-	  * parse only up to a certain OSI layer (for example transport layer) and want to avoid the performance impact and memory consumption of parsing the whole packet.
-	  * Default value is ::OsiModelLayerUnknown which means don't take this parameter into account
-	  * @return
-	  * - If the input fragment isn't an IPv4/IPv6 packet or if it isn't an IPv4/IPv6 fragment, the return value is a pointer to the input fragment
-	  * - If the input fragment is the last one and the reassembled packet is ready - a pointer to the reassembled packet is
-	  *   returned. Notice it's the user's responsibility to free this pointer when done using it
-	  * - If the reassembled packet isn't ready then NULL is returned
-	  */
-	pcpp::Packet* processPacket(pcpp::Packet* fragment, pcpp::IPReassembly::ReassemblyStatus& status, pcpp::ProtocolType parse_until = pcpp::UnknownProtocol, pcpp::OsiModelLayer parse_until_layer = pcpp::OsiModelLayerUnknown);
-
-	/**
-	  * The main API that drives IPReassembly. This method should be called whenever a fragment arrives. This method finds the relevant
-	  * packet this fragment belongs to and runs the IPv4 reassembly logic that is described in IPReassembly.h.
-	  * @param[in] fragment The fragment to process (IPv4 or IPv6). Please notice that the reassembly logic doesn't change or manipulate
-	  * this object in any way. All of its data is copied to internal structures and manipulated there
-	  * @param[out] status An indication of the packet reassembly status following the processing of this fragment. Possible values are:
-	  * - The input fragment is not a IPv4 or IPv6 packet
-	  * - The input fragment is not a IPv4 or IPv6 fragment packet
-	  * - The input fragment is the first fragment of the packet
-	  * - The input fragment is not the first or last fragment
-	  * - The input fragment came out-of-order, meaning that wasn't the fragment that was currently expected (it's data is copied to
-	  *   the out-of-order fragment list)
-	  * - The input fragment is malformed and will be ignored
-	  * - The input fragment is the last one and the packet is now fully reassembled. In this case the return value will contain
-	  *   a pointer to the reassebmled packet
-	  * @param[in] parse_until Optional parameter. Parse the raw and reassembled packets until you reach a certain protocol (inclusive). Can be useful for cases when you need to parse only up to a
-	  * certain layer and want to avoid the performance impact and memory consumption of parsing the whole packet. Default value is ::UnknownProtocol which means don't take this
-	  * parameter into account
-	  * @param[in] parse_until_layer Optional parameter. Parse the raw and reassembled packets until you reach a certain layer in the OSI model (inclusive). Can be useful for cases when you need to
-	  * parse only up to a certain OSI layer (for example transport layer) and want to avoid the performance impact and memory consumption of parsing the whole packet.
-	  * Default value is ::OsiModelLayerUnknown which means don't take this parameter into account
-	  * @return
-	  * - If the input fragment isn't an IPv4/IPv6 packet or if it isn't an IPv4/IPv6 fragment, the return value is a pointer to a Packet object
-	  *   wrapping the input fragment RawPacket object. It's the user responsibility to free this instance
-	  * - If the input fragment is the last one and the reassembled packet is ready - a pointer to the reassembled packet is
-	  *   returned. Notice it's the user's responsibility to free this pointer when done using it
-	  * - If the reassembled packet isn't ready then NULL is returned
-	  */
-	pcpp::Packet* processPacket(pcpp::RawPacket* fragment, pcpp::IPReassembly::ReassemblyStatus& status, pcpp::ProtocolType parse_until = pcpp::UnknownProtocol, pcpp::OsiModelLayer parse_until_layer = pcpp::OsiModelLayerUnknown);
-
-	/**
-	  * Get the maximum capacity as determined in the c'tor
-	  */
-	size_t getMaxCapacity() const { return ip_reassembly_.getMaxCapacity(); }
-
-	/**
-	  * Get the current number of packets being processed
-	  */
-	size_t getCurrentCapacity() const { return ip_reassembly_.getCurrentCapacity(); }
-
-  /////////////////////////////////////////
-  /// Helper functions
-  /////////////////////////////////////////
+    /**
+     * @brief Processes one fragment of an IPv4 packet
+     *
+     * The fragment is copied, so its buffer may be re-used after the call.
+     *
+     * @param fragment            The parsed fragment. Must be a fragment (is_fragment == true).
+     * @param now                 The current time. Must not go backwards between calls.
+     * @param reassembled_packet  [out] The reassembled IPv4 packet (without the fragmentation flags), if this fragment completed it.
+     *                            It points into the internal slab and is valid until the next call of processFragment().
+     *
+     * @return True if the fragment completed a packet
+     */
+    bool processFragment(const PacketParser::Ipv4Packet& fragment, std::chrono::steady_clock::time_point now, PacketParser::Ipv4Packet& reassembled_packet);
+
+    /**
+     * @brief Drops all datagrams that have not been completed within the maximum age
+     *
+     * This is done by processFragment() as well. Calling it while waiting for
+     * new packets frees the slots of abandoned datagrams without any cost on
+     * the packet path.
+     *
+     * @param now  The current time. Must not go backwards between calls.
+     */
+    void removeOldPackages(std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief The maximum number of datagrams that can be reassembled at the same time
+     */
+    size_t getMaxCapacity() const { return slots_.size(); }
+
+    /**
+     * @brief The number of datagrams that are currently being reassembled
+     */
+    size_t getCurrentCapacity() const { return slots_in_use_; }
+
+  //////////////////////////////////////////
+  //// Helper functions
+  //////////////////////////////////////////
   private:
+    static size_t hashKey(const DatagramKey& key);
 
-	static std::unique_ptr<pcpp::IPReassembly::PacketKey> getPacketKey(const pcpp::Packet* packet);
+    size_t findSlot(const DatagramKey& key) const;
+    size_t acquireSlot(const DatagramKey& key, std::chrono::steady_clock::time_point now);
+    void   releaseSlot(size_t slot_index);
 
-	void removeOldPackages();
-	void removePackageFromTimestampMap(std::unique_ptr<pcpp::IPReassembly::PacketKey> packet_key);
-	void updatePackageInTimestampMap  (std::unique_ptr<pcpp::IPReassembly::PacketKey> packet_key);
+    void   lruUnlink  (size_t slot_index);
+    void   lruPushBack(size_t slot_index);
 
-	static void onFragmentsCleanCallback(const pcpp::IPReassembly::PacketKey* packt_key, void* this_ptr);
+    static size_t markBlocksReceived(Slot& slot, size_t first_block, size_t end_block);
 
-  /////////////////////////////////////////
-  /// Member variables
-  /////////////////////////////////////////
+  //////////////////////////////////////////
+  //// Member variables
+  //////////////////////////////////////////
   private:
-    const std::chrono::nanoseconds                            max_package_age_;
-    pcpp::IPReassembly                                        ip_reassembly_;
-    std::unordered_map<int32_t, std::pair<std::unique_ptr<pcpp::IPReassembly::PacketKey>, std::chrono::steady_clock::time_point>> timestamp_map_;
+    static constexpr size_t NO_SLOT = static_cast<size_t>(-1);
+
+    const std::chrono::nanoseconds max_package_age_;
+
+    std::vector<Slot>              slots_;
+    std::vector<size_t>            free_slots_;                                 /**< Stack of indices of unused slots */
+    size_t                         slots_in_use_;
+    size_t                         lru_head_;                                   /**< Slot that has been updated least recently */
+    size_t                         lru_tail_;                                   /**< Slot that has been updated most recently */
+
+    std::vector<size_t>            hash_index_;                                 /**< Open addressing (linear probing) index of slot indices, NO_SLOT for empty buckets. Size is a power of 2. */
+    size_t                         hash_index_mask_;
   };
-}
\ No newline at end of file
+}
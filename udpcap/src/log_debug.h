@@ -29,7 +29,7 @@ namespace Udpcap
 #endif // !NDEBUG
   }
 
-  inline static void LOG_DEBUG(char* message)
+  inline static void LOG_DEBUG(const char* message)
   {
 #ifndef NDEBUG
     LOG_DEBUG(std::string(message));
@@ -0,0 +1,183 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "memory_capture_source.h"
+
+#include "pcap_capture_source.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  MemoryCaptureSource::MemoryCaptureSource(const std::vector<std::vector<char>>& frames, size_t repetitions)
+    : frame_matches_filter_ (std::make_unique<std::atomic<bool>[]>(frames.size()))
+    , repetitions_          (repetitions)
+    , completed_repetitions_(0)
+    , next_frame_index_     (0)
+#ifdef _WIN32
+    , wait_handle_          (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wait_handle_          (-1) // poll() ignores negative file descriptors
+#endif // _WIN32
+    , is_closed_            (false)
+  {
+    size_t total_size = 0;
+    for (const auto& frame : frames)
+      total_size += frame.size();
+
+    frame_buffer_ .reserve(total_size);
+    frame_headers_.reserve(frames.size());
+    frame_data_   .reserve(frames.size());
+
+    std::vector<size_t> frame_offsets;
+    frame_offsets.reserve(frames.size());
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      frame_offsets.push_back(frame_buffer_.size());
+      frame_buffer_.insert(frame_buffer_.end(), frames[i].begin(), frames[i].end());
+
+      pcap_pkthdr header{};
+      header.caplen = static_cast<uint32_t>(frames[i].size());
+      header.len    = static_cast<uint32_t>(frames[i].size());
+      frame_headers_.push_back(header);
+
+      // Until a filter is set, every frame is captured
+      frame_matches_filter_[i].store(true, std::memory_order_relaxed);
+    }
+
+    // The buffer doesn't grow anymore, so the pointers stay valid
+    for (const size_t frame_offset : frame_offsets)
+      frame_data_.push_back(frame_buffer_.data() + frame_offset);
+  }
+
+  MemoryCaptureSource::~MemoryCaptureSource()
+  {
+    close();
+  }
+
+  //////////////////////////////////////////
+  //// CaptureSource API
+  //////////////////////////////////////////
+
+  int MemoryCaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    if (is_closed_)
+    {
+      last_error_ = "Capture source closed";
+      return PCAP_ERROR_NOT_ACTIVATED;
+    }
+
+    for (;;)
+    {
+      if (next_frame_index_ >= frame_headers_.size())
+      {
+        completed_repetitions_++;
+        if (frame_headers_.empty() || ((repetitions_ != 0) && (completed_repetitions_ >= repetitions_)))
+          return PCAP_ERROR_BREAK;
+
+        next_frame_index_ = 0;
+      }
+
+      const size_t frame_index = next_frame_index_++;
+
+      if (frame_matches_filter_[frame_index].load(std::memory_order_relaxed))
+      {
+        *header = &frame_headers_[frame_index];
+        *data   = frame_data_[frame_index];
+        return 1;
+      }
+    }
+  }
+
+  int MemoryCaptureSource::datalink() const
+  {
+    return DLT_EN10MB;
+  }
+
+  int MemoryCaptureSource::timestampPrecision() const
+  {
+    return PCAP_TSTAMP_PRECISION_MICRO; // The frames don't have a timestamp
+  }
+
+  bool MemoryCaptureSource::setFilter(const std::string& filter_string)
+  {
+    pcap_t* dead_pcap_handle = pcap_open_dead(DLT_EN10MB, 65535);
+    if (dead_pcap_handle == nullptr)
+    {
+      last_error_ = "Unable to create pcap handle for compiling filter";
+      return false;
+    }
+
+    bpf_program filter_program{};
+    if (PcapCaptureSource::compileFilter(dead_pcap_handle, &filter_program, filter_string) == PCAP_ERROR)
+    {
+      last_error_ = pcap_geterr(dead_pcap_handle);
+      pcap_perror(dead_pcap_handle, ("UdpcapSocket ERROR: Unable to compile filter \"" + filter_string + "\"").c_str());
+      pcap_close(dead_pcap_handle);
+      return false;
+    }
+
+    for (size_t i = 0; i < frame_headers_.size(); i++)
+    {
+      const bool matches = (pcap_offline_filter(&filter_program, &frame_headers_[i], frame_data_[i]) != 0);
+      frame_matches_filter_[i].store(matches, std::memory_order_relaxed);
+    }
+
+    pcap_freecode(&filter_program);
+    pcap_close(dead_pcap_handle);
+
+    return true;
+  }
+
+  NativeWaitHandle MemoryCaptureSource::getWaitHandle() const
+  {
+    return wait_handle_;
+  }
+
+  pcap_t* MemoryCaptureSource::getPcapHandle() const
+  {
+    return nullptr;
+  }
+
+  std::string MemoryCaptureSource::getLastError() const
+  {
+    return last_error_;
+  }
+
+  void MemoryCaptureSource::close()
+  {
+#ifdef _WIN32
+    if (wait_handle_ != nullptr)
+    {
+      CloseHandle(wait_handle_);
+      wait_handle_ = nullptr;
+    }
+#endif // _WIN32
+
+    is_closed_ = true;
+  }
+}
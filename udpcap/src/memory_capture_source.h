@@ -0,0 +1,85 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Udpcap
+{
+  /**
+   * @brief CaptureSource handing out prebuilt Ethernet frames from memory
+   *
+   * This source exists for measuring the CPU cost of the receive path itself
+   * (parsing, reassembly and copying) without any driver or kernel involved.
+   * All frames are stored in one contiguous buffer and nextPacket() only
+   * advances an index, so the source is never the bottleneck.
+   *
+   * The frames are handed out in order. After the last frame, the source
+   * starts over with the first one, until the frames have been handed out
+   * the given number of times.
+   *
+   * As the frames never change, the capture filter is evaluated once per
+   * frame when it is set, not every time the frame is handed out.
+   */
+  class MemoryCaptureSource : public CaptureSource
+  {
+  public:
+    /**
+     * @param frames       The Ethernet frames
+     * @param repetitions  How often the entire list of frames is handed out. 0 means forever.
+     */
+    MemoryCaptureSource(const std::vector<std::vector<char>>& frames, size_t repetitions);
+    ~MemoryCaptureSource() override;
+
+    // Copy
+    MemoryCaptureSource(const MemoryCaptureSource&)            = delete;
+    MemoryCaptureSource& operator=(const MemoryCaptureSource&) = delete;
+
+    // Move
+    MemoryCaptureSource(MemoryCaptureSource&&)                 = delete;
+    MemoryCaptureSource& operator=(MemoryCaptureSource&&)      = delete;
+
+    int              nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    int              datalink() const override;
+    int              timestampPrecision() const override;
+    bool             setFilter(const std::string& filter_string) override;
+    NativeWaitHandle getWaitHandle() const override;
+    pcap_t*          getPcapHandle() const override;
+    std::string      getLastError() const override;
+    void             close() override;
+
+  private:
+    std::vector<u_char>                     frame_buffer_;                      /**< All frames, back to back */
+    std::vector<pcap_pkthdr>                frame_headers_;
+    std::vector<const u_char*>              frame_data_;                        /**< Pointers into frame_buffer_. In sync with frame_headers_. */
+    std::unique_ptr<std::atomic<bool>[]>    frame_matches_filter_;              /**< Result of the capture filter for each frame. In sync with frame_headers_. */
+
+    const size_t                            repetitions_;
+    size_t                                  completed_repetitions_;
+    size_t                                  next_frame_index_;
+
+    NativeWaitHandle                        wait_handle_;                       /**< Handle that is never signaled, as the receive loop needs something to wait on */
+    bool                                    is_closed_;
+    std::string                             last_error_;
+  };
+}
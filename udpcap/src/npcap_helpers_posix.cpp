@@ -0,0 +1,144 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ * 
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ * 
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+// libpcap implementation of the npcap_helpers API. On POSIX systems there is
+// no driver that needs to be loaded and no registry to query, so this file
+// only has to find the loopback device and check that libpcap is able to
+// enumerate the network devices.
+
+#include "udpcap/npcap_helpers.h"
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include <pcap/pcap.h>
+
+namespace Udpcap
+{
+  namespace // Private Namespace
+  {
+    std::mutex npcap_mutex;
+    bool is_initialized(false);
+
+    std::string loopback_device_name;
+    bool loopback_device_name_initialized(false);
+
+    std::string human_readible_error_("libpcap has not been initialized, yet");
+
+    bool LoadLoopbackDeviceName_NoLock()
+    {
+      std::array<char, PCAP_ERRBUF_SIZE> errbuf{};
+      pcap_if_t* alldevs_rawptr = nullptr;
+
+      if (pcap_findalldevs(&alldevs_rawptr, errbuf.data()) == -1)
+      {
+        human_readible_error_ = "Error in pcap_findalldevs: " + std::string(errbuf.data());
+        fprintf(stderr, "Error in pcap_findalldevs: %s\n", errbuf.data());
+        if (alldevs_rawptr != nullptr)
+          pcap_freealldevs(alldevs_rawptr);
+        return false;
+      }
+
+      // libpcap flags the loopback interface ("lo" on Linux, "lo0" on BSD
+      // derived systems), so we don't have to guess its name.
+      for (pcap_if_t* pcap_dev = alldevs_rawptr; pcap_dev != nullptr; pcap_dev = pcap_dev->next)
+      {
+        if ((pcap_dev->flags & PCAP_IF_LOOPBACK) != 0)
+        {
+          loopback_device_name = pcap_dev->name;
+          break;
+        }
+      }
+
+      pcap_freealldevs(alldevs_rawptr);
+
+      if (loopback_device_name.empty())
+      {
+        human_readible_error_ = "Loopback device is inaccessible. Please check that the user is allowed to capture network traffic (e.g. CAP_NET_RAW and CAP_NET_ADMIN on Linux).";
+        std::cerr << "Udpcap ERROR: " << human_readible_error_ << std::endl;
+        return false;
+      }
+
+      return true;
+    }
+  }
+
+  bool Initialize()
+  {
+    const std::lock_guard<std::mutex> npcap_lock(npcap_mutex);
+
+    if (is_initialized) return true;
+
+    human_readible_error_ = "Unknown error";
+
+    std::cout << "Udpcap: Initializing libpcap (" << pcap_lib_version() << ")..." << std::endl;
+
+    loopback_device_name_initialized = LoadLoopbackDeviceName_NoLock();
+    if (!loopback_device_name_initialized)
+    {
+      return false;
+    }
+
+    std::cout << "Udpcap: Using Loopback device " << loopback_device_name << std::endl;
+
+    human_readible_error_ = "libpcap is ready";
+    std::cout << "Udpcap: " << human_readible_error_ << std::endl;
+
+    is_initialized = true;
+    return true;
+  }
+
+  bool IsInitialized()
+  {
+    const std::lock_guard<std::mutex> npcap_lock(npcap_mutex);
+    return is_initialized;
+  }
+
+  std::string GetLoopbackDeviceUuidString()
+  {
+    // Loopback devices are not identified by a UUID on POSIX systems
+    return "";
+  }
+
+  std::string GetLoopbackDeviceName()
+  {
+    const std::lock_guard<std::mutex> npcap_lock(npcap_mutex);
+
+    if (!loopback_device_name_initialized)
+    {
+      loopback_device_name_initialized = LoadLoopbackDeviceName_NoLock();
+    }
+
+    if (!loopback_device_name.empty())
+      return loopback_device_name;
+    else
+      return "lo";
+  }
+
+  bool IsLoopbackDevice(const std::string& device_name)
+  {
+    return device_name == GetLoopbackDeviceName();
+  }
+
+  std::string GetHumanReadibleErrorText()
+  {
+    const std::lock_guard<std::mutex> npcap_lock(npcap_mutex);
+    return human_readible_error_;
+  }
+}
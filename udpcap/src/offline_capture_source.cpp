@@ -0,0 +1,145 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "offline_capture_source.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  std::unique_ptr<OfflineCaptureSource> OfflineCaptureSource::open(const std::string& file_path, ReplayPacing pacing, double speed_factor)
+  {
+    std::array<char, PCAP_ERRBUF_SIZE> errbuf{};
+
+    // pcap_open_offline() detects pcap and pcapng files by their magic number.
+    // Files with microsecond timestamps are scaled to nanoseconds by libpcap.
+    pcap_t* pcap_handle = pcap_open_offline_with_tstamp_precision(file_path.c_str(), PCAP_TSTAMP_PRECISION_NANO, errbuf.data());
+
+    if (pcap_handle == nullptr)
+    {
+      fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Unable to open capture file " + file_path + ": " + errbuf.data()).c_str());
+      return nullptr;
+    }
+
+    return std::unique_ptr<OfflineCaptureSource>(new OfflineCaptureSource(pcap_handle, pacing, speed_factor));
+  }
+
+  OfflineCaptureSource::OfflineCaptureSource(pcap_t* pcap_handle, ReplayPacing pacing, double speed_factor)
+    : PcapCaptureSource     (pcap_handle)
+#ifdef _WIN32
+    , wait_handle_          (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wait_handle_          (-1) // poll() ignores negative file descriptors
+#endif // _WIN32
+    , pacing_               (pacing)
+    , speed_factor_         (pacing == ReplayPacing::OriginalTiming ? 1.0 : speed_factor)
+    , replay_started_       (false)
+    , first_capture_time_ns_(0)
+    , has_pending_packet_   (false)
+    , pending_header_       (nullptr)
+    , pending_data_         (nullptr)
+  {}
+
+  OfflineCaptureSource::~OfflineCaptureSource()
+  {
+    close();
+  }
+
+  //////////////////////////////////////////
+  //// CaptureSource API
+  //////////////////////////////////////////
+
+  int OfflineCaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    if (!has_pending_packet_)
+    {
+      const int pcap_next_packet_errorcode = PcapCaptureSource::nextPacket(&pending_header_, &pending_data_);
+
+      // PCAP_ERROR_BREAK means that we have reached the end of the file
+      if (pcap_next_packet_errorcode != 1)
+        return pcap_next_packet_errorcode;
+
+      has_pending_packet_ = true;
+
+      if (pacing_ != ReplayPacing::AsFastAsPossible)
+      {
+        const int64_t capture_time_ns = static_cast<int64_t>(pending_header_->ts.tv_sec) * 1000000000 + static_cast<int64_t>(pending_header_->ts.tv_usec);
+
+        if (!replay_started_)
+        {
+          replay_started_        = true;
+          replay_start_time_     = std::chrono::steady_clock::now();
+          first_capture_time_ns_ = capture_time_ns;
+        }
+
+        // Frames are not necessarily sorted by their timestamps (e.g. when
+        // the file was merged from multiple interfaces). We release frames
+        // that appear to be from the past immediately.
+        const int64_t replay_offset_ns = std::max<int64_t>(capture_time_ns - first_capture_time_ns_, 0);
+        pending_ready_time_ = replay_start_time_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::nano>(static_cast<double>(replay_offset_ns) / speed_factor_));
+      }
+    }
+
+    if ((pacing_ != ReplayPacing::AsFastAsPossible) && (std::chrono::steady_clock::now() < pending_ready_time_))
+    {
+      // The frame is not due, yet
+      return 0;
+    }
+
+    has_pending_packet_ = false;
+
+    *header = pending_header_;
+    *data   = pending_data_;
+    return 1;
+  }
+
+  NativeWaitHandle OfflineCaptureSource::getWaitHandle() const
+  {
+    return wait_handle_;
+  }
+
+  std::chrono::steady_clock::time_point OfflineCaptureSource::readyTime() const
+  {
+    if (has_pending_packet_)
+      return pending_ready_time_;
+    else
+      return std::chrono::steady_clock::time_point::max();
+  }
+
+  void OfflineCaptureSource::close()
+  {
+#ifdef _WIN32
+    if (wait_handle_ != nullptr)
+    {
+      CloseHandle(wait_handle_);
+      wait_handle_ = nullptr;
+    }
+#endif // _WIN32
+
+    has_pending_packet_ = false;
+    PcapCaptureSource::close();
+  }
+}
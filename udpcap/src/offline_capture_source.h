@@ -0,0 +1,90 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+#include "pcap_capture_source.h"
+
+#include <udpcap/udpcap_socket.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Udpcap
+{
+  /**
+   * @brief CaptureSource replaying a pcap or pcapng capture file
+   *
+   * The frames are read with libpcap / Npcap, so the datalink type and the
+   * filters work just like with a live PcapCaptureSource. Depending on the
+   * pacing, a frame is held back until its replay time has come: The first
+   * frame is released immediately, every following frame once the time
+   * difference to the first frame (as recorded in the file and divided by the
+   * speed factor) has elapsed.
+   *
+   * A capture file never signals the wait handle. The receive loop learns
+   * about the next frame through readyTime() instead.
+   */
+  class OfflineCaptureSource : public PcapCaptureSource
+  {
+  public:
+    /**
+     * @brief Opens the given capture file
+     *
+     * @param file_path     Path of a pcap or pcapng file
+     * @param pacing        When to release the frames
+     * @param speed_factor  Replay speed relative to the original timing. Only used with ReplayPacing::Scaled.
+     *
+     * @return The capture source or nullptr, if the file could not be opened
+     */
+    static std::unique_ptr<OfflineCaptureSource> open(const std::string& file_path, ReplayPacing pacing, double speed_factor);
+
+    ~OfflineCaptureSource() override;
+
+    // Copy
+    OfflineCaptureSource(const OfflineCaptureSource&)            = delete;
+    OfflineCaptureSource& operator=(const OfflineCaptureSource&) = delete;
+
+    // Move
+    OfflineCaptureSource(OfflineCaptureSource&&)                 = delete;
+    OfflineCaptureSource& operator=(OfflineCaptureSource&&)      = delete;
+
+    int                                   nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    NativeWaitHandle                      getWaitHandle() const override;
+    std::chrono::steady_clock::time_point readyTime() const override;
+    void                                  close() override;
+
+  private:
+    OfflineCaptureSource(pcap_t* pcap_handle, ReplayPacing pacing, double speed_factor);
+
+  private:
+    NativeWaitHandle                      wait_handle_;                         /**< Handle that is never signaled, as the receive loop needs something to wait on */
+    const ReplayPacing                    pacing_;
+    const double                          speed_factor_;
+
+    bool                                  replay_started_;                      /**< Whether the first frame has been read, i.e. replay_start_time_ and first_capture_time_ns_ are valid */
+    std::chrono::steady_clock::time_point replay_start_time_;                   /**< Time at which the first frame has been released */
+    int64_t                               first_capture_time_ns_;               /**< Capture timestamp of the first frame in nanoseconds */
+
+    bool                                  has_pending_packet_;                  /**< Whether a frame has been read from the file, but is not due, yet */
+    pcap_pkthdr*                          pending_header_;
+    const u_char*                         pending_data_;
+    std::chrono::steady_clock::time_point pending_ready_time_;                  /**< Time at which the pending frame is due */
+  };
+}
@@ -0,0 +1,305 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <pcap.h>           // DLT_ values
+
+// Minimal parser for the headers that Udpcap needs from a captured frame.
+//
+// All functions work in place on the capture buffer. They never allocate
+// memory and never read past the given length. Multi-byte fields are read
+// byte-wise, so the headers don't have to be aligned.
+
+namespace Udpcap
+{
+  namespace PacketParser
+  {
+    /**
+     * @brief The parts of an IPv4 packet that Udpcap is interested in
+     *
+     * The pointers point into the buffer that has been parsed.
+     */
+    struct Ipv4Packet
+    {
+      const uint8_t* header;                /**< Start of the IPv4 header */
+      size_t         length;                /**< Length of the IPv4 packet (header + payload). This excludes link-layer padding. */
+      const uint8_t* payload;               /**< Start of the IPv4 payload */
+      size_t         payload_length;        /**< Available payload bytes. May be less than the IPv4 header states, if the frame has been truncated. */
+      uint32_t       source_address;        /**< Network byte order */
+      uint32_t       destination_address;   /**< Network byte order */
+      uint16_t       identification;
+      uint8_t        protocol;
+      bool           is_fragment;           /**< Whether the "more fragments" flag or a fragment offset is set */
+    };
+
+    /**
+     * @brief The parts of a UDP datagram that Udpcap is interested in
+     */
+    struct UdpDatagram
+    {
+      uint16_t       source_port;
+      uint16_t       destination_port;
+      const uint8_t* payload;               /**< Start of the UDP payload */
+      size_t         payload_length;        /**< Available payload bytes. May be less than the UDP header states, if the frame has been truncated. */
+      size_t         datagram_length;       /**< Payload length stated by the UDP header */
+      bool           is_truncated;          /**< Whether payload_length is less than datagram_length */
+    };
+
+    constexpr uint16_t ETHERTYPE_IPV4           = 0x0800;
+    constexpr uint16_t ETHERTYPE_VLAN           = 0x8100;
+    constexpr uint16_t ETHERTYPE_QINQ           = 0x88A8;
+    constexpr uint8_t  IP_PROTOCOL_UDP          = 17;
+    constexpr size_t   ETHERNET_HEADER_LENGTH   = 14;
+    constexpr size_t   VLAN_TAG_LENGTH          = 4;
+    constexpr size_t   LINUX_SLL_HEADER_LENGTH  = 16;
+    constexpr size_t   LINUX_SLL2_HEADER_LENGTH = 20;
+    constexpr size_t   IPV4_MIN_HEADER_LENGTH   = 20;
+    constexpr size_t   UDP_HEADER_LENGTH        = 8;
+
+    inline uint16_t readUint16(const uint8_t* data)
+    {
+      return static_cast<uint16_t>((static_cast<uint16_t>(data[0]) << 8) | data[1]);
+    }
+
+    /**
+     * @brief Function skipping the link-layer header of a frame
+     *
+     * @param frame         The captured frame
+     * @param frame_length  The number of captured bytes
+     * @param ip_data       [out] Start of the IPv4 packet
+     * @param ip_length     [out] Bytes available from ip_data on
+     *
+     * @return True if the frame carries an IPv4 packet
+     */
+    using LinkLayerDecoder = bool (*)(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length);
+
+    /**
+     * @brief Link-layer decoder for the given DLT_ value
+     *
+     * Only the specializations below exist. Use getLinkLayerDecoder() to
+     * select one at runtime.
+     */
+    template <int Datalink>
+    bool decodeLinkLayer(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length);
+
+    // Ethernet, including up to two VLAN tags (802.1Q / 802.1ad).
+    // Also used by the Linux loopback device.
+    template <>
+    inline bool decodeLinkLayer<DLT_EN10MB>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      if (frame_length < ETHERNET_HEADER_LENGTH)
+        return false;
+
+      size_t   offset    = ETHERNET_HEADER_LENGTH;
+      uint16_t ethertype = readUint16(frame + 12);
+
+      for (int i = 0; (i < 2) && ((ethertype == ETHERTYPE_VLAN) || (ethertype == ETHERTYPE_QINQ)); i++)
+      {
+        if (frame_length < offset + VLAN_TAG_LENGTH)
+          return false;
+
+        ethertype = readUint16(frame + offset + 2);
+        offset   += VLAN_TAG_LENGTH;
+      }
+
+      if (ethertype != ETHERTYPE_IPV4)
+        return false;
+
+      ip_data   = frame + offset;
+      ip_length = frame_length - offset;
+      return true;
+    }
+
+    // BSD loopback with a 4 byte address family. DLT_NULL uses the byte order
+    // of the capturing machine, which is not necessarily ours, DLT_LOOP uses
+    // network byte order. AF_INET is 2 on all platforms. This is what the
+    // Npcap loopback adapter delivers.
+    inline bool decodeBsdLoopback(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      if (frame_length < 4)
+        return false;
+
+      const bool is_inet = ((frame[0] == 2) && (frame[1] == 0) && (frame[2] == 0) && (frame[3] == 0))
+                        || ((frame[0] == 0) && (frame[1] == 0) && (frame[2] == 0) && (frame[3] == 2));
+      if (!is_inet)
+        return false;
+
+      ip_data   = frame + 4;
+      ip_length = frame_length - 4;
+      return true;
+    }
+
+    template <>
+    inline bool decodeLinkLayer<DLT_NULL>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      return decodeBsdLoopback(frame, frame_length, ip_data, ip_length);
+    }
+
+    template <>
+    inline bool decodeLinkLayer<DLT_LOOP>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      return decodeBsdLoopback(frame, frame_length, ip_data, ip_length);
+    }
+
+    // Linux "cooked" capture v1, used by the "any" device of older libpcap
+    // versions. 16 byte header with the protocol type in the last 2 bytes.
+    template <>
+    inline bool decodeLinkLayer<DLT_LINUX_SLL>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      if ((frame_length < LINUX_SLL_HEADER_LENGTH) || (readUint16(frame + 14) != ETHERTYPE_IPV4))
+        return false;
+
+      ip_data   = frame + LINUX_SLL_HEADER_LENGTH;
+      ip_length = frame_length - LINUX_SLL_HEADER_LENGTH;
+      return true;
+    }
+
+#ifdef DLT_LINUX_SLL2
+    // Linux "cooked" capture v2, used by the "any" device. 20 byte header
+    // with the protocol type in the first 2 bytes.
+    template <>
+    inline bool decodeLinkLayer<DLT_LINUX_SLL2>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      if ((frame_length < LINUX_SLL2_HEADER_LENGTH) || (readUint16(frame) != ETHERTYPE_IPV4))
+        return false;
+
+      ip_data   = frame + LINUX_SLL2_HEADER_LENGTH;
+      ip_length = frame_length - LINUX_SLL2_HEADER_LENGTH;
+      return true;
+    }
+#endif // DLT_LINUX_SLL2
+
+    // Raw IP without any link-layer header, e.g. from tunnel devices. The
+    // IP version is checked by parseIpv4().
+    template <>
+    inline bool decodeLinkLayer<DLT_RAW>(const uint8_t* frame, size_t frame_length, const uint8_t*& ip_data, size_t& ip_length)
+    {
+      ip_data   = frame;
+      ip_length = frame_length;
+      return true;
+    }
+
+    /**
+     * @brief Selects the link-layer decoder for a capture device
+     *
+     * This is meant to be called once when opening the device, so the
+     * receive path doesn't have to look at the link type for every packet.
+     *
+     * @param datalink  The DLT_ value of the capture device
+     *
+     * @return The decoder or nullptr, if the link type is not supported
+     */
+    inline LinkLayerDecoder getLinkLayerDecoder(int datalink)
+    {
+      switch (datalink)
+      {
+      case DLT_EN10MB:      return &decodeLinkLayer<DLT_EN10MB>;
+      case DLT_NULL:        return &decodeLinkLayer<DLT_NULL>;
+      case DLT_LOOP:        return &decodeLinkLayer<DLT_LOOP>;
+      case DLT_LINUX_SLL:   return &decodeLinkLayer<DLT_LINUX_SLL>;
+#ifdef DLT_LINUX_SLL2
+      case DLT_LINUX_SLL2:  return &decodeLinkLayer<DLT_LINUX_SLL2>;
+#endif // DLT_LINUX_SLL2
+      case DLT_RAW:         return &decodeLinkLayer<DLT_RAW>;
+#ifdef DLT_IPV4
+      case DLT_IPV4:        return &decodeLinkLayer<DLT_RAW>;   // Same as DLT_RAW, but only IPv4
+#endif // DLT_IPV4
+      default:              return nullptr;
+      }
+    }
+
+    /**
+     * @brief Parses an IPv4 header
+     *
+     * @param data    Start of the IPv4 packet
+     * @param length  Bytes available from data on
+     * @param packet  [out] The parsed packet
+     *
+     * @return True if data contains a valid IPv4 header
+     */
+    inline bool parseIpv4(const uint8_t* data, size_t length, Ipv4Packet& packet)
+    {
+      if (length < IPV4_MIN_HEADER_LENGTH)
+        return false;
+
+      // Version must be 4
+      if ((data[0] >> 4) != 4)
+        return false;
+
+      const size_t header_length = static_cast<size_t>(data[0] & 0x0F) * 4;
+      const size_t total_length  = readUint16(data + 2);
+
+      if ((header_length < IPV4_MIN_HEADER_LENGTH) || (header_length > length) || (total_length < header_length))
+        return false;
+
+      // Ethernet may have padded the packet, and the capture may have cut it
+      // off. Never look at anything beyond the IP packet or the captured data.
+      const size_t available_length = (total_length < length ? total_length : length);
+
+      const uint16_t flags_and_fragment_offset = readUint16(data + 6);
+
+      packet.header         = data;
+      packet.length         = available_length;
+      packet.payload        = data + header_length;
+      packet.payload_length = available_length - header_length;
+      packet.identification = readUint16(data + 4);
+      packet.protocol       = data[9];
+      packet.is_fragment    = ((flags_and_fragment_offset & 0x3FFF) != 0); // More fragments flag or fragment offset
+      memcpy(&packet.source_address,      data + 12, sizeof(packet.source_address));
+      memcpy(&packet.destination_address, data + 16, sizeof(packet.destination_address));
+
+      return true;
+    }
+
+    /**
+     * @brief Parses the UDP header of an un-fragmented IPv4 packet
+     *
+     * @param packet    The IPv4 packet
+     * @param datagram  [out] The parsed UDP datagram
+     *
+     * @return True if the IPv4 packet carries a valid UDP header
+     */
+    inline bool parseUdp(const Ipv4Packet& packet, UdpDatagram& datagram)
+    {
+      if ((packet.protocol != IP_PROTOCOL_UDP) || (packet.payload_length < UDP_HEADER_LENGTH))
+        return false;
+
+      const uint8_t* udp_header = packet.payload;
+      const size_t   udp_length = readUint16(udp_header + 4);
+
+      if (udp_length < UDP_HEADER_LENGTH)
+        return false;
+
+      const size_t available_udp_length = (udp_length < packet.payload_length ? udp_length : packet.payload_length);
+
+      datagram.source_port      = readUint16(udp_header);
+      datagram.destination_port = readUint16(udp_header + 2);
+      datagram.payload          = udp_header + UDP_HEADER_LENGTH;
+      datagram.payload_length   = available_udp_length - UDP_HEADER_LENGTH;
+      datagram.datagram_length  = udp_length - UDP_HEADER_LENGTH;
+      datagram.is_truncated     = (available_udp_length < udp_length);
+
+      return true;
+    }
+  }
+}
@@ -0,0 +1,159 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "pcap_capture_source.h"
+
+#include <udpcap/npcap_helpers.h>
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Udpcap
+{
+  PcapCaptureSource::PcapCaptureSource(pcap_t* pcap_handle)
+    : pcap_handle_     (pcap_handle)
+    , dead_pcap_handle_(pcap_open_dead(pcap_datalink(pcap_handle), pcap_snapshot(pcap_handle)))
+#ifdef _WIN32
+    , wait_handle_     (pcap_getevent(pcap_handle))
+#else
+    , wait_handle_     (pcap_get_selectable_fd(pcap_handle))
+#endif // _WIN32
+    , handle_in_use_   (false)
+  {}
+
+  PcapCaptureSource::~PcapCaptureSource()
+  {
+    close();
+  }
+
+  int PcapCaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    if (pcap_handle_ == nullptr)
+      return PCAP_ERROR_NOT_ACTIVATED;
+
+    // Another thread may be setting a filter that it has compiled before, so
+    // we never wait for longer than a single pcap_setfilter()
+    while (!acquireHandle())
+      std::this_thread::yield();
+
+    const int next_packet_result = pcap_next_ex(pcap_handle_, header, data);
+
+    releaseHandle();
+
+    return next_packet_result;
+  }
+
+  int PcapCaptureSource::datalink() const
+  {
+    return pcap_datalink(pcap_handle_);
+  }
+
+  int PcapCaptureSource::timestampPrecision() const
+  {
+    return pcap_get_tstamp_precision(pcap_handle_);
+  }
+
+  bool PcapCaptureSource::setFilter(const std::string& filter_string)
+  {
+    if (pcap_handle_ == nullptr)
+      return false;
+
+    if (dead_pcap_handle_ == nullptr)
+    {
+      fprintf(stderr, "%s\n", "UdpcapSocket ERROR: Unable to create pcap handle for compiling filter");
+      return false;
+    }
+
+    // Compile the filter without touching the live handle, which another
+    // thread may be reading from
+    bpf_program filter_program{};
+    const int pcap_compile_ret = compileFilter(dead_pcap_handle_, &filter_program, filter_string);
+
+    if (pcap_compile_ret == PCAP_ERROR)
+    {
+      pcap_perror(dead_pcap_handle_, ("UdpcapSocket ERROR: Unable to compile filter \"" + filter_string + "\"").c_str()); // TODO: revise error printing
+      return false;
+    }
+
+    // The handle is non-blocking, so the reading thread releases it quickly
+    while (!acquireHandle())
+      std::this_thread::yield();
+
+    const int set_filter_error = pcap_setfilter(pcap_handle_, &filter_program);
+    if (set_filter_error == PCAP_ERROR)
+    {
+      pcap_perror(pcap_handle_, ("UdpcapSocket ERROR: Unable to set filter \"" + filter_string + "\"").c_str());
+    }
+
+    releaseHandle();
+
+    pcap_freecode(&filter_program);
+
+    return (set_filter_error != PCAP_ERROR);
+  }
+
+  NativeWaitHandle PcapCaptureSource::getWaitHandle() const
+  {
+    return wait_handle_;
+  }
+
+  pcap_t* PcapCaptureSource::getPcapHandle() const
+  {
+    return pcap_handle_;
+  }
+
+  int PcapCaptureSource::compileFilter(pcap_t* pcap_handle, bpf_program* filter_program, const std::string& filter_string)
+  {
+    // pcap_compile is not thread safe, so we need a global mutex
+    const std::lock_guard<std::mutex> pcap_compile_lock(pcap_compile_mutex);
+    return pcap_compile(pcap_handle, filter_program, filter_string.c_str(), 1, PCAP_NETMASK_UNKNOWN);
+  }
+
+  std::string PcapCaptureSource::getLastError() const
+  {
+    if (pcap_handle_ == nullptr)
+      return "Capture source closed";
+
+    return pcap_geterr(pcap_handle_);
+  }
+
+  void PcapCaptureSource::close()
+  {
+    if (pcap_handle_ != nullptr)
+    {
+      pcap_close(pcap_handle_);
+      pcap_handle_ = nullptr;
+    }
+
+    if (dead_pcap_handle_ != nullptr)
+    {
+      pcap_close(dead_pcap_handle_);
+      dead_pcap_handle_ = nullptr;
+    }
+  }
+
+  bool PcapCaptureSource::acquireHandle()
+  {
+    return !handle_in_use_.exchange(true);
+  }
+
+  void PcapCaptureSource::releaseHandle()
+  {
+    handle_in_use_ = false;
+  }
+}
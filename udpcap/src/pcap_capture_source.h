@@ -0,0 +1,81 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+
+#include <atomic>
+#include <string>
+
+namespace Udpcap
+{
+  /**
+   * @brief CaptureSource reading from an activated pcap handle (Npcap or libpcap)
+   *
+   * The PcapCaptureSource takes ownership of the handle and closes it in
+   * close() or when being destroyed.
+   *
+   * setFilter() may be called while another thread is calling nextPacket().
+   * As libpcap handles must not be used by two threads at the same time, the
+   * filter is compiled against a dead handle with the same link type and
+   * snapshot length. Only setting the finished program needs the live
+   * handle, so nextPacket() never waits for a filter to compile, and
+   * setFilter() never waits for longer than a single (non-blocking)
+   * pcap_next_ex().
+   */
+  class PcapCaptureSource : public CaptureSource
+  {
+  public:
+    explicit PcapCaptureSource(pcap_t* pcap_handle);
+    ~PcapCaptureSource() override;
+
+    // Copy
+    PcapCaptureSource(const PcapCaptureSource&)            = delete;
+    PcapCaptureSource& operator=(const PcapCaptureSource&) = delete;
+
+    // Move
+    PcapCaptureSource(PcapCaptureSource&&)                 = delete;
+    PcapCaptureSource& operator=(PcapCaptureSource&&)      = delete;
+
+    int              nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    int              datalink() const override;
+    int              timestampPrecision() const override;
+    bool             setFilter(const std::string& filter_string) override;
+    NativeWaitHandle getWaitHandle() const override;
+    pcap_t*          getPcapHandle() const override;
+    std::string      getLastError() const override;
+    void             close() override;
+
+    /**
+     * @brief Thread safe wrapper around pcap_compile()
+     *
+     * pcap_compile() is not thread safe. All filters must therefore be
+     * compiled through this function, which serializes the calls.
+     */
+    static int compileFilter(pcap_t* pcap_handle, bpf_program* filter_program, const std::string& filter_string);
+
+  private:
+    bool acquireHandle();
+    void releaseHandle();
+
+  private:
+    pcap_t*                     pcap_handle_;
+    pcap_t*                     dead_pcap_handle_;                              /**< For compiling filters without touching the pcap_handle_ */
+    NativeWaitHandle            wait_handle_;
+    std::atomic<bool>           handle_in_use_;                                 /**< Set by the thread that is reading from the handle or setting its filter */
+  };
+}
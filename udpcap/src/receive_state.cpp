@@ -0,0 +1,80 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "receive_state.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+namespace Udpcap
+{
+  bool ReceiveState::isMember(const HostAddress& group_address) const
+  {
+    return std::binary_search(multicast_groups.begin(), multicast_groups.end(), group_address);
+  }
+
+  ReceiveStateCell::ReadGuard::ReadGuard(const ReceiveStateCell& cell)
+    : cell_       (cell)
+    , epoch_index_(cell.epoch_.load() & 1)
+    , state_      (nullptr)
+  {
+    // The counter has to be incremented before loading the state, so a
+    // writer that replaces the state afterwards waits for us.
+    cell_.readers_[epoch_index_].fetch_add(1);
+    state_ = cell_.state_.load();
+  }
+
+  ReceiveStateCell::ReadGuard::~ReadGuard()
+  {
+    cell_.readers_[epoch_index_].fetch_sub(1);
+  }
+
+  ReceiveStateCell::ReceiveStateCell()
+    : state_  (new ReceiveState())
+    , epoch_  (0)
+    , readers_{{{0}, {0}}}
+  {}
+
+  ReceiveStateCell::~ReceiveStateCell()
+  {
+    delete state_.load();
+  }
+
+  ReceiveState ReceiveStateCell::copy() const
+  {
+    const ReadGuard current_state(*this);
+    return *current_state;
+  }
+
+  void ReceiveStateCell::publish(const ReceiveState& state)
+  {
+    const ReceiveState* old_state = state_.exchange(new ReceiveState(state));
+
+    // A reader that still sees the old state has incremented one of the two
+    // counters before the exchange. We wait for both of them to drain. The
+    // epoch is flipped before each wait, so new readers increment the other
+    // counter and cannot keep us waiting forever.
+    for (int i = 0; i < 2; i++)
+    {
+      const size_t drained_index = epoch_.fetch_add(1) & 1;
+      while (readers_[drained_index].load() != 0)
+        std::this_thread::yield();
+    }
+
+    delete old_state;
+  }
+}
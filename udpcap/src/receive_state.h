@@ -0,0 +1,113 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <udpcap/host_address.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Udpcap
+{
+  /**
+   * @brief The binding and multicast configuration of a socket, as seen by the receive loop
+   *
+   * A ReceiveState is never modified once it has been published. Changing
+   * the configuration publishes a modified copy instead.
+   */
+  struct ReceiveState
+  {
+    bool                     is_bound                   = false;
+    bool                     is_closed                  = false;                /**< close() has been called since the last bind() */
+    HostAddress              bound_address              = HostAddress::Invalid();
+    uint16_t                 bound_port                 = 0;
+    std::vector<HostAddress> multicast_groups;                                  /**< Sorted */
+    bool                     multicast_loopback_enabled = true;                 /**< Winsocks style IP_MULTICAST_LOOP: if enabled, the socket can receive loopback multicast packages */
+
+    bool isMember(const HostAddress& group_address) const;
+  };
+
+  /**
+   * @brief Publishes ReceiveStates to readers that never wait for a writer
+   *
+   * Readers pin the current state with a ReadGuard, which only increments a
+   * counter. A writer swaps in the new state and frees the old one after a
+   * grace period, i.e. once all readers that may still see it have released
+   * their guards (epoch-based reclamation with two reader counters).
+   *
+   * A writer therefore waits for as long as the readers hold their guards.
+   * Readers must only hold a ReadGuard for a short time and never block
+   * while holding it. Writers must be serialized by the caller and must not
+   * hold a ReadGuard themselves while publishing.
+   */
+  class ReceiveStateCell
+  {
+  public:
+    class ReadGuard
+    {
+    public:
+      explicit ReadGuard(const ReceiveStateCell& cell);
+      ~ReadGuard();
+
+      // Copy
+      ReadGuard(const ReadGuard&)            = delete;
+      ReadGuard& operator=(const ReadGuard&) = delete;
+
+      // Move
+      ReadGuard(ReadGuard&&)                 = delete;
+      ReadGuard& operator=(ReadGuard&&)      = delete;
+
+      const ReceiveState& operator*()  const { return *state_; }
+      const ReceiveState* operator->() const { return state_; }
+
+    private:
+      const ReceiveStateCell& cell_;
+      size_t                  epoch_index_;
+      const ReceiveState*     state_;
+    };
+
+  public:
+    ReceiveStateCell();
+    ~ReceiveStateCell();
+
+    // Copy
+    ReceiveStateCell(const ReceiveStateCell&)            = delete;
+    ReceiveStateCell& operator=(const ReceiveStateCell&) = delete;
+
+    // Move
+    ReceiveStateCell(ReceiveStateCell&&)                 = delete;
+    ReceiveStateCell& operator=(ReceiveStateCell&&)      = delete;
+
+    /**
+     * @brief Returns a copy of the current state for modifying it
+     */
+    ReceiveState copy() const;
+
+    /**
+     * @brief Replaces the current state and waits for the readers of the old one
+     */
+    void publish(const ReceiveState& state);
+
+  private:
+    std::atomic<const ReceiveState*>            state_;
+    std::atomic<size_t>                         epoch_;                         /**< The parity selects the counter that new readers increment */
+    mutable std::array<std::atomic<size_t>, 2>  readers_;                       /**< Number of readers that have entered in an even / odd epoch */
+  };
+}
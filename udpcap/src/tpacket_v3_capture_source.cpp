@@ -0,0 +1,391 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "tpacket_v3_capture_source.h"
+
+#include "pcap_capture_source.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include <arpa/inet.h>        // htons
+#include <linux/filter.h>     // sock_fprog
+#include <linux/if_ether.h>   // ETH_P_ALL
+#include <net/if.h>           // if_nametoindex, ifreq
+#include <net/if_arp.h>       // ARPHRD_*
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Udpcap
+{
+  // Definitions of the constants, as std::max() takes them by reference (not needed anymore in C++17)
+  constexpr size_t   TpacketV3CaptureSource::BLOCK_SIZE;
+  constexpr size_t   TpacketV3CaptureSource::FRAME_SIZE;
+  constexpr size_t   TpacketV3CaptureSource::MIN_BLOCK_COUNT;
+  constexpr unsigned TpacketV3CaptureSource::BLOCK_RETIRE_TOV_MS;
+
+  namespace
+  {
+    void printError(const std::string& device_name, const std::string& what)
+    {
+      fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Device " + device_name + ": " + what + ": " + std::system_category().message(errno)).c_str());
+    }
+  }
+
+  //////////////////////////////////////////
+  //// Constructor & Destructor
+  //////////////////////////////////////////
+
+  std::unique_ptr<TpacketV3CaptureSource> TpacketV3CaptureSource::open(const std::string& device_name, bool is_loopback, size_t ring_buffer_size)
+  {
+    const unsigned int if_index = if_nametoindex(device_name.c_str());
+    if (if_index == 0)
+    {
+      printError(device_name, "Unable to get interface index");
+      return nullptr;
+    }
+
+    // Create the socket with protocol 0, so it doesn't receive anything before
+    // it is bound to the interface.
+    const int packet_socket = socket(AF_PACKET, SOCK_RAW, 0);
+    if (packet_socket < 0)
+    {
+      printError(device_name, "Unable to create packet socket");
+      return nullptr;
+    }
+
+    // Determine the link-layer type. We only know how to handle Ethernet
+    // (including the loopback device, which has an empty Ethernet header) and
+    // devices that deliver raw IP packets.
+    int datalink = -1;
+    {
+      ifreq if_request{};
+      strncpy(if_request.ifr_name, device_name.c_str(), IFNAMSIZ - 1);
+      if (ioctl(packet_socket, SIOCGIFHWADDR, &if_request) != 0)
+      {
+        printError(device_name, "Unable to get hardware type");
+        ::close(packet_socket);
+        return nullptr;
+      }
+
+      switch (if_request.ifr_hwaddr.sa_family)
+      {
+      case ARPHRD_ETHER:
+      case ARPHRD_LOOPBACK:
+        datalink = DLT_EN10MB;
+        break;
+      case ARPHRD_NONE:
+      case ARPHRD_PPP:
+        datalink = DLT_RAW;
+        break;
+      default:
+        fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Device " + device_name + ": Hardware type " + std::to_string(if_request.ifr_hwaddr.sa_family) + " is not supported by the packet mmap capture engine").c_str());
+        ::close(packet_socket);
+        return nullptr;
+      }
+    }
+
+    const int tpacket_version = TPACKET_V3;
+    if (setsockopt(packet_socket, SOL_PACKET, PACKET_VERSION, &tpacket_version, sizeof(tpacket_version)) != 0)
+    {
+      printError(device_name, "Unable to set TPACKET_V3");
+      ::close(packet_socket);
+      return nullptr;
+    }
+
+    // Size the ring. The kernel requires the frame layout to be consistent,
+    // even though TPACKET_V3 frames have variable size.
+    tpacket_req3 ring_request{};
+    ring_request.tp_block_size       = static_cast<unsigned int>(BLOCK_SIZE);
+    ring_request.tp_block_nr         = static_cast<unsigned int>(std::max(ring_buffer_size / BLOCK_SIZE, MIN_BLOCK_COUNT));
+    ring_request.tp_frame_size       = static_cast<unsigned int>(FRAME_SIZE);
+    ring_request.tp_frame_nr         = static_cast<unsigned int>(BLOCK_SIZE / FRAME_SIZE) * ring_request.tp_block_nr;
+    ring_request.tp_retire_blk_tov   = BLOCK_RETIRE_TOV_MS;
+    ring_request.tp_sizeof_priv      = 0;
+    ring_request.tp_feature_req_word = 0;
+
+    if (setsockopt(packet_socket, SOL_PACKET, PACKET_RX_RING, &ring_request, sizeof(ring_request)) != 0)
+    {
+      printError(device_name, "Unable to create receive ring with " + std::to_string(ring_request.tp_block_nr) + " blocks of " + std::to_string(ring_request.tp_block_size) + " bytes");
+      ::close(packet_socket);
+      return nullptr;
+    }
+
+    const size_t ring_size = static_cast<size_t>(ring_request.tp_block_size) * ring_request.tp_block_nr;
+    void* ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, packet_socket, 0);
+    if (ring == MAP_FAILED) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast, performance-no-int-to-ptr) Reason: MAP_FAILED is defined by the system headers
+    {
+      printError(device_name, "Unable to map receive ring");
+      ::close(packet_socket);
+      return nullptr;
+    }
+
+    // Drop everything until the first filter is set. Otherwise the ring would
+    // fill up with unfiltered traffic as soon as the socket is bound.
+    {
+      sock_filter drop_all_instruction{ BPF_RET | BPF_K, 0, 0, 0 };
+      sock_fprog  drop_all_filter{};
+      drop_all_filter.len    = 1;
+      drop_all_filter.filter = &drop_all_instruction;
+      if (setsockopt(packet_socket, SOL_SOCKET, SO_ATTACH_FILTER, &drop_all_filter, sizeof(drop_all_filter)) != 0)
+      {
+        printError(device_name, "Unable to attach initial filter");
+        munmap(ring, ring_size);
+        ::close(packet_socket);
+        return nullptr;
+      }
+    }
+
+    // Same as the pcap devices: Open the device in promiscuous mode, so we
+    // also get multicast traffic that the NIC would otherwise discard.
+    packet_mreq membership_request{};
+    membership_request.mr_ifindex = static_cast<int>(if_index);
+    membership_request.mr_type    = PACKET_MR_PROMISC;
+    if (setsockopt(packet_socket, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership_request, sizeof(membership_request)) != 0)
+    {
+      fprintf(stderr, "%s\n", ("UdpcapSocket WARNING: Device " + device_name + " does not support promiscuous mode").c_str());
+    }
+
+    // Bind the socket to the interface. This starts capturing.
+    sockaddr_ll link_layer_address{};
+    link_layer_address.sll_family   = AF_PACKET;
+    link_layer_address.sll_protocol = htons(ETH_P_ALL);
+    link_layer_address.sll_ifindex  = static_cast<int>(if_index);
+    if (bind(packet_socket, reinterpret_cast<sockaddr*>(&link_layer_address), sizeof(link_layer_address)) != 0)
+    {
+      printError(device_name, "Unable to bind packet socket");
+      munmap(ring, ring_size);
+      ::close(packet_socket);
+      return nullptr;
+    }
+
+    return std::unique_ptr<TpacketV3CaptureSource>(new TpacketV3CaptureSource(packet_socket, is_loopback, static_cast<uint8_t*>(ring), ring_request, datalink));
+  }
+
+  TpacketV3CaptureSource::TpacketV3CaptureSource(int packet_socket, bool is_loopback, uint8_t* ring, const tpacket_req3& ring_request, int datalink)
+    : packet_socket_       (packet_socket)
+    , is_loopback_         (is_loopback)
+    , ring_                (ring)
+    , ring_request_        (ring_request)
+    , datalink_            (datalink)
+    , current_block_index_ (0)
+    , current_block_       (nullptr)
+    , frames_left_in_block_(0)
+    , next_frame_          (nullptr)
+    , current_header_      {}
+    , discard_pending_blocks_(false)
+  {}
+
+  TpacketV3CaptureSource::~TpacketV3CaptureSource()
+  {
+    close();
+  }
+
+  //////////////////////////////////////////
+  //// CaptureSource API
+  //////////////////////////////////////////
+
+  int TpacketV3CaptureSource::nextPacket(pcap_pkthdr** header, const u_char** data)
+  {
+    if (ring_ == nullptr)
+    {
+      last_error_ = "Capture source closed";
+      return PCAP_ERROR_NOT_ACTIVATED;
+    }
+
+    // The filter has changed. The frames that are already in user space
+    // have been captured with the old one.
+    if (discard_pending_blocks_.exchange(false))
+      discardPendingBlocks();
+
+    for (;;)
+    {
+      if (current_block_ == nullptr)
+      {
+        // Check if the kernel has handed the next block to user space. The
+        // acquire load makes sure that we see the frames the kernel has
+        // written before setting the status.
+        tpacket_block_desc* block = getBlock(current_block_index_);
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+          return 0;
+
+        current_block_        = block;
+        frames_left_in_block_ = block->hdr.bh1.num_pkts;
+        next_frame_           = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+      }
+
+      if (frames_left_in_block_ == 0)
+      {
+        // All frames of this block have been returned and the caller is done
+        // with the last one, as it called us again.
+        releaseCurrentBlock();
+        continue;
+      }
+
+      tpacket3_hdr* frame = next_frame_;
+      frames_left_in_block_--;
+      next_frame_ = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(frame) + frame->tp_next_offset);
+
+      // On the loopback device, the kernel passes every frame to us twice: once
+      // outgoing and once incoming. libpcap skips the outgoing copy, so do we.
+      if (is_loopback_)
+      {
+        const sockaddr_ll* link_layer_address = reinterpret_cast<const sockaddr_ll*>(reinterpret_cast<uint8_t*>(frame) + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+        if (link_layer_address->sll_pkttype == PACKET_OUTGOING)
+          continue;
+      }
+
+      current_header_.ts.tv_sec  = static_cast<decltype(current_header_.ts.tv_sec)>(frame->tp_sec);
+      current_header_.ts.tv_usec = static_cast<decltype(current_header_.ts.tv_usec)>(frame->tp_nsec); // Nanoseconds, see timestampPrecision()
+      current_header_.caplen     = frame->tp_snaplen;
+      current_header_.len        = frame->tp_len;
+
+      *header = &current_header_;
+      *data   = reinterpret_cast<const u_char*>(frame) + frame->tp_mac;
+      return 1;
+    }
+  }
+
+  int TpacketV3CaptureSource::datalink() const
+  {
+    return datalink_;
+  }
+
+  int TpacketV3CaptureSource::timestampPrecision() const
+  {
+    return PCAP_TSTAMP_PRECISION_NANO; // The ring delivers nanoseconds
+  }
+
+  bool TpacketV3CaptureSource::setFilter(const std::string& filter_string)
+  {
+    // Use libpcap for compiling the filter expression to classic BPF, which we
+    // can then attach to our socket.
+    pcap_t* dead_pcap_handle = pcap_open_dead(datalink_, 65535);
+    if (dead_pcap_handle == nullptr)
+    {
+      last_error_ = "Unable to create pcap handle for compiling filter";
+      return false;
+    }
+
+    bpf_program filter_program{};
+    if (PcapCaptureSource::compileFilter(dead_pcap_handle, &filter_program, filter_string) == PCAP_ERROR)
+    {
+      last_error_ = pcap_geterr(dead_pcap_handle);
+      pcap_perror(dead_pcap_handle, ("UdpcapSocket ERROR: Unable to compile filter \"" + filter_string + "\"").c_str());
+      pcap_close(dead_pcap_handle);
+      return false;
+    }
+
+    // struct bpf_insn and struct sock_filter share the same memory layout
+    sock_fprog socket_filter{};
+    socket_filter.len    = static_cast<unsigned short>(filter_program.bf_len);
+    socket_filter.filter = reinterpret_cast<sock_filter*>(filter_program.bf_insns);
+
+    bool success = true;
+    if (setsockopt(packet_socket_, SOL_SOCKET, SO_ATTACH_FILTER, &socket_filter, sizeof(socket_filter)) != 0)
+    {
+      last_error_ = "Unable to attach filter: " + std::system_category().message(errno);
+      fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Unable to set filter \"" + filter_string + "\": " + last_error_).c_str());
+      success = false;
+    }
+    else
+    {
+      // We must not touch the ring here, as the receiving thread may be
+      // reading it right now. It discards the old frames itself.
+      discard_pending_blocks_ = true;
+    }
+
+    pcap_freecode(&filter_program);
+    pcap_close(dead_pcap_handle);
+
+    return success;
+  }
+
+  NativeWaitHandle TpacketV3CaptureSource::getWaitHandle() const
+  {
+    return packet_socket_;
+  }
+
+  pcap_t* TpacketV3CaptureSource::getPcapHandle() const
+  {
+    return nullptr;
+  }
+
+  std::string TpacketV3CaptureSource::getLastError() const
+  {
+    return last_error_;
+  }
+
+  void TpacketV3CaptureSource::close()
+  {
+    if (ring_ != nullptr)
+    {
+      munmap(ring_, static_cast<size_t>(ring_request_.tp_block_size) * ring_request_.tp_block_nr);
+      ring_          = nullptr;
+      current_block_ = nullptr;
+    }
+
+    if (packet_socket_ >= 0)
+    {
+      ::close(packet_socket_);
+      packet_socket_ = -1;
+    }
+  }
+
+  //////////////////////////////////////////
+  //// Internal
+  //////////////////////////////////////////
+
+  tpacket_block_desc* TpacketV3CaptureSource::getBlock(unsigned int block_index) const
+  {
+    return reinterpret_cast<tpacket_block_desc*>(ring_ + static_cast<size_t>(block_index) * ring_request_.tp_block_size);
+  }
+
+  void TpacketV3CaptureSource::releaseCurrentBlock()
+  {
+    // Hand the block back to the kernel. The release store makes sure that
+    // we are done reading before the kernel may overwrite the block.
+    __atomic_store_n(&current_block_->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+
+    current_block_       = nullptr;
+    current_block_index_ = (current_block_index_ + 1) % ring_request_.tp_block_nr;
+  }
+
+  void TpacketV3CaptureSource::discardPendingBlocks()
+  {
+    if (current_block_ != nullptr)
+      releaseCurrentBlock();
+
+    // Only discard what has been handed to user space so far. The kernel keeps
+    // retiring blocks in the meantime, so we must not chase it around the ring.
+    for (unsigned int i = 0; i < ring_request_.tp_block_nr; i++)
+    {
+      tpacket_block_desc* block = getBlock(current_block_index_);
+      if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+        break;
+
+      current_block_ = block;
+      releaseCurrentBlock();
+    }
+  }
+}
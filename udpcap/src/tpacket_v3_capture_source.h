@@ -0,0 +1,114 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include "capture_source.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <linux/if_packet.h>
+
+namespace Udpcap
+{
+  /**
+   * @brief Linux CaptureSource reading from an AF_PACKET TPACKET_V3 memory-mapped ring
+   *
+   * The kernel writes the captured frames into a ring of blocks that is shared
+   * with user space. A block is handed to user space once it is full or its
+   * retire timeout has elapsed. nextPacket() then walks the frames of the
+   * block by following the offsets in the frame headers, so there is neither
+   * a system call nor a copy per frame. Only when all blocks are owned by the
+   * kernel, the receive loop has to wait on the socket.
+   *
+   * The block that the last frame was taken from is handed back to the kernel
+   * on the next call to nextPacket(), so the returned data pointer stays valid
+   * until then.
+   *
+   * The socket drops everything until the first filter has been set. The
+   * kernel only applies a filter to frames it captures after the filter has
+   * been attached, so setFilter() makes the next call to nextPacket() discard
+   * the blocks that have already been handed to user space. Frames in the
+   * block that the kernel is filling at that moment may still match the old
+   * filter.
+   */
+  class TpacketV3CaptureSource : public CaptureSource
+  {
+  public:
+    /**
+     * @brief Opens a packet socket on the given device and maps its receive ring
+     *
+     * @param device_name       The name of the network interface
+     * @param is_loopback       Whether the device is the loopback device. Outgoing frames on the loopback device are skipped, as they would be received twice otherwise.
+     * @param ring_buffer_size  Size of the entire ring in bytes. The ring consists of at least MIN_BLOCK_COUNT blocks.
+     *
+     * @return The capture source or nullptr, if the ring could not be set up
+     */
+    static std::unique_ptr<TpacketV3CaptureSource> open(const std::string& device_name, bool is_loopback, size_t ring_buffer_size);
+
+    ~TpacketV3CaptureSource() override;
+
+    // Copy
+    TpacketV3CaptureSource(const TpacketV3CaptureSource&)            = delete;
+    TpacketV3CaptureSource& operator=(const TpacketV3CaptureSource&) = delete;
+
+    // Move
+    TpacketV3CaptureSource(TpacketV3CaptureSource&&)                 = delete;
+    TpacketV3CaptureSource& operator=(TpacketV3CaptureSource&&)      = delete;
+
+    int              nextPacket(pcap_pkthdr** header, const u_char** data) override;
+    int              datalink() const override;
+    int              timestampPrecision() const override;
+    bool             setFilter(const std::string& filter_string) override;
+    NativeWaitHandle getWaitHandle() const override;
+    pcap_t*          getPcapHandle() const override;
+    std::string      getLastError() const override;
+    void             close() override;
+
+  public:
+    static constexpr size_t   BLOCK_SIZE          = 256 * 1024;       /**< Size of a single block. Must be a multiple of the page size and large enough for a 64 KiB frame. */
+    static constexpr size_t   FRAME_SIZE          = 2048;             /**< Nominal frame size required by the kernel for validating the ring layout. Frames in TPACKET_V3 have variable size. */
+    static constexpr size_t   MIN_BLOCK_COUNT     = 8;                /**< Minimum number of blocks, so the kernel can fill blocks while user space is still reading one */
+    static constexpr unsigned BLOCK_RETIRE_TOV_MS = 1;                /**< Time after which a partially filled block is handed to user space. This bounds the added latency. */
+
+  private:
+    TpacketV3CaptureSource(int packet_socket, bool is_loopback, uint8_t* ring, const tpacket_req3& ring_request, int datalink);
+
+    tpacket_block_desc* getBlock(unsigned int block_index) const;
+    void releaseCurrentBlock();
+    void discardPendingBlocks();
+
+  private:
+    int                 packet_socket_;
+    const bool          is_loopback_;
+    uint8_t*            ring_;
+    const tpacket_req3  ring_request_;
+    const int           datalink_;
+
+    unsigned int        current_block_index_;                     /**< Index of the block that is read next */
+    tpacket_block_desc* current_block_;                           /**< The block we are currently reading from (owned by user space) or nullptr */
+    uint32_t            frames_left_in_block_;                    /**< Number of frames that have not been returned from the current block */
+    tpacket3_hdr*       next_frame_;                              /**< Next frame of the current block */
+    pcap_pkthdr         current_header_;                          /**< pcap header of the last returned frame */
+    std::string         last_error_;
+
+    std::atomic<bool>   discard_pending_blocks_;                  /**< Set by setFilter(), so the reading thread discards the frames captured with the old filter */
+  };
+}
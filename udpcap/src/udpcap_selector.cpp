@@ -0,0 +1,44 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "udpcap/udpcap_selector.h"
+
+#include "udpcap_selector_private.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace Udpcap
+{
+  UdpcapSelector::UdpcapSelector()
+    : udpcap_selector_private_(std::make_unique<Udpcap::UdpcapSelectorPrivate>())
+  {}
+
+  UdpcapSelector::~UdpcapSelector() = default;
+
+  // Move
+  UdpcapSelector& UdpcapSelector::operator=(UdpcapSelector&&)  noexcept = default;
+  UdpcapSelector::UdpcapSelector(UdpcapSelector&&)             noexcept = default;
+
+  bool   UdpcapSelector::isValid     () const                                                                                 { return udpcap_selector_private_->isValid(); }
+
+  bool   UdpcapSelector::addSocket   (UdpcapSocket& socket)                                                                   { return udpcap_selector_private_->addSocket(socket); }
+  bool   UdpcapSelector::removeSocket(UdpcapSocket& socket)                                                                   { return udpcap_selector_private_->removeSocket(socket); }
+
+  size_t UdpcapSelector::wait        (std::vector<UdpcapSocket*>& ready_sockets, long long timeout_ms, Udpcap::Error& error)  { return udpcap_selector_private_->wait(ready_sockets, timeout_ms, error); }
+  void   UdpcapSelector::cancel      ()                                                                                       { udpcap_selector_private_->cancel(); }
+}
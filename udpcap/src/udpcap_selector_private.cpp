@@ -0,0 +1,369 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#include "udpcap_selector_private.h"
+
+#include "log_debug.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif // !_WIN32
+
+namespace Udpcap
+{
+  //////////////////////////////////////////
+  //// Selector API
+  //////////////////////////////////////////
+
+  UdpcapSelectorPrivate::UdpcapSelectorPrivate()
+    : is_valid_      (false)
+    , cancelled_     (false)
+#ifdef _WIN32
+    , selector_event_(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#elif defined(__linux__)
+    , epoll_fd_      (epoll_create1(EPOLL_CLOEXEC))
+    , cancel_pipe_   {{-1, -1}}
+#endif // _WIN32
+  {
+#ifdef _WIN32
+    if (selector_event_ == nullptr)
+    {
+      LOG_DEBUG("Selector error: Unable to create event: " + std::system_category().message(GetLastError()));
+      return;
+    }
+
+    is_valid_ = true;
+#elif defined(__linux__)
+    if (epoll_fd_ < 0)
+    {
+      LOG_DEBUG("Selector error: Unable to create epoll instance: " + std::system_category().message(errno));
+      return;
+    }
+
+    // Self-pipe for cancel(). Both ends are non-blocking, so neither
+    // signalling nor draining can ever block.
+    if (pipe(cancel_pipe_.data()) != 0)
+    {
+      LOG_DEBUG("Selector error: Unable to create cancel pipe: " + std::system_category().message(errno));
+      return;
+    }
+    fcntl(cancel_pipe_[0], F_SETFL, fcntl(cancel_pipe_[0], F_GETFL) | O_NONBLOCK);
+    fcntl(cancel_pipe_[1], F_SETFL, fcntl(cancel_pipe_[1], F_GETFL) | O_NONBLOCK);
+
+    // The cancel pipe is the only entry without a socket
+    epoll_event cancel_epoll_event{};
+    cancel_epoll_event.events   = EPOLLIN;
+    cancel_epoll_event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, cancel_pipe_[0], &cancel_epoll_event) != 0)
+    {
+      LOG_DEBUG("Selector error: Unable to add cancel pipe: " + std::system_category().message(errno));
+      return;
+    }
+
+    is_valid_ = true;
+#else
+    LOG_DEBUG("Selector error: Not supported on this platform");
+#endif // _WIN32
+  }
+
+  UdpcapSelectorPrivate::~UdpcapSelectorPrivate()
+  {
+#ifdef _WIN32
+    // Waits for running callbacks, as they reference the entries
+    for (const auto& socket_entry : socket_entries_)
+    {
+      if (socket_entry->wait_ != nullptr)
+        UnregisterWaitEx(socket_entry->wait_, INVALID_HANDLE_VALUE);
+    }
+
+    if (selector_event_ != nullptr)
+      CloseHandle(selector_event_);
+#elif defined(__linux__)
+    if (epoll_fd_ >= 0)
+      ::close(epoll_fd_);
+
+    for (const int fd : cancel_pipe_)
+    {
+      if (fd >= 0)
+        ::close(fd);
+    }
+#endif // _WIN32
+  }
+
+  bool UdpcapSelectorPrivate::isValid() const
+  {
+    return is_valid_;
+  }
+
+  bool UdpcapSelectorPrivate::addSocket(UdpcapSocket& socket)
+  {
+    if (!is_valid_)
+    {
+      LOG_DEBUG("Selector add error: Selector is invalid");
+      return false;
+    }
+
+    if (findSocket(socket) != socket_entries_.end())
+    {
+      LOG_DEBUG("Selector add error: Socket has already been added");
+      return false;
+    }
+
+    const NativeWaitHandle readiness_handle = socket.nativeReadinessHandle();
+
+#ifdef _WIN32
+    if (readiness_handle == nullptr)
+    {
+      LOG_DEBUG("Selector add error: Socket has no readiness handle");
+      return false;
+    }
+
+    // The wait is registered by wait()
+    socket_entries_.push_back(std::make_unique<SocketEntry>(&socket, readiness_handle));
+    socket_entries_.back()->selector_event_ = selector_event_;
+#elif defined(__linux__)
+    if (readiness_handle < 0)
+    {
+      LOG_DEBUG("Selector add error: Socket has no readiness handle");
+      return false;
+    }
+
+    auto socket_entry = std::make_unique<SocketEntry>(&socket, readiness_handle);
+
+    // The readiness handle is an epoll instance itself, which is readable
+    // whenever one of its file descriptors is
+    epoll_event socket_epoll_event{};
+    socket_epoll_event.events   = EPOLLIN;
+    socket_epoll_event.data.ptr = socket_entry.get();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, readiness_handle, &socket_epoll_event) != 0)
+    {
+      LOG_DEBUG("Selector add error: " + std::system_category().message(errno));
+      return false;
+    }
+
+    socket_entries_.push_back(std::move(socket_entry));
+#endif // _WIN32
+
+    return true;
+  }
+
+  bool UdpcapSelectorPrivate::removeSocket(UdpcapSocket& socket)
+  {
+    auto socket_entry_it = findSocket(socket);
+    if (socket_entry_it == socket_entries_.end())
+    {
+      LOG_DEBUG("Selector remove error: Socket has not been added");
+      return false;
+    }
+
+#ifdef _WIN32
+    if ((*socket_entry_it)->wait_ != nullptr)
+      UnregisterWaitEx((*socket_entry_it)->wait_, INVALID_HANDLE_VALUE);
+#elif defined(__linux__)
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, (*socket_entry_it)->readiness_handle_, nullptr);
+#endif // _WIN32
+
+    socket_entries_.erase(socket_entry_it);
+    return true;
+  }
+
+  size_t UdpcapSelectorPrivate::wait(std::vector<UdpcapSocket*>& ready_sockets, long long timeout_ms, Udpcap::Error& error)
+  {
+    ready_sockets.clear();
+
+    if (!is_valid_)
+    {
+      LOG_DEBUG("Selector wait error: Selector is invalid");
+      error = Udpcap::Error::NPCAP_NOT_INITIALIZED;
+      return 0;
+    }
+
+    // calculate until when to wait. If timeout_ms is smaller than 0, we will wait forever.
+    std::chrono::steady_clock::time_point wait_until;
+    if (timeout_ms < 0)
+    {
+      wait_until = std::chrono::steady_clock::time_point::max();
+    }
+    else
+    {
+      wait_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+
+    while (true)
+    {
+      if (cancelled_.exchange(false))
+      {
+        ready_sockets.clear();
+        error = Udpcap::Error::CANCELLED;
+        return 0;
+      }
+
+      if (!ready_sockets.empty())
+      {
+        error = Udpcap::Error::OK;
+        return ready_sockets.size();
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      const bool out_of_time = (now >= wait_until);
+
+      // The first pass always checks the sockets, even with a timeout of 0
+      long long remaining_time_ms = 0;
+      if (wait_until == std::chrono::steady_clock::time_point::max())
+        remaining_time_ms = -1;
+      else if (!out_of_time)
+        // Round up, so we don't spin with a 0ms timeout for the last fraction of a millisecond
+        remaining_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(wait_until - now + std::chrono::microseconds(999)).count();
+
+#ifdef _WIN32
+      // Register a one-shot wait for every socket that doesn't have one. A
+      // repeating wait would fire over and over again, as the readiness
+      // handles are manual-reset events.
+      for (const auto& socket_entry : socket_entries_)
+      {
+        if (socket_entry->wait_ == nullptr)
+        {
+          if (RegisterWaitForSingleObject(&socket_entry->wait_, socket_entry->readiness_handle_, &UdpcapSelectorPrivate::WaitCallback, socket_entry.get(), INFINITE, WT_EXECUTEONLYONCE | WT_EXECUTEINWAITTHREAD) == 0)
+          {
+            socket_entry->wait_ = nullptr;
+            error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Unable to wait for socket: " + std::system_category().message(GetLastError()));
+            LOG_DEBUG(error.ToString());
+            return 0;
+          }
+        }
+      }
+
+      const DWORD wait_ms     = (remaining_time_ms < 0 ? INFINITE : static_cast<DWORD>(std::min<long long>(remaining_time_ms, INFINITE - 1)));
+      const DWORD wait_result = WaitForSingleObject(selector_event_, wait_ms);
+
+      if (wait_result == WAIT_FAILED)
+      {
+        error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Internal error while waiting for sockets: " + std::system_category().message(GetLastError()));
+        LOG_DEBUG(error.ToString());
+        return 0;
+      }
+
+      // Reset the event before collecting the sockets. A wait that fires
+      // after this point sets it again.
+      ResetEvent(selector_event_);
+
+      for (const auto& socket_entry : socket_entries_)
+      {
+        if (socket_entry->fired_.exchange(false))
+        {
+          UnregisterWaitEx(socket_entry->wait_, INVALID_HANDLE_VALUE);
+          socket_entry->wait_ = nullptr;
+
+          // The socket may have been reset in the meantime
+          if (WaitForSingleObject(socket_entry->readiness_handle_, 0) == WAIT_OBJECT_0)
+            ready_sockets.push_back(socket_entry->socket_);
+        }
+      }
+#elif defined(__linux__)
+      // One event per socket and one for the cancel pipe is the most we can get
+      epoll_events_.resize(socket_entries_.size() + 1);
+
+      const int wait_ms      = static_cast<int>(std::min<long long>(remaining_time_ms, std::numeric_limits<int>::max()));
+      const int epoll_result = epoll_wait(epoll_fd_, epoll_events_.data(), static_cast<int>(epoll_events_.size()), wait_ms);
+
+      if (epoll_result < 0)
+      {
+        if (errno == EINTR)
+        {
+          // Interrupted by a signal. Just try again.
+          continue;
+        }
+
+        error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Internal error while waiting for sockets: " + std::system_category().message(errno));
+        LOG_DEBUG(error.ToString());
+        return 0;
+      }
+
+      for (int i = 0; i < epoll_result; i++)
+      {
+        if (epoll_events_[i].data.ptr != nullptr)
+        {
+          ready_sockets.push_back(static_cast<SocketEntry*>(epoll_events_[i].data.ptr)->socket_);
+        }
+        else
+        {
+          // The cancel pipe. As cancel() sets the flag before writing to the
+          // pipe, the loop sees the flag after we have drained the pipe.
+          std::array<char, 64> drain_buffer{};
+          while (read(cancel_pipe_[0], drain_buffer.data(), drain_buffer.size()) > 0) {}
+        }
+      }
+#endif // _WIN32
+
+      if (ready_sockets.empty() && out_of_time && !cancelled_)
+      {
+        error = Udpcap::Error::TIMEOUT;
+        return 0;
+      }
+    }
+  }
+
+  void UdpcapSelectorPrivate::cancel()
+  {
+    if (!is_valid_)
+      return;
+
+    // The flag is set before the signal, so wait() sees it after waking up
+    cancelled_ = true;
+
+#ifdef _WIN32
+    SetEvent(selector_event_);
+#elif defined(__linux__)
+    const char cancel_signal = 1;
+    if ((write(cancel_pipe_[1], &cancel_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      // A full pipe is readable anyways, so EAGAIN is no error
+      LOG_DEBUG("Error signaling selector cancel: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+  }
+
+  //////////////////////////////////////////
+  //// Internal
+  //////////////////////////////////////////
+
+  std::vector<std::unique_ptr<UdpcapSelectorPrivate::SocketEntry>>::iterator UdpcapSelectorPrivate::findSocket(const UdpcapSocket& socket)
+  {
+    return std::find_if(socket_entries_.begin(), socket_entries_.end()
+                        , [&socket](const std::unique_ptr<SocketEntry>& socket_entry) { return socket_entry->socket_ == &socket; });
+  }
+
+#ifdef _WIN32
+  void CALLBACK UdpcapSelectorPrivate::WaitCallback(void* param, BOOLEAN /*timer_or_wait_fired*/)
+  {
+    auto* socket_entry = static_cast<SocketEntry*>(param);
+    socket_entry->fired_ = true;
+    SetEvent(socket_entry->selector_event_);
+  }
+#endif // _WIN32
+}
@@ -0,0 +1,110 @@
+/********************************************************************************
+ * Copyright (c) 2024 Continental Corporation
+ *
+ * This program and the accompanying materials are made available under the
+ * terms of the Apache License, Version 2.0 which is available at
+ * https://www.apache.org/licenses/LICENSE-2.0.
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ ********************************************************************************/
+
+#pragma once
+
+#include <udpcap/error.h>
+#include <udpcap/udpcap_socket.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h> // IWYU pragma: keep
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#endif // _WIN32
+
+namespace Udpcap
+{
+  class UdpcapSelectorPrivate
+  {
+  //////////////////////////////////////////
+  //// Helper Structs
+  //////////////////////////////////////////
+  private:
+    struct SocketEntry
+    {
+      SocketEntry(UdpcapSocket* socket, NativeWaitHandle readiness_handle)
+        : socket_          (socket)
+        , readiness_handle_(readiness_handle)
+#ifdef _WIN32
+        , selector_event_  (nullptr)
+        , wait_            (nullptr)
+        , fired_           (false)
+#endif // _WIN32
+      {}
+      UdpcapSocket* const    socket_;
+      const NativeWaitHandle readiness_handle_;                                 /**< See UdpcapSocket::nativeReadinessHandle(). Owned by the socket. */
+#ifdef _WIN32
+      HANDLE                 selector_event_;                                   /**< Set by the wait callback */
+      HANDLE                 wait_;                                             /**< Thread pool wait for the readiness_handle_. nullptr, while not registered. */
+      std::atomic<bool>      fired_;                                            /**< The wait has fired. It has to be unregistered and registered again. */
+#endif // _WIN32
+    };
+
+  //////////////////////////////////////////
+  //// Selector API
+  //////////////////////////////////////////
+  public:
+    UdpcapSelectorPrivate();
+    ~UdpcapSelectorPrivate();
+
+    // Copy
+    UdpcapSelectorPrivate(UdpcapSelectorPrivate const&)             = delete;
+    UdpcapSelectorPrivate& operator= (UdpcapSelectorPrivate const&) = delete;
+
+    // Move
+    UdpcapSelectorPrivate& operator=(UdpcapSelectorPrivate&&)      = delete;
+    UdpcapSelectorPrivate(UdpcapSelectorPrivate&&)                 = delete;
+
+    bool isValid() const;
+
+    bool addSocket(UdpcapSocket& socket);
+    bool removeSocket(UdpcapSocket& socket);
+
+    size_t wait(std::vector<UdpcapSocket*>& ready_sockets, long long timeout_ms, Udpcap::Error& error);
+    void cancel();
+
+  //////////////////////////////////////////
+  //// Internal
+  //////////////////////////////////////////
+  private:
+    std::vector<std::unique_ptr<SocketEntry>>::iterator findSocket(const UdpcapSocket& socket);
+
+#ifdef _WIN32
+    static void CALLBACK WaitCallback(void* param, BOOLEAN timer_or_wait_fired);
+#endif // _WIN32
+
+  private:
+    bool                                      is_valid_;
+    std::vector<std::unique_ptr<SocketEntry>> socket_entries_;                  /**< The entries must not move, as the native waits point to them */
+    std::atomic<bool>                         cancelled_;
+
+#ifdef _WIN32
+    HANDLE                                    selector_event_;                  /**< Manual-reset event that the waits of all sockets and cancel() set. Windows cannot wait for more than 64 handles at once, so we never wait for the readiness handles directly. */
+#elif defined(__linux__)
+    int                                       epoll_fd_;                        /**< Contains the readiness handles of all sockets (which are epoll instances themselves) and the cancel_pipe_ */
+    std::array<int, 2>                        cancel_pipe_;
+    std::vector<epoll_event>                  epoll_events_;                    /**< Output of epoll_wait, kept to save the allocation */
+#endif // _WIN32
+  };
+}
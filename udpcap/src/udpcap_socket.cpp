@@ -21,6 +21,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace Udpcap
 {
@@ -44,11 +46,56 @@ namespace Udpcap
 
   bool              UdpcapSocket::setReceiveBufferSize       (int receive_buffer_size)                               { return udpcap_socket_private_->setReceiveBufferSize(receive_buffer_size); }
 
+  bool              UdpcapSocket::setCaptureEngine           (CaptureEngine capture_engine)                          { return udpcap_socket_private_->setCaptureEngine(capture_engine); }
+  CaptureEngine     UdpcapSocket::captureEngine              () const                                                { return udpcap_socket_private_->captureEngine(); }
+  bool              UdpcapSocket::setSharedCaptureEnabled    (bool enabled)                                          { return udpcap_socket_private_->setSharedCaptureEnabled(enabled); }
+  bool              UdpcapSocket::isSharedCaptureEnabled     () const                                                { return udpcap_socket_private_->isSharedCaptureEnabled(); }
+  bool              UdpcapSocket::setLoadBalancing           (LoadBalancing load_balancing)                          { return udpcap_socket_private_->setLoadBalancing(load_balancing); }
+  LoadBalancing     UdpcapSocket::loadBalancing              () const                                                { return udpcap_socket_private_->loadBalancing(); }
+  bool              UdpcapSocket::setCaptureQueues           (size_t queue_count, FanoutMode fanout_mode)            { return udpcap_socket_private_->setCaptureQueues(queue_count, fanout_mode); }
+  size_t            UdpcapSocket::captureQueueCount          () const                                                { return udpcap_socket_private_->captureQueueCount(); }
+  bool              UdpcapSocket::setUserBufferSize          (size_t initial_size, size_t max_size)                  { return udpcap_socket_private_->setUserBufferSize(initial_size, max_size); }
+  size_t            UdpcapSocket::userBufferMaxSize          () const                                                { return udpcap_socket_private_->userBufferMaxSize(); }
+  bool              UdpcapSocket::setReceiveQueueLimit       (size_t max_frames, OverflowPolicy overflow_policy)     { return udpcap_socket_private_->setReceiveQueueLimit(max_frames, overflow_policy); }
+  size_t            UdpcapSocket::receiveQueueLimit          () const                                                { return udpcap_socket_private_->receiveQueueLimit(); }
+  OverflowPolicy    UdpcapSocket::overflowPolicy             () const                                                { return udpcap_socket_private_->overflowPolicy(); }
+  ReceiveQueueStatistics UdpcapSocket::receiveQueueStatistics() const                                                { return udpcap_socket_private_->receiveQueueStatistics(); }
+
+  bool              UdpcapSocket::setTimestampSource         (TimestampSource timestamp_source)                      { return udpcap_socket_private_->setTimestampSource(timestamp_source); }
+  TimestampSource   UdpcapSocket::timestampSource            () const                                                { return udpcap_socket_private_->timestampSource(); }
+
+  bool              UdpcapSocket::setTimestampPrecision      (TimestampPrecision timestamp_precision)                { return udpcap_socket_private_->setTimestampPrecision(timestamp_precision); }
+  TimestampPrecision UdpcapSocket::timestampPrecision        () const                                                { return udpcap_socket_private_->timestampPrecision(); }
+
+  bool              UdpcapSocket::setCaptureFile(const std::string& file_path, ReplayPacing pacing, double speed_factor)                                                       { return udpcap_socket_private_->setCaptureFile(file_path, pacing, speed_factor); }
+  bool              UdpcapSocket::setCaptureFrames(const std::vector<std::vector<char>>& frames, size_t repetitions)                                                           { return udpcap_socket_private_->setCaptureFrames(frames, repetitions); }
+
   size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, long long timeout_ms, HostAddress* source_address, uint16_t* source_port, Udpcap::Error& error) { return udpcap_socket_private_->receiveDatagram(data, max_len, timeout_ms, source_address, source_port, error); }
   size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, long long timeout_ms, Udpcap::Error& error)                                                     { return udpcap_socket_private_->receiveDatagram(data, max_len, timeout_ms, nullptr, nullptr, error); }
   size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, Udpcap::Error& error)                                                                           { return udpcap_socket_private_->receiveDatagram(data, max_len, -1, nullptr, nullptr, error); }
   size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, HostAddress* source_address, uint16_t* source_port, Udpcap::Error& error)                       { return udpcap_socket_private_->receiveDatagram(data, max_len, -1, source_address, source_port, error); }
 
+  size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, long long timeout_ms, DatagramInfo& info, Udpcap::Error& error)                                  { return udpcap_socket_private_->receiveDatagram(data, max_len, timeout_ms, info, error); }
+  size_t            UdpcapSocket::receiveDatagram(char* data, size_t max_len, DatagramInfo& info, Udpcap::Error& error)                                                        { return udpcap_socket_private_->receiveDatagram(data, max_len, -1, info, error); }
+
+  size_t            UdpcapSocket::peekDatagramLength(long long timeout_ms, Udpcap::Error& error)                                                                           { return udpcap_socket_private_->peekDatagramLength(timeout_ms, error); }
+  size_t            UdpcapSocket::peekDatagramLength(Udpcap::Error& error)                                                                                                 { return udpcap_socket_private_->peekDatagramLength(-1, error); }
+
+  size_t            UdpcapSocket::receiveDatagrams(DatagramBuffer* buffers, size_t max_count, long long timeout_ms, Udpcap::Error& error)                                     { return udpcap_socket_private_->receiveDatagrams(buffers, max_count, timeout_ms, error); }
+  size_t            UdpcapSocket::receiveDatagrams(DatagramBuffer* buffers, size_t max_count, Udpcap::Error& error)                                                           { return udpcap_socket_private_->receiveDatagrams(buffers, max_count, -1, error); }
+
+  bool              UdpcapSocket::receiveDatagramView(DatagramView& view, long long timeout_ms, Udpcap::Error& error)                                                         { return udpcap_socket_private_->receiveDatagramView(view, timeout_ms, error); }
+  bool              UdpcapSocket::receiveDatagramView(DatagramView& view, Udpcap::Error& error)                                                                               { return udpcap_socket_private_->receiveDatagramView(view, -1, error); }
+
+  bool              UdpcapSocket::setReceiveCallback         (const ReceiveCallback& callback)                       { return udpcap_socket_private_->setReceiveCallback(callback); }
+
+  bool              UdpcapSocket::enableConflation           (size_t max_flows, size_t max_datagram_size)            { return udpcap_socket_private_->enableConflation(max_flows, max_datagram_size); }
+  size_t            UdpcapSocket::receiveLatestDatagrams(DatagramBuffer* buffers, DatagramInfo* infos, size_t max_count, long long timeout_ms, Udpcap::Error& error)          { return udpcap_socket_private_->receiveLatestDatagrams(buffers, infos, max_count, timeout_ms, error); }
+
+  std::vector<NativeWaitHandle> UdpcapSocket::nativeWaitHandles() const                                    { return udpcap_socket_private_->nativeWaitHandles(); }
+  NativeWaitHandle  UdpcapSocket::nativeReadinessHandle      ()                                                      { return udpcap_socket_private_->nativeReadinessHandle(); }
+  void              UdpcapSocket::cancel                     ()                                                      { udpcap_socket_private_->cancel(); }
+
   bool              UdpcapSocket::joinMulticastGroup         (const HostAddress& group_address)                      { return udpcap_socket_private_->joinMulticastGroup(group_address); }
   bool              UdpcapSocket::leaveMulticastGroup        (const HostAddress& group_address)                      { return udpcap_socket_private_->leaveMulticastGroup(group_address); }
 
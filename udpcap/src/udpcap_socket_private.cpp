@@ -20,21 +20,51 @@
 #include <udpcap/host_address.h>
 #include <udpcap/npcap_helpers.h>
 
+#include "buffered_capture_source.h"
+#include "capture_hub.h"
+#include "capture_source.h"
+#include "hub_capture_source.h"
 #include "ip_reassembly.h"
 #include "log_debug.h"
+#include "memory_capture_source.h"
+#include "offline_capture_source.h"
+#include "packet_parser.h"
+#include "pcap_capture_source.h"
 
+#ifdef __linux__
+#include "tpacket_v3_capture_source.h"
+#endif // __linux__
+
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 
 #include <ntddndis.h>       // User-space defines for NDIS driver communication
+#else
+#include <arpa/inet.h>      // ntohs
+#include <fcntl.h>
+#include <net/if.h>         // ifreq
+#include <netinet/in.h>     // sockaddr_in
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef __linux__
+#include <sys/epoll.h>      // epoll instance for the readiness handle
+#endif // __linux__
 
 #include <algorithm>
 #include <array>
+#include <cassert>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
@@ -46,25 +76,144 @@
 
 #include <asio.hpp> // IWYU pragma: keep
 
+namespace
+{
+  constexpr size_t default_receive_queue_size = 2 * 1024 * 1024;                /**< Maximum size of the user space queue, if neither the receive buffer size nor the user buffer size has been set. Matches the default kernel buffer size of pcap. */
+
+  // The ring of a user space queue is allocated and touched upfront, once
+  // per socket and device. Starting at an eighth of the maximum size keeps
+  // that cost low for sockets with little traffic (256 KiB for the default
+  // size), while a burst only takes three doublings to reach the maximum.
+  constexpr size_t initial_receive_queue_size_divisor = 8;
+}
+
 namespace Udpcap
 {
+  /**
+   * @brief Asserts the contract that only one thread receives at a time
+   *
+   * The peeked datagram and the IP reassembly are not protected by a lock,
+   * as they are only ever touched by the receiving thread. Nested receive
+   * calls of the same thread (e.g. peekDatagramLength() calling receive())
+   * are fine. The check is compiled out in release builds.
+   */
+  class UdpcapSocketPrivate::SingleReceiverCheck
+  {
+  public:
+    explicit SingleReceiverCheck(std::atomic<std::thread::id>& receiving_thread)
+      : receiving_thread_(receiving_thread)
+      , is_outermost_    (false)
+    {
+#ifndef NDEBUG
+      std::thread::id no_thread;
+      is_outermost_ = receiving_thread_.compare_exchange_strong(no_thread, std::this_thread::get_id());
+      assert((is_outermost_ || (no_thread == std::this_thread::get_id())) && "Only one thread may receive from a UdpcapSocket at a time");
+#endif // !NDEBUG
+    }
+
+    ~SingleReceiverCheck()
+    {
+      if (is_outermost_)
+        receiving_thread_ = std::thread::id();
+    }
+
+    // Copy
+    SingleReceiverCheck(const SingleReceiverCheck&)            = delete;
+    SingleReceiverCheck& operator=(const SingleReceiverCheck&) = delete;
+
+    // Move
+    SingleReceiverCheck(SingleReceiverCheck&&)                 = delete;
+    SingleReceiverCheck& operator=(SingleReceiverCheck&&)      = delete;
+
+  private:
+    std::atomic<std::thread::id>& receiving_thread_;
+    bool                          is_outermost_;
+  };
+
   //////////////////////////////////////////
   //// Socket API
   //////////////////////////////////////////
 
   UdpcapSocketPrivate::UdpcapSocketPrivate()
     : is_valid_                  (Udpcap::Initialize())
-    , bound_state_               (false)
-    , bound_port_                (0)
-    , multicast_loopback_enabled_(true)
+#ifdef _WIN32
+    , wake_up_event_             (CreateEvent(nullptr, TRUE, FALSE, nullptr))
+#else
+    , wake_up_pipe_              {{-1, -1}}
+    , readiness_epoll_fd_        (-1)
+#endif // _WIN32
+    , wake_up_signaled_          (false)
+    , readiness_handle_requested_(false)
+    , cancel_count_              (0)
     , receive_buffer_size_       (-1)
-    , pcap_devices_closed_       (false)
+    , capture_engine_            (CaptureEngine::Pcap)
+    , shared_capture_enabled_    (false)
+    , load_balancing_            (LoadBalancing::None)
+    , capture_queue_count_       (1)
+    , fanout_mode_               (FanoutMode::Hash)
+    , user_buffer_initial_size_  (0)
+    , user_buffer_max_size_      (0)
+    , receive_queue_limit_       (0)
+    , overflow_policy_           (OverflowPolicy::DropNewest)
+    , timestamp_source_          (TimestampSource::Default)
+    , timestamp_precision_       (TimestampPrecision::Nanoseconds)
+    , replay_pacing_             (ReplayPacing::AsFastAsPossible)
+    , replay_speed_factor_       (1.0)
+    , capture_frame_repetitions_ (1)
+    , has_peeked_datagram_       (false)
+    , receiving_thread_          (std::thread::id())
+    , receive_callback_stop_     (false)
   {
+#ifdef _WIN32
+    // The wake-up event is always the first handle we wait for
+    if (wake_up_event_ == nullptr)
+    {
+      LOG_DEBUG("Error creating wake-up event: " + std::system_category().message(GetLastError()));
+    }
+
+    pcap_win32_handles_.push_back(wake_up_event_);
+#else
+    // Create the self-pipe that we use for waking up a thread that is blocked
+    // in poll(). Both ends are non-blocking, so neither signalling nor
+    // draining can ever block.
+    if (pipe(wake_up_pipe_.data()) == 0)
+    {
+      fcntl(wake_up_pipe_[0], F_SETFL, fcntl(wake_up_pipe_[0], F_GETFL) | O_NONBLOCK);
+      fcntl(wake_up_pipe_[1], F_SETFL, fcntl(wake_up_pipe_[1], F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+      LOG_DEBUG("Error creating wake-up pipe: " + std::system_category().message(errno));
+    }
+
+    pollfd wake_up_pollfd{};
+    wake_up_pollfd.fd     = wake_up_pipe_[0];
+    wake_up_pollfd.events = POLLIN;
+    pcap_pollfds_.push_back(wake_up_pollfd);
+#endif // _WIN32
   }
 
   UdpcapSocketPrivate::~UdpcapSocketPrivate()
   {
     close();
+
+    // close() cannot join the thread, if it has been called from within the callback
+    if (receive_callback_thread_.joinable())
+      receive_callback_thread_.join();
+
+#ifdef _WIN32
+    if (wake_up_event_ != nullptr)
+      CloseHandle(wake_up_event_);
+#else
+    if (readiness_epoll_fd_ >= 0)
+      ::close(readiness_epoll_fd_);
+
+    for (const int fd : wake_up_pipe_)
+    {
+      if (fd >= 0)
+        ::close(fd);
+    }
+#endif // _WIN32
   }
 
   bool UdpcapSocketPrivate::isValid() const
@@ -82,7 +231,9 @@ namespace Udpcap
       return false;
     }
 
-    if (bound_state_)
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+
+    if (isBound())
     {
       // Already bound => fail!
       LOG_DEBUG("Bind error: Socket is already in bound state");
@@ -98,15 +249,41 @@ namespace Udpcap
 
 
     // Valid address => Try to bind to address!
+
+    // A datagram peeked before closing the socket belongs to the old binding
+    has_peeked_datagram_ = false;
     
-    const std::unique_lock<std::shared_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+    const std::unique_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
 
-    if (local_address.isLoopback())
+    if (!capture_frames_.empty())
+    {
+      // Hand out the frames from memory instead of opening any device
+      LOG_DEBUG("Opening " + std::to_string(capture_frames_.size()) + " frames from memory");
+
+      if (!openCaptureFrames_nolock())
+      {
+        LOG_DEBUG("Bind error: Unable to open frames from memory");
+        return false;
+      }
+    }
+    else if (!capture_file_path_.empty())
+    {
+      // Replay the capture file instead of opening any device. The address is
+      // only used for filtering the recorded traffic.
+      LOG_DEBUG(std::string("Opening capture file ") + capture_file_path_);
+
+      if (!openCaptureFile_nolock(capture_file_path_))
+      {
+        LOG_DEBUG(std::string("Bind error: Unable to open ") + capture_file_path_);
+        return false;
+      }
+    }
+    else if (local_address.isLoopback())
     {
       // Bind to localhost (We cannot find it by IP 127.0.0.1, as that IP is technically not even assignable to the loopback adapter).
       LOG_DEBUG(std::string("Opening Loopback device ") + GetLoopbackDeviceName());
 
-      if (!openPcapDevice_nolock(GetLoopbackDeviceName()))
+      if (!openPcapDevice_nolock(GetLoopbackDeviceName(), local_port))
       {
         LOG_DEBUG(std::string("Bind error: Unable to bind to ") + GetLoopbackDeviceName());
         return false;
@@ -127,7 +304,7 @@ namespace Udpcap
       {
         LOG_DEBUG(std::string("Opening ") + dev.first + " (" + dev.second + ")");
 
-        if (!openPcapDevice_nolock(dev.first))
+        if (!openPcapDevice_nolock(dev.first, local_port))
         {
           LOG_DEBUG(std::string("Bind error: Unable to bind to ") + dev.first);
         }
@@ -146,7 +323,7 @@ namespace Udpcap
       
       LOG_DEBUG(std::string("Opening ") + dev.first + " (" + dev.second + ")");
 
-      if (!openPcapDevice_nolock(dev.first))
+      if (!openPcapDevice_nolock(dev.first, local_port))
       {
         LOG_DEBUG(std::string("Bind error: Unable to bind to ") + dev.first);
         return false;
@@ -155,76 +332,806 @@ namespace Udpcap
       // Also open loopback adapter. We always have to expect the local machine sending data to its own IP address.
       LOG_DEBUG(std::string("Opening Loopback device ") + GetLoopbackDeviceName());
 
-      if (!openPcapDevice_nolock(GetLoopbackDeviceName()))
+      if (!openPcapDevice_nolock(GetLoopbackDeviceName(), local_port))
       {
         LOG_DEBUG(std::string("Bind error: Unable to open ") + GetLoopbackDeviceName());
         return false;
       }
     }
     
-    bound_address_       = local_address;
-    bound_port_          = local_port;
-    bound_state_         = true;
-    pcap_devices_closed_ = false;
-
+    ReceiveState receive_state  = receive_state_.copy();
+    receive_state.is_bound      = true;
+    receive_state.is_closed     = false;
+    receive_state.bound_address = local_address;
+    receive_state.bound_port    = local_port;
+    receive_state_.publish(receive_state);
+
+    // Reset the wake-up signal of a previous close(), as it would otherwise
+    // keep waking up the receive loop of the newly bound socket.
+    resetWakeUp();
+
+    bool has_offline_devices = false;
     for (auto& pcap_dev : pcap_devices_)
     {
-      updateCaptureFilter(pcap_dev);
+      updateCaptureFilter(pcap_dev, receive_state);
+      has_offline_devices = (has_offline_devices || pcap_dev.is_offline_);
+    }
+
+    // Capture files and frames from memory don't signal anything on their
+    // own, but their first frames are ready right away
+    if (readiness_handle_requested_ && has_offline_devices)
+      signalWakeUp();
+
+    return true;
+  }
+
+  bool UdpcapSocketPrivate::isBound() const
+  {
+    const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+    return receive_state->is_bound;
+  }
+
+  HostAddress UdpcapSocketPrivate::localAddress() const
+  {
+    const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+    return receive_state->bound_address;
+  }
+
+  uint16_t UdpcapSocketPrivate::localPort() const
+  {
+    const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+    return receive_state->bound_port;
+  }
+
+  bool UdpcapSocketPrivate::setReceiveBufferSize(int buffer_size)
+  {
+    if (!is_valid_)
+    {
+      // Invalid socket, cannot bind => fail!
+      LOG_DEBUG("Set Receive Buffer Size error: Socket is invalid");
+      return false;
+    }
+
+    if (isBound())
+    {
+      // Not bound => fail!
+      LOG_DEBUG("Set Receive Buffer Size error: Socket is already bound");
+      return false;
+    }
+
+    if (buffer_size < MAX_PACKET_SIZE)
+    {
+      // Not bound => fail!
+      LOG_DEBUG("Set Receive Buffer Size error: Buffer size is smaller than the maximum expected packet size (" + std::to_string(MAX_PACKET_SIZE) + ")");
+      return false;
+    }
+
+    receive_buffer_size_ = buffer_size;
+
+    return true;
+  }
+
+  bool UdpcapSocketPrivate::setCaptureEngine(CaptureEngine capture_engine)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Capture Engine error: Socket is already bound");
+      return false;
+    }
+
+#ifndef __linux__
+    if (capture_engine == CaptureEngine::PacketMmap)
+    {
+      LOG_DEBUG("Set Capture Engine error: The packet mmap capture engine is only available on Linux");
+      return false;
+    }
+#endif // !__linux__
+
+    capture_engine_ = capture_engine;
+
+    return true;
+  }
+
+  CaptureEngine UdpcapSocketPrivate::captureEngine() const
+  {
+    return capture_engine_;
+  }
+
+  bool UdpcapSocketPrivate::setSharedCaptureEnabled(bool enabled)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Shared Capture error: Socket is already bound");
+      return false;
+    }
+
+    if (enabled && (overflow_policy_ == OverflowPolicy::Block))
+    {
+      LOG_DEBUG("Set Shared Capture error: Shared capture cannot block, as waiting would stall all other sockets of the interface");
+      return false;
+    }
+
+    shared_capture_enabled_ = enabled;
+
+    return true;
+  }
+
+  bool UdpcapSocketPrivate::isSharedCaptureEnabled() const
+  {
+    return shared_capture_enabled_;
+  }
+
+  bool UdpcapSocketPrivate::setLoadBalancing(LoadBalancing load_balancing)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Load Balancing error: Socket is already bound");
+      return false;
+    }
+
+    if ((load_balancing != LoadBalancing::None) && (overflow_policy_ == OverflowPolicy::Block))
+    {
+      LOG_DEBUG("Set Load Balancing error: Load balancing needs shared capture, which cannot block");
+      return false;
+    }
+
+    load_balancing_ = load_balancing;
+
+    return true;
+  }
+
+  LoadBalancing UdpcapSocketPrivate::loadBalancing() const
+  {
+    return load_balancing_;
+  }
+
+  bool UdpcapSocketPrivate::setCaptureQueues(size_t queue_count, FanoutMode fanout_mode)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Capture Queues error: Socket is already bound");
+      return false;
+    }
+
+    if (queue_count < 1)
+    {
+      LOG_DEBUG("Set Capture Queues error: At least one queue is required");
+      return false;
+    }
+
+#ifndef __linux__
+    if (queue_count > 1)
+    {
+      LOG_DEBUG("Set Capture Queues error: Multiple capture queues are only available on Linux");
+      return false;
+    }
+#endif // !__linux__
+
+    if ((queue_count > 1) && (overflow_policy_ == OverflowPolicy::Block))
+    {
+      LOG_DEBUG("Set Capture Queues error: Multiple capture queues need shared capture, which cannot block");
+      return false;
+    }
+
+    capture_queue_count_ = queue_count;
+    fanout_mode_         = fanout_mode;
+
+    return true;
+  }
+
+  size_t UdpcapSocketPrivate::captureQueueCount() const
+  {
+    return capture_queue_count_;
+  }
+
+  bool UdpcapSocketPrivate::setUserBufferSize(size_t initial_size, size_t max_size)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set User Buffer Size error: Socket is already bound");
+      return false;
+    }
+
+    if (initial_size > max_size)
+    {
+      LOG_DEBUG("Set User Buffer Size error: The initial size exceeds the maximum size");
+      return false;
+    }
+
+    user_buffer_initial_size_ = initial_size;
+    user_buffer_max_size_     = max_size;
+
+    return true;
+  }
+
+  size_t UdpcapSocketPrivate::userBufferMaxSize() const
+  {
+    return user_buffer_max_size_;
+  }
+
+  bool UdpcapSocketPrivate::setReceiveQueueLimit(size_t max_frames, OverflowPolicy overflow_policy)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Receive Queue Limit error: Socket is already bound");
+      return false;
+    }
+
+    if ((overflow_policy == OverflowPolicy::Block) && usesSharedCapture())
+    {
+      LOG_DEBUG("Set Receive Queue Limit error: Shared capture cannot block, as waiting would stall all other sockets of the interface");
+      return false;
+    }
+
+    receive_queue_limit_ = max_frames;
+    overflow_policy_     = overflow_policy;
+
+    return true;
+  }
+
+  size_t UdpcapSocketPrivate::receiveQueueLimit() const
+  {
+    return receive_queue_limit_;
+  }
+
+  OverflowPolicy UdpcapSocketPrivate::overflowPolicy() const
+  {
+    return overflow_policy_;
+  }
+
+  ReceiveQueueStatistics UdpcapSocketPrivate::receiveQueueStatistics() const
+  {
+    ReceiveQueueStatistics statistics;
+
+    // The sources stay valid until the lists are cleared, even if they have been closed
+    const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+
+    for (const auto& pcap_dev : pcap_devices_)
+    {
+      const ReceiveQueueStatistics device_statistics = pcap_dev.capture_source_->queueStatistics();
+      statistics.queued_frames         += device_statistics.queued_frames;
+      statistics.dropped_newest_frames += device_statistics.dropped_newest_frames;
+      statistics.dropped_oldest_frames += device_statistics.dropped_oldest_frames;
+      statistics.blocked_frames        += device_statistics.blocked_frames;
+    }
+
+    const std::shared_ptr<ConflationTable> conflation_table = getConflationTable();
+    if (conflation_table)
+      conflation_table->addStatistics(statistics);
+
+    return statistics;
+  }
+
+  bool UdpcapSocketPrivate::setTimestampSource(TimestampSource timestamp_source)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Timestamp Source error: Socket is already bound");
+      return false;
+    }
+
+    timestamp_source_ = timestamp_source;
+
+    return true;
+  }
+
+  TimestampSource UdpcapSocketPrivate::timestampSource() const
+  {
+    return timestamp_source_;
+  }
+
+  bool UdpcapSocketPrivate::setTimestampPrecision(TimestampPrecision timestamp_precision)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Timestamp Precision error: Socket is already bound");
+      return false;
+    }
+
+    timestamp_precision_ = timestamp_precision;
+
+    return true;
+  }
+
+  TimestampPrecision UdpcapSocketPrivate::timestampPrecision() const
+  {
+    return timestamp_precision_;
+  }
+
+  bool UdpcapSocketPrivate::setCaptureFile(const std::string& file_path, ReplayPacing pacing, double speed_factor)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Capture File error: Socket is already bound");
+      return false;
+    }
+
+    if (file_path.empty())
+    {
+      LOG_DEBUG("Set Capture File error: File path is empty");
+      return false;
+    }
+
+    if ((pacing == ReplayPacing::Scaled) && !(speed_factor > 0.0))
+    {
+      LOG_DEBUG("Set Capture File error: Speed factor must be positive");
+      return false;
+    }
+
+    capture_file_path_   = file_path;
+    replay_pacing_       = pacing;
+    replay_speed_factor_ = speed_factor;
+    capture_frames_.clear();
+
+    return true;
+  }
+
+  bool UdpcapSocketPrivate::setCaptureFrames(const std::vector<std::vector<char>>& frames, size_t repetitions)
+  {
+    if (isBound())
+    {
+      LOG_DEBUG("Set Capture Frames error: Socket is already bound");
+      return false;
+    }
+
+    if (frames.empty())
+    {
+      LOG_DEBUG("Set Capture Frames error: No frames given");
+      return false;
     }
 
+    capture_frames_            = frames;
+    capture_frame_repetitions_ = repetitions;
+    capture_file_path_.clear();
+
     return true;
   }
 
-  bool UdpcapSocketPrivate::isBound() const
+  size_t UdpcapSocketPrivate::receiveDatagram(char*           data
+                                            , size_t          max_len
+                                            , long long       timeout_ms
+                                            , HostAddress*    source_address
+                                            , uint16_t*       source_port
+                                            , Udpcap::Error&  error)
+  {
+    DatagramBuffer buffer;
+    buffer.data    = data;
+    buffer.max_len = max_len;
+
+    if (receiveDatagrams(&buffer, 1, timeout_ms, error) == 0)
+      return 0;
+
+    if (source_address != nullptr)
+      *source_address = buffer.source_address;
+
+    if (source_port != nullptr)
+      *source_port = buffer.source_port;
+
+    return buffer.length;
+  }
+
+  size_t UdpcapSocketPrivate::receiveDatagram(char*           data
+                                            , size_t          max_len
+                                            , long long       timeout_ms
+                                            , DatagramInfo&   info
+                                            , Udpcap::Error&  error)
+  {
+    DatagramBuffer buffer;
+    buffer.data    = data;
+    buffer.max_len = max_len;
+
+    if (receive(&buffer, &info, nullptr, 1, timeout_ms, error) == 0)
+      return 0;
+
+    return buffer.length;
+  }
+
+  size_t UdpcapSocketPrivate::peekDatagramLength(long long       timeout_ms
+                                               , Udpcap::Error& error)
+  {
+    const SingleReceiverCheck single_receiver_check(receiving_thread_);
+
+    if (!has_peeked_datagram_)
+    {
+      DatagramView view;
+      if (receive(nullptr, nullptr, &view, 1, timeout_ms, error) != 1)
+        return 0;
+
+      // The view is only valid until the next call, so we have to keep a copy
+      peeked_datagram_payload_.assign(view.data, view.data + view.length);
+
+      peeked_datagram_info_.source_address      = view.source_address;
+      peeked_datagram_info_.source_port         = view.source_port;
+      peeked_datagram_info_.destination_address = view.destination_address;
+      peeked_datagram_info_.destination_port    = view.destination_port;
+      peeked_datagram_info_.datagram_length     = view.datagram_length;
+      peeked_datagram_info_.timestamp           = view.timestamp;
+      peeked_datagram_info_.device_name         = view.device_name;
+      peeked_datagram_info_.truncated           = view.truncated;
+      peeked_datagram_info_.buffer_too_small    = false;
+
+      has_peeked_datagram_ = true;
+
+      // The datagram is ready to be received now, but we have already reset
+      // the readiness handle
+      if (readiness_handle_requested_)
+        signalWakeUp();
+    }
+
+    error = Udpcap::Error::OK;
+    return peeked_datagram_info_.datagram_length;
+  }
+
+  size_t UdpcapSocketPrivate::receiveDatagrams(DatagramBuffer*   buffers
+                                             , size_t           max_count
+                                             , long long        timeout_ms
+                                             , Udpcap::Error&   error)
+  {
+    return receive(buffers, nullptr, nullptr, max_count, timeout_ms, error);
+  }
+
+  bool UdpcapSocketPrivate::receiveDatagramView(DatagramView&    view
+                                               , long long       timeout_ms
+                                               , Udpcap::Error&  error)
+  {
+    return (receive(nullptr, nullptr, &view, 1, timeout_ms, error) == 1);
+  }
+
+  bool UdpcapSocketPrivate::setReceiveCallback(const ReceiveCallback& callback)
+  {
+    if (!isBound())
+    {
+      LOG_DEBUG("Set Receive Callback error: Socket is not bound");
+      return false;
+    }
+
+    if (!callback)
+    {
+      LOG_DEBUG("Set Receive Callback error: Callback is empty");
+      return false;
+    }
+
+    if (receive_callback_thread_.joinable())
+    {
+      if (!receive_callback_stop_)
+      {
+        LOG_DEBUG("Set Receive Callback error: A callback has already been set");
+        return false;
+      }
+
+      // The thread of a previous binding has been stopped by close() from within its callback
+      receive_callback_thread_.join();
+    }
+
+    receive_callback_        = callback;
+    receive_callback_stop_   = false;
+    receive_callback_thread_ = std::thread(&UdpcapSocketPrivate::receiveCallbackThread, this);
+
+    return true;
+  }
+
+  bool UdpcapSocketPrivate::enableConflation(size_t max_flows, size_t max_datagram_size)
+  {
+    if (max_flows == 0)
+    {
+      LOG_DEBUG("Enable Conflation error: At least one flow is required");
+      return false;
+    }
+
+    auto conflation_table = std::make_shared<ConflationTable>(max_flows, max_datagram_size);
+
+    // The thread only references the table, so it stays valid when conflation is enabled again after binding again
+    if (!setReceiveCallback([conflation_table](const DatagramView& datagram) { conflation_table->update(datagram); }))
+      return false;
+
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+    conflation_table_ = std::move(conflation_table);
+    return true;
+  }
+
+  size_t UdpcapSocketPrivate::receiveLatestDatagrams(DatagramBuffer* buffers, DatagramInfo* infos, size_t max_count, long long timeout_ms, Udpcap::Error& error)
+  {
+    // Our reference keeps the table alive, even if conflation is enabled again meanwhile
+    const std::shared_ptr<ConflationTable> conflation_table = getConflationTable();
+    if (!conflation_table)
+    {
+      LOG_DEBUG("Receive Latest Datagrams error: Conflation is not enabled");
+      error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Conflation is not enabled");
+      return 0;
+    }
+
+    if (max_count == 0)
+    {
+      error = Udpcap::Error::OK;
+      return 0;
+    }
+
+    std::chrono::steady_clock::time_point wait_until;
+    if (timeout_ms < 0)
+    {
+      wait_until = std::chrono::steady_clock::time_point::max();
+    }
+    else
+    {
+      wait_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+
+    return conflation_table->take(buffers, infos, max_count, wait_until, error);
+  }
+
+  void UdpcapSocketPrivate::takePeekedDatagram(DatagramBuffer* buffer, DatagramInfo* info, DatagramView* view)
+  {
+    has_peeked_datagram_ = false;
+
+    const DatagramInfo& peeked_info = peeked_datagram_info_;
+
+    if (view != nullptr)
+    {
+      // The payload stays valid until the next call of peekDatagramLength()
+      view->data                = peeked_datagram_payload_.data();
+      view->length              = peeked_datagram_payload_.size();
+      view->datagram_length     = peeked_info.datagram_length;
+      view->source_address      = peeked_info.source_address;
+      view->source_port         = peeked_info.source_port;
+      view->destination_address = peeked_info.destination_address;
+      view->destination_port    = peeked_info.destination_port;
+      view->timestamp           = peeked_info.timestamp;
+      view->device_name         = peeked_info.device_name;
+      view->truncated           = peeked_info.truncated;
+    }
+    else
+    {
+      const size_t bytes_to_copy = std::min(buffer->max_len, peeked_datagram_payload_.size());
+      memcpy(buffer->data, peeked_datagram_payload_.data(), bytes_to_copy);
+
+      buffer->length          = bytes_to_copy;
+      buffer->datagram_length = peeked_info.datagram_length;
+      buffer->source_address  = peeked_info.source_address;
+      buffer->source_port     = peeked_info.source_port;
+
+      if (info != nullptr)
+      {
+        *info                  = peeked_info;
+        info->buffer_too_small = (peeked_datagram_payload_.size() > buffer->max_len);
+      }
+    }
+  }
+
+  void UdpcapSocketPrivate::receiveCallbackThread()
+  {
+    DatagramView  view;
+    Udpcap::Error error = Udpcap::Error::OK;
+
+    for (;;)
+    {
+      if (!receiveDatagramView(view, -1, error))
+      {
+        // The thread keeps running, if the user has cancelled a receive call
+        if (error == Udpcap::Error::CANCELLED)
+          continue;
+
+        // Closed socket, end of file or an internal error. In any case, there
+        // won't be any more data.
+        if ((error != Udpcap::Error::SOCKET_CLOSED) && (error != Udpcap::Error::END_OF_FILE))
+          LOG_DEBUG("Receive callback thread: " + error.ToString());
+        return;
+      }
+
+      const std::lock_guard<std::mutex> receive_callback_lock(receive_callback_mutex_);
+
+      // close() may have closed the devices while we were waiting for the
+      // lock, so the view would point to released memory
+      if (receive_callback_stop_)
+        return;
+
+      receive_callback_(view);
+    }
+  }
+
+  std::vector<NativeWaitHandle> UdpcapSocketPrivate::nativeWaitHandles() const
+  {
+    std::vector<NativeWaitHandle> wait_handles;
+
+    const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+    const std::lock_guard<std::mutex>               pcap_devices_callback_lock(pcap_devices_callback_mutex_);
+
+    if (isClosed())
+      return wait_handles;
+
+    wait_handles.reserve(pcap_devices_.size());
+    for (const auto& pcap_dev : pcap_devices_)
+    {
+      // Offline devices have a handle that is never signaled
+      if (!pcap_dev.is_offline_)
+        wait_handles.push_back(pcap_dev.capture_source_->getWaitHandle());
+    }
+
+    return wait_handles;
+  }
+
+  NativeWaitHandle UdpcapSocketPrivate::nativeReadinessHandle()
+  {
+    if (!is_valid_)
+    {
+      LOG_DEBUG("Readiness handle error: Socket is invalid");
+#ifdef _WIN32
+      return nullptr;
+#else
+      return -1;
+#endif // _WIN32
+    }
+
+    const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+    const std::lock_guard<std::mutex>               pcap_devices_callback_lock(pcap_devices_callback_mutex_);
+
+#if defined(_WIN32) || defined(__linux__)
+    if (!readiness_handle_requested_)
+    {
+#ifdef __linux__
+      // The epoll instance is readable, whenever any of the file descriptors
+      // in its interest list are readable. It can thus be added to another
+      // epoll set or be polled like any other file descriptor.
+      readiness_epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+      if (readiness_epoll_fd_ < 0)
+      {
+        LOG_DEBUG("Readiness handle error: Unable to create epoll instance: " + std::system_category().message(errno));
+        return -1;
+      }
+
+      epoll_event wake_up_epoll_event{};
+      wake_up_epoll_event.events  = EPOLLIN;
+      wake_up_epoll_event.data.fd = wake_up_pipe_[0];
+      if (epoll_ctl(readiness_epoll_fd_, EPOLL_CTL_ADD, wake_up_pipe_[0], &wake_up_epoll_event) != 0)
+      {
+        LOG_DEBUG("Readiness handle error: Unable to add wake-up pipe: " + std::system_category().message(errno));
+      }
+#endif // __linux__
+
+      readiness_handle_requested_ = true;
+
+      if (!isClosed())
+      {
+        for (const auto& pcap_dev : pcap_devices_)
+          addReadinessWait_nolock(pcap_dev);
+      }
+
+      // We don't know whether there is data left from before, e.g. in a
+      // capture file, so the user has to try receiving once
+      signalWakeUp();
+    }
+#endif // _WIN32 || __linux__
+
+#ifdef _WIN32
+    return wake_up_event_;
+#elif defined(__linux__)
+    return readiness_epoll_fd_;
+#else
+    LOG_DEBUG("Readiness handle error: Not supported on this platform");
+    return -1;
+#endif // _WIN32
+  }
+
+  void UdpcapSocketPrivate::cancel()
   {
-    return bound_state_;
+    // The receive loop checks the counter after resetting the wake-up signal,
+    // so it either sees the new value or is woken up again
+    cancel_count_++;
+    signalWakeUp();
   }
 
-  HostAddress UdpcapSocketPrivate::localAddress() const
+  void UdpcapSocketPrivate::signalWakeUp()
   {
-    return bound_address_;
+    // The flag is set after the signal, so resetWakeUp() cannot miss a signal
+    // that it has to reset. We don't skip the system call when the flag is
+    // already set, as resetWakeUp() may just be resetting the signal.
+#ifdef _WIN32
+    if (SetEvent(wake_up_event_) == 0)
+    {
+      LOG_DEBUG("Error signaling wake-up event: " + std::system_category().message(GetLastError()));
+    }
+#else
+    const char wake_up_signal = 1;
+    if ((write(wake_up_pipe_[1], &wake_up_signal, 1) < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+    {
+      // A full pipe is readable anyways, so EAGAIN is no error
+      LOG_DEBUG("Error signaling wake-up pipe: " + std::system_category().message(errno));
+    }
+#endif // _WIN32
+    wake_up_signaled_ = true;
   }
 
-  uint16_t UdpcapSocketPrivate::localPort() const
+  void UdpcapSocketPrivate::resetWakeUp()
   {
-    return bound_port_;
+    // Only costs a system call, if there actually is a signal
+    if (!wake_up_signaled_.exchange(false))
+      return;
+
+#ifdef _WIN32
+    ResetEvent(wake_up_event_);
+#else
+    std::array<char, 64> drain_buffer{};
+    while (read(wake_up_pipe_[0], drain_buffer.data(), drain_buffer.size()) > 0) {}
+#endif // _WIN32
   }
 
-  bool UdpcapSocketPrivate::setReceiveBufferSize(int buffer_size)
+  void UdpcapSocketPrivate::addReadinessWait_nolock(const PcapDev& pcap_dev)
   {
-    if (!is_valid_)
+    // Offline devices have a handle that is never signaled (or a regular file
+    // that epoll doesn't accept)
+    if (!readiness_handle_requested_ || pcap_dev.is_offline_)
+      return;
+
+#ifdef _WIN32
+    // A thread pool wait forwards the device event to the wake-up event. The
+    // events of the devices are not in the readiness handle itself, as
+    // Windows has no way of combining multiple events into one.
+    HANDLE readiness_wait = nullptr;
+    if (RegisterWaitForSingleObject(&readiness_wait, pcap_dev.capture_source_->getWaitHandle(), &UdpcapSocketPrivate::ReadinessWaitCallback, this, INFINITE, WT_EXECUTEINWAITTHREAD) != 0)
     {
-      // Invalid socket, cannot bind => fail!
-      LOG_DEBUG("Set Receive Buffer Size error: Socket is invalid");
-      return false;
+      readiness_waits_.push_back(readiness_wait);
     }
-
-    if (bound_state_)
+    else
     {
-      // Not bound => fail!
-      LOG_DEBUG("Set Receive Buffer Size error: Socket is already bound");
-      return false;
+      LOG_DEBUG("Readiness handle error: Unable to wait for " + pcap_dev.device_name_ + ": " + std::system_category().message(GetLastError()));
     }
+#elif defined(__linux__)
+    const int wait_handle = pcap_dev.capture_source_->getWaitHandle();
 
-    if (buffer_size < MAX_PACKET_SIZE)
+    epoll_event device_epoll_event{};
+    device_epoll_event.events  = EPOLLIN;
+    device_epoll_event.data.fd = wait_handle;
+    if (epoll_ctl(readiness_epoll_fd_, EPOLL_CTL_ADD, wait_handle, &device_epoll_event) != 0)
     {
-      // Not bound => fail!
-      LOG_DEBUG("Set Receive Buffer Size error: Buffer size is smaller than the maximum expected packet size (" + std::to_string(MAX_PACKET_SIZE) + ")");
-      return false;
+      LOG_DEBUG("Readiness handle error: Unable to add " + pcap_dev.device_name_ + ": " + std::system_category().message(errno));
     }
+#endif // _WIN32
+  }
 
-    receive_buffer_size_ = buffer_size;
+  void UdpcapSocketPrivate::removeReadinessWaits_nolock()
+  {
+#ifdef _WIN32
+    // Waits for running callbacks, so none of them sees a closed device
+    for (HANDLE readiness_wait : readiness_waits_)
+      UnregisterWaitEx(readiness_wait, INVALID_HANDLE_VALUE);
+    readiness_waits_.clear();
+#elif defined(__linux__)
+    if (readiness_epoll_fd_ < 0)
+      return;
 
-    return true;
+    // Closing the file descriptors would remove them as well, but only if
+    // nobody else holds a duplicate (e.g. the AsioUdpcapSocket)
+    for (const auto& pcap_dev : pcap_devices_)
+    {
+      if (!pcap_dev.is_offline_)
+        epoll_ctl(readiness_epoll_fd_, EPOLL_CTL_DEL, pcap_dev.capture_source_->getWaitHandle(), nullptr);
+    }
+#endif // _WIN32
   }
 
-  size_t UdpcapSocketPrivate::receiveDatagram(char*           data
-                                            , size_t          max_len
-                                            , long long       timeout_ms
-                                            , HostAddress*    source_address
-                                            , uint16_t*       source_port
-                                            , Udpcap::Error&  error)
+#ifdef _WIN32
+  void CALLBACK UdpcapSocketPrivate::ReadinessWaitCallback(void* param, BOOLEAN /*timer_or_wait_fired*/)
+  {
+    static_cast<UdpcapSocketPrivate*>(param)->signalWakeUp();
+  }
+#endif // _WIN32
+
+  size_t UdpcapSocketPrivate::receive(DatagramBuffer* buffers, DatagramInfo* infos, DatagramView* view, size_t max_count, long long timeout_ms, Udpcap::Error& error)
   {
+    const SingleReceiverCheck single_receiver_check(receiving_thread_);
+
+    // Either copy the datagrams to the buffers or reference a single datagram
+    // in the view. The data referenced by the view stays valid, as we return
+    // right away and don't touch the device again until the next call.
+
+    if (max_count == 0)
+    {
+      error = Udpcap::Error::OK;
+      return 0;
+    }
+
+    // cancel() only interrupts receive calls that have already started
+    const unsigned long long cancel_count = cancel_count_;
+
     // calculate until when to wait. If timeout_ms is 0 or smaller, we will wait forever.
     std::chrono::steady_clock::time_point wait_until;
     if (timeout_ms < 0)
@@ -244,6 +1151,27 @@ namespace Udpcap
       return 0;
     }
 
+    // We return with a full buffer without checking whether the devices have
+    // more data. An external event loop waiting for the readiness handle
+    // would not necessarily be woken up for that data again, as the device
+    // handles are not always signaled while the capture buffers hold data.
+    const auto return_full_buffer = [this](size_t received_datagrams) -> size_t
+                                    {
+                                      if (readiness_handle_requested_)
+                                        signalWakeUp();
+                                      return received_datagrams;
+                                    };
+
+    // A datagram taken by peekDatagramLength() is handed out before any other
+    // datagram. Once the socket is closed, it is gone just like the data in
+    // the capture buffers.
+    if (has_peeked_datagram_ && !isClosed())
+    {
+      takePeekedDatagram((buffers != nullptr ? &buffers[0] : nullptr), (infos != nullptr ? &infos[0] : nullptr), view);
+      error = Udpcap::Error::OK;
+      return return_full_buffer(1);
+    }
+
     // Check all devices for data
     {
       // Variable to store the result
@@ -251,28 +1179,55 @@ namespace Udpcap
       const u_char* packet_data   (nullptr);
 
       // Lock the lists of open pcap devices in read-mode. We may use the handles, but not modify the lists themselfes.
-      const std::shared_lock<std::shared_mutex> pcap_devices_list_lock(pcap_devices_lists_mutex_);
+      const std::shared_lock<std::shared_timed_mutex> pcap_devices_list_lock(pcap_devices_lists_mutex_);
 
       // Check for data on pcap devices until we are either out of time or have
       // received a datagaram. A datagram may consist of multiple packaets in
-      // case of IP Fragmentation.
+      // case of IP Fragmentation. Once we have received a datagram, we keep
+      // collecting datagrams until no device has data available anymore or
+      // all buffers are filled.
+      size_t received_datagrams = 0;
+
       while (true)
       {
         bool received_any_data = false;
 
+        // Capture files replayed with their original timing release their
+        // frames at a specific time without signaling their wait handle.
+        auto next_ready_time = std::chrono::steady_clock::time_point::max();
+        size_t exhausted_devices = 0;
+
         {
-          // Lock the callback lock. While the callback is running, we cannot close the pcap handle, as that may invalidate the data pointer.
-          const std::lock_guard<std::mutex> pcap_devices_callback_lock(pcap_devices_callback_mutex_);
+          // Pin the receive state for this pass. Every change of the state
+          // (close(), joining or leaving a multicast group, ...) waits for us
+          // to release the old one, so close() can only close the devices
+          // once we are done with their data. We never wait for a change of
+          // the state, and we release it before waiting for new data, so a
+          // change only waits for the frames that are already available to
+          // be processed.
+          const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+
+          // Reset the wake-up signal before checking anything. Whatever
+          // happens after this point signals it again and lets the wait below
+          // return immediately.
+          resetWakeUp();
 
           // Check if the socket is closed and return an error
-          if (pcap_devices_closed_)
+          if (receive_state->is_closed)
           {
-            error = Udpcap::Error::SOCKET_CLOSED;
-            return 0;
+            error = (received_datagrams > 0 ? Udpcap::Error::OK : Udpcap::Error::SOCKET_CLOSED);
+            return received_datagrams;
+          }
+
+          // Check if the receive call has been cancelled by another thread
+          if (cancel_count_ != cancel_count)
+          {
+            error = (received_datagrams > 0 ? Udpcap::Error::OK : Udpcap::Error::CANCELLED);
+            return received_datagrams;
           }
     
           // Check if the socket is bound and return an error
-          if (!bound_state_)
+          if (!receive_state->is_bound)
           {
             // Not bound => fail!
             LOG_DEBUG("Receive error: Socket is not bound");
@@ -280,6 +1235,12 @@ namespace Udpcap
             return 0;
           }
 
+          // The clock is read once for all packets of this pass. This is
+          // precise enough for expiring IP fragments after seconds. As there
+          // is only one receiving thread, the time never goes backwards
+          // between calls of the IP reassembly.
+          const auto now = std::chrono::steady_clock::now();
+
           // Iterate through all devices and check if they have data. There is
           // no other API (that I know of) to check whether data is available on
           // a PCAP device other than trying to claim it. There is a very valid
@@ -290,11 +1251,19 @@ namespace Udpcap
           // state and we don't have information about the amount of data being
           // availabe (e.g. there are 2 packets available, but the event is
           // cleared after we waited for the first one).
-          for (const auto& pcap_dev : pcap_devices_)
+          for (size_t dev_index = 0; dev_index < pcap_devices_.size(); dev_index++)
           {
-            CallbackArgsRawPtr callback_args(data, max_len, source_address, source_port, bound_port_, pcpp::LinkLayerType::LINKTYPE_NULL);
+            const auto& pcap_dev = pcap_devices_[dev_index];
+
+            CallbackArgsRawPtr callback_args((buffers != nullptr ? &buffers[received_datagrams] : nullptr)
+                                            , (infos   != nullptr ? &infos[received_datagrams]   : nullptr)
+                                            , view
+                                            , *receive_state
+                                            , pcap_dev);
+            callback_args.ip_reassembly_ = pcap_devices_ip_reassembly_[dev_index].get();
+            callback_args.now_           = now;
 
-            const int pcap_next_packet_errorcode = pcap_next_ex(pcap_dev.pcap_handle_, &packet_header, &packet_data);
+            const int pcap_next_packet_errorcode = pcap_dev.capture_source_->nextPacket(&packet_header, &packet_data);
 
             // Possible return values:
             //  1: Success! We received a packet.
@@ -313,14 +1282,26 @@ namespace Udpcap
 
               if (callback_args.success_)
               {
-                // Only return datagram if we successfully received a packet. Otherwise, we will continue receiving data, if there is time left.
-                error = Udpcap::Error::OK;
-                return callback_args.bytes_copied_;
+                // Only count the datagram if we successfully received a packet. Otherwise, we will continue receiving data, if there is time left.
+                received_datagrams++;
+
+                if (received_datagrams == max_count)
+                {
+                  error = Udpcap::Error::OK;
+                  return return_full_buffer(received_datagrams);
+                }
               }
             }
             else if (pcap_next_packet_errorcode == 0)
             {
               // Timeout. No packet available. We will continue receiving data, if there is time left.
+              next_ready_time = std::min(next_ready_time, pcap_dev.capture_source_->readyTime());
+              continue;
+            }
+            else if (pcap_next_packet_errorcode == PCAP_ERROR_BREAK)
+            {
+              // The device is a capture file and all of its frames have been read
+              exhausted_devices++;
               continue;
             }
             else if (pcap_next_packet_errorcode == PCAP_ERROR_NOT_ACTIVATED)
@@ -328,25 +1309,49 @@ namespace Udpcap
               // This should never happen, as we only use activated handles.
               error = Udpcap::Error(Udpcap::Error::NOT_BOUND, "Internal error: PCAP handle not activated");
               LOG_DEBUG(error.ToString()); // This should never happen in a proper application
-              return 0;
+              return received_datagrams;
             }
             else if (pcap_next_packet_errorcode == PCAP_ERROR)
             {
               // An error occured. Details can be retrieved using pcap_geterr() or printed to the console using pcap_perror().
-              error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, pcap_geterr(pcap_dev.pcap_handle_));
+              error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, pcap_dev.capture_source_->getLastError());
               LOG_DEBUG(error.ToString());
-              return 0;
+              return received_datagrams;
             }
             else
             {
               // This should never happen according to the documentation.
               error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Internal error: Unknown error code " + std::to_string(pcap_next_packet_errorcode));
               LOG_DEBUG(error.ToString()); // This should never happen in a proper application
-              return 0;
+              return received_datagrams;
             }
           }
+
+          if (!received_any_data && (received_datagrams > 0))
+          {
+            // No device has any more data available right now. Return what we
+            // have instead of waiting for more.
+            error = Udpcap::Error::OK;
+            return received_datagrams;
+          }
+
+          if (!received_any_data && !pcap_devices_.empty() && (exhausted_devices == pcap_devices_.size()))
+          {
+            // There will never be any data again
+            error = Udpcap::Error::END_OF_FILE;
+            return 0;
+          }
+
+          if (!received_any_data)
+          {
+            // We are about to wait for new data anyways, so this is a good
+            // time to drop abandoned fragments
+            for (const auto& ip_reassembly : pcap_devices_ip_reassembly_)
+              ip_reassembly->removeOldPackages(now);
+          }
         }
 
+#ifdef _WIN32
         // Use WaitForMultipleObjects in order to wait for data on the pcap
         // devices. Only wait for data, if we haven't received any data in the
         // last loop. The Win32 event will be resetted after we got notified,
@@ -363,16 +1368,21 @@ namespace Udpcap
             return 0;
           }
 
-          // If we are not out of time, we calculate how many milliseconds we are allowed to wait for new data.
+          // If we are not out of time, we calculate how many milliseconds we
+          // are allowed to wait for new data. We must not sleep past the time
+          // at which a capture file releases its next frame.
+          const auto wake_up_time = std::min(wait_until, next_ready_time);
           unsigned long remaining_time_to_wait_ms = 0;
-          const bool wait_forever = (timeout_ms < 0); // Original parameter "timeout_ms" is negative if we want to wait forever
+          const bool wait_forever = (wake_up_time == std::chrono::steady_clock::time_point::max()); // wait_until is max() if the original parameter "timeout_ms" is negative
           if (wait_forever)
           {
             remaining_time_to_wait_ms = INFINITE;
           }
           else
           {
-            remaining_time_to_wait_ms = static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::milliseconds>(wait_until - now).count());
+            // Round up, so we don't spin with a 0ms timeout for the last fraction of a millisecond
+            const auto remaining_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(wake_up_time - now + std::chrono::microseconds(999)).count();
+            remaining_time_to_wait_ms = static_cast<unsigned long>(std::max<long long>(std::min<long long>(remaining_time_ms, INFINITE - 1), 0));
           }
           
           DWORD num_handles = static_cast<DWORD>(pcap_win32_handles_.size());
@@ -399,9 +1409,10 @@ namespace Udpcap
           }
           else if (wait_result == WAIT_TIMEOUT)
           {
-            //LOG_DEBUG("Receive error: WAIT_TIMEOUT");
-            error = Udpcap::Error::TIMEOUT;
-            return 0;
+            // Either we are out of time or a capture file has a frame ready.
+            // The loop checks the devices again and then returns the timeout
+            // error, if necessary.
+            continue;
           }
           else if (wait_result == WAIT_FAILED)
           {
@@ -412,6 +1423,69 @@ namespace Udpcap
             continue;
           }
         }
+#else
+        // Use poll() in order to wait for data on the pcap devices. Just like
+        // with the Win32 events, we only wait if we haven't received any data
+        // in the last loop, as the selectable file descriptor may not be
+        // readable while libpcap still has packets in its buffer. The first
+        // pollfd is the wake-up pipe, so close() and cancel() can wake us up.
+        if (!received_any_data)
+        {
+          // Check if we are out of time and return an error if so.
+          auto now = std::chrono::steady_clock::now();
+          if (now >= wait_until)
+          {
+            error = Udpcap::Error::TIMEOUT;
+            return 0;
+          }
+
+          // If we are not out of time, we calculate how many milliseconds we
+          // are allowed to wait for new data. We must not sleep past the time
+          // at which a capture file releases its next frame.
+          const auto wake_up_time = std::min(wait_until, next_ready_time);
+          int remaining_time_to_wait_ms = 0;
+          const bool wait_forever = (wake_up_time == std::chrono::steady_clock::time_point::max()); // wait_until is max() if the original parameter "timeout_ms" is negative
+          if (wait_forever)
+          {
+            remaining_time_to_wait_ms = -1;
+          }
+          else
+          {
+            // Round up, so we don't spin with a 0ms timeout for the last fraction of a millisecond
+            const auto remaining_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(wake_up_time - now + std::chrono::microseconds(999)).count();
+            remaining_time_to_wait_ms = static_cast<int>(std::max<long long>(std::min<long long>(remaining_time_ms, std::numeric_limits<int>::max()), 0));
+          }
+
+          const int poll_result = poll(pcap_pollfds_.data(), static_cast<nfds_t>(pcap_pollfds_.size()), remaining_time_to_wait_ms);
+
+          if (poll_result > 0)
+          {
+            // SUCCESS! Some file descriptor is readable (or the wake-up pipe
+            // was written to). Just like on Windows, we let the code
+            // above run again, which checks for a closed socket and then
+            // checks all pcap devices for data.
+            continue;
+          }
+          else if (poll_result == 0)
+          {
+            // Either we are out of time or a capture file has a frame ready.
+            // The loop checks the devices again and then returns the timeout
+            // error, if necessary.
+            continue;
+          }
+          else if (errno == EINTR)
+          {
+            // Interrupted by a signal. Just try again.
+            continue;
+          }
+          else
+          {
+            error = Udpcap::Error(Udpcap::Error::GENERIC_ERROR, "Internal error while waiting for data: " + std::system_category().message(errno));
+            LOG_DEBUG(error.ToString()); // This should never happen in a proper application
+            return received_datagrams;
+          }
+        }
+#endif // _WIN32
       }
     }
   }
@@ -436,28 +1510,38 @@ namespace Udpcap
       return false;
     }
 
-    if (!bound_state_)
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+
+    ReceiveState receive_state = receive_state_.copy();
+
+    if (!receive_state.is_bound)
     {
       LOG_DEBUG("Join Multicast Group error: Sockt is not in bound state");
       return false;
     }
 
-    if (multicast_groups_.find(group_address) != multicast_groups_.end())
+    auto& multicast_groups = receive_state.multicast_groups;
+    const auto group_it    = std::lower_bound(multicast_groups.begin(), multicast_groups.end(), group_address);
+    if ((group_it != multicast_groups.end()) && (*group_it == group_address))
     {
       LOG_DEBUG("Join Multicast Group error: Already joined " + group_address.toString());
       return false;
     }
 
-    // Add theg group to the group list
-    multicast_groups_.emplace(group_address);
+    // Add the group to the group list
+    multicast_groups.insert(group_it, group_address);
+    receive_state_.publish(receive_state);
 
     // Update the capture filters, so the devices will capture the multicast traffic
-    updateAllCaptureFilters();
+    {
+      const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+      updateAllCaptureFilters_nolock(receive_state);
+    }
 
-    if (multicast_loopback_enabled_)
+    if (receive_state.multicast_loopback_enabled)
     {
       // Trigger the Windows kernel to also send multicast traffic to localhost
-      kickstartLoopbackMulticast();
+      kickstartLoopbackMulticast(receive_state);
     }
 
     return true;
@@ -477,85 +1561,143 @@ namespace Udpcap
       return false;
     }
 
-    auto group_it = multicast_groups_.find(group_address);
-    if (group_it == multicast_groups_.end())
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+
+    ReceiveState receive_state = receive_state_.copy();
+
+    auto& multicast_groups = receive_state.multicast_groups;
+    const auto group_it    = std::lower_bound(multicast_groups.begin(), multicast_groups.end(), group_address);
+    if ((group_it == multicast_groups.end()) || (*group_it != group_address))
     {
       LOG_DEBUG("Leave Multicast Group error: Not member of " + group_address.toString());
       return false;
     }
 
-    // Remove the group from the group list
-    multicast_groups_.erase(group_it);
+    // Remove the group from the group list. From now on, the receive loop
+    // drops the datagrams of the group that the old filter has let through.
+    multicast_groups.erase(group_it);
+    receive_state_.publish(receive_state);
 
     // Update all capture filtes
-    updateAllCaptureFilters();
+    {
+      const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+      updateAllCaptureFilters_nolock(receive_state);
+    }
 
     return true;
   }
 
   void UdpcapSocketPrivate::setMulticastLoopbackEnabled(bool enabled)
   {
-    if (multicast_loopback_enabled_ == enabled)
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+
+    ReceiveState receive_state = receive_state_.copy();
+
+    if (receive_state.multicast_loopback_enabled == enabled)
     {
       // Nothing changed
       return;
     }
 
-    multicast_loopback_enabled_ = enabled;
+    receive_state.multicast_loopback_enabled = enabled;
+    receive_state_.publish(receive_state);
 
-    if (multicast_loopback_enabled_)
+    if (receive_state.multicast_loopback_enabled)
     {
       // Trigger the Windows kernel to also send multicast traffic to localhost
-      kickstartLoopbackMulticast();
+      kickstartLoopbackMulticast(receive_state);
     }
 
-    updateAllCaptureFilters();
+    const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+    updateAllCaptureFilters_nolock(receive_state);
   }
 
   bool UdpcapSocketPrivate::isMulticastLoopbackEnabled() const
   {
-    return multicast_loopback_enabled_;
+    const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+    return receive_state->multicast_loopback_enabled;
   }
 
   void UdpcapSocketPrivate::close()
   {
+    // Unless we are called from within the callback, we wait for a running
+    // callback to return and keep the thread from calling it again, as the
+    // datagram it receives points into the capture buffers we are about to
+    // close.
+    const bool is_receive_callback_thread = (std::this_thread::get_id() == receive_callback_thread_.get_id());
+
+    std::unique_lock<std::mutex> receive_callback_lock(receive_callback_mutex_, std::defer_lock);
+    if (!is_receive_callback_thread)
+      receive_callback_lock.lock();
+
+    receive_callback_stop_ = true;
+
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+
     {
       // Lock the lists of open pcap devices in read-mode. We may use the handles,
       // but not modify the lists themselfes. This is in order to assure that the
       // ReceiveDatagram function still has all pcap devices available after
-      // returning from WaitForMultipleObjects.
-      const std::shared_lock<std::shared_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+      // returning from WaitForMultipleObjects / poll.
+      const std::shared_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
 
       {
-        // Lock the callback lock. While the callback is running, we cannot close
-        // the pcap handle, as that may invalidate the data pointer.
         const std::lock_guard<std::mutex> pcap_devices_callback_lock(pcap_devices_callback_mutex_);
-        pcap_devices_closed_ = true;
+
+        // Once the closed state is published, the receive loop does not use
+        // the pcap handles anymore. It may still be in the middle of a pass
+        // that has seen the old state, which publish() waits for.
+        ReceiveState receive_state  = receive_state_.copy();
+        receive_state.is_bound      = false;
+        receive_state.is_closed     = true;
+        receive_state.bound_address = HostAddress::Invalid();
+        receive_state.bound_port    = 0;
+        receive_state_.publish(receive_state);
+
+        removeReadinessWaits_nolock();
         for (auto& pcap_dev : pcap_devices_)
         {
           LOG_DEBUG(std::string("Closing ") + pcap_dev.device_name_);
-          pcap_close(pcap_dev.pcap_handle_);
+          pcap_dev.capture_source_->close();
         }
       }
+
+      // Closing the file descriptors does not wake up a thread that is blocked
+      // in poll(), and a failing WaitForMultipleObjects would not be
+      // deterministic either, so we explicitely signal the receive loop.
+      signalWakeUp();
     }
 
     {
       // Lock the lists of open pcap devices in write-mode. We may now modify the lists themselfes.
-      const std::unique_lock<std::shared_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
+      const std::unique_lock<std::shared_timed_mutex> pcap_devices_lists_lock(pcap_devices_lists_mutex_);
       pcap_devices_              .clear();
-      pcap_win32_handles_        .clear();
+#ifdef _WIN32
+      pcap_win32_handles_        .resize(1); // Keep the wake-up event
+#else
+      pcap_pollfds_              .resize(1); // Keep the wake-up pipe
+#endif // _WIN32
       pcap_devices_ip_reassembly_.clear();
     }
 
-    bound_state_ = false;
-    bound_port_ = 0;
-    bound_address_ = HostAddress::Invalid();
+    if (receive_callback_lock.owns_lock())
+    {
+      // The thread is woken up by the closed devices and exits
+      receive_callback_lock.unlock();
+      if (receive_callback_thread_.joinable())
+        receive_callback_thread_.join();
+    }
+
+    // Wake up the consumers of the latest datagrams. We still hold the
+    // configuration_lock, so we access the table directly.
+    if (conflation_table_)
+      conflation_table_->close();
   }
 
   bool UdpcapSocketPrivate::isClosed() const
   {
-    const std::lock_guard<std::mutex> pcap_callback_lock(pcap_devices_callback_mutex_);
-    return pcap_devices_closed_;
+    const ReceiveStateCell::ReadGuard receive_state(receive_state_);
+    return receive_state->is_closed;
   }
 
   //////////////////////////////////////////
@@ -593,14 +1735,14 @@ namespace Udpcap
       // matches the one we are looking for.
       for (pcap_addr* pcap_dev_addr = pcap_dev->addresses; pcap_dev_addr != nullptr; pcap_dev_addr = pcap_dev_addr->next)
       {
-        if (pcap_dev_addr->addr->sa_family == AF_INET)
+        if ((pcap_dev_addr->addr != nullptr) && (pcap_dev_addr->addr->sa_family == AF_INET))
         {         
           struct sockaddr_in* device_ipv4_addr = reinterpret_cast<struct sockaddr_in *>(pcap_dev_addr->addr);
           if (device_ipv4_addr->sin_addr.s_addr == ip.toInt())
           {
             // The IPv4 address matches!
             pcap_freealldevs(alldevs_ptr);
-            return std::make_pair(std::string(pcap_dev->name), std::string(pcap_dev->description));
+            return std::make_pair(std::string(pcap_dev->name), std::string(pcap_dev->description != nullptr ? pcap_dev->description : ""));
           }
         }
       }
@@ -629,7 +1771,23 @@ namespace Udpcap
     std::vector<std::pair<std::string, std::string>> alldev_vector;
     for (pcap_if_t* pcap_dev = alldevs_ptr; pcap_dev != nullptr; pcap_dev = pcap_dev->next)
     {
-      alldev_vector.emplace_back(std::string(pcap_dev->name), std::string(pcap_dev->description));
+#ifndef _WIN32
+      // libpcap also lists pseudo devices like "any", "nflog" or "usbmon",
+      // that would either duplicate the traffic of the real devices or never
+      // carry any IPv4 traffic. We therefore only open the loopback device
+      // and devices that have an IPv4 address assigned.
+      bool has_ipv4_address = false;
+      for (pcap_addr* pcap_dev_addr = pcap_dev->addresses; pcap_dev_addr != nullptr; pcap_dev_addr = pcap_dev_addr->next)
+      {
+        if ((pcap_dev_addr->addr != nullptr) && (pcap_dev_addr->addr->sa_family == AF_INET))
+          has_ipv4_address = true;
+      }
+
+      if (!has_ipv4_address && ((pcap_dev->flags & PCAP_IF_LOOPBACK) == 0))
+        continue;
+#endif // !_WIN32
+
+      alldev_vector.emplace_back(std::string(pcap_dev->name), std::string(pcap_dev->description != nullptr ? pcap_dev->description : ""));
     }
 
     pcap_freealldevs(alldevs_ptr);
@@ -637,28 +1795,54 @@ namespace Udpcap
     return alldev_vector;
   }
 
-  std::string UdpcapSocketPrivate::getMac(pcap_t* pcap_handle)
+  std::string UdpcapSocketPrivate::getMac(const PcapDev& pcap_dev)
   {
     // Check whether the handle actually is an ethernet device
-    if (pcap_datalink(pcap_handle) == DLT_EN10MB)
+    if (pcap_dev.datalink_ == DLT_EN10MB)
     {
       // Data for the OID Request
       size_t mac_size = 6;
       std::vector<char> mac(mac_size);
 
+#ifdef _WIN32
       // Send OID-Get-Request to the driver
-      if (pcap_oid_get_request(pcap_handle, OID_802_3_CURRENT_ADDRESS, mac.data(), &mac_size) != 0)
+      if (pcap_oid_get_request(pcap_dev.capture_source_->getPcapHandle(), OID_802_3_CURRENT_ADDRESS, mac.data(), &mac_size) != 0)
       {
         LOG_DEBUG("Error getting MAC address");
         return "";
       }
+#elif defined(__linux__)
+      // Ask the kernel for the hardware address of the interface
+      const int ioctl_socket = socket(AF_INET, SOCK_DGRAM, 0);
+      if (ioctl_socket < 0)
+      {
+        LOG_DEBUG("Error getting MAC address: " + std::system_category().message(errno));
+        return "";
+      }
+
+      ifreq if_request{};
+      strncpy(if_request.ifr_name, pcap_dev.device_name_.c_str(), IFNAMSIZ - 1);
+      const int ioctl_result = ioctl(ioctl_socket, SIOCGIFHWADDR, &if_request);
+      ::close(ioctl_socket);
+
+      if (ioctl_result != 0)
+      {
+        LOG_DEBUG("Error getting MAC address: " + std::system_category().message(errno));
+        return "";
+      }
+
+      memcpy(mac.data(), if_request.ifr_hwaddr.sa_data, mac_size);
+#else
+      // We don't know how to get the MAC address on this platform
+      return "";
+#endif // _WIN32
 
       // Convert binary mac into human-readble form (we need it this way for the kernel filter)
       std::string mac_string(18, ' ');
       snprintf(&mac_string[0], mac_string.size(), "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]); // NOLINT(readability-container-data-pointer) Reason: I need to write to the string, but the data() pointer is const. Since C++11, the operation is safe, as stings are required to be stored in contiguous memory.
       mac_string.pop_back(); // Remove terminating null char
 
-      return std::move(mac_string);
+      return mac_string;
     }
     else
     {
@@ -667,7 +1851,116 @@ namespace Udpcap
     }
   }
 
-  bool UdpcapSocketPrivate::openPcapDevice_nolock(const std::string& device_name)
+  bool UdpcapSocketPrivate::openPcapDevice_nolock(const std::string& device_name, uint16_t port)
+  {
+    std::unique_ptr<CaptureSource> capture_source;
+
+    if (usesSharedCapture())
+    {
+      // Sockets with different capture engines or queues cannot share a handle
+      std::string capture_hub_key = std::to_string(static_cast<int>(capture_engine_)) + ":" + device_name;
+      if (capture_queue_count_ > 1)
+        capture_hub_key += ":" + std::to_string(capture_queue_count_) + "x" + std::to_string(static_cast<int>(fanout_mode_));
+
+      auto capture_hub = CaptureHub::acquire(capture_hub_key, [this, &device_name]() { return openDeviceCaptureSource(device_name); }, capture_queue_count_, fanout_mode_);
+      if (!capture_hub)
+        return false;
+
+      // The queue takes the role of the kernel buffer, or of the user buffer if there is one
+      size_t max_queued_bytes     = (receive_buffer_size_ > 0 ? static_cast<size_t>(receive_buffer_size_) : default_receive_queue_size);
+      size_t initial_queued_bytes = max_queued_bytes / initial_receive_queue_size_divisor;
+      if (user_buffer_max_size_ > 0)
+      {
+        max_queued_bytes     = user_buffer_max_size_;
+        initial_queued_bytes = user_buffer_initial_size_;
+      }
+
+      capture_source = std::make_unique<HubCaptureSource>(capture_hub, port, load_balancing_, initial_queued_bytes, max_queued_bytes, receive_queue_limit_, overflow_policy_ == OverflowPolicy::DropOldest);
+    }
+    else
+    {
+      capture_source = openDeviceCaptureSource(device_name);
+      if (!capture_source)
+        return false;
+
+      if (user_buffer_max_size_ > 0)
+      {
+        capture_source = std::make_unique<BufferedCaptureSource>(std::move(capture_source), user_buffer_initial_size_, user_buffer_max_size_, receive_queue_limit_, overflow_policy_);
+      }
+      else if ((receive_queue_limit_ > 0) || (overflow_policy_ != OverflowPolicy::DropNewest))
+      {
+        // The receive queue needs a user buffer, so we create one that is just as large as the kernel buffer
+        const size_t max_buffer_size = (receive_buffer_size_ > 0 ? static_cast<size_t>(receive_buffer_size_) : default_receive_queue_size);
+        capture_source = std::make_unique<BufferedCaptureSource>(std::move(capture_source), max_buffer_size / initial_receive_queue_size_divisor, max_buffer_size, receive_queue_limit_, overflow_policy_);
+      }
+    }
+
+    return addPcapDev_nolock(PcapDev(std::move(capture_source), IsLoopbackDevice(device_name), false, device_name));
+  }
+
+  bool UdpcapSocketPrivate::usesSharedCapture() const
+  {
+    // Load balancing and capture queues are done by the CaptureHub, so they need shared capture
+    return shared_capture_enabled_ || (load_balancing_ != LoadBalancing::None) || (capture_queue_count_ > 1);
+  }
+
+  std::unique_ptr<CaptureSource> UdpcapSocketPrivate::openDeviceCaptureSource(const std::string& device_name) const
+  {
+#ifdef __linux__
+    if (capture_engine_ == CaptureEngine::PacketMmap)
+    {
+      if ((timestamp_source_ != TimestampSource::Default) && (timestamp_source_ != TimestampSource::Host))
+      {
+        fprintf(stderr, "%s\n", ("UdpcapSocket WARNING: Device " + device_name + ": The packet mmap capture engine only supports host timestamps. Using the host clock.").c_str());
+      }
+
+      const size_t ring_buffer_size = (receive_buffer_size_ > 0 ? static_cast<size_t>(receive_buffer_size_) : 0);
+      return TpacketV3CaptureSource::open(device_name, IsLoopbackDevice(device_name), ring_buffer_size);
+    }
+#endif // __linux__
+
+    return openPcapCaptureSource(device_name);
+  }
+
+  bool UdpcapSocketPrivate::openCaptureFile_nolock(const std::string& file_path)
+  {
+    std::unique_ptr<CaptureSource> capture_source = OfflineCaptureSource::open(file_path, replay_pacing_, replay_speed_factor_);
+    if (!capture_source)
+      return false;
+
+    return addPcapDev_nolock(PcapDev(std::move(capture_source), false, true, file_path));
+  }
+
+  bool UdpcapSocketPrivate::openCaptureFrames_nolock()
+  {
+    return addPcapDev_nolock(PcapDev(std::make_unique<MemoryCaptureSource>(capture_frames_, capture_frame_repetitions_), false, true, "memory"));
+  }
+
+  bool UdpcapSocketPrivate::addPcapDev_nolock(PcapDev&& pcap_dev)
+  {
+    if (pcap_dev.decode_link_layer_ == nullptr)
+    {
+      fprintf(stderr, "%s\n", ("UdpcapSocket ERROR: Unsupported link type " + std::to_string(pcap_dev.datalink_) + " on " + pcap_dev.device_name_).c_str());
+      pcap_dev.capture_source_->close();
+      return false;
+    }
+
+#ifdef _WIN32
+    pcap_win32_handles_        .push_back(pcap_dev.capture_source_->getWaitHandle());
+#else
+    pollfd pcap_pollfd{};
+    pcap_pollfd.fd     = pcap_dev.capture_source_->getWaitHandle();
+    pcap_pollfd.events = POLLIN;
+    pcap_pollfds_              .push_back(pcap_pollfd);
+#endif // _WIN32
+    addReadinessWait_nolock(pcap_dev);
+    pcap_devices_              .push_back(std::move(pcap_dev));
+    pcap_devices_ip_reassembly_.emplace_back(std::make_unique<Udpcap::IpReassembly>(std::chrono::seconds(5)));
+
+    return true;
+  }
+
+  std::unique_ptr<CaptureSource> UdpcapSocketPrivate::openPcapCaptureSource(const std::string& device_name) const
   {
     std::array<char, PCAP_ERRBUF_SIZE> errbuf{};
 
@@ -676,13 +1969,26 @@ namespace Udpcap
     if (pcap_handle == nullptr)
     {
       fprintf(stderr, "\nUnable to open the adapter: %s\n", errbuf.data());
-      return false;
+      return nullptr;
     }
 
     pcap_set_snaplen(pcap_handle, MAX_PACKET_SIZE);
     pcap_set_promisc(pcap_handle, 1 /*true*/); // We only want Packets destined for this adapter. We are not interested in others.
     pcap_set_immediate_mode(pcap_handle, 1 /*true*/);
 
+    if (timestamp_source_ != TimestampSource::Default)
+    {
+      // The device keeps its default clock, if it doesn't support the requested one
+      const int set_tstamp_type_error = pcap_set_tstamp_type(pcap_handle, toPcapTimestampType(timestamp_source_));
+      if (set_tstamp_type_error == PCAP_WARNING_TSTAMP_TYPE_NOTSUP)
+        fprintf(stderr, "%s\n", ("UdpcapSocket WARNING: Device " + device_name + " does not support the timestamp source " + pcap_tstamp_type_val_to_name(toPcapTimestampType(timestamp_source_)) + ". Using the default source.").c_str());
+      else if (set_tstamp_type_error != 0)
+        fprintf(stderr, "%s\n", ("UdpcapSocket WARNING: Device " + device_name + " does not support setting the timestamp source. Using the default source.").c_str());
+    }
+
+    // Not all devices support nanoseconds. Those keep using microseconds.
+    pcap_set_tstamp_precision(pcap_handle, (timestamp_precision_ == TimestampPrecision::Nanoseconds ? PCAP_TSTAMP_PRECISION_NANO : PCAP_TSTAMP_PRECISION_MICRO));
+
     std::array<char, PCAP_ERRBUF_SIZE> pcap_setnonblock_errbuf{};
     pcap_setnonblock(pcap_handle, 1 /*true*/,pcap_setnonblock_errbuf.data());
 
@@ -699,60 +2005,89 @@ namespace Udpcap
     case PCAP_WARNING_PROMISC_NOTSUP:
       pcap_perror(pcap_handle, ("UdpcapSocket WARNING: Device " + device_name + " does not support promiscuous mode").c_str());
       break;
+    case PCAP_WARNING_TSTAMP_TYPE_NOTSUP:
+      pcap_perror(pcap_handle, ("UdpcapSocket WARNING: Device " + device_name + " does not support the requested timestamp source").c_str());
+      break;
     case PCAP_WARNING:
       pcap_perror(pcap_handle, ("UdpcapSocket WARNING: Device " + device_name).c_str());
       break;
     case PCAP_ERROR_ACTIVATED:
       fprintf(stderr, "%s", ("UdpcapSocket ERROR: Device " + device_name + " already activated").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     case PCAP_ERROR_NO_SUCH_DEVICE:
       pcap_perror(pcap_handle, ("UdpcapSocket ERROR: Device " + device_name + " does not exist").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     case PCAP_ERROR_PERM_DENIED:
       pcap_perror(pcap_handle, ("UdpcapSocket ERROR: Device " + device_name + ": Permissoin denied").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     case PCAP_ERROR_RFMON_NOTSUP:
       fprintf(stderr, "%s", ("UdpcapSocket ERROR: Device " + device_name + ": Does not support monitoring").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     case PCAP_ERROR_IFACE_NOT_UP:
       fprintf(stderr, "%s", ("UdpcapSocket ERROR: Device " + device_name + ": Interface is down").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     case PCAP_ERROR:
       pcap_perror(pcap_handle, ("UdpcapSocket ERROR: Device " + device_name).c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     default:
       fprintf(stderr, "%s", ("UdpcapSocket ERROR: Device " + device_name + ": Unknown error").c_str());
       pcap_close(pcap_handle);
-      return false;
+      return nullptr;
     }
 
 
-    const PcapDev pcap_dev(pcap_handle, IsLoopbackDevice(device_name), device_name);
-   
-    pcap_devices_              .push_back(pcap_dev);
-    pcap_win32_handles_        .push_back(pcap_getevent(pcap_handle));
-    pcap_devices_ip_reassembly_.emplace_back(std::make_unique<Udpcap::IpReassembly>(std::chrono::seconds(5)));
+#ifndef _WIN32
+    if (pcap_get_selectable_fd(pcap_handle) < 0)
+    {
+      fprintf(stderr, "%s", ("UdpcapSocket ERROR: Device " + device_name + ": Does not provide a selectable file descriptor").c_str());
+      pcap_close(pcap_handle);
+      return nullptr;
+    }
+#endif // !_WIN32
 
-    return true;
+    return std::make_unique<PcapCaptureSource>(pcap_handle);
+  }
+
+  int UdpcapSocketPrivate::toPcapTimestampType(TimestampSource timestamp_source)
+  {
+    switch (timestamp_source)
+    {
+    case TimestampSource::HostLowPrecision:   return PCAP_TSTAMP_HOST_LOWPREC;
+    case TimestampSource::HostHighPrecision:  return PCAP_TSTAMP_HOST_HIPREC;
+    case TimestampSource::Adapter:            return PCAP_TSTAMP_ADAPTER;
+    case TimestampSource::AdapterUnsynced:    return PCAP_TSTAMP_ADAPTER_UNSYNCED;
+    default:                                  return PCAP_TSTAMP_HOST;
+    }
   }
 
-  std::string UdpcapSocketPrivate::createFilterString(PcapDev& pcap_dev) const
+  std::string UdpcapSocketPrivate::createFilterString(PcapDev& pcap_dev, const ReceiveState& receive_state)
   {
     std::stringstream ss;
 
-    // No outgoing packets (determined by MAC, loopback packages don't have an ethernet header)
-    if (!pcap_dev.is_loopback_)
+    // No outgoing packets (determined by MAC, loopback packages don't have an ethernet header).
+    // Offline frames have been recorded elsewhere, so there is no own MAC to filter.
+    if (!pcap_dev.is_loopback_ && !pcap_dev.is_offline_)
     {
-      const std::string mac_string = getMac(pcap_dev.pcap_handle_);
+      const std::string mac_string = getMac(pcap_dev);
       if (!mac_string.empty())
       {
+#ifdef _WIN32
         ss << "not ether src " << mac_string;
+#else
+        // On Linux, multicast traffic that is looped back by the local IP
+        // stack is not passed to the packet capture. Instead, we capture the
+        // outgoing copy, which obviously has our own MAC as source.
+        if (receive_state.multicast_loopback_enabled)
+          ss << "(not ether src " << mac_string << " or ip multicast)";
+        else
+          ss << "not ether src " << mac_string;
+#endif // _WIN32
         ss << " and ";
       }
     }
@@ -761,25 +2096,26 @@ namespace Udpcap
     ss << "ip and udp";
 
     // UDP Port or IPv4 fragmented traffic (in IP fragments we cannot see the UDP port, yet)
-    ss << " and (udp port " << bound_port_ << " or (ip[6:2] & 0x3fff != 0))";
+    ss << " and (udp port " << receive_state.bound_port << " or (ip[6:2] & 0x3fff != 0))";
 
     // IP
     // Unicast traffic
     ss << " and (((not ip multicast) ";
-    if (bound_address_ != HostAddress::Any() && bound_address_ != HostAddress::Broadcast())
+    if (receive_state.bound_address != HostAddress::Any() && receive_state.bound_address != HostAddress::Broadcast())
     {
-      ss << "and (ip dst " << bound_address_.toString() << ")";
+      ss << "and (ip dst " << receive_state.bound_address.toString() << ")";
     }
     ss << ")";
       
     // Multicast traffic
-    if ((!multicast_groups_.empty())
-      &&(!pcap_dev.is_loopback_ || multicast_loopback_enabled_))
+    const auto& multicast_groups = receive_state.multicast_groups;
+    if ((!multicast_groups.empty())
+      &&(!pcap_dev.is_loopback_ || receive_state.multicast_loopback_enabled))
     {
       ss << " or (ip multicast and (";
-      for (auto ip_it = multicast_groups_.begin(); ip_it != multicast_groups_.end(); ip_it++)
+      for (auto ip_it = multicast_groups.begin(); ip_it != multicast_groups.end(); ip_it++)
       {
-        if (ip_it != multicast_groups_.begin())
+        if (ip_it != multicast_groups.begin())
           ss << " or ";
         ss << "dst " << ip_it->toString();
       }
@@ -791,50 +2127,34 @@ namespace Udpcap
     return ss.str();
   }
 
-  void UdpcapSocketPrivate::updateCaptureFilter(PcapDev& pcap_dev)
+  void UdpcapSocketPrivate::updateCaptureFilter(PcapDev& pcap_dev, const ReceiveState& receive_state)
   {
     // Create new filter
-    const std::string filter_string = createFilterString(pcap_dev);
+    const std::string filter_string = createFilterString(pcap_dev, receive_state);
 
     LOG_DEBUG("Setting filter string: " + filter_string);
 
-    bpf_program filter_program{};
-
-    // Compile the filter
-    int pcap_compile_ret(PCAP_ERROR);
-    {
-      // pcap_compile is not thread safe, so we need a global mutex
-      const std::lock_guard<std::mutex> pcap_compile_lock(pcap_compile_mutex);
-      pcap_compile_ret = pcap_compile(pcap_dev.pcap_handle_, &filter_program, filter_string.c_str(), 1, PCAP_NETMASK_UNKNOWN);
-    }
-
-    if (pcap_compile_ret == PCAP_ERROR)
-    {
-      pcap_perror(pcap_dev.pcap_handle_, ("UdpcapSocket ERROR: Unable to compile filter \"" + filter_string + "\"").c_str()); // TODO: revise error printing
-    }
-    else
-    {
-      // Set the filter
-      auto set_filter_error = pcap_setfilter(pcap_dev.pcap_handle_, &filter_program);
-      if (set_filter_error == PCAP_ERROR)
-      {
-        pcap_perror(pcap_dev.pcap_handle_, ("UdpcapSocket ERROR: Unable to set filter \"" + filter_string + "\"").c_str());
-      }
-
-      pcap_freecode(&filter_program);
-    }
+    // Compile and set the filter. Errors are printed by the capture source.
+    // The capture sources compile the filter without blocking a thread that
+    // is receiving from them.
+    pcap_dev.capture_source_->setFilter(filter_string);
   }
 
-  void UdpcapSocketPrivate::updateAllCaptureFilters()
+  void UdpcapSocketPrivate::updateAllCaptureFilters_nolock(const ReceiveState& receive_state)
   {
     for (auto& pcap_dev : pcap_devices_)
     {
-      updateCaptureFilter(pcap_dev);
+      updateCaptureFilter(pcap_dev, receive_state);
     }
   }
 
-  void UdpcapSocketPrivate::kickstartLoopbackMulticast() const
+  void UdpcapSocketPrivate::kickstartLoopbackMulticast(const ReceiveState& receive_state) const
   {
+#ifdef _WIN32
+    // There is no loopback adapter when replaying a capture file or frames from memory
+    if (!capture_file_path_.empty() || !capture_frames_.empty())
+      return;
+
     constexpr uint16_t kickstart_port = 62000;
 
     asio::io_context iocontext;
@@ -897,7 +2217,7 @@ namespace Udpcap
     }
 
     // Join all multicast groups
-    for (const auto& multicast_group : multicast_groups_)
+    for (const auto& multicast_group : receive_state.multicast_groups)
     {
       const asio::ip::address asio_mc_group = asio::ip::make_address(multicast_group.toString());
 
@@ -910,7 +2230,7 @@ namespace Udpcap
     }
 
     // Send data to all multicast groups
-    for (const auto& multicast_group : multicast_groups_)
+    for (const auto& multicast_group : receive_state.multicast_groups)
     {
       LOG_DEBUG(std::string("Sending loopback kickstart packet to ") + multicast_group.toString() + ":" + std::to_string(kickstart_port));
       const asio::ip::address asio_mc_group = asio::ip::make_address(multicast_group.toString());
@@ -935,71 +2255,112 @@ namespace Udpcap
         LOG_DEBUG("Failed to close kickstart socket: " + ec.message());
       }
     }
+#else
+    // Only the Npcap loopback adapter suffers from the multicast cold start
+    // issue. Other platforms don't need the kickstart packet.
+    static_cast<void>(receive_state);
+#endif // _WIN32
+  }
+
+  std::shared_ptr<ConflationTable> UdpcapSocketPrivate::getConflationTable() const
+  {
+    const std::lock_guard<std::mutex> configuration_lock(configuration_mutex_);
+    return conflation_table_;
   }
 
   void UdpcapSocketPrivate::PacketHandlerRawPtr(unsigned char* param, const struct pcap_pkthdr* header, const unsigned char* pkt_data)
   {
     CallbackArgsRawPtr* callback_args = reinterpret_cast<CallbackArgsRawPtr*>(param);
+    callback_args->packet_header_ = header;
 
-    pcpp::RawPacket       rawPacket(pkt_data, header->caplen, header->ts, false, callback_args->link_type_);
-    const pcpp::Packet    packet(&rawPacket, pcpp::UDP);
+    const uint8_t* ip_data   = nullptr;
+    size_t         ip_length = 0;
+    if (!callback_args->decode_link_layer_(pkt_data, header->caplen, ip_data, ip_length))
+      return;
 
-    const pcpp::IPv4Layer* ip_layer = packet.getLayerOfType<pcpp::IPv4Layer>();
-    const pcpp::UdpLayer*  udp_layer = packet.getLayerOfType<pcpp::UdpLayer>();
+    PacketParser::Ipv4Packet ip_packet{};
+    if (!PacketParser::parseIpv4(ip_data, ip_length, ip_packet))
+      return;
 
-    if (ip_layer != nullptr)
+    if (ip_packet.is_fragment)
     {
-      if (ip_layer->isFragment())
-      {
-        // Handle fragmented IP traffic
-        pcpp::IPReassembly::ReassemblyStatus status(pcpp::IPReassembly::ReassemblyStatus::NON_IP_PACKET);
-
-        // Try to reasseble packet
-        pcpp::Packet* reassembled_packet = callback_args->ip_reassembly_->processPacket(&rawPacket, status);
-
-        // If we are done reassembling the packet, we return it to the user
-        if (reassembled_packet != nullptr)
-        {
-          const pcpp::Packet re_parsed_packet(reassembled_packet->getRawPacket(), pcpp::UDP);
-
-          const pcpp::IPv4Layer* reassembled_ip_layer = re_parsed_packet.getLayerOfType<pcpp::IPv4Layer>();
-          const pcpp::UdpLayer*  reassembled_udp_layer = re_parsed_packet.getLayerOfType<pcpp::UdpLayer>();
+      // Handle fragmented IP traffic
+      PacketParser::Ipv4Packet reassembled_ip_packet{};
 
-          if ((reassembled_ip_layer != nullptr) && (reassembled_udp_layer != nullptr))
-            FillCallbackArgsRawPtr(callback_args, reassembled_ip_layer, reassembled_udp_layer);
-
-          delete reassembled_packet; // We need to manually delete the packet pointer
-        }
-      }
-      else if (udp_layer != nullptr)
+      // If we are done reassembling the packet, we return it to the user
+      if (callback_args->ip_reassembly_->processFragment(ip_packet, callback_args->now_, reassembled_ip_packet))
       {
-        // Handle normal IP traffic (un-fragmented)
-        FillCallbackArgsRawPtr(callback_args, ip_layer, udp_layer);
+        PacketParser::UdpDatagram udp_datagram{};
+        if (PacketParser::parseUdp(reassembled_ip_packet, udp_datagram))
+          FillCallbackArgsRawPtr(callback_args, reassembled_ip_packet, udp_datagram);
       }
     }
-
+    else
+    {
+      // Handle normal IP traffic (un-fragmented)
+      PacketParser::UdpDatagram udp_datagram{};
+      if (PacketParser::parseUdp(ip_packet, udp_datagram))
+        FillCallbackArgsRawPtr(callback_args, ip_packet, udp_datagram);
+    }
   }
 
-  void UdpcapSocketPrivate::FillCallbackArgsRawPtr(CallbackArgsRawPtr* callback_args, const pcpp::IPv4Layer* ip_layer, const pcpp::UdpLayer* udp_layer)
+  void UdpcapSocketPrivate::FillCallbackArgsRawPtr(CallbackArgsRawPtr* callback_args, const PacketParser::Ipv4Packet& ip_packet, const PacketParser::UdpDatagram& udp_datagram)
   {
-    auto dst_port = ntohs(udp_layer->getUdpHeader()->portDst);
+    const ReceiveState& receive_state = callback_args->receive_state_;
+    const HostAddress   destination_address(ip_packet.destination_address);
 
-    if (dst_port == callback_args->bound_port_)
+    // The filter of the devices may still let through datagrams of a group
+    // that has just been left
+    if ((udp_datagram.destination_port == receive_state.bound_port)
+      && (!destination_address.isMulticast() || receive_state.isMember(destination_address)))
     {
-      if (callback_args->source_address_ != nullptr)
-        *callback_args->source_address_ = HostAddress(ip_layer->getSrcIPv4Address().toInt());
+      const PcapDev& pcap_dev = callback_args->pcap_dev_;
+      const timeval& ts       = callback_args->packet_header_->ts;
 
-      if (callback_args->source_port_ != nullptr)
-        *callback_args->source_port_ = ntohs(udp_layer->getUdpHeader()->portSrc);
+      if (callback_args->view_ != nullptr)
+      {
+        DatagramView& view = *callback_args->view_;
+
+        view.data                = reinterpret_cast<const char*>(udp_datagram.payload);
+        view.length              = udp_datagram.payload_length;
+        view.datagram_length     = udp_datagram.datagram_length;
+        view.source_address      = HostAddress(ip_packet.source_address);
+        view.source_port         = udp_datagram.source_port;
+        view.destination_address = destination_address;
+        view.destination_port    = udp_datagram.destination_port;
+        view.timestamp           = std::chrono::seconds(ts.tv_sec) + ts.tv_usec * pcap_dev.timestamp_unit_;
+        view.device_name         = pcap_dev.stable_device_name_;
+        view.truncated           = udp_datagram.is_truncated;
+      }
+      else
+      {
+        DatagramBuffer& buffer = *callback_args->buffer_;
 
+        const size_t bytes_to_copy = std::min(buffer.max_len, udp_datagram.payload_length);
+        memcpy(buffer.data, udp_datagram.payload, bytes_to_copy);
 
-      const size_t bytes_to_copy = std::min(callback_args->destination_buffer_size_, udp_layer->getLayerPayloadSize());
+        buffer.length          = bytes_to_copy;
+        buffer.datagram_length = udp_datagram.datagram_length;
+        buffer.source_address  = HostAddress(ip_packet.source_address);
+        buffer.source_port     = udp_datagram.source_port;
 
-      memcpy_s(callback_args->destination_buffer_, callback_args->destination_buffer_size_, udp_layer->getLayerPayload(), bytes_to_copy);
-      callback_args->bytes_copied_ = bytes_to_copy;
+        if (callback_args->info_ != nullptr)
+        {
+          DatagramInfo& info = *callback_args->info_;
+
+          info.source_address      = buffer.source_address;
+          info.source_port         = buffer.source_port;
+          info.destination_address = destination_address;
+          info.destination_port    = udp_datagram.destination_port;
+          info.datagram_length     = udp_datagram.datagram_length;
+          info.timestamp           = std::chrono::seconds(ts.tv_sec) + ts.tv_usec * pcap_dev.timestamp_unit_;
+          info.device_name         = pcap_dev.stable_device_name_;
+          info.truncated           = udp_datagram.is_truncated;
+          info.buffer_too_small    = (udp_datagram.payload_length > buffer.max_len);
+        }
+      }
 
       callback_args->success_ = true;
     }
-
   }
 }
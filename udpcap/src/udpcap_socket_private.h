@@ -18,30 +18,34 @@
 
 #include <udpcap/host_address.h>
 #include <udpcap/error.h>
+#include <udpcap/udpcap_socket.h>
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <memory>
-#include <set>
+#include <mutex>
 #include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <pcap.h>           // Pcap API
 
-#ifdef _MSC_VER
-#pragma warning( push )
-#pragma warning( disable: 4800 4200)
-#endif // _MSC_VER
-#include <Packet.h>         // Pcap++
-#include <IPv4Layer.h>      // Pcap++ IPv4
-#include <UdpLayer.h>       // Pcap++ UDP
-#ifdef _MSC_VER
-#pragma warning( pop )
-#endif // _MSC_VER
+#ifndef _WIN32
+#include <poll.h>           // poll() for waiting on the pcap selectable file descriptors
+#endif // !_WIN32
 
+#include "capture_source.h"
+#include "conflation_table.h"
+#include "device_name_table.h"
 #include "ip_reassembly.h"
+#include "packet_parser.h"
+#include "receive_state.h"
 
 namespace Udpcap
 {
@@ -53,39 +57,50 @@ namespace Udpcap
   private:
     struct PcapDev
     {
-      PcapDev(pcap_t* pcap_handle, bool is_loopback, const std::string& device_name)
-        : pcap_handle_(pcap_handle)
-        , is_loopback_   (is_loopback)
-        , device_name_(device_name)
+      PcapDev(std::unique_ptr<CaptureSource>&& capture_source, bool is_loopback, bool is_offline, const std::string& device_name)
+        : capture_source_    (std::move(capture_source))
+        , is_loopback_       (is_loopback)
+        , is_offline_        (is_offline)
+        , device_name_       (device_name)
+        , stable_device_name_(internDeviceName(device_name))
+        , datalink_          (capture_source_->datalink())
+        , decode_link_layer_ (PacketParser::getLinkLayerDecoder(datalink_))
+        , timestamp_unit_    (capture_source_->timestampPrecision() == PCAP_TSTAMP_PRECISION_NANO ? 1 : 1000)
       {}
-      pcap_t*      pcap_handle_;
-      bool         is_loopback_;
-      std::string  device_name_;
+      std::unique_ptr<CaptureSource>   capture_source_;
+      bool                             is_loopback_;
+      bool                             is_offline_;                             /**< The frames come from a capture file or from memory, not from a live network device */
+      std::string                      device_name_;
+      const char*                      stable_device_name_;                     /**< device_name_, but valid for the lifetime of the process. This is what DatagramInfo and DatagramView point to. */
+      int                              datalink_;                               /**< DLT_ value of the capture source, determined when opening the device */
+      PacketParser::LinkLayerDecoder   decode_link_layer_;                      /**< Decoder for datalink_. nullptr, if the link type is not supported. */
+      std::chrono::nanoseconds         timestamp_unit_;                         /**< Unit of pcap_pkthdr::ts.tv_usec, i.e. 1ns or 1000ns */
     };
 
     struct CallbackArgsRawPtr
     {
-      CallbackArgsRawPtr(char* destination_buffer, size_t destination_buffer_size, HostAddress* source_address, uint16_t* source_port, uint16_t bound_port, pcpp::LinkLayerType link_type)
-        : destination_buffer_     (destination_buffer)
-        , destination_buffer_size_(destination_buffer_size)
-        , bytes_copied_           (0)
-        , source_address_         (source_address)
-        , source_port_            (source_port)
+      CallbackArgsRawPtr(DatagramBuffer* buffer, DatagramInfo* info, DatagramView* view, const ReceiveState& receive_state, const PcapDev& pcap_dev)
+        : buffer_                 (buffer)
+        , info_                   (info)
+        , view_                   (view)
         , success_                (false)
-        , link_type_              (link_type)
-        , bound_port_             (bound_port)
+        , packet_header_          (nullptr)
+        , pcap_dev_               (pcap_dev)
+        , decode_link_layer_      (pcap_dev.decode_link_layer_)
+        , receive_state_          (receive_state)
         , ip_reassembly_          (nullptr)
       {}
-      char* const               destination_buffer_;
-      const size_t              destination_buffer_size_;
-      size_t                    bytes_copied_;
-      HostAddress* const        source_address_;
-      uint16_t* const           source_port_;
-      bool                      success_;
-
-      pcpp::LinkLayerType       link_type_;
-      const uint16_t            bound_port_;
-      Udpcap::IpReassembly*     ip_reassembly_;
+      DatagramBuffer* const                buffer_;                             /**< Destination for copying the datagram. nullptr, if view_ is used. */
+      DatagramInfo* const                  info_;                               /**< Destination for the metadata of the copied datagram. May be nullptr. */
+      DatagramView* const                  view_;                               /**< Destination for referencing the datagram without a copy. nullptr, if buffer_ is used. */
+      bool                                 success_;
+      const pcap_pkthdr*                   packet_header_;                      /**< Header of the packet that is currently being handled */
+
+      const PcapDev&                       pcap_dev_;                           /**< The device the packet has been captured on */
+      const PacketParser::LinkLayerDecoder decode_link_layer_;
+      const ReceiveState&                  receive_state_;                      /**< Pinned by the receive loop for the current pass over all devices */
+      Udpcap::IpReassembly*                ip_reassembly_;
+      std::chrono::steady_clock::time_point now_;                               /**< Coarse current time, read once per pass over all devices */
     };
 
   //////////////////////////////////////////
@@ -115,6 +130,35 @@ namespace Udpcap
 
     bool setReceiveBufferSize(int buffer_size);
 
+    bool setCaptureEngine(CaptureEngine capture_engine);
+    CaptureEngine captureEngine() const;
+
+    bool setSharedCaptureEnabled(bool enabled);
+    bool isSharedCaptureEnabled() const;
+
+    bool setLoadBalancing(LoadBalancing load_balancing);
+    LoadBalancing loadBalancing() const;
+
+    bool setCaptureQueues(size_t queue_count, FanoutMode fanout_mode);
+    size_t captureQueueCount() const;
+
+    bool setUserBufferSize(size_t initial_size, size_t max_size);
+    size_t userBufferMaxSize() const;
+
+    bool setReceiveQueueLimit(size_t max_frames, OverflowPolicy overflow_policy);
+    size_t receiveQueueLimit() const;
+    OverflowPolicy overflowPolicy() const;
+    ReceiveQueueStatistics receiveQueueStatistics() const;
+
+    bool setTimestampSource(TimestampSource timestamp_source);
+    TimestampSource timestampSource() const;
+
+    bool setTimestampPrecision(TimestampPrecision timestamp_precision);
+    TimestampPrecision timestampPrecision() const;
+
+    bool setCaptureFile(const std::string& file_path, ReplayPacing pacing, double speed_factor);
+    bool setCaptureFrames(const std::vector<std::vector<char>>& frames, size_t repetitions);
+
     size_t receiveDatagram(char*            data
                           , size_t          max_len
                           , long long       timeout_ms
@@ -122,6 +166,38 @@ namespace Udpcap
                           , uint16_t*       source_port
                           , Udpcap::Error&  error);
 
+    size_t receiveDatagram(char*            data
+                          , size_t          max_len
+                          , long long       timeout_ms
+                          , DatagramInfo&   info
+                          , Udpcap::Error&  error);
+
+    size_t peekDatagramLength(long long       timeout_ms
+                             , Udpcap::Error& error);
+
+    size_t receiveDatagrams(DatagramBuffer*   buffers
+                           , size_t           max_count
+                           , long long        timeout_ms
+                           , Udpcap::Error&   error);
+
+    bool receiveDatagramView(DatagramView&    view
+                            , long long       timeout_ms
+                            , Udpcap::Error&  error);
+
+    bool setReceiveCallback(const ReceiveCallback& callback);
+
+    bool enableConflation(size_t max_flows, size_t max_datagram_size);
+    size_t receiveLatestDatagrams(DatagramBuffer*   buffers
+                                 , DatagramInfo*    infos
+                                 , size_t           max_count
+                                 , long long        timeout_ms
+                                 , Udpcap::Error&   error);
+
+    std::vector<NativeWaitHandle> nativeWaitHandles() const;
+    NativeWaitHandle nativeReadinessHandle();
+
+    void cancel();
+
     bool joinMulticastGroup(const HostAddress& group_address);
     bool leaveMulticastGroup(const HostAddress& group_address);
 
@@ -138,37 +214,97 @@ namespace Udpcap
     static std::pair<std::string, std::string> getDeviceByIp(const HostAddress& ip);
     static std::vector<std::pair<std::string, std::string>> getAllDevices();
 
-    static std::string getMac(pcap_t* pcap_handle);
+    static std::string getMac(const PcapDev& pcap_dev);
 
-    bool openPcapDevice_nolock(const std::string& device_name);
+    bool openPcapDevice_nolock(const std::string& device_name, uint16_t port);
+    bool usesSharedCapture() const;
+    bool openCaptureFile_nolock(const std::string& file_path);
+    bool openCaptureFrames_nolock();
+    bool addPcapDev_nolock(PcapDev&& pcap_dev);
+    std::unique_ptr<CaptureSource> openDeviceCaptureSource(const std::string& device_name) const;
+    std::unique_ptr<CaptureSource> openPcapCaptureSource(const std::string& device_name) const;
+    static int toPcapTimestampType(TimestampSource timestamp_source);
 
-    std::string createFilterString(PcapDev& pcap_dev) const;
-    void updateCaptureFilter(PcapDev& pcap_dev);
-    void updateAllCaptureFilters();
+    size_t receive(DatagramBuffer* buffers, DatagramInfo* infos, DatagramView* view, size_t max_count, long long timeout_ms, Udpcap::Error& error);
+    void takePeekedDatagram(DatagramBuffer* buffer, DatagramInfo* info, DatagramView* view);
 
-    void kickstartLoopbackMulticast() const;
+    class SingleReceiverCheck;
+
+    void receiveCallbackThread();
+
+    void signalWakeUp();
+    void resetWakeUp();
+    void addReadinessWait_nolock(const PcapDev& pcap_dev);
+    void removeReadinessWaits_nolock();
+#ifdef _WIN32
+    static void CALLBACK ReadinessWaitCallback(void* param, BOOLEAN timer_or_wait_fired);
+#endif // _WIN32
+
+    static std::string createFilterString(PcapDev& pcap_dev, const ReceiveState& receive_state);
+    static void updateCaptureFilter(PcapDev& pcap_dev, const ReceiveState& receive_state);
+    void updateAllCaptureFilters_nolock(const ReceiveState& receive_state);
+
+    void kickstartLoopbackMulticast(const ReceiveState& receive_state) const;
+
+    std::shared_ptr<ConflationTable> getConflationTable() const;
 
     // Callbacks
     static void PacketHandlerRawPtr(unsigned char* param, const struct pcap_pkthdr* header, const unsigned char* pkt_data);
-    static void FillCallbackArgsRawPtr(CallbackArgsRawPtr* callback_args, const pcpp::IPv4Layer* ip_layer, const pcpp::UdpLayer* udp_layer);
+    static void FillCallbackArgsRawPtr(CallbackArgsRawPtr* callback_args, const PacketParser::Ipv4Packet& ip_packet, const PacketParser::UdpDatagram& udp_datagram);
 
   private:
     bool        is_valid_;                                                      /**< If the socket is valid and ready to use (e.g. npcap was initialized successfully) */
 
-    bool        bound_state_;                                                   /**< Whether the socket is in bound state and ready to receive data */
-    HostAddress bound_address_;                                                 /**< Local interface address used to read data from */
-    uint16_t    bound_port_;                                                    /**< Local port to read data from */
-
-    std::set<HostAddress> multicast_groups_;
-    bool                  multicast_loopback_enabled_;                          /**< Winsocks style IP_MULTICAST_LOOP: if enabled, the socket can receive loopback multicast packages */
+    ReceiveStateCell receive_state_;                                            /**< Bound address and port, multicast groups and whether the socket has been closed. Read by the receive loop without locking. */
+    mutable std::mutex configuration_mutex_;                                    /**< Serializes bind(), close() and the multicast functions, which publish a new receive_state_. Also protects the conflation_table_ pointer. Never locked by the receive loop. */
 
-    mutable std::shared_mutex       pcap_devices_lists_mutex_;                  /**< Mutex to protect the pcap_devices_, pcap_win32_handles_, pcap_devices_ip_reassembly_ lists. Only the lists, not the content. */
-    mutable std::mutex              pcap_devices_callback_mutex_;               /**< Mutex to protect the pcap_devices during a callback AND the pcap_devices_closed variable. While a callback is running, the pcap_devices MUST NOT be closed. */
-    bool                            pcap_devices_closed_;                       /**< Tells whether we have already closed the socket. */
+    mutable std::shared_timed_mutex pcap_devices_lists_mutex_;                  /**< Mutex to protect the pcap_devices_, pcap_win32_handles_ / pcap_pollfds_, pcap_devices_ip_reassembly_ lists. Only the lists, not the content. */
+    mutable std::mutex              pcap_devices_callback_mutex_;               /**< Mutex to protect the pcap_devices while they are used outside of the receive loop, e.g. for getting their handles. The receive loop is protected by the grace period of receive_state_ instead. */
     std::vector<PcapDev>            pcap_devices_;                              /**< List of open PcapDevices */
-    std::vector<HANDLE>             pcap_win32_handles_;                        /**< Native Win32 handles to wait for data on the PCAP Devices. The List is in sync with pcap_devices. */
+#ifdef _WIN32
+    std::vector<HANDLE>             pcap_win32_handles_;                        /**< Native Win32 handles to wait for data. The first element is the wake_up_event_, the following elements are in sync with pcap_devices. */
+    HANDLE                          wake_up_event_;                             /**< Manual-reset event that wakes up a thread blocked in WaitForMultipleObjects on close() and cancel(). It is also the readiness handle. */
+    std::vector<HANDLE>             readiness_waits_;                           /**< Thread pool waits that forward the events of the live devices to the wake_up_event_. Only registered once the readiness handle has been requested. */
+#else
+    std::vector<pollfd>             pcap_pollfds_;                              /**< Selectable file descriptors to wait for data. The first element is the read end of the wake_up_pipe_, the following elements are in sync with pcap_devices. */
+    std::array<int, 2>              wake_up_pipe_;                              /**< Self-pipe that wakes up a thread blocked in poll() on close() and cancel(). Closing a file descriptor does not interrupt poll() on POSIX systems. */
+    int                             readiness_epoll_fd_;                        /**< Linux only: epoll instance with the wake_up_pipe_ and the live devices, i.e. the readiness handle. -1 until it has been requested. */
+#endif // _WIN32
+    std::atomic<bool>               wake_up_signaled_;                          /**< Whether the wake-up signal is set. Saves the system calls for setting it twice or resetting it when it is not set. */
+    std::atomic<bool>               readiness_handle_requested_;                /**< Once set, receive calls signal that more datagrams may be available when returning with a full buffer */
+    std::atomic<unsigned long long> cancel_count_;                              /**< Incremented by cancel(). A receive call returns, once it differs from the value at its start. */
     std::vector<std::unique_ptr<Udpcap::IpReassembly>> pcap_devices_ip_reassembly_;          /**< IP Reassembly for fragmented IP traffic. The list is in sync with the pcap_devices. */
 
     int                  receive_buffer_size_;
+    CaptureEngine        capture_engine_;                                       /**< The engine used for opening the devices in bind() */
+    bool                 shared_capture_enabled_;                               /**< Whether bind() subscribes to the process-wide CaptureHub of each device instead of opening it */
+    LoadBalancing        load_balancing_;                                       /**< Anything but None implies shared capture */
+    size_t               capture_queue_count_;                                  /**< More than 1 implies shared capture */
+    FanoutMode           fanout_mode_;
+    size_t               user_buffer_initial_size_;
+    size_t               user_buffer_max_size_;                                 /**< If not 0, bind() drains each live device into a BufferedCaptureSource */
+    size_t               receive_queue_limit_;                                  /**< Maximum number of frames in the BufferedCaptureSource or HubCaptureSource, 0 for no limit */
+    OverflowPolicy       overflow_policy_;                                      /**< Anything but DropNewest implies a user buffer, unless shared capture is used */
+    TimestampSource      timestamp_source_;                                     /**< Requested when opening the devices in bind() */
+    TimestampPrecision   timestamp_precision_;                                  /**< Requested when opening the devices in bind() */
+
+    std::string          capture_file_path_;                                    /**< If not empty, bind() opens this capture file instead of the network devices */
+    ReplayPacing         replay_pacing_;
+    double               replay_speed_factor_;
+
+    std::vector<std::vector<char>> capture_frames_;                             /**< If not empty, bind() hands out these frames instead of opening the network devices */
+    size_t                         capture_frame_repetitions_;
+
+    std::atomic<bool>              has_peeked_datagram_;                        /**< Whether peekDatagramLength() has taken a datagram that has not been received, yet. Cleared by bind(). */
+    std::vector<char>              peeked_datagram_payload_;                    /**< Only touched by the receiving thread */
+    DatagramInfo                   peeked_datagram_info_;                       /**< Only touched by the receiving thread */
+    std::atomic<std::thread::id>   receiving_thread_;                           /**< The thread that is currently receiving. Used for checking that there is only one in debug builds. */
+
+    ReceiveCallback                receive_callback_;
+    std::thread                    receive_callback_thread_;                    /**< Calls receive_callback_ for every datagram. Started by setReceiveCallback(), joined by close(). */
+    std::mutex                     receive_callback_mutex_;                     /**< Held by the thread while the callback is running. close() holds it while closing the devices, so the data of a running callback stays valid. */
+    std::atomic<bool>              receive_callback_stop_;                      /**< Tells the thread to exit instead of calling the callback */
+
+    std::shared_ptr<ConflationTable> conflation_table_;                         /**< Updated by the receive callback thread in conflation mode, nullptr otherwise. Protected by the configuration_mutex_, use getConflationTable(). */
   };
 }